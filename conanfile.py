@@ -10,7 +10,8 @@ class ConanPackage(ConanFile):
         ('boost/1.74.0'),
         ('libcurl/7.86.0'),
         ('openssl/3.2.1'),
-        ('nlohmann_json/3.9.1')
+        ('nlohmann_json/3.9.1'),
+        ('zlib/1.2.13')
     ]
 
     default_options = (
@@ -0,0 +1,245 @@
+#ifndef FEED_CAPTURE_H
+#define FEED_CAPTURE_H
+#pragma once
+
+#include <network-monitor/transport-network.h>
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace NetworkMonitor
+{
+
+/*! \brief One message of a feed capture
+ */
+struct FeedMessage
+{
+  // Time the client received the message
+  std::chrono::system_clock::time_point receivedAt {};
+
+  std::string payload {};
+};
+
+/*! \brief Streaming writer of a WebSocket feed capture
+ *
+ *  A capture file starts with a 16-byte header, "NMFEED01" and the u64 time
+ *  the capture was opened, in nanoseconds since the epoch, little-endian.
+ *  One record per message follows:
+ *
+ *    varint nanoseconds since the previous record | varint size | payload
+ *
+ *  Varints are LEB128. The time deltas take 3 to 4 bytes at feed rates, so a
+ *  record costs its payload and about 5 bytes. Records are only appended: A
+ *  capture can be read while it is written, and one cut short by a crash
+ *  reads up to its last complete record.
+ *
+ *  Several clients can record into the same capture. Times never go
+ *  backwards in a capture: A message received before the previous record
+ *  gets its time.
+ */
+class FeedCapture
+{
+public:
+  /*! \brief Construct a capture
+   *
+   *  \note This constructor does not open the capture file
+   */
+  FeedCapture();
+
+  /*! \brief Destructor
+   *
+   *  Closes the capture file, after writing the buffered records.
+   */
+  ~FeedCapture();
+
+  FeedCapture(const FeedCapture&) = delete;
+  FeedCapture& operator=(const FeedCapture&) = delete;
+
+  /*! \brief Create the capture file, replacing any file at `path`
+   *
+   *  \returns false if the file could not be created. GetError tells why.
+   */
+  bool Open(
+    const std::filesystem::path& path
+  );
+
+  /*! \brief Append a message
+   *
+   *  Records are buffered: They reach the file on Flush, on Close, or when
+   *  the buffer is full.
+   */
+  void Record(
+    std::string_view payload,
+    std::chrono::system_clock::time_point receivedAt =
+      std::chrono::system_clock::now()
+  );
+
+  /*! \brief Write the buffered records to the file
+   *
+   *  \returns false if the file could not be written
+   */
+  bool Flush();
+
+  /*! \brief Write the buffered records and close the file
+   */
+  void Close();
+
+  /*! \brief Get the number of messages recorded
+   */
+  std::uint64_t GetMessageCount() const;
+
+  /*! \brief Get the size of the capture so far, header included
+   */
+  std::uint64_t GetByteCount() const;
+
+  /*! \brief Get the last I/O error, if any
+   */
+  std::string GetError() const;
+
+private:
+  mutable std::mutex m_mutex {};
+  std::filesystem::path m_path {};
+  std::ofstream m_file {};
+  std::vector<char> m_fileBuffer {};
+  std::int64_t m_lastTime {0};
+  std::uint64_t m_nMessages {0};
+  std::uint64_t m_nBytes {0};
+  std::string m_error {};
+};
+
+/*! \brief Streaming reader of a WebSocket feed capture
+ *
+ *  See FeedCapture for the format. The reader keeps one record in memory at
+ *  a time, whatever the size of the capture.
+ */
+class FeedCaptureReader
+{
+public:
+  /*! \brief Open a capture file
+   *
+   *  \returns false if the file could not be opened or is not a capture.
+   *           GetError tells why.
+   */
+  bool Open(
+    const std::filesystem::path& path
+  );
+
+  /*! \brief Read the next message
+   *
+   *  \returns false at the end of the capture, or at an incomplete record
+   *           at the end of it. IsTruncated tells them apart.
+   */
+  bool Next(
+    FeedMessage& message
+  );
+
+  /*! \brief Get the time the capture was opened
+   */
+  std::chrono::system_clock::time_point GetStartTime() const;
+
+  /*! \brief Check if the capture ended with an incomplete record
+   */
+  bool IsTruncated() const;
+
+  /*! \brief Get the error of the last Open, if any
+   */
+  std::string GetError() const;
+
+private:
+  std::ifstream m_file {};
+  std::int64_t m_startTime {0};
+  std::int64_t m_lastTime {0};
+  bool m_truncated {false};
+  std::string m_error {};
+
+  bool ReadVarint(
+    std::uint64_t& value
+  );
+};
+
+/*! \brief Parse a passenger event from a feed message
+ *
+ *  The message is a STOMP MESSAGE frame with a JSON body:
+ *
+ *    {"datetime":"2024-01-01T08:00:00.000000Z","passenger_event":"in",
+ *     "station_id":"station_042"}
+ *
+ *  \returns false if the message is not a passenger event, like the
+ *           CONNECTED frame, or if it is malformed
+ */
+bool ParsePassengerEventMessage(
+  std::string_view message,
+  PassengerEvent& event
+);
+
+/*! \brief Configuration of a feed capture replay
+ */
+struct FeedReplayOptions
+{
+  // 1 replays the messages at the pace they were captured, 2 twice as fast.
+  //  0 replays them as fast as possible.
+  double speed {0.0};
+};
+
+/*! \brief Throughput and latency of a feed capture replay
+ *
+ *  The latency of a message runs from the time it is due to the time the
+ *  network recorded it. At a given speed, a message is due at its capture
+ *  time, scaled, so the latency includes the time it waits behind the
+ *  previous messages when the pipeline falls behind. As fast as possible, a
+ *  message is due when the replay reads it.
+ */
+struct FeedReplayReport
+{
+  // Empty if the whole capture was replayed
+  std::string error {};
+
+  std::uint64_t nMessages {0};
+  std::uint64_t nBytes {0};
+
+  // Messages that carried a passenger event, and the ones the network
+  //  accepted
+  std::uint64_t nEvents {0};
+  std::uint64_t nRecorded {0};
+
+  // The capture ended with an incomplete record
+  bool truncated {false};
+
+  // Wall time of the replay, and time between the first and the last
+  //  message of the capture
+  std::chrono::nanoseconds duration {0};
+  std::chrono::nanoseconds captureDuration {0};
+
+  // Latency percentiles, in nanoseconds
+  std::int64_t p50 {0};
+  std::int64_t p90 {0};
+  std::int64_t p99 {0};
+  std::int64_t p999 {0};
+  std::int64_t max {0};
+
+  /*! \brief Get the messages replayed per second
+   */
+  double GetMessageRate() const;
+};
+
+/*! \brief Replay a feed capture through the passenger event pipeline
+ *
+ *  Each message goes through ParsePassengerEventMessage and
+ *  TransportNetwork::RecordPassengerEvent, like the messages of a live
+ *  feed, on the calling thread.
+ */
+FeedReplayReport ReplayFeedCapture(
+  const std::filesystem::path& path,
+  TransportNetwork& network,
+  const FeedReplayOptions& options = {}
+);
+
+} // namespace NetworkMonitor
+
+#endif
@@ -4,12 +4,24 @@
 
 #include <nlohmann/json.hpp>
 
+#include <chrono>
+#include <cstdint>
 #include <filesystem>
+#include <functional>
+#include <istream>
+#include <memory>
 #include <string>
+#include <vector>
 
 namespace NetworkMonitor
 {
 /*! \brief Download a file from remote HTTPS URL
+  *
+  *  The request accepts compressed content encodings such as gzip. curl
+  *  decodes the response as it arrives, so the destination always holds the
+  *  file as published. All the download functions behave the same, except
+  *  for DownloadFileResumable, whose byte ranges require the identity
+  *  encoding.
   *
   *  \param destination  The full path and filename of the output file. The path
   *                      to the file must exist.
@@ -22,14 +34,288 @@ bool DownloadFile(
   const std::filesystem::path& caCertFile = {}
 );
 
+/*! \brief Outcome of a conditional download
+  */
+enum class DownloadStatus
+{
+  Failed,
+  Downloaded,   // The remote file changed, or there was no local copy yet
+  NotModified,  // The server confirmed that the local copy is up to date
+};
+
+/*! \brief Download a file from remote HTTPS URL, unless the local copy is up
+  *         to date
+  *
+  *  The ETag and Last-Modified response headers of the last download are
+  *  stored in a JSON file next to the destination, named
+  *  <destination>.meta. The next download sends them back as If-None-Match
+  *  and If-Modified-Since. On a 304 Not Modified response no content is
+  *  transferred and the local copy is kept.
+  *
+  *  The new content is written to a temporary file, so the destination is
+  *  left untouched if the download fails.
+  *
+  *  \param destination  The full path and filename of the output file. The path
+  *                      to the file must exist.
+  *  \param caCertFile   The path to a cacert.pem file to perform certificate
+  *                      verification in an HTTPS connection.
+  */
+DownloadStatus DownloadFileIfModified(
+  const std::string& fileUrl,
+  const std::filesystem::path& destination,
+  const std::filesystem::path& caCertFile = {}
+);
+
+/*! \brief Download a file from remote HTTPS URL and consume it as a stream
+  *
+  *  The content is not stored: onStream reads it from an input stream whose
+  *  reads drive the transfer and block until the next bytes arrive. This lets
+  *  a parser consume the file while it downloads, for example:
+  *
+  *      TransportNetwork network {};
+  *      DownloadFileToStream(fileUrl, [&network](std::istream& src) {
+  *        return network.FromJson(src);
+  *      }, caCertFile);
+  *
+  *  The stream reaches its end when the transfer completes or fails. An HTTP
+  *  error response ends the stream before any content. If onStream returns
+  *  false or throws, the rest of the transfer is aborted.
+  *
+  *  \param onStream     Called once, on the calling thread, with the stream.
+  *                      Exceptions thrown by onStream are propagated, unless
+  *                      the transfer failed.
+  *  \param caCertFile   The path to a cacert.pem file to perform certificate
+  *                      verification in an HTTPS connection.
+  *
+  *  \returns false if the transfer failed or if onStream returned false
+  */
+bool DownloadFileToStream(
+  const std::string& fileUrl,
+  const std::function<bool (std::istream&)>& onStream,
+  const std::filesystem::path& caCertFile = {}
+);
+
+/*! \brief Download a file from remote HTTPS URL, resuming an earlier
+  *         interrupted download
+  *
+  *  The content goes to <destination>.part, and the progress and the
+  *  validators of the remote file to <destination>.part.meta. If the
+  *  transfer fails, both are kept, and the next call only asks for the
+  *  missing bytes with an HTTP Range request. The If-Range header makes
+  *  sure the remote file did not change in between: If it did, the
+  *  download starts over. The destination is only replaced by a complete
+  *  file.
+  *
+  *  \param destination  The full path and filename of the output file. The path
+  *                      to the file must exist.
+  *  \param caCertFile   The path to a cacert.pem file to perform certificate
+  *                      verification in an HTTPS connection.
+  *  \param nChunks      If more than 1, and the server supports ranges, the
+  *                      file is split into this many byte ranges that
+  *                      download in parallel and resume separately.
+  */
+bool DownloadFileResumable(
+  const std::string& fileUrl,
+  const std::filesystem::path& destination,
+  const std::filesystem::path& caCertFile = {},
+  std::size_t nChunks = 1
+);
+
+/*! \brief A file to download in a batch
+  */
+struct DownloadRequest
+{
+  std::string fileUrl {};
+
+  // The full path and filename of the output file. The path to the file must
+  //  exist.
+  std::filesystem::path destination {};
+};
+
+/*! \brief Outcome of one file of a batch download
+  */
+struct DownloadResult
+{
+  std::string fileUrl {};
+  std::filesystem::path destination {};
+  bool ok {false};
+
+  // HTTP status code, or 0 if no response was received
+  long responseCode {0};
+
+  // Description of the failure. Empty on success.
+  std::string error {};
+
+  // Size of the body, time of the transfer from when it started, not
+  //  counting the time it waited for maxConcurrent, and the resulting
+  //  throughput
+  std::uint64_t bytes {0};
+  std::chrono::nanoseconds duration {0};
+  double bytesPerSecond {0.0};
+};
+
+/*! \brief Download several files from remote HTTPS URLs concurrently
+  *
+  *  All the transfers run on the calling thread, multiplexed by one curl multi
+  *  handle. As in DownloadFileIfModified, each file is written to a temporary
+  *  file first, so a destination is only replaced by a complete download.
+  *
+  *  \param requests       The files to download
+  *  \param deadline       Time limit for the whole batch. Transfers that are
+  *                        still running when it expires fail. 0 means no
+  *                        limit.
+  *  \param onDone         Called on the calling thread as soon as each
+  *                        transfer completes or fails
+  *  \param caCertFile     The path to a cacert.pem file to perform certificate
+  *                        verification in an HTTPS connection.
+  *  \param maxConcurrent  Maximum number of transfers running at the same
+  *                        time. 0 means no limit.
+  *
+  *  \returns The result of each request, in the order of the requests
+  */
+std::vector<DownloadResult> DownloadFiles(
+  const std::vector<DownloadRequest>& requests,
+  std::chrono::milliseconds deadline = std::chrono::milliseconds {0},
+  const std::function<void (const DownloadResult&)>& onDone = nullptr,
+  const std::filesystem::path& caCertFile = {},
+  std::size_t maxConcurrent = 0
+);
+
+/*! \brief Counters of a Downloader
+  */
+struct DownloaderStats
+{
+  // Transfers started, and the new connections they had to open. The
+  //  difference are transfers that reused a warm connection.
+  std::uint64_t transfers {0};
+  std::uint64_t newConnections {0};
+};
+
+/*! \brief Downloader that keeps its network state between downloads
+  *
+  *  The free download functions set up curl from scratch on every call, so
+  *  each download pays for DNS resolution, TCP connection and TLS handshake.
+  *  A Downloader keeps its curl handles, a shared DNS, connection and TLS
+  *  session cache, and the CA bundle, which it reads once. Repeated
+  *  downloads from the same host reuse a warm connection.
+  *
+  *  The methods behave like the free functions with the same names.
+  *
+  *  \note A Downloader is not thread-safe: Use one per thread.
+  */
+class Downloader
+{
+  public:
+    /*! \brief Construct a downloader
+      *
+      *  \param caCertFile   The path to a cacert.pem file to perform certificate
+      *                      verification in an HTTPS connection. If empty,
+      *                      curl uses the system certificates.
+      */
+    explicit Downloader(
+      const std::filesystem::path& caCertFile = {}
+    );
+
+    /*! \brief Destructor
+      *
+      *  Closes the open connections.
+      */
+    ~Downloader();
+
+    Downloader(const Downloader&) = delete;
+    Downloader& operator=(const Downloader&) = delete;
+
+    /*! \brief Download a file. See DownloadFile.
+      */
+    bool DownloadFile(
+      const std::string& fileUrl,
+      const std::filesystem::path& destination
+    );
+
+    /*! \brief Download a file unless the local copy is up to date. See
+      *         DownloadFileIfModified.
+      */
+    DownloadStatus DownloadFileIfModified(
+      const std::string& fileUrl,
+      const std::filesystem::path& destination
+    );
+
+    /*! \brief Download a file and consume it as a stream. See
+      *         DownloadFileToStream.
+      */
+    bool DownloadFileToStream(
+      const std::string& fileUrl,
+      const std::function<bool (std::istream&)>& onStream
+    );
+
+    /*! \brief Download a file, resuming an earlier interrupted download. See
+      *         DownloadFileResumable.
+      */
+    bool DownloadFileResumable(
+      const std::string& fileUrl,
+      const std::filesystem::path& destination,
+      std::size_t nChunks = 1
+    );
+
+    /*! \brief Download several files concurrently. See DownloadFiles.
+      */
+    std::vector<DownloadResult> DownloadFiles(
+      const std::vector<DownloadRequest>& requests,
+      std::chrono::milliseconds deadline = std::chrono::milliseconds {0},
+      const std::function<void (const DownloadResult&)>& onDone = nullptr,
+      std::size_t maxConcurrent = 0
+    );
+
+    /*! \brief Get the downloader counters
+      */
+    DownloaderStats GetStats() const;
+
+  private:
+    // The curl state lives in the implementation, so that users of this
+    //  header do not depend on curl.
+    struct Impl;
+    std::unique_ptr<Impl> m_impl;
+};
+
+/*! \brief Why a JSON file could not be parsed
+  */
+struct JsonFileError
+{
+  // Empty if the file was parsed successfully
+  std::string message {};
+
+  // Number of bytes read when parsing failed. Points at or just past the
+  //  offending character. For gzip files, this counts uncompressed bytes.
+  //  0 if the file could not be read or decompressed at all, or if the
+  //  parser rejected a value rather than the syntax.
+  std::size_t byteOffset {0};
+};
+
 /*! \brief Parse a local file into a JSON object
+  *
+  *  The file is memory-mapped and parsed from the contiguous buffer. gzip
+  *  files, such as .json.gz, are decompressed on the fly while parsing.
   *
   *  \param source The path to the JSON file to load and parse
+  *  \returns      An empty JSON object if the file does not exist or is not
+  *                valid JSON.
   */
 nlohmann::json ParseJsonFile(
   const std::filesystem::path& source
 );
 
+/*! \brief Parse a local file into a JSON object, reporting errors
+  *
+  *  \param source The path to the JSON file to load and parse
+  *  \param error  Filled in if the file could not be read or parsed, with the
+  *                byte offset at which parsing stopped.
+  *  \returns      An empty JSON object on failure.
+  */
+nlohmann::json ParseJsonFile(
+  const std::filesystem::path& source,
+  JsonFileError& error
+);
+
 }
 
 #endif
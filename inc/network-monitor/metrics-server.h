@@ -0,0 +1,223 @@
+#ifndef METRICS_SERVER_H
+#define METRICS_SERVER_H
+#pragma once
+
+#include <network-monitor/metrics.h>
+
+#include <boost/asio.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace NetworkMonitor
+{
+class TransportNetwork;
+class WebSocketClient;
+class WebSocketClientManager;
+
+/*! \brief Writer for the Prometheus text exposition format (version 0.0.4)
+  *
+  *  The samples of a metric family must be added one after the other: The
+  *  writer adds the # HELP and # TYPE lines when the family name changes.
+  */
+class PrometheusWriter
+{
+  public:
+    using Labels = std::vector<std::pair<std::string, std::string>>;
+
+    /*! \brief Add a sample of a counter
+      */
+    void AddCounter(
+      const std::string& name,
+      const std::string& help,
+      double value,
+      const Labels& labels = {}
+    );
+
+    /*! \brief Add a sample of a gauge
+      */
+    void AddGauge(
+      const std::string& name,
+      const std::string& help,
+      double value,
+      const Labels& labels = {}
+    );
+
+    /*! \brief Add a latency histogram as a summary, in seconds
+      *
+      *  The summary has the 0.5, 0.9, 0.99 and 0.999 quantiles, plus the
+      *  <name>_sum and <name>_count samples.
+      */
+    void AddSummary(
+      const std::string& name,
+      const std::string& help,
+      const LatencySnapshot& snapshot,
+      const Labels& labels = {}
+    );
+
+    /*! \brief Get the text written so far
+      */
+    const std::string& GetText() const;
+
+    /*! \brief Move out the text written so far
+      *
+      *  The writer still remembers the current family, so a family can span
+      *  two pieces of text.
+      */
+    std::string TakeText();
+
+  private:
+    std::string m_text {};
+    std::string m_family {};
+
+    void AddFamily(
+      const std::string& name,
+      const std::string& help,
+      const char* type
+    );
+
+    void AddSample(
+      const std::string& name,
+      const Labels& labels,
+      double value
+    );
+};
+
+/*! \brief Adds the samples of a group of metrics to a scrape
+  *
+  *  Collectors run on the metrics server thread, once per scrape.
+  */
+using MetricsCollector = std::function<void (PrometheusWriter& writer)>;
+
+/*! \brief Collect the histograms and counters of GetMetricsRegistry
+  *
+  *  Counters keep their name. Histograms are reported as summaries in
+  *  seconds, with a _ns suffix in the name replaced by _seconds.
+  */
+MetricsCollector CollectRegistryMetrics();
+
+/*! \brief Collect the passenger count of each station of a network, as the
+  *         network_monitor_station_passengers gauge
+  *
+  *  The network must outlive the server. See
+  *  TransportNetwork::ForEachPassengerCount for what may run concurrently.
+  */
+MetricsCollector CollectPassengerCounts(
+  const TransportNetwork& network
+);
+
+/*! \brief Collect the traffic counters and reconnections of a client
+  *
+  *  \param client  Must outlive the server.
+  *  \param name    Value of the client label.
+  */
+MetricsCollector CollectWebSocketClient(
+  const WebSocketClient& client,
+  std::string name
+);
+
+/*! \brief Collect the traffic counters and reconnections of all the clients
+  *         of a manager, labelled with their index
+  *
+  *  \param manager Must outlive the server.
+  */
+MetricsCollector CollectWebSocketClientManager(
+  WebSocketClientManager& manager
+);
+
+/*! \brief Configuration of a MetricsServer
+  */
+struct MetricsServerOptions
+{
+  // Address and port to listen on. Port 0 picks a free port; use
+  //  MetricsServer::GetPort to find out which one.
+  std::string address {"127.0.0.1"};
+  unsigned short port {0};
+
+  // Target of the metrics page. Other targets get a 404.
+  std::string target {"/metrics"};
+};
+
+/*! \brief Local HTTP endpoint for Prometheus scrapes
+  *
+  *  Each GET on the target runs the collectors in the order they were added
+  *  and streams the result as a chunked response, one chunk per collector:
+  *  The server never builds the whole page, and it starts sending before the
+  *  last collector runs.
+  *
+  *  The server runs on its own thread. Collectors only read snapshots and
+  *  atomic counters, so a scrape never takes a lock that the ingestion or
+  *  query threads hold on their hot paths.
+  */
+class MetricsServer
+{
+  public:
+    /*! \brief Construct a metrics server
+      *
+      *  \note This constructor does not start listening
+      */
+    explicit MetricsServer(
+      const MetricsServerOptions& options
+    );
+
+    /*! \brief Destructor
+      *
+      *  Stops the server.
+      */
+    ~MetricsServer();
+
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+
+    /*! \brief Add a collector to the scrapes
+      *
+      *  \note Collectors must be added before Start.
+      */
+    void AddCollector(
+      MetricsCollector collector
+    );
+
+    /*! \brief Start listening and serving on the server thread
+      *
+      *  \returns false if the server could not listen on the requested
+      *           address
+      */
+    bool Start();
+
+    /*! \brief Stop serving and join the server thread
+      */
+    void Stop();
+
+    /*! \brief Get the port the server listens on
+      */
+    unsigned short GetPort() const;
+
+    /*! \brief Get the number of scrapes served so far
+      */
+    std::uint64_t GetScrapes() const;
+
+  private:
+    class Session;
+    friend class Session;
+
+    MetricsServerOptions m_options {};
+    std::vector<MetricsCollector> m_collectors {};
+
+    boost::asio::io_context m_ioc {};
+    boost::asio::ip::tcp::acceptor m_acceptor;
+    std::thread m_thread {};
+    unsigned short m_port {0};
+
+    std::atomic<std::uint64_t> m_scrapes {0};
+
+    void Accept();
+};
+
+} // namespace NetworkMonitor
+
+#endif
@@ -0,0 +1,302 @@
+#ifndef METRICS_H
+#define METRICS_H
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace NetworkMonitor
+{
+/*! \brief Merged content of a latency histogram
+  *
+  *  Values are in nanoseconds. Percentiles are accurate to within 1/64 (about
+  *  1.6%) of the value, like an HDR histogram with 2 significant digits.
+  */
+struct LatencySnapshot
+{
+  std::string name {};
+  std::uint64_t count {0};
+  std::uint64_t sum {0};
+  std::uint64_t min {0};
+  std::uint64_t max {0};
+  std::uint64_t p50 {0};
+  std::uint64_t p90 {0};
+  std::uint64_t p99 {0};
+  std::uint64_t p999 {0};
+
+  // Number of values in each bucket. See LatencyHistogram::GetBucketLimit.
+  std::vector<std::uint64_t> buckets {};
+
+  /*! \brief Get the value below which `percentile` percent of the values
+    *         fall, 0 if the histogram is empty
+    */
+  std::uint64_t GetPercentile(
+    double percentile
+  ) const;
+};
+
+/*! \brief Value of a counter, summed over all the threads
+  */
+struct CounterSnapshot
+{
+  std::string name {};
+  std::uint64_t value {0};
+};
+
+/*! \brief Latency histogram with a lock-free, per-thread recording path
+  *
+  *  Each thread records into its own set of buckets, so recording never
+  *  contends with other threads or with Snapshot: It is a few plain loads
+  *  and stores. Snapshot merges the buckets of all the threads that ever
+  *  recorded a value.
+  *
+  *  Buckets are log-linear: Values below 128 ns have their own bucket, then
+  *  each power of 2 is split into 64 buckets. Values above about 18 minutes
+  *  go to the last bucket.
+  *
+  *  \note Histograms are meant to live for the whole program, like the ones
+  *        in GetLibraryMetrics. Threads keep a pointer to their buckets, so a
+  *        histogram must not be destroyed while threads may still record.
+  */
+class LatencyHistogram
+{
+  public:
+    static constexpr std::size_t kSubBucketBits {6};
+    static constexpr std::size_t kMaxValueBits {40};
+    static constexpr std::size_t kBucketCount {
+      (kMaxValueBits - kSubBucketBits + 1) << kSubBucketBits
+    };
+
+    /*! \brief Construct an empty histogram
+      *
+      *  \param name  Name under which the histogram is reported. Histograms
+      *               register with GetMetricsRegistry.
+      */
+    explicit LatencyHistogram(
+      std::string name
+    );
+
+    ~LatencyHistogram();
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    /*! \brief Record a latency from the calling thread
+      */
+    void Record(
+      std::chrono::nanoseconds latency
+    );
+
+    /*! \brief Merge the values recorded by all the threads
+      */
+    LatencySnapshot Snapshot() const;
+
+    /*! \brief Get the name of the histogram
+      */
+    const std::string& GetName() const;
+
+    /*! \brief Get the bucket of a value
+      */
+    static std::size_t GetBucket(
+      std::uint64_t value
+    );
+
+    /*! \brief Get the highest value that falls in a bucket
+      */
+    static std::uint64_t GetBucketLimit(
+      std::size_t bucket
+    );
+
+  private:
+    // Buckets of one thread. Only that thread writes them, so it can
+    //  increment with a relaxed load and store instead of an atomic
+    //  read-modify-write; readers see each count either before or after.
+    struct Shard
+    {
+      std::array<std::atomic<std::uint64_t>, kBucketCount> buckets {};
+      std::atomic<std::uint64_t> count {0};
+      std::atomic<std::uint64_t> sum {0};
+      std::atomic<std::uint64_t> min {UINT64_MAX};
+      std::atomic<std::uint64_t> max {0};
+    };
+
+    std::string m_name {};
+
+    // Index of this histogram in the per-thread shard tables
+    std::size_t m_slot {0};
+
+    mutable std::mutex m_shardsMutex {};
+    std::vector<std::unique_ptr<Shard>> m_shards {};
+
+    Shard& AddShard();
+};
+
+/*! \brief Counter with a lock-free, per-thread recording path
+  *
+  *  Like LatencyHistogram, each thread adds to its own slot, and Snapshot
+  *  sums them. The same lifetime rules apply.
+  */
+class Counter
+{
+  public:
+    /*! \brief Construct a counter at 0
+      *
+      *  \param name  Name under which the counter is reported. Counters
+      *               register with GetMetricsRegistry.
+      */
+    explicit Counter(
+      std::string name
+    );
+
+    ~Counter();
+
+    Counter(const Counter&) = delete;
+    Counter& operator=(const Counter&) = delete;
+
+    /*! \brief Add to the counter from the calling thread
+      */
+    void Add(
+      std::uint64_t value = 1
+    );
+
+    /*! \brief Sum the values added by all the threads
+      */
+    CounterSnapshot Snapshot() const;
+
+    /*! \brief Get the name of the counter
+      */
+    const std::string& GetName() const;
+
+  private:
+    // Keep the slots of different threads on different cache lines
+    struct alignas(64) Shard
+    {
+      std::atomic<std::uint64_t> value {0};
+    };
+
+    std::string m_name {};
+    std::size_t m_slot {0};
+
+    mutable std::mutex m_shardsMutex {};
+    std::vector<std::unique_ptr<Shard>> m_shards {};
+
+    Shard& AddShard();
+};
+
+/*! \brief Records the time between its construction and its destruction
+  */
+class ScopedLatency
+{
+  public:
+    explicit ScopedLatency(
+      LatencyHistogram& histogram
+    ) : m_histogram { histogram }
+      , m_startedAt { std::chrono::steady_clock::now() }
+    {
+    }
+
+    ~ScopedLatency()
+    {
+      m_histogram.Record(std::chrono::steady_clock::now() - m_startedAt);
+    }
+
+    ScopedLatency(const ScopedLatency&) = delete;
+    ScopedLatency& operator=(const ScopedLatency&) = delete;
+
+  private:
+    LatencyHistogram& m_histogram;
+    std::chrono::steady_clock::time_point m_startedAt;
+};
+
+/*! \brief All the histograms and counters of the program
+  */
+class MetricsRegistry
+{
+  public:
+    /*! \brief Snapshot all the registered histograms, sorted by name
+      */
+    std::vector<LatencySnapshot> SnapshotHistograms() const;
+
+    /*! \brief Snapshot all the registered counters, sorted by name
+      */
+    std::vector<CounterSnapshot> SnapshotCounters() const;
+
+  private:
+    friend class LatencyHistogram;
+    friend class Counter;
+
+    mutable std::mutex m_mutex {};
+    std::vector<const LatencyHistogram*> m_histograms {};
+    std::vector<const Counter*> m_counters {};
+};
+
+/*! \brief Get the registry of the program
+  */
+MetricsRegistry& GetMetricsRegistry();
+
+/*! \brief Metrics of the library hot paths
+  *
+  *  These are only recorded if the library is built with
+  *  NETWORK_MONITOR_METRICS defined (CMake option NETWORK_MONITOR_METRICS).
+  *  Otherwise the instrumentation is compiled out and they stay empty.
+  */
+struct LibraryMetrics
+{
+  LatencyHistogram getTravelTime {
+    "transport_network_get_travel_time_ns"
+  };
+  LatencyHistogram getTravelTimeOnRoute {
+    "transport_network_get_travel_time_on_route_ns"
+  };
+  LatencyHistogram getRoutesServingStation {
+    "transport_network_get_routes_serving_station_ns"
+  };
+  LatencyHistogram getJourneys { "transport_network_get_journeys_ns" };
+  LatencyHistogram getAlternativeJourneys {
+    "transport_network_get_alternative_journeys_ns"
+  };
+  LatencyHistogram recordPassengerEvent {
+    "transport_network_record_passenger_event_ns"
+  };
+  LatencyHistogram recordPassengerEvents {
+    "transport_network_record_passenger_events_ns"
+  };
+  Counter passengerEvents { "transport_network_passenger_events_total" };
+  Counter passengerEventsRejected {
+    "transport_network_passenger_events_rejected_total"
+  };
+
+  // Time spent handling a received message, including the user callback
+  LatencyHistogram webSocketOnRead { "websocket_client_on_read_ns" };
+  Counter webSocketMessages { "websocket_client_messages_total" };
+};
+
+/*! \brief Get the metrics of the library hot paths
+  */
+LibraryMetrics& GetLibraryMetrics();
+
+} // namespace NetworkMonitor
+
+// Instrumentation of the hot paths. Without NETWORK_MONITOR_METRICS these
+//  expand to nothing, so the disabled build pays nothing at all.
+#define NETWORK_MONITOR_CONCAT_INNER(a, b) a##b
+#define NETWORK_MONITOR_CONCAT(a, b) NETWORK_MONITOR_CONCAT_INNER(a, b)
+#if defined(NETWORK_MONITOR_METRICS)
+#define NETWORK_MONITOR_TIME_SCOPE(metric)                                    \
+  ::NetworkMonitor::ScopedLatency NETWORK_MONITOR_CONCAT(                     \
+    networkMonitorLatency, __LINE__                                           \
+  ) { ::NetworkMonitor::GetLibraryMetrics().metric }
+#define NETWORK_MONITOR_COUNT(metric)                                         \
+  ::NetworkMonitor::GetLibraryMetrics().metric.Add()
+#else
+#define NETWORK_MONITOR_TIME_SCOPE(metric) do {} while (false)
+#define NETWORK_MONITOR_COUNT(metric) do {} while (false)
+#endif
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef NETWORK_GENERATOR_H
+#define NETWORK_GENERATOR_H
+#pragma once
+
+#include <nlohmann/json.hpp>
+
+#include <cstdint>
+#include <cstddef>
+
+namespace NetworkMonitor
+{
+/*! \brief Shape of the travel times between adjacent stations
+  */
+enum class TravelTimeDistribution
+{
+  // Every value between the minimum and the maximum is equally likely
+  Uniform,
+
+  // Mostly short hops around the mean, with a long tail up to the maximum,
+  //  like a mix of city-center and suburban sections
+  Exponential,
+};
+
+/*! \brief Parameters of a synthetic network layout
+  */
+struct NetworkGeneratorOptions
+{
+  std::size_t nStations {1000};
+  std::size_t nLines {30};
+
+  // Each line has a trunk, served by one route in each direction. Routes
+  //  after the first two serve a shorter section of the trunk, alternating
+  //  direction.
+  std::size_t routesPerLine {2};
+
+  // Number of stops on the trunk of a line. Lines can end up longer, so that
+  //  every station is served, or shorter, if they run out of stations that
+  //  they do not already serve.
+  std::size_t minRouteLength {10};
+  std::size_t maxRouteLength {40};
+
+  // Probability, between 0 and 1, that a stop is an interchange with a
+  //  station already served by another line. Once all the stations are on a
+  //  line, every new stop is an interchange.
+  double interchangeDensity {0.1};
+
+  // Travel times between adjacent stations, in minutes
+  TravelTimeDistribution travelTimeDistribution {
+    TravelTimeDistribution::Uniform
+  };
+  unsigned int minTravelTime {1};
+  unsigned int maxTravelTime {5};
+
+  // Only used by the exponential distribution
+  double meanTravelTime {2.0};
+
+  std::uint64_t seed {1};
+};
+
+/*! \brief Generate a network layout in the TransportNetwork::FromJson schema
+  *
+  *  The layout has stations, lines with their routes, and one travel time for
+  *  each pair of adjacent stations. The same options give the same layout,
+  *  byte for byte, on every platform: The generator does not use the
+  *  implementation-defined standard distributions.
+  *
+  *  Station, line and route IDs are numbered from 0 and zero-padded to at
+  *  least 3 digits: station_000, line_000, route_000.
+  *
+  *  \throws std::invalid_argument if the options cannot produce a valid
+  *          network, for example with fewer than 2 stations or a route
+  *          length below 2
+  */
+nlohmann::json GenerateNetworkLayout(
+  const NetworkGeneratorOptions& options
+);
+
+} // namespace NetworkMonitor
+
+#endif
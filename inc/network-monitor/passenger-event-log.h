@@ -0,0 +1,349 @@
+#ifndef PASSENGER_EVENT_LOG_H
+#define PASSENGER_EVENT_LOG_H
+#pragma once
+
+#include <network-monitor/transport-network.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace NetworkMonitor
+{
+
+/*! \brief Configuration of a PassengerEventLog
+ */
+struct PassengerEventLogOptions
+{
+  // Directory of the log segments. Open creates it if needed.
+  std::filesystem::path directory {};
+
+  // The writer thread collects the events appended during this interval,
+  //  then writes and syncs them together (group commit)
+  std::chrono::milliseconds commitInterval {5};
+
+  // A new segment starts when the current one would grow past this size
+  std::size_t segmentSize {64 << 20};
+
+  // fdatasync each group. Only turn this off if losing the last events on a
+  //  machine crash is fine, as in tests and benchmarks.
+  bool sync {true};
+};
+
+/*! \brief Append-only, checksummed log of passenger events
+ *
+ *  The log is a directory of segment files, events-<first sequence>.log.
+ *  Each segment starts with a 16-byte header, followed by batch records:
+ *
+ *    u32 payload size | u32 CRC-32 | u64 first sequence | u32 event count
+ *    payload: per event, u8 type | i64 timestamp (ns) | u16 ID size | ID
+ *
+ *  Integers are little-endian. The CRC covers the sequence, the count and
+ *  the payload.
+ *
+ *  Append only encodes the events into a memory buffer. A writer thread
+ *  writes the buffer as one batch record every commitInterval and syncs it,
+ *  so the ingestion thread never waits for the disk. Each event gets a
+ *  sequence number, in the order of the appends.
+ *
+ *  A crash in the middle of a write leaves a torn batch at the end of the
+ *  last segment: Open cuts it off, and ReplayPassengerEventLog stops there.
+ */
+class PassengerEventLog
+{
+public:
+  /*! \brief Construct a log
+   *
+   *  \note This constructor does not open the log
+   */
+  explicit PassengerEventLog(
+    const PassengerEventLogOptions& options
+  );
+
+  /*! \brief Destructor
+   *
+   *  Closes the log, after writing the events appended so far.
+   */
+  ~PassengerEventLog();
+
+  PassengerEventLog(const PassengerEventLog&) = delete;
+  PassengerEventLog& operator=(const PassengerEventLog&) = delete;
+
+  /*! \brief Open the log for appending, after the events already in it
+   *
+   *  \returns false if the directory or the last segment could not be
+   *           opened. GetError tells why.
+   */
+  bool Open();
+
+  /*! \brief Append an event
+   *
+   *  Events without a timestamp get the current time, so that a replay puts
+   *  them in the right passenger flow bucket.
+   *
+   *  \returns the sequence number of the event
+   */
+  std::uint64_t Append(
+    const PassengerEvent& event
+  );
+
+  /*! \brief Append a batch of events
+   *
+   *  \returns the sequence number of the first event
+   */
+  std::uint64_t Append(
+    const std::vector<PassengerEvent>& events
+  );
+
+  /*! \brief Wait until the events appended so far are written and synced
+   *
+   *  A failed write keeps its events in memory: The writer thread retries
+   *  them, in order, every commitInterval, so that the log never skips a
+   *  sequence number.
+   *
+   *  \returns false if the log could not write them. GetError tells why.
+   */
+  bool Flush();
+
+  /*! \brief Write the events appended so far and stop the writer thread
+   */
+  void Close();
+
+  /*! \brief Get the sequence number of the next event to append
+   */
+  std::uint64_t GetNextSequence() const;
+
+  /*! \brief Get the first sequence number that is not written and synced
+   */
+  std::uint64_t GetDurableSequence() const;
+
+  /*! \brief Get the last I/O error, if any
+   */
+  std::string GetError() const;
+
+  /*! \brief Get the directory of the log segments
+   */
+  const std::filesystem::path& GetDirectory() const;
+
+private:
+  PassengerEventLogOptions m_options {};
+
+  mutable std::mutex m_mutex {};
+  std::condition_variable m_wakeWriter {};
+  std::condition_variable m_committed {};
+
+  // Events appended since the last commit, encoded as a batch payload
+  std::string m_pending {};
+  std::uint64_t m_pendingFirst {0};
+  std::uint32_t m_nPending {0};
+
+  std::uint64_t m_nextSequence {0};
+  std::uint64_t m_durableSequence {0};
+  bool m_flushRequested {false};
+  bool m_stopping {false};
+  std::string m_error {};
+  std::uint64_t m_nFailedWrites {0};
+
+  // Owned by the writer thread once the log is open
+  int m_fd {-1};
+  std::size_t m_segmentBytes {0};
+  std::thread m_writer {};
+
+  void Encode(
+    const PassengerEvent& event
+  );
+
+  void RunWriter();
+
+  bool WriteBatch(
+    const std::string& payload,
+    std::uint64_t firstSequence,
+    std::uint32_t nEvents,
+    std::string& error
+  );
+
+  bool StartSegment(
+    std::uint64_t firstSequence,
+    std::string& error
+  );
+};
+
+/*! \brief Outcome of a passenger event log replay
+ */
+struct PassengerEventLogReplay
+{
+  // Empty if the log could be read up to its end. A torn batch at the end of
+  //  the last segment is not an error.
+  std::string error {};
+
+  // Events read from the log, and the ones the network accepted
+  std::uint64_t nEvents {0};
+  std::uint64_t nRecorded {0};
+
+  // Sequence number after the last event read
+  std::uint64_t nextSequence {0};
+
+  std::size_t nSegments {0};
+  bool tornTail {false};
+};
+
+/*! \brief Replay a passenger event log into a network
+ *
+ *  The segments are mapped and decoded one batch record at a time, and each
+ *  batch goes through TransportNetwork::RecordPassengerEvents.
+ *
+ *  \param fromSequence Skip the events before this sequence number. It is an
+ *                      error if a checkpoint already removed them.
+ */
+PassengerEventLogReplay ReplayPassengerEventLog(
+  const std::filesystem::path& directory,
+  TransportNetwork& network,
+  std::uint64_t fromSequence = 0
+);
+
+/*! \brief Outcome of a passenger count checkpoint
+ */
+struct PassengerCheckpoint
+{
+  // Empty if the checkpoint was written
+  std::string error {};
+
+  // The checkpoint holds the counts after the events before this sequence
+  //  number
+  std::uint64_t sequence {0};
+
+  std::size_t nStations {0};
+  std::size_t nBytes {0};
+
+  // Log segments removed because all their events come before the checkpoint
+  std::size_t nSegmentsRemoved {0};
+};
+
+/*! \brief Write a checkpoint of the passenger counts of a network into the
+ *         directory of its event log
+ *
+ *  The network must record the same events as the log, in the same order, so
+ *  that its event sequence matches the sequence numbers of the log.
+ *
+ *  The counts come from TransportNetwork::SnapshotPassengerCounts, so the
+ *  recording thread goes on while the checkpoint is taken. The log is flushed
+ *  first, so that the events after the checkpoint are on disk before the
+ *  ones it replaces are removed. The checkpoint file is
+ *  checkpoint-<sequence>.ckpt:
+ *
+ *    "NMCKPT01" | u64 sequence | u32 station count | u32 CRC-32
+ *    per station, varint ID size | ID | zigzag varint passenger count
+ *
+ *  It is written to a temporary file and renamed, so a crash leaves either
+ *  the previous checkpoint or the new one. Then the older checkpoints and the
+ *  log segments that end before the checkpoint are removed.
+ *
+ *  \param sync fsync the checkpoint and the directory before removing
+ *              anything
+ */
+PassengerCheckpoint WritePassengerCheckpoint(
+  const TransportNetwork& network,
+  PassengerEventLog& log,
+  bool sync = true
+);
+
+/*! \brief Configuration of a PassengerCheckpointer
+ */
+struct PassengerCheckpointOptions
+{
+  // Time between two checkpoints. Recovery replays up to this much of the
+  //  event log.
+  std::chrono::milliseconds interval {60000};
+
+  // See WritePassengerCheckpoint
+  bool sync {true};
+};
+
+/*! \brief Write passenger count checkpoints periodically, on a thread of
+ *         its own
+ *
+ *  The network and the log must outlive the checkpointer.
+ */
+class PassengerCheckpointer
+{
+public:
+  /*! \brief Construct a checkpointer
+   *
+   *  \note This constructor does not start the checkpoint thread
+   */
+  PassengerCheckpointer(
+    const PassengerCheckpointOptions& options,
+    const TransportNetwork& network,
+    PassengerEventLog& log
+  );
+
+  /*! \brief Destructor
+   *
+   *  Stops the checkpoint thread, without a last checkpoint.
+   */
+  ~PassengerCheckpointer();
+
+  PassengerCheckpointer(const PassengerCheckpointer&) = delete;
+  PassengerCheckpointer& operator=(const PassengerCheckpointer&) = delete;
+
+  /*! \brief Start the checkpoint thread
+   */
+  void Start();
+
+  /*! \brief Stop the checkpoint thread
+   */
+  void Stop();
+
+  /*! \brief Get the outcome of the last checkpoint
+   */
+  PassengerCheckpoint GetLastCheckpoint() const;
+
+private:
+  PassengerCheckpointOptions m_options {};
+  const TransportNetwork& m_network;
+  PassengerEventLog& m_log;
+
+  mutable std::mutex m_mutex {};
+  std::condition_variable m_wake {};
+  bool m_stopping {false};
+  PassengerCheckpoint m_lastCheckpoint {};
+  std::thread m_thread {};
+
+  void Run();
+};
+
+/*! \brief Outcome of a passenger count recovery
+ */
+struct PassengerRecovery
+{
+  // Empty if the network was recovered. A missing checkpoint is not an error.
+  std::string error {};
+
+  // The checkpoint loaded, if any
+  bool checkpointLoaded {false};
+  std::uint64_t checkpointSequence {0};
+  std::size_t nStationsRestored {0};
+
+  // Replay of the event log after the checkpoint
+  PassengerEventLogReplay replay {};
+};
+
+/*! \brief Recover the passenger counts of a network from the latest
+ *         checkpoint and the event log after it
+ *
+ *  Without a checkpoint, the whole log is replayed. Use it on a network that
+ *  has not recorded any event yet.
+ */
+PassengerRecovery RecoverPassengerCounts(
+  const std::filesystem::path& directory,
+  TransportNetwork& network
+);
+
+} // namespace NetworkMonitor
+
+#endif
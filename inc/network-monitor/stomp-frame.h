@@ -0,0 +1,101 @@
+#ifndef STOMP_FRAME_H
+#define STOMP_FRAME_H
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace NetworkMonitor
+{
+/*! \brief STOMP 1.2 frame command
+  */
+enum class StompCommand
+{
+  Unknown,
+  Abort,
+  Ack,
+  Begin,
+  Commit,
+  Connect,
+  Connected,
+  Disconnect,
+  Error,
+  Message,
+  Nack,
+  Receipt,
+  Send,
+  Stomp,
+  Subscribe,
+  Unsubscribe
+};
+
+/*! \brief Convert a STOMP command to its wire representation
+  *
+  *  \returns An empty string for StompCommand::Unknown
+  */
+std::string_view ToString(
+  StompCommand command
+);
+
+/*! \brief Convert a wire command to a STOMP command
+  *
+  *  \returns StompCommand::Unknown if the command is not a STOMP 1.2 command
+  */
+StompCommand ToStompCommand(
+  std::string_view command
+);
+
+/*! \brief STOMP 1.2 frame
+  *
+  *  Header values are stored unescaped. Only the first occurrence of a
+  *  repeated header is significant, as per the STOMP specification.
+  */
+struct StompFrame
+{
+  StompCommand command { StompCommand::Unknown };
+  std::vector<std::pair<std::string, std::string>> headers {};
+  std::string body {};
+
+  /*! \brief Get the value of a header
+    *
+    *  \returns An empty view if the header is not in the frame
+    */
+  std::string_view GetHeader(
+    std::string_view name
+  ) const;
+
+  /*! \brief Check if the frame has a header
+    */
+  bool HasHeader(
+    std::string_view name
+  ) const;
+};
+
+/*! \brief Parse a STOMP frame
+  *
+  *  Accepts both LF and CRLF line endings. If the frame has a content-length
+  *  header the body is read up to that length, otherwise up to the first NULL
+  *  octet.
+  *
+  *  \returns false if the frame is malformed. The content of `frame` is
+  *           unspecified in that case.
+  */
+bool ParseStompFrame(
+  std::string_view src,
+  StompFrame& frame
+);
+
+/*! \brief Serialize a STOMP frame, including the terminating NULL octet
+  *
+  *  Header values are escaped, except in CONNECT and CONNECTED frames, as
+  *  required by the specification.
+  */
+std::string SerializeStompFrame(
+  const StompFrame& frame
+);
+
+} // namespace NetworkMonitor
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef TLS_SESSION_CACHE_H
+#define TLS_SESSION_CACHE_H
+#pragma once
+
+#include <openssl/ssl.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace NetworkMonitor
+{
+/*! \brief Client-side cache of TLS sessions, keyed by server
+  *
+  *  Offering a cached session (TLS 1.2 session ID or TLS 1.3 ticket) in the
+  *  ClientHello lets the server skip the certificate exchange and key
+  *  agreement, which saves at least one network round trip on reconnects.
+  *
+  *  One cache can be shared by multiple clients on multiple threads.
+  */
+class TlsSessionCache
+{
+  public:
+    /*! \brief Construct an empty cache
+      */
+    TlsSessionCache();
+
+    /*! \brief Destructor
+      */
+    ~TlsSessionCache();
+
+    TlsSessionCache(const TlsSessionCache&) = delete;
+    TlsSessionCache& operator=(const TlsSessionCache&) = delete;
+
+    /*! \brief Offer the cached session for a server to a new connection
+      *
+      *  Call this before the TLS handshake. Whether the server accepted the
+      *  session can be checked with SSL_session_reused after the handshake.
+      *
+      *  \param key  The server key, for example "<host>:<port>"
+      *  \param ssl  The connection that is about to start the handshake
+      *
+      *  \returns true if a cached session was offered
+      */
+    bool Apply(
+      const std::string& key,
+      SSL* ssl
+    ) const;
+
+    /*! \brief Store the session of an established connection
+      *
+      *  The session is only stored if it can be resumed. With TLS 1.3 the
+      *  server sends the session tickets after the handshake, so this method
+      *  should be called again once some application data was read.
+      *
+      *  \returns true if the session was stored
+      */
+    bool Save(
+      const std::string& key,
+      SSL* ssl
+    );
+
+    /*! \brief Drop the cached session for a server
+      */
+    void Erase(
+      const std::string& key
+    );
+
+    /*! \brief Get the number of cached sessions
+      */
+    std::size_t Size() const;
+
+  private:
+    struct SessionDeleter
+    {
+      void operator()(SSL_SESSION* session) const;
+    };
+    using SessionPtr = std::unique_ptr<SSL_SESSION, SessionDeleter>;
+
+    mutable std::mutex m_mutex {};
+    std::unordered_map<std::string, SessionPtr> m_sessions {};
+};
+
+} // namespace NetworkMonitor
+
+#endif
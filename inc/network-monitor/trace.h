@@ -0,0 +1,192 @@
+#ifndef TRACE_H
+#define TRACE_H
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace NetworkMonitor
+{
+/*! \brief A completed span
+  */
+struct TraceEvent
+{
+  // Static strings: Spans keep the pointers, not a copy
+  const char* category {nullptr};
+  const char* name {nullptr};
+
+  // Index of the recording thread, in the order threads first recorded
+  std::uint32_t threadId {0};
+
+  // Nanoseconds on the steady clock, so spans that started before the
+  //  recorder was created still line up
+  std::int64_t start {0};
+  std::int64_t duration {0};
+};
+
+/*! \brief Records spans into per-thread ring buffers and dumps them in the
+  *         Chrome trace_event format
+  *
+  *  Each thread records into its own ring buffer of kCapacity spans, so
+  *  recording takes no lock and never waits for a dump. When a buffer is
+  *  full, new spans overwrite the oldest ones: A dump shows the last
+  *  kCapacity spans of each thread. Dumps can run on any thread, at any time.
+  *
+  *  Load the output of WriteChromeTrace in chrome://tracing or in Perfetto.
+  */
+class TraceRecorder
+{
+  public:
+    static constexpr std::size_t kCapacity {1 << 14};
+
+    TraceRecorder(const TraceRecorder&) = delete;
+    TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+    /*! \brief Record a span of the calling thread
+      *
+      *  \param category  Static string
+      *  \param name      Static string
+      */
+    void Record(
+      const char* category,
+      const char* name,
+      std::chrono::steady_clock::time_point start,
+      std::chrono::steady_clock::time_point end
+    );
+
+    /*! \brief Name the calling thread in the dumps
+      */
+    void SetThreadName(
+      const std::string& name
+    );
+
+    /*! \brief Get the spans recorded since the last Clear, sorted by start
+      *
+      *  Spans that a thread overwrites while they are being read are left
+      *  out.
+      */
+    std::vector<TraceEvent> Snapshot() const;
+
+    /*! \brief Drop the spans recorded so far
+      */
+    void Clear();
+
+    /*! \brief Write the spans as a Chrome trace_event JSON object
+      */
+    void WriteChromeTrace(
+      std::ostream& out
+    ) const;
+
+    /*! \brief Write the spans as a Chrome trace_event JSON file
+      *
+      *  \returns false if the file could not be written
+      */
+    bool WriteChromeTrace(
+      const std::filesystem::path& destination
+    ) const;
+
+  private:
+    // Threads find their buffer through a thread_local pointer, so there can
+    //  only be one recorder: GetTraceRecorder.
+    friend TraceRecorder& GetTraceRecorder();
+
+    TraceRecorder();
+
+    // A slot is a seqlock: Its sequence is odd while the owning thread writes
+    //  it. Readers check that the sequence is the one they expect and did
+    //  not change while they read the fields.
+    struct Slot
+    {
+      std::atomic<std::uint64_t> sequence {0};
+      std::atomic<const char*> category {nullptr};
+      std::atomic<const char*> name {nullptr};
+      std::atomic<std::int64_t> start {0};
+      std::atomic<std::int64_t> duration {0};
+    };
+
+    struct Buffer
+    {
+      std::uint32_t threadId {0};
+      std::string threadName {};
+      std::array<Slot, kCapacity> slots {};
+
+      // Number of spans ever recorded, and the number at the last Clear
+      std::atomic<std::uint64_t> head {0};
+      std::atomic<std::uint64_t> clearedAt {0};
+    };
+
+    // Buffers stay after their thread exits, so dumps still show its spans
+    mutable std::mutex m_mutex {};
+    std::vector<std::unique_ptr<Buffer>> m_buffers {};
+
+    Buffer& GetBuffer();
+};
+
+/*! \brief Get the trace recorder of the program
+  */
+TraceRecorder& GetTraceRecorder();
+
+/*! \brief Records a span from its construction to its destruction
+  */
+class TraceSpan
+{
+  public:
+    TraceSpan(
+      const char* category,
+      const char* name
+    ) : m_category { category }
+      , m_name { name }
+      , m_startedAt { std::chrono::steady_clock::now() }
+    {
+    }
+
+    ~TraceSpan()
+    {
+      GetTraceRecorder().Record(m_category, m_name, m_startedAt,
+                                std::chrono::steady_clock::now());
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+  private:
+    const char* m_category;
+    const char* m_name;
+    std::chrono::steady_clock::time_point m_startedAt;
+};
+
+} // namespace NetworkMonitor
+
+// Trace spans of the library. Like the metrics macros, these expand to
+//  nothing unless the library is built with NETWORK_MONITOR_TRACING defined
+//  (CMake option NETWORK_MONITOR_TRACING).
+#define NETWORK_MONITOR_TRACE_CONCAT_INNER(a, b) a##b
+#define NETWORK_MONITOR_TRACE_CONCAT(a, b)                                    \
+  NETWORK_MONITOR_TRACE_CONCAT_INNER(a, b)
+#if defined(NETWORK_MONITOR_TRACING)
+#define NETWORK_MONITOR_TRACE_SCOPE(category, name)                           \
+  ::NetworkMonitor::TraceSpan NETWORK_MONITOR_TRACE_CONCAT(                   \
+    networkMonitorSpan, __LINE__                                              \
+  ) { category, name }
+#define NETWORK_MONITOR_TRACE_SINCE(category, name, startedAt)                \
+  ::NetworkMonitor::GetTraceRecorder().Record(                                \
+    category, name, startedAt, std::chrono::steady_clock::now()               \
+  )
+#define NETWORK_MONITOR_TRACE_THREAD_NAME(name)                               \
+  ::NetworkMonitor::GetTraceRecorder().SetThreadName(name)
+#else
+#define NETWORK_MONITOR_TRACE_SCOPE(category, name) do {} while (false)
+#define NETWORK_MONITOR_TRACE_SINCE(category, name, startedAt)                \
+  do {} while (false)
+#define NETWORK_MONITOR_TRACE_THREAD_NAME(name) do {} while (false)
+#endif
+
+#endif
@@ -4,7 +4,15 @@
 
 #include <nlohmann/json.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <map>
+#include <mutex>
 #include <string>
+#include <utility>
 #include <vector>
 #include <unordered_map>
 
@@ -96,6 +104,197 @@ struct PassengerEvent
 
   Id stationId {};
   Type type { Type::In };
+
+  // Time of the event, for the passenger flow history. Events without a
+  //  timestamp are recorded at the time they reach the network.
+  std::chrono::system_clock::time_point timestamp {};
+};
+
+/*! \brief Resolution and length of the passenger flow history of each station
+ *
+ *  Each station keeps a ring of nBuckets time buckets of bucketWidth, with
+ *  the passengers that entered and left the station in each bucket. The
+ *  history covers the last nBuckets * bucketWidth and takes 16 bytes per
+ *  bucket and station, whatever the number of events.
+ */
+struct PassengerFlowOptions
+{
+  // Windows are rounded up to whole buckets
+  std::chrono::seconds bucketWidth {10};
+
+  // 0 disables the history
+  std::size_t nBuckets {32};
+};
+
+/*! \brief Passengers that entered and left a station over a time window
+ */
+struct PassengerFlow
+{
+  long long int in {0};
+  long long int out {0};
+
+  // Time covered by the counts: The requested window, rounded up to whole
+  //  buckets and capped to the length of the history
+  std::chrono::seconds window {0};
+
+  /*! \brief Get the entries per second over the window
+   */
+  double GetInRate() const;
+
+  /*! \brief Get the exits per second over the window
+   */
+  double GetOutRate() const;
+};
+
+/*! \brief Passenger count of a station
+ */
+struct StationPassengerCount
+{
+  Id stationId {};
+  long long int passengerCount {0};
+};
+
+/*! \brief Passenger counts of all the stations at one point of the event
+ *         stream
+ */
+struct PassengerCountSnapshot
+{
+  // Number of passenger events the network had been given at that point,
+  //  see TransportNetwork::GetPassengerEventSequence
+  std::uint64_t sequence {0};
+
+  std::vector<StationPassengerCount> counts {};
+};
+
+/*! \brief Cost of changing routes during a journey, in the unit of the
+ *         travel times
+ *
+ *  Changing from a route of line A to a route of line B at station S costs
+ *  the penalty of the (A, B) line pair if there is one, otherwise the
+ *  penalty of S if there is one, otherwise the default penalty. Changing
+ *  between two routes of the same line is a change too: Set the (A, A) pair
+ *  to make it cheaper.
+ */
+struct InterchangePenalties
+{
+  unsigned int defaultPenalty {0};
+  std::unordered_map<Id, unsigned int> stations {};
+
+  // Keyed by the line of the arriving route, then the line of the departing
+  //  route
+  std::map<std::pair<Id, Id>, unsigned int> linePairs {};
+};
+
+/*! \brief Configuration of a journey query
+ */
+struct JourneyOptions
+{
+  InterchangePenalties penalties {};
+
+  // Journeys with more route changes are not considered
+  std::size_t maxTransfers {5};
+};
+
+/*! \brief Part of a journey on a single route
+ */
+struct JourneyLeg
+{
+  Id line {};
+  Id route {};
+  Id fromStation {};
+  Id toStation {};
+
+  // Number of stops travelled, the arrival stop included
+  std::size_t nStops {0};
+
+  unsigned int travelTime {0};
+
+  // Interchange penalty paid to board the route, 0 on the first leg
+  unsigned int penalty {0};
+};
+
+/*! \brief Journey between two stations, one leg per route
+ */
+struct Journey
+{
+  std::vector<JourneyLeg> legs {};
+
+  // Travel time plus interchange penalties
+  unsigned int cost {0};
+
+  // Travel time of all the legs
+  unsigned int travelTime {0};
+
+  /*! \brief Get the number of route changes
+   */
+  std::size_t GetTransferCount() const;
+};
+
+/*! \brief Configuration of an alternative journeys query
+ */
+struct AlternativeJourneyOptions
+{
+  JourneyOptions journey {};
+
+  // Alternatives that cost more than the cheapest loopless journey times
+  //  1 + this are not considered
+  double maxStretch {0.5};
+
+  // Fraction of its travel time an alternative can share with each cheaper
+  //  alternative, on the same pairs of consecutive stops
+  double maxSharing {0.8};
+
+  // Distinct candidate journeys built, returned or not, before the search
+  //  gives up
+  std::size_t maxCandidates {64};
+};
+
+/*! \brief Estimated heap footprint of a TransportNetwork, in bytes
+ *
+ *  The estimate follows the libstdc++ layouts of the containers and of the
+ *  make_shared allocations. Each object is counted in one category only.
+ */
+struct TransportNetworkMemoryUsage
+{
+  // Station nodes, with their shared_ptr control blocks, and station names
+  std::size_t stations {0};
+
+  // Edge objects, with their control blocks, and the edge vector of each
+  //  station
+  std::size_t edges {0};
+
+  // Route objects, with their control blocks, and their vectors of stops
+  std::size_t routes {0};
+
+  // Line objects, with their control blocks, and line names
+  std::size_t lines {0};
+
+  // Heap buffers of the station, route and line ID strings, including the
+  //  copies used as map keys. Short IDs live inside the strings and cost
+  //  nothing here.
+  std::size_t ids {0};
+
+  // Hash map nodes and bucket arrays
+  std::size_t maps {0};
+
+  // Stations sorted by passenger count, for the crowding queries
+  std::size_t rankings {0};
+
+  // Passenger flow history buckets
+  std::size_t flows {0};
+
+  // Estimated malloc headers and rounding of all the allocations above
+  std::size_t allocator {0};
+
+  std::size_t nStations {0};
+  std::size_t nEdges {0};
+  std::size_t nRoutes {0};
+  std::size_t nLines {0};
+  std::size_t nAllocations {0};
+
+  /*! \brief Get the sum of all the categories
+   */
+  std::size_t GetTotal() const;
 };
 
 /*! \brief Underground network representation
@@ -106,6 +305,12 @@ public:
   /*! \brief Default constructor
    */
   TransportNetwork();
+
+  /*! \brief Construct a network with a custom passenger flow history
+   */
+  explicit TransportNetwork(
+    const PassengerFlowOptions& flowOptions
+  );
   
   /*! \brief Default destructor
    */
@@ -170,6 +375,53 @@ public:
     const PassengerEvent& event
   );
 
+  /*! \brief Record a batch of passenger events
+   *
+   *  Same as calling RecordPassengerEvent for each event, except that the
+   *  crowding ranking is updated once per station of the batch instead of
+   *  once per event.
+   *
+   *  \returns the number of events recorded. Events for stations that are
+   *           not in the network, or that are not recognized, are skipped.
+   */
+  std::size_t RecordPassengerEvents(
+    const std::vector<PassengerEvent>& events
+  );
+
+  /*! \brief Get the number of passenger events given to the network so far
+   *
+   *  Every event passed to RecordPassengerEvent or RecordPassengerEvents
+   *  counts, even if the network rejects it, so that the number follows the
+   *  sequence numbers of a PassengerEventLog that gets the same events in the
+   *  same order.
+   */
+  std::uint64_t GetPassengerEventSequence() const;
+
+  /*! \brief Take a consistent snapshot of the passenger counts
+   *
+   *  The snapshot holds the count of each station after exactly `sequence`
+   *  events, as if the events had stopped while it was taken. It can run on
+   *  another thread than the one recording the events, without pausing it:
+   *  The snapshot only waits for the RecordPassengerEvent(s) call in
+   *  progress, if any, and the recording thread saves the count of a station
+   *  the first time it changes it after the snapshot started. Stations and
+   *  lines must not be added at the same time.
+   */
+  PassengerCountSnapshot SnapshotPassengerCounts() const;
+
+  /*! \brief Set the passenger counts and the event sequence from a snapshot
+   *
+   *  This restores a network, before it records new events, from the counts
+   *  of an earlier one. The passenger flow history is not part of the
+   *  snapshot and stays as it is.
+   *
+   *  \returns the number of stations restored. Stations that are not in the
+   *           network are skipped.
+   */
+  std::size_t RestorePassengerCounts(
+    const PassengerCountSnapshot& snapshot
+  );
+
   /*! \brief Get the number of passengers currently recorded at a station
    *
    *  The returned number can be negative: This happens if we start recording
@@ -182,6 +434,63 @@ public:
     const Id& station
   ) const;
 
+  /*! \brief Get the passengers that entered and left a station over the
+   *         last `window`
+   *
+   *  The window ends with the time bucket of `now`, and it is rounded up to
+   *  whole buckets: With 10-second buckets, a 5-minute window at 12:00:04
+   *  counts the events from 11:55:10 to 12:00:09. Events older than the
+   *  history, or recorded out of order after their bucket was reused, are
+   *  only counted in GetPassengerCount.
+   *
+   *  Like ForEachPassengerCount, this can run on another thread than the
+   *  one recording the events.
+   *
+   *  \throws std::runtime_error if the station is not in the network
+   */
+  PassengerFlow GetPassengerFlow(
+    const Id& station,
+    std::chrono::seconds window,
+    std::chrono::system_clock::time_point now =
+      std::chrono::system_clock::now()
+  ) const;
+
+  /*! \brief Get the `k` stations with the most passengers, most crowded
+   *         first
+   *
+   *  The network keeps its stations sorted by passenger count as it records
+   *  the events, so this takes O(k) and does not depend on the size of the
+   *  network. Stations with the same count come in no particular order.
+   *
+   *  Like ForEachPassengerCount, this can run on another thread than the
+   *  one recording the events: It returns the ranking as it was between two
+   *  events, and tries again if an event moved it while it was being read.
+   */
+  std::vector<StationPassengerCount> GetMostCrowdedStations(
+    std::size_t k
+  ) const;
+
+  /*! \brief Get the `k` stations with the fewest passengers, least crowded
+   *         first
+   *
+   *  See GetMostCrowdedStations.
+   */
+  std::vector<StationPassengerCount> GetLeastCrowdedStations(
+    std::size_t k
+  ) const;
+
+  /*! \brief Call `visit` with the passenger count of each station, in no
+   *         particular order
+   *
+   *  This can run on a reporting thread while another thread records
+   *  passenger events: The counts are read without locking, and each one is
+   *  either before or after a concurrent event. Stations and lines must not
+   *  be added at the same time.
+   */
+  void ForEachPassengerCount(
+    const std::function<void (const Id&, long long int)>& visit
+  ) const;
+
   /*! \brief Get list of routes serving a given station
    *
    *  \returns An empty vector if there was an error getting the list of
@@ -246,6 +555,61 @@ public:
     const Id& stationB
   ) const;
 
+  /*! \brief Get the journeys between two stations that trade cost for route
+   *         changes
+   *
+   *  A journey rides one route per leg, and pays an interchange penalty
+   *  between two legs. The results form a Pareto front: They are sorted by
+   *  number of transfers, fewest first, and each one costs strictly less
+   *  than the previous one. A journey that is not in the results costs at
+   *  least as much as one with as many transfers or fewer.
+   *
+   *  The search goes round by round, one more transfer per round, and scans
+   *  each route that serves a station reached in the previous round once
+   *  per round, like RAPTOR on a timetable without times. A backward search
+   *  from the destination bounds the travel time left from each station, so
+   *  the rounds skip what cannot beat the best journey found so far.
+   *
+   *  \returns An empty vector if either station is not in the network, if
+   *           they are the same station, or if no journey with at most
+   *           `options.maxTransfers` transfers connects them
+   */
+  std::vector<Journey> GetJourneys(
+    const Id& from,
+    const Id& to,
+    const JourneyOptions& options = {}
+  ) const;
+
+  /*! \brief Get up to k cheapest alternative journeys between two stations
+   *
+   *  The journeys are loopless, sorted by cost, cheapest first, and the
+   *  first one is the cheapest loopless journey with at most
+   *  `options.journey.maxTransfers` transfers. An alternative is skipped if
+   *  it costs more than the first journey times 1 + `options.maxStretch`,
+   *  or if it shares more than `options.maxSharing` of its travel time with
+   *  a cheaper alternative. Line pair penalties can make a journey that
+   *  passes a station twice cheaper than the first one: It is never
+   *  returned, and the stretch does not apply to it.
+   *
+   *  One round-based search labels every station it can reach within the
+   *  cost limit, with at most `options.journey.maxTransfers` transfers.
+   *  Each label is a via station: its journey, followed by the cheapest path
+   *  of the backward search from that station to the destination, is a
+   *  candidate. The candidates are built in the order of their lower bound,
+   *  so the search stops once k journeys are final, without any further
+   *  search of the network.
+   *
+   *  \returns An empty vector if either station is not in the network, if
+   *           they are the same station, if k is 0, or if no journey
+   *           connects them
+   */
+  std::vector<Journey> GetAlternativeJourneys(
+    const Id& from,
+    const Id& to,
+    std::size_t k,
+    const AlternativeJourneyOptions& options = {}
+  ) const;
+
   /*! \brief Populate the network from a JSON object
    *
    *  \param src Ownership of the source JSON object is moved to this method
@@ -263,12 +627,53 @@ public:
     nlohmann::json&& src
   );
 
+  /*! \brief Populate the network from a JSON stream
+   *
+   *  The stream is parsed incrementally: Stations, lines and travel times are
+   *  added to the network as soon as they are complete, without building a
+   *  JSON object of the whole source first. Lines that appear before the
+   *  stations, and travel times that appear before the lines, are held back
+   *  until their dependencies have been added.
+   *
+   *  \returns false if stations and lines where parsed successfully, but not
+   *           the travel times
+   *
+   *  \throws  std::runtime_error If there was an issue adding new stations or
+   *                              lines to the network, or if the stations,
+   *                              lines or travel_times section is missing
+   *  \throws  nlohman::json::exception If the stream is not valid JSON
+   */
+  bool FromJson(
+    std::istream& src
+  );
+
+  /*! \brief Estimate the memory used by the network, by category
+   *
+   *  Copies of a network share their stations, lines and routes: Each copy
+   *  reports the shared objects as its own.
+   */
+  TransportNetworkMemoryUsage MemoryUsage() const;
+
 private:
   // Forward-declare all internal structs
   struct GraphEdge;
   struct GraphNode;
   struct RouteInternal;
   struct LineInternal;
+  struct JourneySearch;
+
+  // Passenger flow in one time bucket. Only RecordPassengerEvent writes the
+  //  buckets. When it reuses a bucket for a new time slot, it invalidates
+  //  the index before it resets the counts, so that readers on other threads
+  //  can tell that the counts they read do not belong to the slot they
+  //  expected.
+  struct FlowBucket
+  {
+    // Number of the time slot since the epoch, -1 while it is being reset
+    std::atomic<std::int64_t> index {-1};
+    std::atomic<std::uint32_t> in {0};
+    std::atomic<std::uint32_t> out {0};
+  };
 
   // Graph node
   // We use this as the internal station representation
@@ -276,9 +681,46 @@ private:
   {
     Id id {};
     std::string name {};
-    long long int passengerCount {0};
+
+    // Position of the station in the order it was added, for the per-station
+    //  arrays of the journey search
+    std::size_t index {0};
+
+    // Only RecordPassengerEvent writes the count, but ForEachPassengerCount
+    //  may read it from another thread
+    std::atomic<long long int> passengerCount {0};
     std::vector<std::shared_ptr<GraphEdge>> edges {};
 
+    // Each route that serves the station, with the position of the station
+    //  in it. Unlike the edges, this includes the routes that end here.
+    std::vector<std::pair<RouteInternal*, std::uint32_t>> routeStops {};
+
+    // Count before the first event of the current snapshot epoch, saved by
+    //  the recording thread for SnapshotPassengerCounts
+    std::atomic<long long int> snapshotCount {0};
+    std::atomic<std::uint64_t> snapshotEpoch {0};
+
+    // Ring of PassengerFlowOptions::nBuckets time buckets
+    std::vector<FlowBucket> flow {};
+
+    // Position of the station in the crowding ranking
+    std::size_t rank {0};
+
+    // Count an event in the bucket of a time slot. All the stations have as
+    //  many buckets, so the position of a slot in the ring is the same for
+    //  all of them.
+    void RecordFlow(
+      std::int64_t slot,
+      std::size_t position,
+      PassengerEvent::Type type
+    );
+
+    // Sum the buckets of the time slots from first to last
+    PassengerFlow GetFlow(
+      std::int64_t first,
+      std::int64_t last
+    ) const;
+
     // Find the edge for a specific line route
     std::vector<
       std::shared_ptr<GraphEdge>
@@ -295,6 +737,9 @@ private:
     std::shared_ptr<RouteInternal> route {nullptr};
     std::shared_ptr<GraphNode> nextStop {nullptr};
     unsigned int travelTime {0};
+
+    // Position of the departure stop in the route
+    std::uint32_t position {0};
   };
 
   // Internal route representation
@@ -304,6 +749,20 @@ private:
     Id id {};
     std::shared_ptr<LineInternal> line {nullptr};
     std::vector<std::shared_ptr<GraphNode>> stops {};
+
+    // Position of the route in the order it was added, like GraphNode::index
+    std::size_t index {0};
+
+    // The stops again, with their index and the travel time to the next
+    //  one, 0 for the last stop. The journey search walks the routes along
+    //  this array, without reading the stops and edges.
+    struct Stop
+    {
+      GraphNode* node {nullptr};
+      std::uint32_t index {0};
+      unsigned int travelTime {0};
+    };
+    std::vector<Stop> path {};
   };
 
   // Internal line representation
@@ -315,10 +774,126 @@ private:
     std::unordered_map<Id, std::shared_ptr<RouteInternal>> routes {};
   };
 
+  // Stations sorted by passenger count, highest first
+  // Only the thread that records the passenger events writes the ranking. A
+  // passenger event moves its station to the edge of the group of stations
+  // with the same count, then past the neighbour groups until the order is
+  // right again: One swap for a single passenger, without any allocation.
+  // Readers on other threads copy the entries they need and check the
+  // sequence number, which is odd while the writer moves entries.
+  struct CrowdRanking
+  {
+    struct Entry
+    {
+      std::atomic<long long int> passengerCount {0};
+      std::atomic<GraphNode*> station {nullptr};
+
+      Entry() = default;
+      Entry(const Entry& other);
+      Entry& operator=(const Entry& other);
+    };
+
+    std::atomic<std::uint64_t> sequence {0};
+    std::vector<Entry> entries {};
+
+    // Add a station with its current passenger count
+    void Add(
+      GraphNode& station
+    );
+
+    // Move a station to the place of its new passenger count
+    void Update(
+      GraphNode& station,
+      long long int passengerCount
+    );
+
+    // Copy the first or last k entries, from the ends inwards
+    std::vector<StationPassengerCount> Get(
+      std::size_t k,
+      bool mostCrowded
+    ) const;
+
+  private:
+    // Exchange two entries and the ranks of their stations
+    void Swap(
+      std::size_t a,
+      std::size_t b
+    );
+
+    // Find the first and the last entry with the same count as an entry
+    std::size_t FindGroupFirst(
+      std::size_t position
+    ) const;
+    std::size_t FindGroupLast(
+      std::size_t position
+    ) const;
+  };
+
+  // Consistent snapshots of the passenger counts
+  // Each snapshot starts a new epoch. The recording thread reads the epoch at
+  // the start of each RecordPassengerEvent(s) call and, the first time it
+  // changes a count in a new epoch, saves the count it had before. The
+  // snapshot reads the saved count of the stations that changed since its
+  // epoch started, and the current count of the others. `calls` is odd while
+  // a call runs, so that the snapshot can wait for the one call that may
+  // still be in the previous epoch.
+  struct CountSnapshots
+  {
+    // One snapshot at a time
+    std::mutex mutex {};
+
+    std::atomic<std::uint64_t> epoch {0};
+    std::atomic<std::uint64_t> calls {0};
+
+    // Events given to the network, with the same saving scheme as the counts
+    std::atomic<std::uint64_t> sequence {0};
+    std::atomic<std::uint64_t> savedSequence {0};
+    std::atomic<std::uint64_t> savedEpoch {0};
+  };
+
   // Map station and lines by ID. We do not map line routes here, as they
   // are mapped within each line representation
   std::unordered_map<Id, std::shared_ptr<GraphNode>> m_stations {};
   std::unordered_map<Id, std::shared_ptr<LineInternal>> m_lines {};
+
+  // Number of routes of all the lines
+  std::size_t m_nRoutes {0};
+
+  // Copies of the network share the ranking, like they share the stations
+  // Created with the first station.
+  std::shared_ptr<CrowdRanking> m_crowdRanking {nullptr};
+
+  // Shared by the copies of the network, like the stations
+  std::shared_ptr<CountSnapshots> m_countSnapshots {
+    std::make_shared<CountSnapshots>()
+  };
+
+  PassengerFlowOptions m_flowOptions {};
+
+  // Time slot and ring position of the last recorded event, to skip the
+  //  divisions while the events stay in the same second
+  std::int64_t m_lastFlowSecond {-1};
+  std::int64_t m_lastFlowSlot {-1};
+  std::size_t m_lastFlowPosition {0};
+
+  // Start a RecordPassengerEvent(s) call of nEvents events and get its
+  //  snapshot epoch, and end it
+  std::uint64_t BeginPassengerEvents(
+    std::size_t nEvents
+  );
+  void EndPassengerEvents();
+
+  // Update the count and the flow history of a station, but not the ranking
+  bool ApplyPassengerEvent(
+    GraphNode& station,
+    const PassengerEvent& event,
+    std::uint64_t epoch
+  );
+
+  // Get the time slot of a passenger flow bucket
+  std::int64_t GetFlowSlot(
+    std::chrono::system_clock::time_point time
+  ) const;
   
   // Get station by ID
   std::shared_ptr<GraphNode> GetStation(
@@ -0,0 +1,157 @@
+#ifndef WEBSOCKET_CLIENT_MANAGER_H
+#define WEBSOCKET_CLIENT_MANAGER_H
+#pragma once
+
+#include <network-monitor/tls-session-cache.h>
+#include <network-monitor/websocket-client.h>
+
+#include <boost/asio.hpp>
+#include <boost/beast/ssl.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace NetworkMonitor
+{
+/*! \brief Message-rate statistics of a connection owned by a
+  *         WebSocketClientManager
+  */
+struct ConnectionStats
+{
+  std::size_t clientIdx {0};
+  std::size_t threadIdx {0};
+  std::string url {};
+  std::string endpoint {};
+
+  // Cumulative traffic counters
+  WebSocketClientStats traffic {};
+
+  // Average rate since the connection was established. 0 if the client is not
+  //  connected yet.
+  double messagesPerSecond {0.0};
+  double bytesPerSecond {0.0};
+
+  // Rate since the previous call to WebSocketClientManager::GetStats, or since
+  //  the connection was established for the first call.
+  double recentMessagesPerSecond {0.0};
+};
+
+/*! \brief Run many WebSocket clients across a pool of threads
+  *
+  *  The manager owns one io_context per thread. Each client is assigned to the
+  *  least loaded io_context when it is added and stays there for its whole
+  *  lifetime, so all the client callbacks run on that io_context thread.
+  *  Clients on different threads never share a lock.
+  *
+  *  All the clients share one TLS session cache, so a client connecting to a
+  *  server that another client already connected to resumes its TLS session.
+  */
+class WebSocketClientManager
+{
+  public:
+    /*! \brief Construct a client manager
+      *
+      *  \note This constructor does not start the thread pool
+      *
+      *  \param ctx      The TLS context shared by all the clients. It must
+      *                  outlive the manager.
+      *  \param nThreads The number of io_context threads. 0 means one thread
+      *                  per hardware core.
+      */
+    WebSocketClientManager(
+      boost::asio::ssl::context& ctx,
+      std::size_t nThreads = 0
+    );
+
+    /*! \brief Destructor
+      *
+      *  Stops the thread pool and destroys all the clients.
+      */
+    ~WebSocketClientManager();
+
+    WebSocketClientManager(const WebSocketClientManager&) = delete;
+    WebSocketClientManager& operator=(const WebSocketClientManager&) = delete;
+
+    /*! \brief Create a new client on the least loaded io_context
+      *
+      *  \note The client is not connected. Call Connect on the returned client.
+      *        Clients can be added both before and after Run.
+      *
+      *  \returns A shared pointer to the client. The manager keeps the client
+      *           alive until the manager is destroyed.
+      */
+    std::shared_ptr<WebSocketClient> AddClient(
+      const std::string& url,
+      const std::string& endpoint,
+      const std::string& port
+    );
+
+    /*! \brief Start one thread per io_context
+      *
+      *  This method returns immediately. Calling Run on a running manager has
+      *  no effect.
+      */
+    void Run();
+
+    /*! \brief Stop all the io_context objects and join their threads
+      *
+      *  Pending asynchronous operations are abandoned. The manager cannot be
+      *  restarted after it was stopped.
+      */
+    void Stop();
+
+    /*! \brief Get the number of io_context threads
+      */
+    std::size_t GetThreadCount() const;
+
+    /*! \brief Get the statistics of all the clients, in the order they were
+      *         added
+      */
+    std::vector<ConnectionStats> GetStats();
+
+    /*! \brief Get the TLS session cache shared by all the clients
+      */
+    std::shared_ptr<TlsSessionCache> GetTlsSessionCache() const;
+
+  private:
+    struct ClientEntry
+    {
+      std::shared_ptr<WebSocketClient> client {nullptr};
+      std::size_t threadIdx {0};
+      std::string url {};
+      std::string endpoint {};
+
+      // Last sample, used to compute the recent message rate
+      std::uint64_t lastMessages {0};
+      std::chrono::steady_clock::time_point lastSampleAt {};
+    };
+
+    using WorkGuard = boost::asio::executor_work_guard<
+      boost::asio::io_context::executor_type
+    >;
+
+    boost::asio::ssl::context& m_ctx;
+    std::shared_ptr<TlsSessionCache> m_tlsSessionCache {nullptr};
+
+    // The io_context objects must outlive the clients, which hold strands on
+    //  them. Members are destroyed in reverse order, so these come first.
+    std::vector<std::unique_ptr<boost::asio::io_context>> m_iocs {};
+    std::vector<WorkGuard> m_workGuards {};
+    std::vector<std::thread> m_threads {};
+    std::vector<std::size_t> m_clientsPerThread {};
+
+    std::mutex m_clientsMutex {};
+    std::vector<ClientEntry> m_clients {};
+
+    bool m_running {false};
+    bool m_stopped {false};
+};
+
+} // namespace NetworkMonitor
+
+#endif
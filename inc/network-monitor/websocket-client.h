@@ -2,19 +2,93 @@
 #define WEBSOCKET_CLIENT_H
 #pragma once
 
+#include <network-monitor/tls-session-cache.h>
+
 #include <boost/asio.hpp>
 #include <boost/beast.hpp>
 #include <boost/system/error_code.hpp>
 #include <boost/beast/ssl.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <string_view>
 #include <functional>
+#include <random>
+#include <vector>
 
 namespace NetworkMonitor
 {
+
+class FeedCapture;
+
+/*! \brief Traffic counters of a WebSocket client
+  *
+  *  Counters are cumulative since the client was constructed.
+  */
+struct WebSocketClientStats
+{
+  std::uint64_t messagesReceived {0};
+  std::uint64_t bytesReceived {0};
+  std::uint64_t messagesSent {0};
+  std::uint64_t bytesSent {0};
+
+  // Time at which the last successful WebSocket handshake completed. Left at
+  // its default value if the client never connected.
+  std::chrono::steady_clock::time_point connectedAt {};
+
+  // Duration of the last TLS handshake, and of the whole last connection
+  //  sequence (resolve, TCP connect, TLS and WebSocket handshakes).
+  std::chrono::nanoseconds tlsHandshakeDuration {0};
+  std::chrono::nanoseconds connectDuration {0};
+
+  // true if the last TLS handshake resumed a cached session
+  bool tlsSessionResumed {false};
+
+  // Number of successful automatic reconnections, and the total time without
+  //  incoming data across all of them
+  std::uint64_t reconnects {0};
+  std::chrono::nanoseconds totalGapDuration {0};
+};
+
+/*! \brief Automatic reconnection policy
+  *
+  *  The delay before attempt n (starting at 0) is
+  *  min(maxDelay, initialDelay * multiplier^n), reduced by a random fraction
+  *  of up to `jitter`. The jitter keeps many clients that lost their
+  *  connection at the same time from reconnecting in lockstep.
+  */
+struct ReconnectPolicy
+{
+  std::chrono::milliseconds initialDelay {100};
+  std::chrono::milliseconds maxDelay {30'000};
+  double multiplier {2.0};
+
+  // Fraction of the delay, between 0 and 1, that is randomized
+  double jitter {0.5};
+
+  // Give up after this many failed attempts in a row. 0 means never give up.
+  unsigned int maxAttempts {0};
+};
+
+/*! \brief Result of an automatic reconnection
+  */
+struct ReconnectInfo
+{
+  // Number of connection attempts it took, including the successful one
+  unsigned int attempts {0};
+
+  // Time between the last message received on the old connection (or its
+  //  drop, if no message was received) and the end of the replay on the new
+  //  connection. Messages the server published during the gap were missed.
+  std::chrono::nanoseconds gap {0};
+};
+
 /*! \brief Client to connect to a WebSocket server over plain TCP
   */
 class WebSocketClient
@@ -31,13 +105,19 @@ class WebSocketClient
       *  \param ioc      The io_context object. The user takes care of calling
       *                  ioc.run()
       *  \param ctx      The TLS context to setup a TLS socket stream
+      *  \param tlsSessionCache Optional cache of TLS sessions. When set, the
+      *                  client offers the cached session for this server in
+      *                  its TLS handshake and stores the new session once
+      *                  connected. Clients sharing a cache resume each other's
+      *                  sessions.
       */
     WebSocketClient(
       const std::string& url,
       const std::string& endpoint,
       const std::string& port,
       boost::asio::io_context& ioc,
-      boost::asio::ssl::context& ctx
+      boost::asio::ssl::context& ctx,
+      std::shared_ptr<TlsSessionCache> tlsSessionCache = nullptr
     );
 
     /*! \brief Destructor.
@@ -51,7 +131,9 @@ class WebSocketClient
       *                      received. The message is an rvalue reference;
       *                      ownership is passed to the receiver
       *  \param onDisconnect Called when the connection is closed by the server
-      *                      or due to a connection error.
+      *                      or due to a connection error. If automatic
+      *                      reconnection is enabled, it is only called when
+      *                      the client gives up reconnecting.
       */
     void Connect(
       std::function<void (boost::system::error_code)> onConnect     = nullptr,
@@ -61,6 +143,9 @@ class WebSocketClient
     );
 
     /*! \brief Send a text message to the WebSocket server
+      *
+      *  Messages are written one at a time, in the order of the calls. This
+      *  method can be called from any thread.
       *
       *  \param message  The message to send. The caller must ensure that this
       *                  string stays in scope until the onSend handler is called
@@ -73,6 +158,9 @@ class WebSocketClient
     );
 
     /*! \brief Close the WebSocket connection
+      *
+      *  This method can be called from any thread. The connection is closed
+      *  on the client strand, after the handlers already running there.
       *
       *  \param onClose  Called when the connection is closed, successfully or
       *                  not
@@ -81,21 +169,200 @@ class WebSocketClient
       std::function<void (boost::system::error_code)> onClose = nullptr
     );
 
+    /*! \brief Enable automatic reconnection
+      *
+      *  When the connection drops without a call to Close, the client waits
+      *  according to the policy and reconnects. After each reconnection it
+      *  sends the replay messages in order and then calls onReconnect.
+      *
+      *  During the replay the client already reads from the new connection:
+      *  onMessage receives the server's responses to the replay messages,
+      *  such as a STOMP CONNECTED frame, before onReconnect is called.
+      *  Messages passed to Send while the client reconnects are written after
+      *  the replay. A handler that restores the session itself when it sees
+      *  those responses would do it twice, so it should skip them after a
+      *  reconnection.
+      *
+      *  \note Call this before Connect. The initial connection is not retried:
+      *        Its failures are reported to onConnect as usual.
+      *
+      *  \param policy       The backoff policy
+      *  \param onReconnect  Called after a successful reconnection and replay,
+      *                      or with an error when the client gives up
+      */
+    void EnableReconnect(
+      const ReconnectPolicy& policy,
+      std::function<void (boost::system::error_code,
+                          const ReconnectInfo&)> onReconnect = nullptr
+    );
+
+    /*! \brief Set the messages to send again after each reconnection
+      *
+      *  Use this to restore the server-side session state, for example the
+      *  STOMP CONNECT and SUBSCRIBE frames. The messages are not sent on the
+      *  initial connection.
+      */
+    void SetReplayMessages(
+      std::vector<std::string> messages
+    );
+
+    /*! \brief Record every message the client receives into a capture
+      *
+      *  Each message is recorded with the time it was read, before it is
+      *  passed on, with both the callback and the awaitable API. Clients can
+      *  share a capture.
+      *
+      *  \note Call this before Connect
+      */
+    void SetFeedCapture(
+      std::shared_ptr<FeedCapture> capture
+    );
+
+#if defined(BOOST_ASIO_HAS_CO_AWAIT)
+    /*! \brief Get the executor of the client strand
+      *
+      *  Coroutines that use the awaitable API must run on this executor:
+      *
+      *      boost::asio::co_spawn(client.GetExecutor(), [&]()
+      *        -> boost::asio::awaitable<void> {
+      *          co_await client.Connect(boost::asio::use_awaitable);
+      *          ...
+      *        }, boost::asio::detached);
+      */
+    boost::asio::strand<boost::asio::io_context::executor_type> GetExecutor(
+    ) const;
+
+    /*! \brief Connect to the server (awaitable)
+      *
+      *  Unlike the callback API, this does not start a background read loop:
+      *  The caller reads each message with Read. Automatic reconnection is not
+      *  available with the awaitable API.
+      *
+      *  \throws boost::system::system_error if the connection failed
+      */
+    boost::asio::awaitable<void> Connect(
+      boost::asio::use_awaitable_t<>
+    );
+
+    /*! \brief Read the next message (awaitable)
+      *
+      *  \param message Replaced with the message. Pass the same string to
+      *                 each call: Once its capacity fits the largest message,
+      *                 reading does not allocate.
+      *
+      *  \throws boost::system::system_error if the connection was closed or
+      *          lost
+      */
+    boost::asio::awaitable<void> Read(
+      std::string& message,
+      boost::asio::use_awaitable_t<>
+    );
+
+    /*! \brief Send a text message to the WebSocket server (awaitable)
+      *
+      *  The message only needs to stay in scope until the returned awaitable
+      *  completes.
+      *
+      *  \throws boost::system::system_error if the message could not be sent
+      */
+    boost::asio::awaitable<void> Send(
+      const std::string& message,
+      boost::asio::use_awaitable_t<>
+    );
+
+    /*! \brief Close the WebSocket connection (awaitable)
+      *
+      *  \throws boost::system::system_error if the connection could not be
+      *          closed cleanly
+      */
+    boost::asio::awaitable<void> Close(
+      boost::asio::use_awaitable_t<>
+    );
+#endif // BOOST_ASIO_HAS_CO_AWAIT
+
+    /*! \brief Get the traffic counters of this client
+      *
+      *  This method can be called from any thread, also while the client is
+      *  running on its io_context.
+      */
+    WebSocketClientStats GetStats() const;
+
   private:
     std::string m_url{};
     std::string m_endpoint{};
     std::string m_port{};
 
+    using Stream = boost::beast::websocket::stream<
+      boost::beast::ssl_stream<boost::beast::tcp_stream>
+    >;
+
     // We leave these uninitialized because they do not support a default
     //  constructor
+    // All the I/O objects share one strand, so their handlers never run
+    //  concurrently.
+    boost::asio::strand<boost::asio::io_context::executor_type> m_strand;
+    boost::asio::ssl::context& m_ctx;
     boost::asio::ip::tcp::resolver m_resolver;
-    boost::beast::websocket::stream<
-      boost::beast::ssl_stream<boost::beast::tcp_stream>
-    > m_ws;
+    boost::asio::steady_timer m_reconnectTimer;
+
+    // A WebSocket stream cannot be reused after its connection failed, so we
+    //  create a new one for each reconnection.
+    std::unique_ptr<Stream> m_ws {nullptr};
     boost::beast::flat_buffer m_rBuffer{};
 
+    // Only accessed on the WebSocket strand, except in Connect
     bool m_closed { true };
 
+    // Outgoing messages of Send and of the replay, written one at a time.
+    //  The front one is in flight if m_writing is set. Only accessed on the
+    //  WebSocket strand.
+    struct QueuedWrite
+    {
+      const std::string* message {nullptr};
+      std::function<void (boost::system::error_code)> onSend {nullptr};
+      bool replay {false};
+    };
+    std::deque<QueuedWrite> m_writeQueue {};
+    bool m_writing {false};
+
+    // Automatic reconnection. Only accessed on the WebSocket strand, except
+    //  for the setup methods that are called before Connect.
+    bool m_reconnectEnabled {false};
+    ReconnectPolicy m_reconnectPolicy {};
+    std::vector<std::string> m_replayMessages {};
+    bool m_reconnecting {false};
+    unsigned int m_reconnectAttempts {0};
+    std::chrono::steady_clock::time_point m_lastMessageAt {};
+    std::chrono::steady_clock::time_point m_disconnectedAt {};
+    std::minstd_rand m_random;
+    std::function<void (boost::system::error_code,
+                        const ReconnectInfo&)> m_onReconnect {nullptr};
+
+    // Traffic counters. These are written on the WebSocket strand and read
+    //  from any thread through GetStats().
+    std::atomic<std::uint64_t> m_messagesReceived {0};
+    std::atomic<std::uint64_t> m_bytesReceived {0};
+    std::atomic<std::uint64_t> m_messagesSent {0};
+    std::atomic<std::uint64_t> m_bytesSent {0};
+    std::atomic<std::chrono::steady_clock::rep> m_connectedAt {0};
+    std::atomic<std::chrono::nanoseconds::rep> m_tlsHandshakeDuration {0};
+    std::atomic<std::chrono::nanoseconds::rep> m_connectDuration {0};
+    std::atomic<bool> m_tlsSessionResumed {false};
+    std::atomic<std::uint64_t> m_reconnects {0};
+    std::atomic<std::chrono::nanoseconds::rep> m_totalGapDuration {0};
+
+    // TLS session resumption
+    std::shared_ptr<TlsSessionCache> m_tlsSessionCache {nullptr};
+    std::string m_tlsSessionKey {};
+    bool m_tlsSessionSaved {false};
+
+    // Capture of the received messages, if any
+    std::shared_ptr<FeedCapture> m_feedCapture {nullptr};
+
+    // Only accessed on the WebSocket strand
+    std::chrono::steady_clock::time_point m_connectStartedAt {};
+    std::chrono::steady_clock::time_point m_tlsStartedAt {};
+
     std::function<void (boost::system::error_code)> m_onConnect {nullptr};
     std::function<void (boost::system::error_code,
                         std::string&&)> m_onMessage {nullptr};
@@ -127,6 +394,44 @@ class WebSocketClient
       const boost::system::error_code& ec
     );
 
+    void SaveTlsSession();
+
+    // Steps shared by the callback and the awaitable APIs
+    void PrepareTlsHandshake();
+
+    void OnTlsHandshakeDone();
+
+    void OnWebSocketHandshakeDone();
+
+    void TakeMessage(
+      std::size_t nBytes,
+      std::string& message
+    );
+
+    void StartConnection();
+
+    void OnConnectionFailed(
+      const boost::system::error_code& ec
+    );
+
+    void OnConnectionLost(
+      const boost::system::error_code& ec
+    );
+
+    void ScheduleReconnect();
+
+    void WriteNext();
+
+    void QueueReplayMessages();
+
+    void DropQueuedReplay();
+
+    void FailQueuedWrites(
+      const boost::system::error_code& ec
+    );
+
+    void OnReconnected();
+
 };
 
 } // namespace NetworkMonitor
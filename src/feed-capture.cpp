@@ -0,0 +1,449 @@
+#include <network-monitor/feed-capture.h>
+#include <network-monitor/stomp-frame.h>
+#include <network-monitor/trace.h>
+#include <network-monitor/transport-network.h>
+
+#include "varint.h"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using NetworkMonitor::AppendVarint;
+using NetworkMonitor::FeedCapture;
+using NetworkMonitor::FeedCaptureReader;
+using NetworkMonitor::FeedMessage;
+using NetworkMonitor::FeedReplayOptions;
+using NetworkMonitor::FeedReplayReport;
+using NetworkMonitor::ParseStompFrame;
+using NetworkMonitor::PassengerEvent;
+using NetworkMonitor::StompCommand;
+using NetworkMonitor::StompFrame;
+using NetworkMonitor::TransportNetwork;
+
+static constexpr std::string_view kCaptureMagic { "NMFEED01" };
+static constexpr std::size_t kCaptureHeaderSize {16};
+
+// Records reach the file in chunks of this size
+static constexpr std::size_t kFileBufferSize {1 << 20};
+
+// Static functions
+
+static std::int64_t ToNanoseconds(
+  std::chrono::system_clock::time_point time
+)
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    time.time_since_epoch()
+  ).count();
+}
+
+static std::chrono::system_clock::time_point FromNanoseconds(
+  std::int64_t nanoseconds
+)
+{
+  return std::chrono::system_clock::time_point {
+    std::chrono::duration_cast<std::chrono::system_clock::duration>(
+      std::chrono::nanoseconds {nanoseconds}
+    )
+  };
+}
+
+// Read a fixed number of digits
+static bool ParseDigits(
+  std::string_view text,
+  std::size_t offset,
+  std::size_t nDigits,
+  int& value
+)
+{
+  if (offset + nDigits > text.size())
+    return false;
+  const auto* first { text.data() + offset };
+  const auto [end, ec] = std::from_chars(first, first + nDigits, value);
+  return ec == std::errc {} && end == first + nDigits;
+}
+
+// ISO 8601 UTC date, as the feed sends it: 2024-01-01T08:00:00.000000Z. The
+//  fraction of a second is optional and can have up to 9 digits.
+static bool ParseDateTime(
+  std::string_view text,
+  std::chrono::system_clock::time_point& time
+)
+{
+  int year {0};
+  int month {0};
+  int day {0};
+  int hours {0};
+  int minutes {0};
+  int seconds {0};
+  if (text.size() < 20 ||
+      !ParseDigits(text, 0, 4, year) || text[4] != '-' ||
+      !ParseDigits(text, 5, 2, month) || text[7] != '-' ||
+      !ParseDigits(text, 8, 2, day) || text[10] != 'T' ||
+      !ParseDigits(text, 11, 2, hours) || text[13] != ':' ||
+      !ParseDigits(text, 14, 2, minutes) || text[16] != ':' ||
+      !ParseDigits(text, 17, 2, seconds) || text.back() != 'Z')
+  {
+    return false;
+  }
+  const std::chrono::year_month_day date {
+    std::chrono::year {year},
+    std::chrono::month {static_cast<unsigned int>(month)},
+    std::chrono::day {static_cast<unsigned int>(day)}
+  };
+  if (!date.ok() || hours > 23 || minutes > 59 || seconds > 60)
+    return false;
+
+  std::int64_t nanoseconds {0};
+  const auto fraction { text.substr(19, text.size() - 20) };
+  if (!fraction.empty())
+  {
+    if (fraction[0] != '.' || fraction.size() < 2 || fraction.size() > 10)
+      return false;
+    std::int64_t scale {1'000'000'000};
+    for (const auto c: fraction.substr(1))
+    {
+      if (c < '0' || c > '9')
+        return false;
+      scale /= 10;
+      nanoseconds += (c - '0') * scale;
+    }
+  }
+  time = std::chrono::time_point_cast<std::chrono::system_clock::duration>(
+    std::chrono::sys_days {date} + std::chrono::hours {hours} +
+    std::chrono::minutes {minutes} + std::chrono::seconds {seconds} +
+    std::chrono::nanoseconds {nanoseconds}
+  );
+  return true;
+}
+
+static std::int64_t Percentile(
+  const std::vector<std::int64_t>& sorted,
+  double percentile
+)
+{
+  if (sorted.empty())
+    return 0;
+  const auto idx { static_cast<std::size_t>(
+    percentile / 100.0 * static_cast<double>(sorted.size() - 1) + 0.5
+  )};
+  return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+// FeedCapture - Public methods
+
+FeedCapture::FeedCapture() = default;
+
+FeedCapture::~FeedCapture()
+{
+  Close();
+}
+
+bool FeedCapture::Open(
+  const std::filesystem::path& path
+)
+{
+  std::lock_guard<std::mutex> lock { m_mutex };
+  if (m_file.is_open())
+    return false;
+
+  // A large buffer, so that the client thread rarely waits for a write
+  m_fileBuffer.resize(kFileBufferSize);
+  m_file.rdbuf()->pubsetbuf(m_fileBuffer.data(),
+                            static_cast<std::streamsize>(m_fileBuffer.size()));
+  m_file.open(path, std::ios::binary | std::ios::trunc);
+  if (!m_file)
+  {
+    m_error = "Could not create " + path.string();
+    return false;
+  }
+  m_path = path;
+  m_lastTime = ToNanoseconds(std::chrono::system_clock::now());
+  std::string header { kCaptureMagic };
+  for (std::size_t idx {0}; idx < 8; ++idx)
+  {
+    header.push_back(static_cast<char>(
+      static_cast<std::uint64_t>(m_lastTime) >> (8 * idx) & 0xff
+    ));
+  }
+  m_file.write(header.data(), static_cast<std::streamsize>(header.size()));
+  m_nMessages = 0;
+  m_nBytes = header.size();
+  return true;
+}
+
+void FeedCapture::Record(
+  std::string_view payload,
+  std::chrono::system_clock::time_point receivedAt
+)
+{
+  std::lock_guard<std::mutex> lock { m_mutex };
+  if (!m_file.is_open())
+    return;
+  const auto time { std::max(ToNanoseconds(receivedAt), m_lastTime) };
+
+  // Both varints fit in 20 bytes
+  std::string prefix {};
+  prefix.reserve(20);
+  AppendVarint(prefix, static_cast<std::uint64_t>(time - m_lastTime));
+  AppendVarint(prefix, payload.size());
+  m_file.write(prefix.data(), static_cast<std::streamsize>(prefix.size()));
+  m_file.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+  m_lastTime = time;
+  ++m_nMessages;
+  m_nBytes += prefix.size() + payload.size();
+}
+
+bool FeedCapture::Flush()
+{
+  std::lock_guard<std::mutex> lock { m_mutex };
+  if (!m_file.is_open())
+    return m_error.empty();
+  if (!m_file.flush())
+  {
+    m_error = "Could not write to " + m_path.string();
+    return false;
+  }
+  return true;
+}
+
+void FeedCapture::Close()
+{
+  std::lock_guard<std::mutex> lock { m_mutex };
+  if (!m_file.is_open())
+    return;
+  m_file.close();
+  if (!m_file)
+    m_error = "Could not write to " + m_path.string();
+}
+
+std::uint64_t FeedCapture::GetMessageCount() const
+{
+  std::lock_guard<std::mutex> lock { m_mutex };
+  return m_nMessages;
+}
+
+std::uint64_t FeedCapture::GetByteCount() const
+{
+  std::lock_guard<std::mutex> lock { m_mutex };
+  return m_nBytes;
+}
+
+std::string FeedCapture::GetError() const
+{
+  std::lock_guard<std::mutex> lock { m_mutex };
+  return m_error;
+}
+
+// FeedCaptureReader - Public methods
+
+bool FeedCaptureReader::Open(
+  const std::filesystem::path& path
+)
+{
+  m_file.open(path, std::ios::binary);
+  if (!m_file)
+  {
+    m_error = "Could not open " + path.string();
+    return false;
+  }
+  char header[kCaptureHeaderSize] {};
+  if (!m_file.read(header, sizeof(header)) ||
+      std::string_view { header, kCaptureMagic.size() } != kCaptureMagic)
+  {
+    m_error = "Not a feed capture: " + path.string();
+    return false;
+  }
+  std::uint64_t startTime {0};
+  for (std::size_t idx {0}; idx < 8; ++idx)
+  {
+    startTime |= static_cast<std::uint64_t>(
+      static_cast<unsigned char>(header[8 + idx])
+    ) << (8 * idx);
+  }
+  m_startTime = static_cast<std::int64_t>(startTime);
+  m_lastTime = m_startTime;
+  m_truncated = false;
+  return true;
+}
+
+bool FeedCaptureReader::Next(
+  FeedMessage& message
+)
+{
+  if (!m_file.is_open() || m_truncated)
+    return false;
+
+  // A clean end of the capture falls between two records
+  if (m_file.peek() == std::ifstream::traits_type::eof())
+    return false;
+  std::uint64_t delta {0};
+  std::uint64_t size {0};
+  if (!ReadVarint(delta) || !ReadVarint(size))
+  {
+    m_truncated = true;
+    return false;
+  }
+  message.payload.resize(size);
+  if (!m_file.read(message.payload.data(),
+                   static_cast<std::streamsize>(size)))
+  {
+    m_truncated = true;
+    return false;
+  }
+  m_lastTime += static_cast<std::int64_t>(delta);
+  message.receivedAt = FromNanoseconds(m_lastTime);
+  return true;
+}
+
+std::chrono::system_clock::time_point FeedCaptureReader::GetStartTime() const
+{
+  return FromNanoseconds(m_startTime);
+}
+
+bool FeedCaptureReader::IsTruncated() const
+{
+  return m_truncated;
+}
+
+std::string FeedCaptureReader::GetError() const
+{
+  return m_error;
+}
+
+// FeedCaptureReader - Private methods
+
+bool FeedCaptureReader::ReadVarint(
+  std::uint64_t& value
+)
+{
+  value = 0;
+  for (unsigned int shift {0}; shift < 64; shift += 7)
+  {
+    const auto byte { m_file.get() };
+    if (byte == std::ifstream::traits_type::eof())
+      return false;
+    value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0)
+      return true;
+  }
+  return false;
+}
+
+// FeedReplayReport - Public methods
+
+double FeedReplayReport::GetMessageRate() const
+{
+  if (duration.count() == 0)
+    return 0.0;
+  return static_cast<double>(nMessages) /
+         std::chrono::duration<double>(duration).count();
+}
+
+// Public functions
+
+bool NetworkMonitor::ParsePassengerEventMessage(
+  std::string_view message,
+  PassengerEvent& event
+)
+{
+  StompFrame frame {};
+  if (!ParseStompFrame(message, frame) ||
+      frame.command != StompCommand::Message)
+  {
+    return false;
+  }
+  const auto body = nlohmann::json::parse(frame.body, nullptr, false);
+  if (!body.is_object())
+    return false;
+  const auto stationId { body.find("station_id") };
+  const auto type { body.find("passenger_event") };
+  const auto dateTime { body.find("datetime") };
+  if (stationId == body.end() || !stationId->is_string() ||
+      type == body.end() || !type->is_string() ||
+      dateTime == body.end() || !dateTime->is_string())
+  {
+    return false;
+  }
+  const auto& typeName { type->get_ref<const std::string&>() };
+  if (typeName == "in")
+    event.type = PassengerEvent::Type::In;
+  else if (typeName == "out")
+    event.type = PassengerEvent::Type::Out;
+  else
+    return false;
+  event.stationId = stationId->get<std::string>();
+  return ParseDateTime(dateTime->get_ref<const std::string&>(),
+                       event.timestamp);
+}
+
+FeedReplayReport NetworkMonitor::ReplayFeedCapture(
+  const std::filesystem::path& path,
+  TransportNetwork& network,
+  const FeedReplayOptions& options
+)
+{
+  NETWORK_MONITOR_TRACE_SCOPE("feed-capture", "Replay");
+  FeedReplayReport report {};
+  FeedCaptureReader reader {};
+  if (!reader.Open(path))
+  {
+    report.error = reader.GetError();
+    return report;
+  }
+
+  std::vector<std::int64_t> latencies {};
+  FeedMessage message {};
+  PassengerEvent event {};
+  std::chrono::system_clock::time_point firstAt {};
+  const auto startedAt { std::chrono::steady_clock::now() };
+  while (reader.Next(message))
+  {
+    if (report.nMessages == 0)
+      firstAt = message.receivedAt;
+    report.captureDuration = message.receivedAt - firstAt;
+
+    // Wait for the time of the message, scaled, unless we are behind
+    auto dueAt { std::chrono::steady_clock::now() };
+    if (options.speed > 0.0)
+    {
+      dueAt = startedAt +
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          report.captureDuration / options.speed
+        );
+      std::this_thread::sleep_until(dueAt);
+    }
+
+    ++report.nMessages;
+    report.nBytes += message.payload.size();
+    if (ParsePassengerEventMessage(message.payload, event))
+    {
+      ++report.nEvents;
+      report.nRecorded += network.RecordPassengerEvent(event) ? 1 : 0;
+    }
+    latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - dueAt
+    ).count());
+  }
+  report.duration = std::chrono::steady_clock::now() - startedAt;
+  report.truncated = reader.IsTruncated();
+
+  std::sort(latencies.begin(), latencies.end());
+  report.p50 = Percentile(latencies, 50.0);
+  report.p90 = Percentile(latencies, 90.0);
+  report.p99 = Percentile(latencies, 99.0);
+  report.p999 = Percentile(latencies, 99.9);
+  report.max = latencies.empty() ? 0 : latencies.back();
+  return report;
+}
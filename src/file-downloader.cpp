@@ -1,49 +1,947 @@
 #include <network-monitor/file-downloader.h>
+#include <network-monitor/trace.h>
 
 #include <curl/curl.h>
 #include <nlohmann/json.hpp>
+#include <zlib.h>
 
+#include <fcntl.h>
 #include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
 #include <filesystem>
+#include <functional>
+#include <istream>
+#include <iterator>
+#include <memory>
+#include <streambuf>
 #include <string>
+#include <string_view>
 #include <fstream>
+#include <vector>
 
-bool NetworkMonitor::DownloadFile(
+using NetworkMonitor::Downloader;
+using NetworkMonitor::DownloaderStats;
+using NetworkMonitor::DownloadRequest;
+using NetworkMonitor::DownloadResult;
+using NetworkMonitor::DownloadStatus;
+using NetworkMonitor::JsonFileError;
+
+// Static functions
+
+// Validators of the last download, as stored in the metadata file
+struct CacheValidators
+{
+  std::string url {};
+  std::string etag {};
+  std::string lastModified {};
+
+  // Only filled in from response headers, not stored
+  bool acceptRanges {false};
+};
+
+// Byte range [begin, end) of a resumable download, of which the first
+//  `written` bytes are on disk
+struct ChunkState
+{
+  std::uint64_t begin {0};
+  std::uint64_t end {0};
+  std::uint64_t written {0};
+};
+
+// Progress of a resumable download, as stored next to the partial file
+// Single-range downloads do not know the size up front and have no chunks:
+//  Their progress is the size of the partial file.
+struct PartialState
+{
+  CacheValidators validators {};
+  std::uint64_t size {0};
+  std::vector<ChunkState> chunks {};
+};
+
+static std::filesystem::path GetMetadataPath(
+  const std::filesystem::path& destination
+)
+{
+  auto path { destination };
+  path += ".meta";
+  return path;
+}
+
+static CacheValidators LoadValidators(
+  const std::filesystem::path& destination
+)
+{
+  CacheValidators validators {};
+  // Not brace-initialized: That would wrap the object in a JSON array
+  const auto metadata = NetworkMonitor::ParseJsonFile(
+    GetMetadataPath(destination)
+  );
+  if (!metadata.is_object())
+    return validators;
+
+  validators.url = metadata.value("url", "");
+  validators.etag = metadata.value("etag", "");
+  validators.lastModified = metadata.value("last_modified", "");
+  return validators;
+}
+
+static bool SaveValidators(
+  const std::filesystem::path& destination,
+  const CacheValidators& validators
+)
+{
+  const nlohmann::json metadata {
+    {"url", validators.url},
+    {"etag", validators.etag},
+    {"last_modified", validators.lastModified},
+  };
+  std::ofstream file { GetMetadataPath(destination) };
+  file << metadata.dump(2) << '\n';
+  return static_cast<bool>(file);
+}
+
+static PartialState LoadPartialState(
+  const std::filesystem::path& partial
+)
+{
+  PartialState state {};
+  state.validators = LoadValidators(partial);
+  const auto metadata = NetworkMonitor::ParseJsonFile(
+    GetMetadataPath(partial)
+  );
+  if (!metadata.is_object())
+    return state;
+
+  try
+  {
+    state.size = metadata.value("size", std::uint64_t {0});
+    for (const auto& chunk: metadata.value("chunks", nlohmann::json::array()))
+    {
+      state.chunks.push_back(ChunkState {
+        chunk.at(0).get<std::uint64_t>(),
+        chunk.at(1).get<std::uint64_t>(),
+        chunk.at(2).get<std::uint64_t>()
+      });
+    }
+  }
+  catch (const nlohmann::json::exception&)
+  {
+    // Start over
+    return {};
+  }
+  return state;
+}
+
+static bool SavePartialState(
+  const std::filesystem::path& partial,
+  const PartialState& state
+)
+{
+  nlohmann::json chunks = nlohmann::json::array();
+  for (const auto& chunk: state.chunks)
+    chunks.push_back({chunk.begin, chunk.end, chunk.written});
+  const nlohmann::json metadata {
+    {"url", state.validators.url},
+    {"etag", state.validators.etag},
+    {"last_modified", state.validators.lastModified},
+    {"size", state.size},
+    {"chunks", std::move(chunks)},
+  };
+  std::ofstream file { GetMetadataPath(partial) };
+  file << metadata.dump(2) << '\n';
+  return static_cast<bool>(file);
+}
+
+// Value of the If-Range header that makes a range request safe: The server
+//  only honors the range if the file did not change.
+static std::string GetIfRange(
+  const CacheValidators& validators
+)
+{
+  return !validators.etag.empty() ? validators.etag : validators.lastModified;
+}
+
+// Write target of a resumable transfer
+// The status code is only known once the body starts: 206 continues the
+//  partial file, 200 means that the server sends the whole file.
+struct ResumableWrite
+{
+  CURL* curl { nullptr };
+  std::filesystem::path partial {};
+  std::FILE* fp { nullptr };
+  long responseCode { 0 };
+
+  // Single-range downloads: the validators to store once the body starts
+  PartialState* state { nullptr };
+  const CacheValidators* received { nullptr };
+
+  // Chunked downloads: the chunk to fill in, and where it starts on disk
+  ChunkState* chunk { nullptr };
+};
+
+static size_t OnResumableWrite(
+  char* data,
+  size_t size,
+  size_t nItems,
+  void* userData
+)
+{
+  auto& target { *static_cast<ResumableWrite*>(userData) };
+  if (target.fp == nullptr)
+  {
+    curl_easy_getinfo(target.curl, CURLINFO_RESPONSE_CODE,
+                      &target.responseCode);
+    if (target.chunk != nullptr)
+    {
+      // A chunk only makes sense as the range we asked for
+      if (target.responseCode != 206)
+        return 0;
+      target.fp = fopen(target.partial.string().c_str(), "r+b");
+      if (target.fp == nullptr ||
+          fseeko(target.fp, static_cast<off_t>(
+            target.chunk->begin + target.chunk->written
+          ), SEEK_SET) != 0)
+        return 0;
+    }
+    else
+    {
+      if (target.responseCode != 200 && target.responseCode != 206)
+        return 0;
+      target.fp = fopen(target.partial.string().c_str(),
+                        target.responseCode == 206 ? "ab" : "wb");
+      if (target.fp == nullptr)
+        return 0;
+
+      // Remember what we are downloading, in case we get interrupted
+      target.state->validators.etag = target.received->etag;
+      target.state->validators.lastModified = target.received->lastModified;
+      SavePartialState(target.partial, *target.state);
+    }
+  }
+
+  const auto nBytes { fwrite(data, size, nItems, target.fp) * size };
+  if (target.chunk != nullptr)
+    target.chunk->written += nBytes;
+  return nBytes;
+}
+
+// Stream buffer that pulls its content from a curl transfer
+// Each underflow runs the transfer until curl delivers more bytes. curl hands
+// us at most CURL_MAX_WRITE_SIZE bytes per write callback, so the buffer
+// stays small no matter the size of the file.
+class CurlStreamBuffer : public std::streambuf
+{
+public:
+  CurlStreamBuffer(
+    CURLM* multi,
+    CURL* curl
+  ) : m_multi { multi }
+    , m_curl { curl }
+  {
+    curl_easy_setopt(m_curl, CURLOPT_WRITEFUNCTION, OnWrite);
+    curl_easy_setopt(m_curl, CURLOPT_WRITEDATA, this);
+  }
+
+  // Whether curl reported the end of the transfer. Only then does GetResult
+  //  hold its result.
+  bool IsDone() const
+  {
+    return m_done;
+  }
+
+  CURLcode GetResult() const
+  {
+    return m_result;
+  }
+
+  // Run the transfer to its end, discarding any content left
+  CURLcode Finish()
+  {
+    while (!m_done)
+    {
+      m_buffer.clear();
+      Perform();
+    }
+    setg(nullptr, nullptr, nullptr);
+    return m_result;
+  }
+
+protected:
+  int_type underflow() override
+  {
+    if (gptr() < egptr())
+      return traits_type::to_int_type(*gptr());
+
+    m_buffer.clear();
+    while (m_buffer.empty() && !m_done)
+      Perform();
+    if (m_buffer.empty())
+      return traits_type::eof();
+
+    setg(m_buffer.data(), m_buffer.data(), m_buffer.data() + m_buffer.size());
+    return traits_type::to_int_type(*gptr());
+  }
+
+private:
+  CURLM* m_multi { nullptr };
+  CURL* m_curl { nullptr };
+  std::vector<char> m_buffer {};
+  bool m_done { false };
+  CURLcode m_result { CURLE_OK };
+
+  static size_t OnWrite(
+    char* data,
+    size_t size,
+    size_t nItems,
+    void* userData
+  )
+  {
+    auto& buffer { static_cast<CurlStreamBuffer*>(userData)->m_buffer };
+    buffer.insert(buffer.end(), data, data + size * nItems);
+    return size * nItems;
+  }
+
+  // Make progress on the transfer, waiting for the socket if needed
+  void Perform()
+  {
+    int nRunning { 0 };
+    CURLMcode code { curl_multi_perform(m_multi, &nRunning) };
+    if (code != CURLM_OK)
+    {
+      m_done = true;
+      m_result = CURLE_RECV_ERROR;
+      return;
+    }
+
+    int nMessages { 0 };
+    while (CURLMsg* message { curl_multi_info_read(m_multi, &nMessages) })
+    {
+      if (message->msg == CURLMSG_DONE)
+      {
+        m_done = true;
+        m_result = message->data.result;
+      }
+    }
+    if (!m_done && m_buffer.empty())
+      curl_multi_poll(m_multi, nullptr, 0, 1000, nullptr);
+  }
+};
+
+// Stream buffer that inflates gzip data from memory
+// The parser reads the uncompressed text through a fixed-size window, so it
+// never has to sit fully in memory.
+class GzipStreamBuffer : public std::streambuf
+{
+public:
+  GzipStreamBuffer(
+    const char* data,
+    std::size_t size
+  )
+  {
+    // 15 + 16: gzip header, with the largest window
+    m_ok = inflateInit2(&m_stream, 15 + 16) == Z_OK;
+    m_stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    m_stream.avail_in = static_cast<uInt>(size);
+  }
+
+  ~GzipStreamBuffer()
+  {
+    inflateEnd(&m_stream);
+  }
+
+  GzipStreamBuffer(const GzipStreamBuffer&) = delete;
+  GzipStreamBuffer& operator=(const GzipStreamBuffer&) = delete;
+
+  // Empty unless the compressed data is corrupt or truncated
+  const std::string& GetError() const
+  {
+    return m_error;
+  }
+
+protected:
+  int_type underflow() override
+  {
+    if (gptr() < egptr())
+      return traits_type::to_int_type(*gptr());
+
+    std::size_t nBytes { 0 };
+    while (nBytes == 0 && m_ok && !m_done)
+    {
+      m_stream.next_out = reinterpret_cast<Bytef*>(m_buffer.data());
+      m_stream.avail_out = static_cast<uInt>(m_buffer.size());
+      const int result { inflate(&m_stream, Z_NO_FLUSH) };
+      nBytes = m_buffer.size() - m_stream.avail_out;
+      if (result == Z_STREAM_END)
+      {
+        m_done = true;
+      }
+      else if (result != Z_OK ||
+               (m_stream.avail_in == 0 && nBytes == 0))
+      {
+        m_ok = false;
+        m_error = m_stream.msg != nullptr ? m_stream.msg :
+                                            "truncated gzip data";
+      }
+    }
+    if (nBytes == 0)
+      return traits_type::eof();
+
+    setg(m_buffer.data(), m_buffer.data(), m_buffer.data() + nBytes);
+    return traits_type::to_int_type(*gptr());
+  }
+
+private:
+  z_stream m_stream {};
+  std::array<char, 64 * 1024> m_buffer {};
+  bool m_ok { false };
+  bool m_done { false };
+  std::string m_error {};
+};
+
+// Read-only mapping of a whole file, unmapped when it goes out of scope
+class MappedFile
+{
+public:
+  MappedFile() = default;
+
+  ~MappedFile()
+  {
+    if (m_data != nullptr)
+      munmap(m_data, m_size);
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  // Map the first size bytes of an open file. Returns false if mmap failed.
+  bool Map(
+    int fd,
+    std::size_t size
+  )
+  {
+    void* data { mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) };
+    if (data == MAP_FAILED)
+      return false;
+    m_data = data;
+    m_size = size;
+    madvise(m_data, m_size, MADV_SEQUENTIAL);
+    return true;
+  }
+
+  const char* GetData() const
+  {
+    return static_cast<const char*>(m_data);
+  }
+
+private:
+  void* m_data { nullptr };
+  std::size_t m_size { 0 };
+};
+
+// curl calls this once per response header line. With redirects, it also
+//  sees the headers of the intermediate responses, so we start over on each
+//  status line.
+static size_t OnHeaderLine(
+  char* buffer,
+  size_t size,
+  size_t nItems,
+  void* userData
+)
+{
+  auto& validators { *static_cast<CacheValidators*>(userData) };
+  const std::string_view line { buffer, size * nItems };
+  if (line.rfind("HTTP/", 0) == 0)
+  {
+    validators.etag.clear();
+    validators.lastModified.clear();
+    validators.acceptRanges = false;
+    return size * nItems;
+  }
+
+  const auto colon { line.find(':') };
+  if (colon == std::string_view::npos)
+    return size * nItems;
+
+  std::string name { line.substr(0, colon) };
+  std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) {
+    return static_cast<char>(std::tolower(c));
+  });
+  auto value { line.substr(colon + 1) };
+  const auto first { value.find_first_not_of(" \t") };
+  const auto last { value.find_last_not_of(" \t\r\n") };
+  value = first == std::string_view::npos ?
+    std::string_view {} : value.substr(first, last - first + 1);
+
+  if (name == "etag")
+    validators.etag = value;
+  else if (name == "last-modified")
+    validators.lastModified = value;
+  else if (name == "accept-ranges")
+    validators.acceptRanges = value == "bytes";
+  return size * nItems;
+}
+
+// Downloader::Impl
+
+struct Downloader::Impl
+{
+  std::filesystem::path caCertFile {};
+  std::string caBundle {}; // Only used by curl < 7.87
+  CURLSH* share { nullptr };
+  CURLM* multi { nullptr };
+  std::vector<CURL*> idle {};
+  DownloaderStats stats {};
+
+  // Get an easy handle with the common options set
+  CURL* Acquire();
+
+  // Return a handle to the pool once its transfer is done
+  void Release(
+    CURL* curl
+  );
+
+  // Resumable download as a single range, and as parallel chunks
+  bool ResumeSingle(
+    const std::string& fileUrl,
+    const std::filesystem::path& destination,
+    bool retried = false
+  );
+
+  bool ResumeChunked(
+    const std::string& fileUrl,
+    const std::filesystem::path& destination,
+    std::size_t nChunks
+  );
+
+  // Run the transfers on the multi handle until nPending of them are done,
+  //  or until the deadline. Completed handles are removed from the multi
+  //  handle before onDone is called.
+  // Returns true if the deadline expired.
+  bool RunMulti(
+    std::size_t nPending,
+    std::chrono::steady_clock::time_point deadlineAt,
+    const std::function<void (CURL*, CURLcode)>& onDone
+  );
+};
+
+CURL* Downloader::Impl::Acquire()
+{
+  CURL* curl { nullptr };
+  if (idle.empty())
+  {
+    curl = curl_easy_init();
+    if (curl == nullptr)
+      return nullptr;
+  }
+  else
+  {
+    // A reset handle keeps its connections and caches
+    curl = idle.back();
+    idle.pop_back();
+    curl_easy_reset(curl);
+  }
+
+  curl_easy_setopt(curl, CURLOPT_SHARE, share);
+  curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 2L);
+
+  // Layouts compress well: Ask for any encoding curl can decode on the fly
+  curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+#if LIBCURL_VERSION_NUM >= 0x075700
+  // curl parses the bundle once and keeps the certificate store in memory
+  if (!caCertFile.empty())
+  {
+    curl_easy_setopt(curl, CURLOPT_CAINFO, caCertFile.string().c_str());
+    curl_easy_setopt(curl, CURLOPT_CA_CACHE_TIMEOUT, 24L * 60 * 60);
+  }
+#else
+  // Older versions cannot cache the store, but we at least read the file
+  //  only once
+  if (!caBundle.empty())
+  {
+    curl_blob blob {
+      caBundle.data(),
+      caBundle.size(),
+      CURL_BLOB_NOCOPY
+    };
+    curl_easy_setopt(curl, CURLOPT_CAINFO_BLOB, &blob);
+  }
+  else if (!caCertFile.empty())
+  {
+    // We could not read the bundle: Let curl report the error
+    curl_easy_setopt(curl, CURLOPT_CAINFO, caCertFile.string().c_str());
+  }
+#endif
+  ++stats.transfers;
+  return curl;
+}
+
+void Downloader::Impl::Release(
+  CURL* curl
+)
+{
+  long nConnects { 0 };
+  curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &nConnects);
+  stats.newConnections += static_cast<std::uint64_t>(nConnects);
+  idle.push_back(curl);
+}
+
+bool Downloader::Impl::RunMulti(
+  std::size_t nPending,
+  std::chrono::steady_clock::time_point deadlineAt,
+  const std::function<void (CURL*, CURLcode)>& onDone
+)
+{
+  const bool hasDeadline {
+    deadlineAt != std::chrono::steady_clock::time_point::max()
+  };
+  while (nPending > 0)
+  {
+    int nRunning { 0 };
+    if (curl_multi_perform(multi, &nRunning) != CURLM_OK)
+      return false;
+
+    int nMessages { 0 };
+    while (CURLMsg* message { curl_multi_info_read(multi, &nMessages) })
+    {
+      if (message->msg != CURLMSG_DONE)
+        continue;
+
+      CURL* curl { message->easy_handle };
+      const auto res { message->data.result };
+      curl_multi_remove_handle(multi, curl);
+      onDone(curl, res);
+      --nPending;
+    }
+    if (nPending == 0)
+      break;
+
+    int timeoutMs { 1000 };
+    if (hasDeadline)
+    {
+      const auto left { std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadlineAt - std::chrono::steady_clock::now()
+      ).count() };
+      if (left <= 0)
+        return true;
+      timeoutMs = static_cast<int>(std::min<long long>(left, timeoutMs));
+    }
+    curl_multi_poll(multi, nullptr, 0, timeoutMs, nullptr);
+  }
+  return false;
+}
+
+bool Downloader::Impl::ResumeSingle(
   const std::string& fileUrl,
   const std::filesystem::path& destination,
-  const std::filesystem::path& caCertFile
+  bool retried
 )
 {
-  // Initialize curl
-  CURL* curl { curl_easy_init() };  
+  auto partial { destination };
+  partial += ".part";
+  std::error_code ec {};
+
+  // Continue from the end of the partial file, if it belongs to this URL.
+  // Without a validator for If-Range we could not tell if the file changed
+  //  since, so we start over.
+  auto state { LoadPartialState(partial) };
+  std::uint64_t offset { 0 };
+  if (state.validators.url == fileUrl && state.chunks.empty() &&
+      !GetIfRange(state.validators).empty() &&
+      std::filesystem::exists(partial))
+  {
+    offset = std::filesystem::file_size(partial, ec);
+  }
+  else
+  {
+    std::filesystem::remove(partial, ec);
+    state = {};
+    state.validators.url = fileUrl;
+  }
+
+  CURL* curl { Acquire() };
   if (curl == nullptr)
+    return false;
+
+  // We send the range ourselves: With CURLOPT_RESUME_FROM_LARGE, curl fails
+  //  on the 200 reply to a changed file before we can start over. Here the
+  //  write function truncates the partial file instead.
+  curl_slist* headers { nullptr };
+  const auto range { std::to_string(offset) + "-" };
+  if (offset > 0)
+  {
+    headers = curl_slist_append(
+      headers, ("If-Range: " + GetIfRange(state.validators)).c_str()
+    );
+    curl_easy_setopt(curl, CURLOPT_RANGE, range.c_str());
+  }
+
+  CacheValidators received { fileUrl };
+  ResumableWrite target { curl, partial };
+  target.state = &state;
+  target.received = &received;
+  curl_easy_setopt(curl, CURLOPT_URL, fileUrl.c_str());
+  // Ranges apply to the encoded bytes, so we ask for the file as it is
+  curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, nullptr);
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+  curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, OnHeaderLine);
+  curl_easy_setopt(curl, CURLOPT_HEADERDATA, &received);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, OnResumableWrite);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &target);
+
+  CURLcode res = curl_easy_perform(curl);
+  long responseCode { 0 };
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &responseCode);
+  Release(curl);
+  curl_slist_free_all(headers);
+  if (target.fp != nullptr)
+    fclose(target.fp);
+
+  // The partial file already has all the bytes, or more: Start over
+  if (responseCode == 416 && !retried)
+  {
+    std::filesystem::remove(partial, ec);
+    std::filesystem::remove(GetMetadataPath(partial), ec);
+    return ResumeSingle(fileUrl, destination, true);
+  }
+
+  // On failure we keep the partial file for the next attempt
+  if (res != CURLE_OK || (responseCode != 200 && responseCode != 206))
+    return false;
+
+  // An empty file never calls the write function
+  if (target.fp == nullptr)
+    std::ofstream { partial, std::ios::binary | std::ios::trunc };
+
+  std::filesystem::rename(partial, destination, ec);
+  if (ec)
+    return false;
+  std::filesystem::remove(GetMetadataPath(partial), ec);
+  return true;
+}
+
+bool Downloader::Impl::ResumeChunked(
+  const std::string& fileUrl,
+  const std::filesystem::path& destination,
+  std::size_t nChunks
+)
+{
+  auto partial { destination };
+  partial += ".part";
+  std::error_code ec {};
+
+  // Find out the size, and whether the server supports ranges at all
+  CacheValidators received { fileUrl };
   {
+    CURL* curl { Acquire() };
+    if (curl == nullptr)
+      return false;
+    curl_easy_setopt(curl, CURLOPT_URL, fileUrl.c_str());
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, nullptr);
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, OnHeaderLine);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &received);
+    CURLcode res = curl_easy_perform(curl);
+    long responseCode { 0 };
+    curl_off_t size { -1 };
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &responseCode);
+    curl_easy_getinfo(curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &size);
+    Release(curl);
+    if (res != CURLE_OK || responseCode != 200)
+      return false;
+    if (!received.acceptRanges || size < static_cast<curl_off_t>(nChunks))
+      return ResumeSingle(fileUrl, destination);
+
+    // Resume the chunks of an earlier attempt on the same version of the
+    //  file, or start over
+    auto state { LoadPartialState(partial) };
+    const bool resumable {
+      state.validators.url == fileUrl &&
+      state.validators.etag == received.etag &&
+      state.validators.lastModified == received.lastModified &&
+      state.size == static_cast<std::uint64_t>(size) &&
+      !state.chunks.empty() &&
+      std::filesystem::exists(partial) &&
+      std::filesystem::file_size(partial, ec) == state.size
+    };
+    if (!resumable)
+    {
+      state = {};
+      state.validators = received;
+      state.size = static_cast<std::uint64_t>(size);
+      const auto chunkSize { state.size / nChunks };
+      for (std::size_t idx {0}; idx < nChunks; ++idx)
+      {
+        state.chunks.push_back(ChunkState {
+          idx * chunkSize,
+          idx + 1 == nChunks ? state.size : (idx + 1) * chunkSize,
+          0
+        });
+      }
+      std::ofstream { partial, std::ios::binary | std::ios::trunc };
+      std::filesystem::resize_file(partial, state.size, ec);
+      if (ec || !SavePartialState(partial, state))
+        return false;
+    }
+    received = state.validators;
+  }
+
+  // Fetch the missing part of each chunk concurrently
+  auto state { LoadPartialState(partial) };
+  const auto ifRange { "If-Range: " + GetIfRange(state.validators) };
+  curl_slist* headers { nullptr };
+  if (!GetIfRange(state.validators).empty())
+    headers = curl_slist_append(headers, ifRange.c_str());
+
+  std::vector<ResumableWrite> targets {};
+  std::vector<std::string> ranges {};
+  targets.reserve(state.chunks.size());
+  ranges.reserve(state.chunks.size());
+  for (auto& chunk: state.chunks)
+  {
+    if (chunk.begin + chunk.written >= chunk.end)
+      continue;
+    CURL* curl { Acquire() };
+    if (curl == nullptr)
+      break;
+    ranges.push_back(
+      std::to_string(chunk.begin + chunk.written) + "-" +
+      std::to_string(chunk.end - 1)
+    );
+    targets.push_back(ResumableWrite { curl, partial });
+    auto& target { targets.back() };
+    target.chunk = &chunk;
+    curl_easy_setopt(curl, CURLOPT_URL, fileUrl.c_str());
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, nullptr);
+    curl_easy_setopt(curl, CURLOPT_RANGE, ranges.back().c_str());
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, OnResumableWrite);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &target);
+    curl_multi_add_handle(multi, curl);
+  }
+  bool changed { false };
+  RunMulti(targets.size(), std::chrono::steady_clock::time_point::max(),
+    [&targets, &changed](CURL* curl, CURLcode) {
+      for (auto& target: targets)
+      {
+        if (target.curl == curl)
+          changed |= target.responseCode == 200;
+      }
+    }
+  );
+  for (auto& target: targets)
+  {
+    // Still attached if the multi handle failed
+    curl_multi_remove_handle(multi, target.curl);
+    if (target.fp != nullptr)
+      fclose(target.fp);
+    Release(target.curl);
+  }
+  curl_slist_free_all(headers);
+
+  // The file changed since the first attempt: The next call starts over
+  if (changed)
+  {
+    std::filesystem::remove(partial, ec);
+    std::filesystem::remove(GetMetadataPath(partial), ec);
     return false;
   }
 
-  std::string readBuffer{};
+  const bool done { std::all_of(state.chunks.begin(), state.chunks.end(),
+    [](const auto& chunk) {
+      return chunk.begin + chunk.written == chunk.end;
+    }
+  )};
+  if (!done)
+  {
+    SavePartialState(partial, state);
+    return false;
+  }
+
+  std::filesystem::rename(partial, destination, ec);
+  if (ec)
+    return false;
+  std::filesystem::remove(GetMetadataPath(partial), ec);
+  return true;
+}
+
+// Downloader - Public methods
+
+Downloader::Downloader(
+  const std::filesystem::path& caCertFile
+) : m_impl { std::make_unique<Impl>() }
+{
+  m_impl->caCertFile = caCertFile;
+#if LIBCURL_VERSION_NUM < 0x075700
+  if (!caCertFile.empty())
+  {
+    std::ifstream file { caCertFile, std::ios::binary };
+    m_impl->caBundle.assign(
+      std::istreambuf_iterator<char> { file },
+      std::istreambuf_iterator<char> {}
+    );
+  }
+#endif
+
+  m_impl->share = curl_share_init();
+  if (m_impl->share != nullptr)
+  {
+    curl_share_setopt(m_impl->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(m_impl->share, CURLSHOPT_SHARE,
+                      CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(m_impl->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+  }
+  m_impl->multi = curl_multi_init();
+}
+
+Downloader::~Downloader()
+{
+  // The share handle must outlive the easy handles that use it
+  for (auto curl: m_impl->idle)
+    curl_easy_cleanup(curl);
+  if (m_impl->multi != nullptr)
+    curl_multi_cleanup(m_impl->multi);
+  if (m_impl->share != nullptr)
+    curl_share_cleanup(m_impl->share);
+}
+
+bool Downloader::DownloadFile(
+  const std::string& fileUrl,
+  const std::filesystem::path& destination
+)
+{
+  NETWORK_MONITOR_TRACE_SCOPE("download", "DownloadFile");
+  CURL* curl { m_impl->Acquire() };
+  if (curl == nullptr)
+    return false;
 
   // Open the file
   std::FILE* fp { fopen(destination.string().c_str(), "wb") };
   if (fp == nullptr)
   {
-    // Remember to clean up in all program paths
-    curl_easy_cleanup(curl);
+    // Remember to release the handle in all program paths
+    m_impl->Release(curl);
     return false;
   }
 
-  // Configure curl
   curl_easy_setopt(curl, CURLOPT_URL, fileUrl.c_str());
-  curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-  curl_easy_setopt(curl, CURLOPT_CAINFO, caCertFile.string().c_str());
-  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
-  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 2L);
   curl_easy_setopt(curl, CURLOPT_WRITEDATA, fp);
   // curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
 
   // Send CURL request
   CURLcode res = curl_easy_perform(curl);
-  curl_easy_cleanup(curl);
+  m_impl->Release(curl);
 
   // Close the file
   fclose(fp);
@@ -51,22 +949,441 @@ bool NetworkMonitor::DownloadFile(
   return res == CURLE_OK;
 }
 
+DownloadStatus Downloader::DownloadFileIfModified(
+  const std::string& fileUrl,
+  const std::filesystem::path& destination
+)
+{
+  NETWORK_MONITOR_TRACE_SCOPE("download", "DownloadFileIfModified");
+
+  // We can only revalidate a local copy that came from the same URL
+  auto cached { LoadValidators(destination) };
+  if (cached.url != fileUrl || !std::filesystem::exists(destination))
+    cached = {};
+
+  CURL* curl { m_impl->Acquire() };
+  if (curl == nullptr)
+    return DownloadStatus::Failed;
+
+  auto partial { destination };
+  partial += ".part";
+  std::FILE* fp { fopen(partial.string().c_str(), "wb") };
+  if (fp == nullptr)
+  {
+    m_impl->Release(curl);
+    return DownloadStatus::Failed;
+  }
+
+  curl_slist* headers { nullptr };
+  if (!cached.etag.empty())
+  {
+    headers = curl_slist_append(headers,
+      ("If-None-Match: " + cached.etag).c_str()
+    );
+  }
+  if (!cached.lastModified.empty())
+  {
+    headers = curl_slist_append(headers,
+      ("If-Modified-Since: " + cached.lastModified).c_str()
+    );
+  }
+
+  CacheValidators received { fileUrl };
+  curl_easy_setopt(curl, CURLOPT_URL, fileUrl.c_str());
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+  curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, OnHeaderLine);
+  curl_easy_setopt(curl, CURLOPT_HEADERDATA, &received);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, fp);
+
+  CURLcode res = curl_easy_perform(curl);
+  long responseCode { 0 };
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &responseCode);
+  m_impl->Release(curl);
+  curl_slist_free_all(headers);
+  fclose(fp);
+
+  std::error_code ec {};
+  if (res == CURLE_OK && responseCode == 304)
+  {
+    std::filesystem::remove(partial, ec);
+    return DownloadStatus::NotModified;
+  }
+  if (res != CURLE_OK || responseCode != 200)
+  {
+    std::filesystem::remove(partial, ec);
+    return DownloadStatus::Failed;
+  }
+
+  // Replace the local copy in one step, then remember the new validators
+  std::filesystem::rename(partial, destination, ec);
+  if (ec)
+  {
+    std::filesystem::remove(partial, ec);
+    return DownloadStatus::Failed;
+  }
+  if (received.etag.empty() && received.lastModified.empty())
+    std::filesystem::remove(GetMetadataPath(destination), ec);
+  else
+    SaveValidators(destination, received);
+  return DownloadStatus::Downloaded;
+}
+
+bool Downloader::DownloadFileToStream(
+  const std::string& fileUrl,
+  const std::function<bool (std::istream&)>& onStream
+)
+{
+  NETWORK_MONITOR_TRACE_SCOPE("download", "DownloadFileToStream");
+  CURLM* multi { m_impl->multi };
+  if (multi == nullptr)
+    return false;
+  CURL* curl { m_impl->Acquire() };
+  if (curl == nullptr)
+    return false;
+
+  // We do not want an error page in the stream
+  curl_easy_setopt(curl, CURLOPT_URL, fileUrl.c_str());
+  curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+  CurlStreamBuffer buffer { multi, curl };
+  curl_multi_add_handle(multi, curl);
+
+  // Remember to clean up in all program paths, also if onStream throws
+  auto cleanup { [this, multi, curl]() {
+    curl_multi_remove_handle(multi, curl);
+    m_impl->Release(curl);
+  }};
+
+  bool consumed { false };
+  try
+  {
+    std::istream stream { &buffer };
+    consumed = onStream(stream);
+  }
+  catch (...)
+  {
+    // A failed transfer explains the exception: A parser saw a truncated or
+    //  empty stream. The stream only ends early once curl has reported the
+    //  failure, so we do not need to wait for the rest of the transfer.
+    const bool failed { buffer.IsDone() && buffer.GetResult() != CURLE_OK };
+    cleanup();
+    if (failed)
+      return false;
+    throw;
+  }
+
+  // Only run the transfer to its end to check that the content onStream
+  //  accepted was complete. Removing the handle aborts a rejected transfer,
+  //  so we do not download the rest of the file just to discard it.
+  const CURLcode res { consumed ? buffer.Finish() : CURLE_OK };
+  cleanup();
+
+  return consumed && res == CURLE_OK;
+}
+
+std::vector<DownloadResult> Downloader::DownloadFiles(
+  const std::vector<DownloadRequest>& requests,
+  std::chrono::milliseconds deadline,
+  const std::function<void (const DownloadResult&)>& onDone,
+  std::size_t maxConcurrent
+)
+{
+  struct Transfer
+  {
+    CURL* curl { nullptr };
+    std::FILE* fp { nullptr };
+    std::filesystem::path partial {};
+    bool done { false };
+  };
+
+  const auto startedAt { std::chrono::steady_clock::now() };
+  std::vector<DownloadResult> results(requests.size());
+  std::vector<Transfer> transfers(requests.size());
+
+  // Close the file, move it into place or delete it, and report
+  auto finish { [&](std::size_t idx, CURLcode res, const std::string& error) {
+    auto& transfer { transfers[idx] };
+    auto& result { results[idx] };
+    transfer.done = true;
+    if (transfer.fp != nullptr)
+      fclose(transfer.fp);
+    transfer.fp = nullptr;
+
+    if (transfer.curl != nullptr)
+    {
+      // A transfer only joins the multi handle when it starts, so its curl
+      //  time leaves out the time it waited for its turn
+      curl_off_t bytes { 0 };
+      curl_off_t totalTime { 0 };
+      curl_easy_getinfo(transfer.curl, CURLINFO_SIZE_DOWNLOAD_T, &bytes);
+      curl_easy_getinfo(transfer.curl, CURLINFO_TOTAL_TIME_T, &totalTime);
+      curl_easy_getinfo(transfer.curl, CURLINFO_RESPONSE_CODE,
+                        &result.responseCode);
+      result.bytes = static_cast<std::uint64_t>(bytes);
+      result.duration = std::chrono::microseconds { totalTime };
+    }
+    const auto seconds { std::chrono::duration<double> {
+      result.duration
+    }.count() };
+    result.bytesPerSecond = seconds > 0.0 ? result.bytes / seconds : 0.0;
+    result.ok = res == CURLE_OK && error.empty();
+    result.error = !error.empty() ? error :
+                   res != CURLE_OK ? curl_easy_strerror(res) : "";
+
+    std::error_code ec {};
+    if (result.ok)
+      std::filesystem::rename(transfer.partial, result.destination, ec);
+    if (!result.ok || ec)
+      std::filesystem::remove(transfer.partial, ec);
+    if (onDone)
+      onDone(result);
+  }};
+
+  CURLM* multi { m_impl->multi };
+  if (multi == nullptr)
+  {
+    for (std::size_t idx {0}; idx < requests.size(); ++idx)
+    {
+      results[idx].fileUrl = requests[idx].fileUrl;
+      results[idx].destination = requests[idx].destination;
+      finish(idx, CURLE_FAILED_INIT, "");
+    }
+    return results;
+  }
+  // The transfers past maxConcurrent wait in the queue until another one is
+  //  done
+  std::size_t nPending { 0 };
+  std::vector<CURL*> queued {};
+  for (std::size_t idx {0}; idx < requests.size(); ++idx)
+  {
+    auto& transfer { transfers[idx] };
+    auto& result { results[idx] };
+    result.fileUrl = requests[idx].fileUrl;
+    result.destination = requests[idx].destination;
+
+    transfer.partial = result.destination;
+    transfer.partial += ".part";
+    transfer.fp = fopen(transfer.partial.string().c_str(), "wb");
+    if (transfer.fp == nullptr)
+    {
+      finish(idx, CURLE_WRITE_ERROR, "Could not open the destination");
+      continue;
+    }
+    transfer.curl = m_impl->Acquire();
+    if (transfer.curl == nullptr)
+    {
+      finish(idx, CURLE_FAILED_INIT, "");
+      continue;
+    }
+
+    curl_easy_setopt(transfer.curl, CURLOPT_URL, result.fileUrl.c_str());
+    curl_easy_setopt(transfer.curl, CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(transfer.curl, CURLOPT_WRITEDATA, transfer.fp);
+    curl_easy_setopt(transfer.curl, CURLOPT_PRIVATE, &transfer);
+    if (maxConcurrent == 0 || nPending < maxConcurrent)
+      curl_multi_add_handle(multi, transfer.curl);
+    else
+      queued.push_back(transfer.curl);
+    ++nPending;
+  }
+  std::reverse(queued.begin(), queued.end());
+
+  // Run all the transfers until they are done or the deadline expires
+  const bool expired { m_impl->RunMulti(nPending,
+    deadline.count() > 0 ? startedAt + deadline :
+                           std::chrono::steady_clock::time_point::max(),
+    [&transfers, &finish, &queued, multi](CURL* curl, CURLcode res) {
+      Transfer* transfer { nullptr };
+      curl_easy_getinfo(curl, CURLINFO_PRIVATE, &transfer);
+      finish(static_cast<std::size_t>(transfer - transfers.data()), res, "");
+      if (!queued.empty())
+      {
+        curl_multi_add_handle(multi, queued.back());
+        queued.pop_back();
+      }
+    }
+  )};
+
+  // Whatever is still running missed the deadline, or the multi handle
+  //  failed
+  for (std::size_t idx {0}; idx < transfers.size(); ++idx)
+  {
+    auto& transfer { transfers[idx] };
+    if (transfer.done)
+      continue;
+    curl_multi_remove_handle(multi, transfer.curl);
+    if (expired)
+      finish(idx, CURLE_OPERATION_TIMEDOUT, "Deadline exceeded");
+    else
+      finish(idx, CURLE_RECV_ERROR, "");
+  }
+
+  for (auto& transfer: transfers)
+  {
+    if (transfer.curl != nullptr)
+      m_impl->Release(transfer.curl);
+  }
+  return results;
+}
+
+bool Downloader::DownloadFileResumable(
+  const std::string& fileUrl,
+  const std::filesystem::path& destination,
+  std::size_t nChunks
+)
+{
+  if (nChunks > 1)
+    return m_impl->ResumeChunked(fileUrl, destination, nChunks);
+  return m_impl->ResumeSingle(fileUrl, destination);
+}
+
+DownloaderStats Downloader::GetStats() const
+{
+  return m_impl->stats;
+}
+
+// Free functions
+// Each call uses a fresh Downloader, so nothing is reused between calls.
+
+bool NetworkMonitor::DownloadFile(
+  const std::string& fileUrl,
+  const std::filesystem::path& destination,
+  const std::filesystem::path& caCertFile
+)
+{
+  Downloader downloader { caCertFile };
+  return downloader.DownloadFile(fileUrl, destination);
+}
+
+DownloadStatus NetworkMonitor::DownloadFileIfModified(
+  const std::string& fileUrl,
+  const std::filesystem::path& destination,
+  const std::filesystem::path& caCertFile
+)
+{
+  Downloader downloader { caCertFile };
+  return downloader.DownloadFileIfModified(fileUrl, destination);
+}
+
+bool NetworkMonitor::DownloadFileToStream(
+  const std::string& fileUrl,
+  const std::function<bool (std::istream&)>& onStream,
+  const std::filesystem::path& caCertFile
+)
+{
+  Downloader downloader { caCertFile };
+  return downloader.DownloadFileToStream(fileUrl, onStream);
+}
+
+bool NetworkMonitor::DownloadFileResumable(
+  const std::string& fileUrl,
+  const std::filesystem::path& destination,
+  const std::filesystem::path& caCertFile,
+  std::size_t nChunks
+)
+{
+  Downloader downloader { caCertFile };
+  return downloader.DownloadFileResumable(fileUrl, destination, nChunks);
+}
+
+std::vector<DownloadResult> NetworkMonitor::DownloadFiles(
+  const std::vector<DownloadRequest>& requests,
+  std::chrono::milliseconds deadline,
+  const std::function<void (const DownloadResult&)>& onDone,
+  const std::filesystem::path& caCertFile,
+  std::size_t maxConcurrent
+)
+{
+  Downloader downloader { caCertFile };
+  return downloader.DownloadFiles(requests, deadline, onDone, maxConcurrent);
+}
+
+
 nlohmann::json NetworkMonitor::ParseJsonFile(
   const std::filesystem::path& source
 )
 {
+  JsonFileError error {};
+  return ParseJsonFile(source, error);
+}
+
+nlohmann::json NetworkMonitor::ParseJsonFile(
+  const std::filesystem::path& source,
+  JsonFileError& error
+)
+{
+  NETWORK_MONITOR_TRACE_SCOPE("json", "ParseJsonFile");
+  error = {};
   nlohmann::json parsed {};
-  if (!std::filesystem::exists(source))
+
+  // Reading through an ifstream goes one character at a time through the
+  //  stream buffer. The parser is much faster on a contiguous buffer, and
+  //  mapping the file gives us one without a copy. Compressed files go
+  //  through a small inflate buffer instead.
+  const int fd { open(source.c_str(), O_RDONLY | O_CLOEXEC) };
+  if (fd < 0)
+  {
+    error.message = "Could not open " + source.string() + ": " +
+                    std::strerror(errno);
+    return parsed;
+  }
+  struct stat info {};
+  if (fstat(fd, &info) != 0)
+  {
+    error.message = "Could not stat " + source.string() + ": " +
+                    std::strerror(errno);
+    close(fd);
     return parsed;
+  }
+  const auto size { static_cast<std::size_t>(info.st_size) };
+  MappedFile mapped {};
+  if (size > 0 && !mapped.Map(fd, size))
+  {
+    error.message = "Could not map " + source.string() + ": " +
+                    std::strerror(errno);
+    close(fd);
+    return parsed;
+  }
+  close(fd);
 
-  try 
+  const char* begin { mapped.GetData() };
+  try
   {
-    std::ifstream file { source };
-    file >> parsed;
+    // gzip files start with 1f 8b, which is never valid JSON
+    if (size >= 2 && begin[0] == '\x1f' && begin[1] == '\x8b')
+    {
+      GzipStreamBuffer buffer { begin, size };
+      std::istream stream { &buffer };
+      try
+      {
+        parsed = nlohmann::json::parse(stream);
+      }
+      catch (const nlohmann::json::parse_error&)
+      {
+        // The parser only sees an early end of the text
+        if (buffer.GetError().empty())
+          throw;
+        error.message = "Invalid gzip data in " + source.string() + ": " +
+                        buffer.GetError();
+        parsed = nlohmann::json {};
+      }
+    }
+    else
+    {
+      parsed = nlohmann::json::parse(begin, begin + size);
+    }
   }
-  catch (...)
+  catch (const nlohmann::json::parse_error& e)
+  {
+    error.message = e.what();
+    error.byteOffset = e.byte;
+    parsed = nlohmann::json {};
+  }
+  catch (const nlohmann::json::exception& e)
   {
-    // Will return an empty object
+    // Valid syntax the parser still rejects, such as a number that
+    //  overflows a double
+    error.message = e.what();
+    parsed = nlohmann::json {};
   }
 
   return parsed;
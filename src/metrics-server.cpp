@@ -0,0 +1,583 @@
+#include <network-monitor/metrics-server.h>
+
+#include <network-monitor/metrics.h>
+#include <network-monitor/transport-network.h>
+#include <network-monitor/websocket-client.h>
+#include <network-monitor/websocket-client-manager.h>
+
+#include <boost/asio.hpp>
+#include <boost/beast.hpp>
+
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using NetworkMonitor::Id;
+using NetworkMonitor::LatencySnapshot;
+using NetworkMonitor::MetricsCollector;
+using NetworkMonitor::MetricsServer;
+using NetworkMonitor::MetricsServerOptions;
+using NetworkMonitor::PrometheusWriter;
+using NetworkMonitor::TransportNetwork;
+using NetworkMonitor::WebSocketClient;
+using NetworkMonitor::WebSocketClientManager;
+using NetworkMonitor::WebSocketClientStats;
+
+using tcp = boost::asio::ip::tcp;
+namespace http = boost::beast::http;
+
+// Static functions
+
+// Format a sample value. Integers up to 2^53 come out without a fraction.
+static void AppendValue(std::string& text, double value)
+{
+  if (std::isnan(value))
+  {
+    text += "NaN";
+    return;
+  }
+  if (std::isinf(value))
+  {
+    text += value > 0 ? "+Inf" : "-Inf";
+    return;
+  }
+  char buffer[32] {};
+  const auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+  text.append(buffer, end);
+}
+
+// Escape a label value or a help text. Help texts keep their double quotes.
+static void AppendEscaped(std::string& text, std::string_view value,
+                          bool escapeQuotes)
+{
+  for (const auto c: value)
+  {
+    switch (c)
+    {
+    case '\\':
+      text += "\\\\";
+      break;
+    case '\n':
+      text += "\\n";
+      break;
+    case '"':
+      text += escapeQuotes ? "\\\"" : "\"";
+      break;
+    default:
+      text += c;
+      break;
+    }
+  }
+}
+
+static double ToSeconds(std::uint64_t nanoseconds)
+{
+  return static_cast<double>(nanoseconds) / 1e9;
+}
+
+// Add the counters of a set of WebSocket clients, one family at a time
+static void AddWebSocketStats(
+  PrometheusWriter& writer,
+  const std::vector<std::pair<std::string, WebSocketClientStats>>& clients
+)
+{
+  struct Family
+  {
+    const char* name;
+    const char* help;
+    double (*value)(const WebSocketClientStats&);
+  };
+  static const Family kFamilies[] {
+    {"network_monitor_websocket_received_messages_total",
+     "WebSocket messages received",
+     [](const WebSocketClientStats& stats) {
+       return static_cast<double>(stats.messagesReceived);
+     }},
+    {"network_monitor_websocket_received_bytes_total",
+     "WebSocket payload bytes received",
+     [](const WebSocketClientStats& stats) {
+       return static_cast<double>(stats.bytesReceived);
+     }},
+    {"network_monitor_websocket_sent_messages_total",
+     "WebSocket messages sent",
+     [](const WebSocketClientStats& stats) {
+       return static_cast<double>(stats.messagesSent);
+     }},
+    {"network_monitor_websocket_sent_bytes_total",
+     "WebSocket payload bytes sent",
+     [](const WebSocketClientStats& stats) {
+       return static_cast<double>(stats.bytesSent);
+     }},
+    {"network_monitor_websocket_reconnects_total",
+     "Successful automatic reconnections",
+     [](const WebSocketClientStats& stats) {
+       return static_cast<double>(stats.reconnects);
+     }},
+    {"network_monitor_websocket_gap_seconds_total",
+     "Time without incoming data across all the reconnections",
+     [](const WebSocketClientStats& stats) {
+       return std::chrono::duration<double>(stats.totalGapDuration).count();
+     }},
+  };
+  for (const auto& family: kFamilies)
+  {
+    for (const auto& [name, stats]: clients)
+    {
+      writer.AddCounter(family.name, family.help, family.value(stats),
+                        {{"client", name}});
+    }
+  }
+}
+
+// PrometheusWriter - Public methods
+
+void PrometheusWriter::AddCounter(
+  const std::string& name,
+  const std::string& help,
+  double value,
+  const Labels& labels
+)
+{
+  AddFamily(name, help, "counter");
+  AddSample(name, labels, value);
+}
+
+void PrometheusWriter::AddGauge(
+  const std::string& name,
+  const std::string& help,
+  double value,
+  const Labels& labels
+)
+{
+  AddFamily(name, help, "gauge");
+  AddSample(name, labels, value);
+}
+
+void PrometheusWriter::AddSummary(
+  const std::string& name,
+  const std::string& help,
+  const LatencySnapshot& snapshot,
+  const Labels& labels
+)
+{
+  AddFamily(name, help, "summary");
+  const std::pair<const char*, std::uint64_t> quantiles[] {
+    {"0.5", snapshot.p50},
+    {"0.9", snapshot.p90},
+    {"0.99", snapshot.p99},
+    {"0.999", snapshot.p999},
+  };
+  auto quantileLabels { labels };
+  quantileLabels.emplace_back("quantile", "");
+  for (const auto& [quantile, value]: quantiles)
+  {
+    quantileLabels.back().second = quantile;
+    AddSample(name, quantileLabels, ToSeconds(value));
+  }
+  AddSample(name + "_sum", labels, ToSeconds(snapshot.sum));
+  AddSample(name + "_count", labels, static_cast<double>(snapshot.count));
+}
+
+const std::string& PrometheusWriter::GetText() const
+{
+  return m_text;
+}
+
+std::string PrometheusWriter::TakeText()
+{
+  auto text { std::move(m_text) };
+  m_text.clear();
+  return text;
+}
+
+// PrometheusWriter - Private methods
+
+void PrometheusWriter::AddFamily(
+  const std::string& name,
+  const std::string& help,
+  const char* type
+)
+{
+  if (name == m_family)
+    return;
+
+  m_family = name;
+  if (!help.empty())
+  {
+    m_text += "# HELP ";
+    m_text += name;
+    m_text += ' ';
+    AppendEscaped(m_text, help, false);
+    m_text += '\n';
+  }
+  m_text += "# TYPE ";
+  m_text += name;
+  m_text += ' ';
+  m_text += type;
+  m_text += '\n';
+}
+
+void PrometheusWriter::AddSample(
+  const std::string& name,
+  const Labels& labels,
+  double value
+)
+{
+  m_text += name;
+  if (!labels.empty())
+  {
+    m_text += '{';
+    for (std::size_t idx {0}; idx < labels.size(); ++idx)
+    {
+      if (idx > 0)
+        m_text += ',';
+      m_text += labels[idx].first;
+      m_text += "=\"";
+      AppendEscaped(m_text, labels[idx].second, true);
+      m_text += '"';
+    }
+    m_text += '}';
+  }
+  m_text += ' ';
+  AppendValue(m_text, value);
+  m_text += '\n';
+}
+
+// Collectors
+
+MetricsCollector NetworkMonitor::CollectRegistryMetrics()
+{
+  return [](PrometheusWriter& writer) {
+    // The library metrics register on first use. We report them from the
+    //  first scrape, even if they are still at 0.
+    GetLibraryMetrics();
+    const auto& registry { GetMetricsRegistry() };
+    for (const auto& counter: registry.SnapshotCounters())
+    {
+      writer.AddCounter(counter.name, "",
+                        static_cast<double>(counter.value));
+    }
+    constexpr std::string_view suffix { "_ns" };
+    for (const auto& histogram: registry.SnapshotHistograms())
+    {
+      auto name { histogram.name };
+      if (name.size() > suffix.size() &&
+          name.compare(name.size() - suffix.size(), suffix.size(),
+                       suffix) == 0)
+      {
+        name.resize(name.size() - suffix.size());
+      }
+      writer.AddSummary(name + "_seconds", "", histogram);
+    }
+  };
+}
+
+MetricsCollector NetworkMonitor::CollectPassengerCounts(
+  const TransportNetwork& network
+)
+{
+  return [&network](PrometheusWriter& writer) {
+    PrometheusWriter::Labels labels { {"station", ""} };
+    network.ForEachPassengerCount(
+      [&writer, &labels](const Id& station, long long int count) {
+        labels.front().second = station;
+        writer.AddGauge("network_monitor_station_passengers",
+                        "Passengers currently at the station",
+                        static_cast<double>(count), labels);
+      }
+    );
+  };
+}
+
+MetricsCollector NetworkMonitor::CollectWebSocketClient(
+  const WebSocketClient& client,
+  std::string name
+)
+{
+  return [&client, name = std::move(name)](PrometheusWriter& writer) {
+    AddWebSocketStats(writer, {{name, client.GetStats()}});
+  };
+}
+
+MetricsCollector NetworkMonitor::CollectWebSocketClientManager(
+  WebSocketClientManager& manager
+)
+{
+  return [&manager](PrometheusWriter& writer) {
+    std::vector<std::pair<std::string, WebSocketClientStats>> clients {};
+    for (auto& stats: manager.GetStats())
+    {
+      clients.emplace_back(std::to_string(stats.clientIdx),
+                           std::move(stats.traffic));
+    }
+    AddWebSocketStats(writer, clients);
+  };
+}
+
+// One client connection. The server has a single thread, so the handlers of
+//  a session never run concurrently.
+class MetricsServer::Session : public std::enable_shared_from_this<Session>
+{
+  public:
+    Session(
+      MetricsServer& server,
+      tcp::socket&& socket
+    ) : m_server { server }
+      , m_stream { std::move(socket) }
+    {
+    }
+
+    void Run()
+    {
+      boost::asio::dispatch(m_stream.get_executor(),
+        [self = shared_from_this()]() {
+          self->DoReadRequest();
+        }
+      );
+    }
+
+  private:
+    MetricsServer& m_server;
+    boost::beast::tcp_stream m_stream;
+    boost::beast::flat_buffer m_buffer {};
+    http::request<http::empty_body> m_request {};
+
+    // Scrape in progress
+    http::response<http::empty_body> m_response {};
+    std::optional<http::response_serializer<http::empty_body>> m_serializer {};
+    PrometheusWriter m_writer {};
+    std::size_t m_nextCollector {0};
+    std::string m_chunk {};
+
+    void DoReadRequest()
+    {
+      m_request = {};
+      m_stream.expires_after(std::chrono::seconds(30));
+      http::async_read(m_stream, m_buffer, m_request,
+        [self = shared_from_this()](auto ec, auto) {
+          if (ec)
+            return;
+
+          self->OnRequest();
+        }
+      );
+    }
+
+    void OnRequest()
+    {
+      if (std::string(m_request.target()) != m_server.m_options.target)
+      {
+        SendError(http::status::not_found, "Not found\n");
+        return;
+      }
+      if (m_request.method() != http::verb::get &&
+          m_request.method() != http::verb::head)
+      {
+        SendError(http::status::method_not_allowed, "Method not allowed\n");
+        return;
+      }
+      m_server.m_scrapes.fetch_add(1, std::memory_order_relaxed);
+
+      // We do not know the length of the page before we have run all the
+      //  collectors, so we send it in chunks as they produce it.
+      m_response = http::response<http::empty_body> {
+        http::status::ok, m_request.version()
+      };
+      m_response.set(http::field::content_type,
+                     "text/plain; version=0.0.4; charset=utf-8");
+      m_response.keep_alive(m_request.keep_alive());
+      m_response.chunked(true);
+      m_serializer.emplace(m_response);
+      m_writer = {};
+      m_nextCollector = 0;
+      http::async_write_header(m_stream, *m_serializer,
+        [self = shared_from_this()](auto ec, auto) {
+          if (ec)
+            return;
+
+          if (self->m_request.method() == http::verb::head)
+          {
+            self->OnResponseSent();
+            return;
+          }
+          self->DoWriteChunk();
+        }
+      );
+    }
+
+    void DoWriteChunk()
+    {
+      // Run the collectors until one of them has something to send
+      const auto& collectors { m_server.m_collectors };
+      try
+      {
+        while (m_writer.GetText().empty() &&
+               m_nextCollector < collectors.size())
+        {
+          collectors[m_nextCollector++](m_writer);
+        }
+      }
+      catch (const std::exception&)
+      {
+        // Close without the last chunk, so the scrape fails instead of
+        //  returning partial data
+        boost::system::error_code ec {};
+        m_stream.socket().shutdown(tcp::socket::shutdown_both, ec);
+        return;
+      }
+
+      if (m_writer.GetText().empty())
+      {
+        boost::asio::async_write(m_stream, http::make_chunk_last(),
+          [self = shared_from_this()](auto ec, auto) {
+            if (ec)
+              return;
+
+            self->OnResponseSent();
+          }
+        );
+        return;
+      }
+
+      m_chunk = m_writer.TakeText();
+      boost::asio::async_write(m_stream,
+        http::make_chunk(boost::asio::buffer(m_chunk)),
+        [self = shared_from_this()](auto ec, auto) {
+          if (ec)
+            return;
+
+          self->DoWriteChunk();
+        }
+      );
+    }
+
+    void SendError(
+      http::status status,
+      const char* body
+    )
+    {
+      auto response { std::make_shared<http::response<http::string_body>>(
+        status, m_request.version()
+      )};
+      response->set(http::field::content_type, "text/plain");
+      response->body() = body;
+      response->keep_alive(m_request.keep_alive());
+      response->prepare_payload();
+      http::async_write(m_stream, *response,
+        [self = shared_from_this(), response](auto ec, auto) {
+          if (ec)
+            return;
+
+          self->OnResponseSent();
+        }
+      );
+    }
+
+    void OnResponseSent()
+    {
+      if (m_request.keep_alive())
+      {
+        DoReadRequest();
+        return;
+      }
+      boost::system::error_code ec {};
+      m_stream.socket().shutdown(tcp::socket::shutdown_send, ec);
+    }
+};
+
+// MetricsServer - Public methods
+
+MetricsServer::MetricsServer(
+  const MetricsServerOptions& options
+) : m_options { options }
+  , m_acceptor { m_ioc }
+{
+}
+
+MetricsServer::~MetricsServer()
+{
+  Stop();
+}
+
+void MetricsServer::AddCollector(
+  MetricsCollector collector
+)
+{
+  m_collectors.push_back(std::move(collector));
+}
+
+bool MetricsServer::Start()
+{
+  boost::system::error_code ec {};
+  const auto address { boost::asio::ip::make_address(m_options.address, ec) };
+  if (ec)
+    return false;
+  const tcp::endpoint endpoint { address, m_options.port };
+  m_acceptor.open(endpoint.protocol(), ec);
+  if (ec)
+    return false;
+  m_acceptor.set_option(boost::asio::socket_base::reuse_address(true), ec);
+  m_acceptor.bind(endpoint, ec);
+  if (ec)
+    return false;
+  m_acceptor.listen(boost::asio::socket_base::max_listen_connections, ec);
+  if (ec)
+    return false;
+  m_port = m_acceptor.local_endpoint().port();
+
+  Accept();
+
+  m_thread = std::thread([this]() {
+    m_ioc.run();
+  });
+  return true;
+}
+
+void MetricsServer::Stop()
+{
+  m_ioc.stop();
+  if (m_thread.joinable())
+    m_thread.join();
+
+  // No thread is running the acceptor any more, so we can touch it here
+  boost::system::error_code ec {};
+  m_acceptor.close(ec);
+}
+
+unsigned short MetricsServer::GetPort() const
+{
+  return m_port;
+}
+
+std::uint64_t MetricsServer::GetScrapes() const
+{
+  return m_scrapes.load(std::memory_order_relaxed);
+}
+
+// MetricsServer - Private methods
+
+void MetricsServer::Accept()
+{
+  m_acceptor.async_accept(m_ioc,
+    [this](auto ec, tcp::socket socket) {
+      if (ec)
+      {
+        // The acceptor was closed
+        if (ec == boost::asio::error::operation_aborted)
+          return;
+      }
+      else
+      {
+        std::make_shared<Session>(*this, std::move(socket))->Run();
+      }
+      Accept();
+    }
+  );
+}
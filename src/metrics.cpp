@@ -0,0 +1,305 @@
+#include <network-monitor/metrics.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using NetworkMonitor::Counter;
+using NetworkMonitor::CounterSnapshot;
+using NetworkMonitor::LatencyHistogram;
+using NetworkMonitor::LatencySnapshot;
+using NetworkMonitor::LibraryMetrics;
+using NetworkMonitor::MetricsRegistry;
+
+// Each thread finds its shard of a metric at the metric slot. Slots are
+//  never reused, so a table entry can only point to the shard of the metric
+//  that owns the slot.
+static std::atomic<std::size_t> gNextHistogramSlot {0};
+static std::atomic<std::size_t> gNextCounterSlot {0};
+thread_local std::vector<void*> tHistogramShards {};
+thread_local std::vector<void*> tCounterShards {};
+
+// Single-writer increment: Only the owning thread writes the shard
+static void Increment(
+  std::atomic<std::uint64_t>& value,
+  std::uint64_t delta
+)
+{
+  value.store(value.load(std::memory_order_relaxed) + delta,
+              std::memory_order_relaxed);
+}
+
+template <typename Metric>
+static void Unregister(
+  std::vector<const Metric*>& metrics,
+  const Metric* metric
+)
+{
+  metrics.erase(std::remove(metrics.begin(), metrics.end(), metric),
+                metrics.end());
+}
+
+// LatencySnapshot
+
+std::uint64_t LatencySnapshot::GetPercentile(
+  double percentile
+) const
+{
+  if (count == 0)
+    return 0;
+
+  // The value of the rank-th smallest value, counting from 1
+  const auto rank { std::max<std::uint64_t>(1, static_cast<std::uint64_t>(
+    std::ceil(std::clamp(percentile, 0.0, 100.0) / 100.0 *
+              static_cast<double>(count))
+  ))};
+  std::uint64_t seen {0};
+  for (std::size_t bucket {0}; bucket < buckets.size(); ++bucket)
+  {
+    seen += buckets[bucket];
+    if (seen >= rank)
+    {
+      return std::clamp(LatencyHistogram::GetBucketLimit(bucket), min, max);
+    }
+  }
+  return max;
+}
+
+// LatencyHistogram
+
+LatencyHistogram::LatencyHistogram(
+  std::string name
+) : m_name { std::move(name) }
+  , m_slot { gNextHistogramSlot.fetch_add(1, std::memory_order_relaxed) }
+{
+  auto& registry { GetMetricsRegistry() };
+  std::lock_guard<std::mutex> lock { registry.m_mutex };
+  registry.m_histograms.push_back(this);
+}
+
+LatencyHistogram::~LatencyHistogram()
+{
+  auto& registry { GetMetricsRegistry() };
+  std::lock_guard<std::mutex> lock { registry.m_mutex };
+  Unregister(registry.m_histograms, this);
+}
+
+void LatencyHistogram::Record(
+  std::chrono::nanoseconds latency
+)
+{
+  auto& table { tHistogramShards };
+  auto* shard { m_slot < table.size() ?
+    static_cast<Shard*>(table[m_slot]) : nullptr
+  };
+  if (shard == nullptr)
+    shard = &AddShard();
+
+  const auto value { static_cast<std::uint64_t>(
+    std::max<std::chrono::nanoseconds::rep>(0, latency.count())
+  )};
+  Increment(shard->buckets[GetBucket(value)], 1);
+  Increment(shard->count, 1);
+  Increment(shard->sum, value);
+  if (value < shard->min.load(std::memory_order_relaxed))
+    shard->min.store(value, std::memory_order_relaxed);
+  if (value > shard->max.load(std::memory_order_relaxed))
+    shard->max.store(value, std::memory_order_relaxed);
+}
+
+LatencySnapshot LatencyHistogram::Snapshot() const
+{
+  LatencySnapshot snapshot {};
+  snapshot.name = m_name;
+  snapshot.buckets.resize(kBucketCount, 0);
+  snapshot.min = UINT64_MAX;
+  {
+    std::lock_guard<std::mutex> lock { m_shardsMutex };
+    for (const auto& shard: m_shards)
+    {
+      for (std::size_t bucket {0}; bucket < kBucketCount; ++bucket)
+      {
+        snapshot.buckets[bucket] +=
+          shard->buckets[bucket].load(std::memory_order_relaxed);
+      }
+      snapshot.count += shard->count.load(std::memory_order_relaxed);
+      snapshot.sum += shard->sum.load(std::memory_order_relaxed);
+      snapshot.min = std::min(snapshot.min,
+                              shard->min.load(std::memory_order_relaxed));
+      snapshot.max = std::max(snapshot.max,
+                              shard->max.load(std::memory_order_relaxed));
+    }
+  }
+  if (snapshot.count == 0)
+    snapshot.min = 0;
+
+  snapshot.p50 = snapshot.GetPercentile(50.0);
+  snapshot.p90 = snapshot.GetPercentile(90.0);
+  snapshot.p99 = snapshot.GetPercentile(99.0);
+  snapshot.p999 = snapshot.GetPercentile(99.9);
+  return snapshot;
+}
+
+const std::string& LatencyHistogram::GetName() const
+{
+  return m_name;
+}
+
+std::size_t LatencyHistogram::GetBucket(
+  std::uint64_t value
+)
+{
+  // Below 2 * 64, each value has its own bucket
+  constexpr std::uint64_t linearLimit { 2ull << kSubBucketBits };
+  if (value < linearLimit)
+    return static_cast<std::size_t>(value);
+
+  // Then each power of 2 is split into 64 buckets, using the 7 most
+  //  significant bits of the value
+  value = std::min<std::uint64_t>(value, (1ull << kMaxValueBits) - 1);
+  const auto shift {
+    static_cast<std::size_t>(std::bit_width(value)) - 1 - kSubBucketBits
+  };
+  return (shift << kSubBucketBits) + static_cast<std::size_t>(value >> shift);
+}
+
+std::uint64_t LatencyHistogram::GetBucketLimit(
+  std::size_t bucket
+)
+{
+  constexpr std::size_t linearLimit { 2ull << kSubBucketBits };
+  if (bucket < linearLimit)
+    return bucket;
+
+  const auto shift { (bucket >> kSubBucketBits) - 1 };
+  const auto top { bucket - (shift << kSubBucketBits) };
+  return ((static_cast<std::uint64_t>(top) + 1) << shift) - 1;
+}
+
+LatencyHistogram::Shard& LatencyHistogram::AddShard()
+{
+  auto shard { std::make_unique<Shard>() };
+  auto& added { *shard };
+  {
+    std::lock_guard<std::mutex> lock { m_shardsMutex };
+    m_shards.push_back(std::move(shard));
+  }
+  auto& table { tHistogramShards };
+  if (table.size() <= m_slot)
+    table.resize(m_slot + 1, nullptr);
+  table[m_slot] = &added;
+  return added;
+}
+
+// Counter
+
+Counter::Counter(
+  std::string name
+) : m_name { std::move(name) }
+  , m_slot { gNextCounterSlot.fetch_add(1, std::memory_order_relaxed) }
+{
+  auto& registry { GetMetricsRegistry() };
+  std::lock_guard<std::mutex> lock { registry.m_mutex };
+  registry.m_counters.push_back(this);
+}
+
+Counter::~Counter()
+{
+  auto& registry { GetMetricsRegistry() };
+  std::lock_guard<std::mutex> lock { registry.m_mutex };
+  Unregister(registry.m_counters, this);
+}
+
+void Counter::Add(
+  std::uint64_t value
+)
+{
+  auto& table { tCounterShards };
+  auto* shard { m_slot < table.size() ?
+    static_cast<Shard*>(table[m_slot]) : nullptr
+  };
+  if (shard == nullptr)
+    shard = &AddShard();
+  Increment(shard->value, value);
+}
+
+CounterSnapshot Counter::Snapshot() const
+{
+  CounterSnapshot snapshot { m_name, 0 };
+  std::lock_guard<std::mutex> lock { m_shardsMutex };
+  for (const auto& shard: m_shards)
+    snapshot.value += shard->value.load(std::memory_order_relaxed);
+  return snapshot;
+}
+
+const std::string& Counter::GetName() const
+{
+  return m_name;
+}
+
+Counter::Shard& Counter::AddShard()
+{
+  auto shard { std::make_unique<Shard>() };
+  auto& added { *shard };
+  {
+    std::lock_guard<std::mutex> lock { m_shardsMutex };
+    m_shards.push_back(std::move(shard));
+  }
+  auto& table { tCounterShards };
+  if (table.size() <= m_slot)
+    table.resize(m_slot + 1, nullptr);
+  table[m_slot] = &added;
+  return added;
+}
+
+// MetricsRegistry
+
+std::vector<LatencySnapshot> MetricsRegistry::SnapshotHistograms() const
+{
+  std::vector<LatencySnapshot> snapshots {};
+  {
+    std::lock_guard<std::mutex> lock { m_mutex };
+    for (const auto* histogram: m_histograms)
+      snapshots.push_back(histogram->Snapshot());
+  }
+  std::sort(snapshots.begin(), snapshots.end(),
+    [](const auto& a, const auto& b) { return a.name < b.name; }
+  );
+  return snapshots;
+}
+
+std::vector<CounterSnapshot> MetricsRegistry::SnapshotCounters() const
+{
+  std::vector<CounterSnapshot> snapshots {};
+  {
+    std::lock_guard<std::mutex> lock { m_mutex };
+    for (const auto* counter: m_counters)
+      snapshots.push_back(counter->Snapshot());
+  }
+  std::sort(snapshots.begin(), snapshots.end(),
+    [](const auto& a, const auto& b) { return a.name < b.name; }
+  );
+  return snapshots;
+}
+
+// Public functions
+
+MetricsRegistry& NetworkMonitor::GetMetricsRegistry()
+{
+  static MetricsRegistry registry {};
+  return registry;
+}
+
+LibraryMetrics& NetworkMonitor::GetLibraryMetrics()
+{
+  // Constructed after the registry, so destroyed before it
+  static LibraryMetrics metrics {};
+  return metrics;
+}
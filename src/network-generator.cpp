@@ -0,0 +1,293 @@
+#include <network-monitor/network-generator.h>
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+using NetworkMonitor::NetworkGeneratorOptions;
+using NetworkMonitor::TravelTimeDistribution;
+
+// Random numbers that are the same on every platform
+// std::mt19937_64 is fully specified by the standard, but the distributions
+//  are not, so we derive the values ourselves.
+class Random
+{
+public:
+  explicit Random(
+    std::uint64_t seed
+  ) : m_engine { seed }
+  {
+  }
+
+  // Uniform integer in [0, bound). The modulo bias is negligible for the
+  //  bounds we use.
+  std::size_t Below(
+    std::size_t bound
+  )
+  {
+    return static_cast<std::size_t>(m_engine() % bound);
+  }
+
+  // Uniform double in [0, 1)
+  double Unit()
+  {
+    return static_cast<double>(m_engine() >> 11) * 0x1.0p-53;
+  }
+
+private:
+  std::mt19937_64 m_engine;
+};
+
+static std::string MakeId(
+  const char* prefix,
+  std::size_t idx,
+  std::size_t count
+)
+{
+  // Pad to the width of the largest ID, and to at least 3 digits like the
+  //  reference layout
+  const auto width { std::max<std::size_t>(
+    3, std::to_string(count == 0 ? 0 : count - 1).size()
+  )};
+  auto number { std::to_string(idx) };
+  if (number.size() < width)
+    number.insert(0, width - number.size(), '0');
+  return prefix + number;
+}
+
+static unsigned int GetTravelTime(
+  const NetworkGeneratorOptions& options,
+  Random& random
+)
+{
+  const auto range { options.maxTravelTime - options.minTravelTime + 1 };
+  switch (options.travelTimeDistribution)
+  {
+  case TravelTimeDistribution::Exponential:
+  {
+    const auto value { -std::log(1.0 - random.Unit()) *
+                       options.meanTravelTime };
+    return std::clamp(
+      static_cast<unsigned int>(std::lround(value)),
+      options.minTravelTime,
+      options.maxTravelTime
+    );
+  }
+  case TravelTimeDistribution::Uniform:
+  default:
+    return options.minTravelTime +
+           static_cast<unsigned int>(random.Below(range));
+  }
+}
+
+static void CheckOptions(
+  const NetworkGeneratorOptions& options
+)
+{
+  if (options.nStations < 2)
+    throw std::invalid_argument("A network needs at least 2 stations");
+  if (options.nLines == 0)
+    throw std::invalid_argument("A network needs at least 1 line");
+  if (options.routesPerLine == 0)
+    throw std::invalid_argument("A line needs at least 1 route");
+  if (options.minRouteLength < 2 ||
+      options.maxRouteLength < options.minRouteLength)
+  {
+    throw std::invalid_argument(
+      "Route lengths must be at least 2, and the minimum at most the maximum"
+    );
+  }
+  if (!(options.interchangeDensity >= 0.0 &&
+        options.interchangeDensity <= 1.0))
+  {
+    throw std::invalid_argument("The interchange density must be in [0, 1]");
+  }
+  if (options.minTravelTime == 0 ||
+      options.maxTravelTime < options.minTravelTime)
+  {
+    throw std::invalid_argument(
+      "Travel times must be at least 1, and the minimum at most the maximum"
+    );
+  }
+  if (options.travelTimeDistribution == TravelTimeDistribution::Exponential &&
+      !(options.meanTravelTime > 0.0))
+  {
+    throw std::invalid_argument("The mean travel time must be positive");
+  }
+}
+
+// Public functions
+
+nlohmann::json NetworkMonitor::GenerateNetworkLayout(
+  const NetworkGeneratorOptions& options
+)
+{
+  CheckOptions(options);
+  Random random { options.seed };
+
+  // Lay out the trunk of each line as a sequence of station indices
+  // New stations are taken in order, so station_000 is on line_000.
+  std::vector<std::vector<std::size_t>> trunks(options.nLines);
+  std::vector<std::size_t> served {};
+  served.reserve(options.nStations);
+  std::size_t nextStation {0};
+  for (auto& trunk: trunks)
+  {
+    const auto length { options.minRouteLength + random.Below(
+      options.maxRouteLength - options.minRouteLength + 1
+    )};
+    std::unordered_set<std::size_t> onLine {};
+    while (trunk.size() < length)
+    {
+      // Interchanges can only be with stations that other lines serve
+      const bool interchange {
+        nextStation == options.nStations ||
+        (served.size() > onLine.size() &&
+         random.Unit() < options.interchangeDensity)
+      };
+      if (!interchange)
+      {
+        onLine.insert(nextStation);
+        trunk.push_back(nextStation);
+        served.push_back(nextStation++);
+        continue;
+      }
+
+      // A route cannot go through the same station twice. After a few
+      //  collisions in a row we take a new station, or the first one that
+      //  the line does not serve yet.
+      bool added { false };
+      for (std::size_t attempt {0}; attempt < 8 && !added; ++attempt)
+      {
+        const auto station { served[random.Below(served.size())] };
+        if (onLine.insert(station).second)
+        {
+          trunk.push_back(station);
+          added = true;
+        }
+      }
+      if (!added && nextStation < options.nStations)
+      {
+        onLine.insert(nextStation);
+        trunk.push_back(nextStation);
+        served.push_back(nextStation++);
+        added = true;
+      }
+      for (std::size_t idx {0}; idx < served.size() && !added; ++idx)
+      {
+        if (onLine.insert(served[idx]).second)
+        {
+          trunk.push_back(served[idx]);
+          added = true;
+        }
+      }
+
+      // The line already serves every station
+      if (!added)
+        break;
+    }
+  }
+
+  // Every station must be served: Extend the lines in turn with the rest
+  for (std::size_t idx {0}; nextStation < options.nStations; ++idx)
+    trunks[idx % trunks.size()].push_back(nextStation++);
+
+  // Stations
+  nlohmann::json layout {
+    {"stations", nlohmann::json::array()},
+    {"lines", nlohmann::json::array()},
+    {"travel_times", nlohmann::json::array()},
+  };
+  std::vector<std::string> stationIds {};
+  stationIds.reserve(options.nStations);
+  auto& stations { layout["stations"] };
+  for (std::size_t idx {0}; idx < options.nStations; ++idx)
+  {
+    stationIds.push_back(MakeId("station_", idx, options.nStations));
+    stations.push_back({
+      {"station_id", stationIds.back()},
+      {"name", "Station " + std::to_string(idx)},
+    });
+  }
+
+  // Lines and routes. The first two routes run the whole trunk, inbound and
+  //  outbound. The others run a random section of at least 2 stops.
+  const auto nRoutes { options.nLines * options.routesPerLine };
+  auto& lines { layout["lines"] };
+  auto& travelTimes { layout["travel_times"] };
+  std::unordered_set<std::string> timedPairs {};
+  std::size_t routeIdx {0};
+  for (std::size_t lineIdx {0}; lineIdx < trunks.size(); ++lineIdx)
+  {
+    const auto& trunk { trunks[lineIdx] };
+    const auto lineId { MakeId("line_", lineIdx, options.nLines) };
+    nlohmann::json routes = nlohmann::json::array();
+    std::string trunkRouteId {};
+    for (std::size_t idx {0}; idx < options.routesPerLine; ++idx)
+    {
+      std::size_t first {0};
+      std::size_t last { trunk.size() - 1 };
+      if (idx >= 2)
+      {
+        first = random.Below(trunk.size() - 1);
+        last = first + 1 + random.Below(trunk.size() - first - 1);
+      }
+      std::vector<std::string> stops {};
+      for (auto stop { first }; stop <= last; ++stop)
+        stops.push_back(stationIds[trunk[stop]]);
+      const bool inbound { idx % 2 == 0 };
+      if (!inbound)
+        std::reverse(stops.begin(), stops.end());
+
+      const auto routeId { MakeId("route_", routeIdx++, nRoutes) };
+      if (idx == 0)
+        trunkRouteId = routeId;
+      routes.push_back({
+        {"route_id", routeId},
+        {"direction", inbound ? "inbound" : "outbound"},
+        {"line_id", lineId},
+        {"start_station_id", stops.front()},
+        {"end_station_id", stops.back()},
+        {"route_stops", std::move(stops)},
+      });
+    }
+
+    // Travel times are per pair of stations, whatever the line or direction
+    for (std::size_t stop {1}; stop < trunk.size(); ++stop)
+    {
+      const auto& stationA { stationIds[trunk[stop - 1]] };
+      const auto& stationB { stationIds[trunk[stop]] };
+      const auto key { stationA < stationB ? stationA + "/" + stationB :
+                                             stationB + "/" + stationA };
+      if (!timedPairs.insert(key).second)
+        continue;
+      travelTimes.push_back({
+        {"start_station_id", stationA},
+        {"end_station_id", stationB},
+        {"line_id", lineId},
+        {"route_id", trunkRouteId},
+        {"travel_time", GetTravelTime(options, random)},
+      });
+    }
+
+    nlohmann::json lineStations = nlohmann::json::array();
+    for (const auto station: trunk)
+      lineStations.push_back(stationIds[station]);
+    lines.push_back({
+      {"line_id", lineId},
+      {"name", "Line " + std::to_string(lineIdx)},
+      {"stations", std::move(lineStations)},
+      {"routes", std::move(routes)},
+    });
+  }
+
+  return layout;
+}
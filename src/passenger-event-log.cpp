@@ -0,0 +1,1035 @@
+#include <network-monitor/passenger-event-log.h>
+#include <network-monitor/trace.h>
+#include <network-monitor/transport-network.h>
+
+#include "varint.h"
+
+#include <zlib.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+using NetworkMonitor::AppendVarint;
+using NetworkMonitor::PassengerCheckpoint;
+using NetworkMonitor::PassengerCheckpointer;
+using NetworkMonitor::PassengerCheckpointOptions;
+using NetworkMonitor::PassengerCountSnapshot;
+using NetworkMonitor::PassengerEvent;
+using NetworkMonitor::PassengerEventLog;
+using NetworkMonitor::PassengerEventLogOptions;
+using NetworkMonitor::PassengerEventLogReplay;
+using NetworkMonitor::PassengerRecovery;
+using NetworkMonitor::ReadVarint;
+using NetworkMonitor::TransportNetwork;
+
+// Segment header: magic and the sequence number of the first event
+static constexpr std::string_view kSegmentMagic { "NMEVLOG1" };
+static constexpr std::size_t kSegmentHeaderSize {16};
+
+// Batch record header: payload size, CRC-32, first sequence, event count
+static constexpr std::size_t kBatchHeaderSize {20};
+
+// Checkpoint header: magic, sequence, station count and CRC-32 of the entries
+static constexpr std::string_view kCheckpointMagic { "NMCKPT01" };
+static constexpr std::size_t kCheckpointHeaderSize {24};
+
+// Past this many pending bytes, Append wakes the writer before the end of
+//  the commit interval
+static constexpr std::size_t kMaxPendingBytes {1 << 20};
+
+// Static functions
+
+template <typename T>
+static void StoreLittleEndian(
+  char* data,
+  T value
+)
+{
+  for (std::size_t idx {0}; idx < sizeof(T); ++idx)
+  {
+    data[idx] = static_cast<char>(
+      static_cast<std::uint64_t>(value) >> (8 * idx) & 0xff
+    );
+  }
+}
+
+template <typename T>
+static void AppendLittleEndian(
+  std::string& buffer,
+  T value
+)
+{
+  char bytes[sizeof(T)] {};
+  StoreLittleEndian(bytes, value);
+  buffer.append(bytes, sizeof(T));
+}
+
+template <typename T>
+static T ReadLittleEndian(
+  const unsigned char* data
+)
+{
+  std::uint64_t value {0};
+  for (std::size_t idx {0}; idx < sizeof(T); ++idx)
+    value |= static_cast<std::uint64_t>(data[idx]) << (8 * idx);
+  return static_cast<T>(value);
+}
+
+// Name of a segment or checkpoint file, after its sequence number
+static std::string GetSequenceFileName(
+  const char* prefix,
+  std::uint64_t sequence,
+  const char* suffix
+)
+{
+  char name[64] {};
+  std::snprintf(name, sizeof(name), "%s%020llu%s", prefix,
+                static_cast<unsigned long long>(sequence), suffix);
+  return name;
+}
+
+static std::string GetSegmentName(
+  std::uint64_t firstSequence
+)
+{
+  return GetSequenceFileName("events-", firstSequence, ".log");
+}
+
+static std::string GetCheckpointName(
+  std::uint64_t sequence
+)
+{
+  return GetSequenceFileName("checkpoint-", sequence, ".ckpt");
+}
+
+static std::string GetErrnoMessage(
+  const std::string& what,
+  const std::filesystem::path& path
+)
+{
+  return what + " " + path.string() + ": " + std::strerror(errno);
+}
+
+static bool WriteAll(
+  int fd,
+  const char* data,
+  std::size_t size
+)
+{
+  while (size > 0)
+  {
+    const auto written { write(fd, data, size) };
+    if (written < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    data += written;
+    size -= static_cast<std::size_t>(written);
+  }
+  return true;
+}
+
+// Sync the directory entry of a new segment
+static bool SyncDirectory(
+  const std::filesystem::path& directory
+)
+{
+  const int fd {
+    open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)
+  };
+  if (fd < 0)
+    return false;
+  const bool ok { fsync(fd) == 0 };
+  close(fd);
+  return ok;
+}
+
+namespace {
+
+struct SegmentFile
+{
+  std::uint64_t firstSequence {0};
+  std::filesystem::path path {};
+};
+
+struct SegmentScan
+{
+  // Size of the header and of the valid batch records after it
+  std::size_t validBytes {0};
+  std::uint64_t nextSequence {0};
+
+  // The segment ends with an incomplete or corrupt batch record
+  bool torn {false};
+
+  // The segment could not be read at all
+  std::string error {};
+};
+
+using BatchVisitor = std::function<bool (
+  std::uint64_t firstSequence,
+  std::uint32_t nEvents,
+  const unsigned char* payload,
+  std::size_t size
+)>;
+
+// Read-only mapping of a whole file
+class MappedFile
+{
+public:
+  bool Map(
+    const std::filesystem::path& path,
+    std::string& error
+  )
+  {
+    const int fd { open(path.c_str(), O_RDONLY | O_CLOEXEC) };
+    if (fd < 0)
+    {
+      error = GetErrnoMessage("Could not open", path);
+      return false;
+    }
+    struct stat info {};
+    if (fstat(fd, &info) != 0)
+    {
+      error = GetErrnoMessage("Could not stat", path);
+      close(fd);
+      return false;
+    }
+    m_size = static_cast<std::size_t>(info.st_size);
+    if (m_size > 0)
+    {
+      m_data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (m_data == MAP_FAILED)
+      {
+        m_data = nullptr;
+        error = GetErrnoMessage("Could not map", path);
+        close(fd);
+        return false;
+      }
+      madvise(m_data, m_size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+    return true;
+  }
+
+  ~MappedFile()
+  {
+    if (m_data != nullptr)
+      munmap(m_data, m_size);
+  }
+
+  const unsigned char* GetData() const
+  {
+    return static_cast<const unsigned char*>(m_data);
+  }
+
+  std::size_t GetSize() const
+  {
+    return m_size;
+  }
+
+private:
+  void* m_data {nullptr};
+  std::size_t m_size {0};
+};
+
+} // namespace
+
+// Files of the directory named after a sequence number, in sequence order
+static std::vector<SegmentFile> ListSequenceFiles(
+  const std::filesystem::path& directory,
+  const std::string& prefix,
+  const std::string& suffix,
+  std::error_code& ec
+)
+{
+  std::vector<SegmentFile> files {};
+  for (const auto& entry: std::filesystem::directory_iterator(directory, ec))
+  {
+    const auto name { entry.path().filename().string() };
+    if (name.size() != prefix.size() + 20 + suffix.size() ||
+        name.compare(0, prefix.size(), prefix) != 0 ||
+        name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0)
+    {
+      continue;
+    }
+    const auto digits { name.substr(prefix.size(), 20) };
+    if (!std::all_of(digits.begin(), digits.end(),
+                     [](char c) { return c >= '0' && c <= '9'; }))
+    {
+      continue;
+    }
+    files.push_back({std::stoull(digits), entry.path()});
+  }
+  std::sort(files.begin(), files.end(),
+    [](const auto& a, const auto& b) {
+      return a.firstSequence < b.firstSequence;
+    }
+  );
+  return files;
+}
+
+static std::vector<SegmentFile> ListSegments(
+  const std::filesystem::path& directory,
+  std::error_code& ec
+)
+{
+  return ListSequenceFiles(directory, "events-", ".log", ec);
+}
+
+static std::vector<SegmentFile> ListCheckpoints(
+  const std::filesystem::path& directory,
+  std::error_code& ec
+)
+{
+  return ListSequenceFiles(directory, "checkpoint-", ".ckpt", ec);
+}
+
+// Check the batch records of a segment and pass the valid ones to `visit`,
+//  in order. The scan stops early if `visit` returns false.
+static SegmentScan ScanSegment(
+  const SegmentFile& segment,
+  const BatchVisitor& visit
+)
+{
+  SegmentScan scan {};
+  scan.nextSequence = segment.firstSequence;
+  MappedFile file {};
+  if (!file.Map(segment.path, scan.error))
+    return scan;
+  const auto* data { file.GetData() };
+  const auto size { file.GetSize() };
+
+  // A crash right after the segment was created
+  if (size < kSegmentHeaderSize)
+  {
+    scan.torn = true;
+    return scan;
+  }
+  if (std::string_view { reinterpret_cast<const char*>(data),
+                         kSegmentMagic.size() } != kSegmentMagic ||
+      ReadLittleEndian<std::uint64_t>(data + 8) != segment.firstSequence)
+  {
+    scan.error = "Invalid segment header in " + segment.path.string();
+    return scan;
+  }
+
+  std::size_t offset { kSegmentHeaderSize };
+  scan.validBytes = offset;
+  while (offset < size)
+  {
+    if (size - offset < kBatchHeaderSize)
+    {
+      scan.torn = true;
+      break;
+    }
+    const auto* header { data + offset };
+    const auto payloadSize { ReadLittleEndian<std::uint32_t>(header) };
+    const auto crc { ReadLittleEndian<std::uint32_t>(header + 4) };
+    const auto firstSequence { ReadLittleEndian<std::uint64_t>(header + 8) };
+    const auto nEvents { ReadLittleEndian<std::uint32_t>(header + 16) };
+    if (payloadSize > size - offset - kBatchHeaderSize)
+    {
+      scan.torn = true;
+      break;
+    }
+    const auto* payload { header + kBatchHeaderSize };
+    auto computed { crc32(0L, header + 8, kBatchHeaderSize - 8) };
+    computed = crc32(computed, payload, payloadSize);
+    if (computed != crc || firstSequence != scan.nextSequence)
+    {
+      scan.torn = true;
+      break;
+    }
+    if (visit && !visit(firstSequence, nEvents, payload, payloadSize))
+      break;
+    offset += kBatchHeaderSize + payloadSize;
+    scan.validBytes = offset;
+    scan.nextSequence += nEvents;
+  }
+  return scan;
+}
+
+// Decode the events of a batch payload into `events`, reusing its strings
+static bool DecodeBatch(
+  const unsigned char* payload,
+  std::size_t size,
+  std::uint32_t nEvents,
+  std::vector<PassengerEvent>& events
+)
+{
+  events.resize(nEvents);
+  std::size_t offset {0};
+  for (auto& event: events)
+  {
+    if (size - offset < 11)
+      return false;
+    switch (payload[offset])
+    {
+    case 0:
+      event.type = PassengerEvent::Type::In;
+      break;
+    case 1:
+      event.type = PassengerEvent::Type::Out;
+      break;
+    default:
+      return false;
+    }
+    event.timestamp = std::chrono::system_clock::time_point {
+      std::chrono::duration_cast<std::chrono::system_clock::duration>(
+        std::chrono::nanoseconds {
+          ReadLittleEndian<std::int64_t>(payload + offset + 1)
+        }
+      )
+    };
+    const auto idSize { ReadLittleEndian<std::uint16_t>(payload + offset + 9) };
+    offset += 11;
+    if (size - offset < idSize)
+      return false;
+    event.stationId.assign(reinterpret_cast<const char*>(payload + offset),
+                           idSize);
+    offset += idSize;
+  }
+  return offset == size;
+}
+
+static std::string EncodeCheckpoint(
+  const PassengerCountSnapshot& snapshot
+)
+{
+  std::string entries {};
+  for (const auto& count: snapshot.counts)
+  {
+    AppendVarint(entries, count.stationId.size());
+    entries += count.stationId;
+    const auto value { static_cast<std::int64_t>(count.passengerCount) };
+    AppendVarint(entries, static_cast<std::uint64_t>(value) << 1 ^
+                          static_cast<std::uint64_t>(value >> 63));
+  }
+  std::string checkpoint { kCheckpointMagic };
+  AppendLittleEndian(checkpoint, snapshot.sequence);
+  AppendLittleEndian(checkpoint,
+                     static_cast<std::uint32_t>(snapshot.counts.size()));
+  AppendLittleEndian(checkpoint, static_cast<std::uint32_t>(
+    crc32(0L, reinterpret_cast<const Bytef*>(entries.data()),
+          static_cast<uInt>(entries.size()))
+  ));
+  return checkpoint + entries;
+}
+
+static bool LoadCheckpoint(
+  const SegmentFile& file,
+  PassengerCountSnapshot& snapshot,
+  std::string& error
+)
+{
+  MappedFile mapped {};
+  if (!mapped.Map(file.path, error))
+    return false;
+  const auto* data { mapped.GetData() };
+  const auto size { mapped.GetSize() };
+  if (size < kCheckpointHeaderSize ||
+      std::string_view { reinterpret_cast<const char*>(data),
+                         kCheckpointMagic.size() } != kCheckpointMagic ||
+      ReadLittleEndian<std::uint64_t>(data + 8) != file.firstSequence ||
+      crc32(0L, data + kCheckpointHeaderSize,
+            static_cast<uInt>(size - kCheckpointHeaderSize)) !=
+        ReadLittleEndian<std::uint32_t>(data + 20))
+  {
+    error = "Invalid checkpoint " + file.path.string();
+    return false;
+  }
+  snapshot.sequence = file.firstSequence;
+  snapshot.counts.resize(ReadLittleEndian<std::uint32_t>(data + 16));
+  std::size_t offset { kCheckpointHeaderSize };
+  for (auto& count: snapshot.counts)
+  {
+    std::uint64_t idSize {0};
+    std::uint64_t value {0};
+    if (!ReadVarint(data, size, offset, idSize) || size - offset < idSize)
+      break;
+    count.stationId.assign(reinterpret_cast<const char*>(data + offset),
+                           idSize);
+    offset += idSize;
+    if (!ReadVarint(data, size, offset, value))
+      break;
+    count.passengerCount = static_cast<long long int>(
+      static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(
+        value & 1
+      )
+    );
+  }
+  if (offset != size)
+  {
+    error = "Invalid checkpoint entries in " + file.path.string();
+    return false;
+  }
+  return true;
+}
+
+// PassengerEventLog - Public methods
+
+PassengerEventLog::PassengerEventLog(
+  const PassengerEventLogOptions& options
+) : m_options { options }
+{
+}
+
+PassengerEventLog::~PassengerEventLog()
+{
+  Close();
+}
+
+bool PassengerEventLog::Open()
+{
+  std::lock_guard<std::mutex> lock { m_mutex };
+  if (m_writer.joinable())
+    return false;
+
+  std::error_code ec {};
+  std::filesystem::create_directories(m_options.directory, ec);
+  const auto segments { ListSegments(m_options.directory, ec) };
+  if (ec)
+  {
+    m_error = "Could not list " + m_options.directory.string() + ": " +
+              ec.message();
+    return false;
+  }
+
+  // Append to the last segment, after its last valid batch record
+  m_nextSequence = 0;
+  if (!segments.empty())
+  {
+    const auto& last { segments.back() };
+    const auto scan { ScanSegment(last, nullptr) };
+    if (!scan.error.empty())
+    {
+      m_error = scan.error;
+      return false;
+    }
+    m_nextSequence = scan.nextSequence;
+    if (scan.validBytes > 0)
+    {
+      m_fd = open(last.path.c_str(), O_WRONLY | O_CLOEXEC);
+      if (m_fd < 0 || ftruncate(m_fd, scan.validBytes) != 0 ||
+          lseek(m_fd, 0, SEEK_END) < 0)
+      {
+        m_error = GetErrnoMessage("Could not reopen", last.path);
+        if (m_fd >= 0)
+          close(m_fd);
+        m_fd = -1;
+        return false;
+      }
+      m_segmentBytes = scan.validBytes;
+    }
+  }
+  // Events that a failing log could not write before it closed are lost
+  m_pending.clear();
+  m_nPending = 0;
+  m_pendingFirst = m_nextSequence;
+  m_durableSequence = m_nextSequence;
+  m_stopping = false;
+  m_writer = std::thread([this]() {
+    NETWORK_MONITOR_TRACE_THREAD_NAME("passenger-event-log");
+    RunWriter();
+  });
+  return true;
+}
+
+std::uint64_t PassengerEventLog::Append(
+  const PassengerEvent& event
+)
+{
+  std::lock_guard<std::mutex> lock { m_mutex };
+  Encode(event);
+  ++m_nPending;
+  if (m_pending.size() >= kMaxPendingBytes)
+    m_wakeWriter.notify_one();
+  return m_nextSequence++;
+}
+
+std::uint64_t PassengerEventLog::Append(
+  const std::vector<PassengerEvent>& events
+)
+{
+  std::lock_guard<std::mutex> lock { m_mutex };
+  const auto first { m_nextSequence };
+  for (const auto& event: events)
+    Encode(event);
+  m_nPending += static_cast<std::uint32_t>(events.size());
+  m_nextSequence += events.size();
+  if (m_pending.size() >= kMaxPendingBytes)
+    m_wakeWriter.notify_one();
+  return first;
+}
+
+bool PassengerEventLog::Flush()
+{
+  std::unique_lock<std::mutex> lock { m_mutex };
+  if (!m_writer.joinable())
+    return m_error.empty() && m_nPending == 0;
+  const auto target { m_nextSequence };
+  const auto nFailedWrites { m_nFailedWrites };
+  m_flushRequested = true;
+  m_wakeWriter.notify_one();
+  m_committed.wait(lock, [this, target, nFailedWrites]() {
+    return m_durableSequence >= target || m_nFailedWrites != nFailedWrites;
+  });
+  return m_durableSequence >= target;
+}
+
+void PassengerEventLog::Close()
+{
+  {
+    std::lock_guard<std::mutex> lock { m_mutex };
+    m_stopping = true;
+  }
+  m_wakeWriter.notify_one();
+  if (m_writer.joinable())
+    m_writer.join();
+  if (m_fd >= 0)
+  {
+    close(m_fd);
+    m_fd = -1;
+  }
+}
+
+std::uint64_t PassengerEventLog::GetNextSequence() const
+{
+  std::lock_guard<std::mutex> lock { m_mutex };
+  return m_nextSequence;
+}
+
+std::uint64_t PassengerEventLog::GetDurableSequence() const
+{
+  std::lock_guard<std::mutex> lock { m_mutex };
+  return m_durableSequence;
+}
+
+std::string PassengerEventLog::GetError() const
+{
+  std::lock_guard<std::mutex> lock { m_mutex };
+  return m_error;
+}
+
+const std::filesystem::path& PassengerEventLog::GetDirectory() const
+{
+  return m_options.directory;
+}
+
+// PassengerEventLog - Private methods
+
+void PassengerEventLog::Encode(
+  const PassengerEvent& event
+)
+{
+  const auto timestamp {
+    event.timestamp == std::chrono::system_clock::time_point {} ?
+      std::chrono::system_clock::now() : event.timestamp
+  };
+  const auto idSize {
+    std::min<std::size_t>(event.stationId.size(), 0xffff)
+  };
+  char fields[11] {};
+  fields[0] = event.type == PassengerEvent::Type::In ? 0 : 1;
+  StoreLittleEndian(fields + 1, static_cast<std::int64_t>(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(
+      timestamp.time_since_epoch()
+    ).count()
+  ));
+  StoreLittleEndian(fields + 9, static_cast<std::uint16_t>(idSize));
+  m_pending.append(fields, sizeof(fields));
+  m_pending.append(event.stationId, 0, idSize);
+}
+
+void PassengerEventLog::RunWriter()
+{
+  std::string payload {};
+  bool failed {false};
+  std::unique_lock<std::mutex> lock { m_mutex };
+  while (true)
+  {
+    // After a failed write, only retry every commit interval, even if the
+    //  pending events pile up
+    m_wakeWriter.wait_for(lock, m_options.commitInterval, [this, failed]() {
+      return m_stopping || m_flushRequested ||
+             (!failed && m_pending.size() >= kMaxPendingBytes);
+    });
+    m_flushRequested = false;
+    if (m_nPending > 0)
+    {
+      // Swap the buffers, so that the appends go on while we write
+      payload.clear();
+      payload.swap(m_pending);
+      const auto first { m_pendingFirst };
+      const auto nEvents { m_nPending };
+      m_nPending = 0;
+      lock.unlock();
+
+      NETWORK_MONITOR_TRACE_SCOPE("passenger-event-log", "commit");
+      std::string error {};
+      failed = !WriteBatch(payload, first, nEvents, error);
+
+      lock.lock();
+      if (!failed)
+      {
+        m_pendingFirst = first + nEvents;
+        m_durableSequence = m_pendingFirst;
+      }
+      else
+      {
+        // Put the events back in front of the ones appended since: The
+        //  next record must start at the first event that is not on disk
+        payload += m_pending;
+        m_pending.swap(payload);
+        m_nPending += nEvents;
+        m_error = error;
+        ++m_nFailedWrites;
+      }
+    }
+    m_committed.notify_all();
+
+    // Give up on the events we cannot write once we are asked to stop
+    if (m_stopping && (m_nPending == 0 || failed))
+      break;
+  }
+}
+
+bool PassengerEventLog::WriteBatch(
+  const std::string& payload,
+  std::uint64_t firstSequence,
+  std::uint32_t nEvents,
+  std::string& error
+)
+{
+  const auto recordSize { kBatchHeaderSize + payload.size() };
+  if (m_fd < 0 || (m_segmentBytes > kSegmentHeaderSize &&
+                   m_segmentBytes + recordSize > m_options.segmentSize))
+  {
+    if (!StartSegment(firstSequence, error))
+      return false;
+  }
+
+  // The CRC covers the end of the header and the payload
+  std::string covered {};
+  AppendLittleEndian(covered, firstSequence);
+  AppendLittleEndian(covered, nEvents);
+  auto crc { crc32(0L, reinterpret_cast<const Bytef*>(covered.data()),
+                   static_cast<uInt>(covered.size())) };
+  crc = crc32(crc, reinterpret_cast<const Bytef*>(payload.data()),
+              static_cast<uInt>(payload.size()));
+  std::string header {};
+  AppendLittleEndian(header, static_cast<std::uint32_t>(payload.size()));
+  AppendLittleEndian(header, static_cast<std::uint32_t>(crc));
+  header += covered;
+
+  if (!WriteAll(m_fd, header.data(), header.size()) ||
+      !WriteAll(m_fd, payload.data(), payload.size()) ||
+      (m_options.sync && fdatasync(m_fd) != 0))
+  {
+    error = GetErrnoMessage("Could not write to", m_options.directory);
+
+    // Cut off what we wrote of the record, so that the next one follows
+    //  the last valid record
+    if (ftruncate(m_fd, m_segmentBytes) != 0 ||
+        lseek(m_fd, 0, SEEK_END) < 0)
+    {
+      close(m_fd);
+      m_fd = -1;
+    }
+    return false;
+  }
+  m_segmentBytes += recordSize;
+  return true;
+}
+
+bool PassengerEventLog::StartSegment(
+  std::uint64_t firstSequence,
+  std::string& error
+)
+{
+  if (m_fd >= 0)
+  {
+    close(m_fd);
+    m_fd = -1;
+  }
+  const auto path { m_options.directory / GetSegmentName(firstSequence) };
+  m_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (m_fd < 0)
+  {
+    error = GetErrnoMessage("Could not create", path);
+    return false;
+  }
+  std::string header { kSegmentMagic };
+  AppendLittleEndian(header, firstSequence);
+  if (!WriteAll(m_fd, header.data(), header.size()) ||
+      (m_options.sync &&
+       (fdatasync(m_fd) != 0 || !SyncDirectory(m_options.directory))))
+  {
+    error = GetErrnoMessage("Could not write to", path);
+    close(m_fd);
+    m_fd = -1;
+    return false;
+  }
+  m_segmentBytes = kSegmentHeaderSize;
+  return true;
+}
+
+// PassengerCheckpointer - Public methods
+
+PassengerCheckpointer::PassengerCheckpointer(
+  const PassengerCheckpointOptions& options,
+  const TransportNetwork& network,
+  PassengerEventLog& log
+) : m_options { options }
+  , m_network { network }
+  , m_log { log }
+{
+}
+
+PassengerCheckpointer::~PassengerCheckpointer()
+{
+  Stop();
+}
+
+void PassengerCheckpointer::Start()
+{
+  std::lock_guard<std::mutex> lock { m_mutex };
+  if (m_thread.joinable())
+    return;
+  m_stopping = false;
+  m_thread = std::thread([this]() {
+    NETWORK_MONITOR_TRACE_THREAD_NAME("passenger-checkpoint");
+    Run();
+  });
+}
+
+void PassengerCheckpointer::Stop()
+{
+  {
+    std::lock_guard<std::mutex> lock { m_mutex };
+    m_stopping = true;
+  }
+  m_wake.notify_one();
+  if (m_thread.joinable())
+    m_thread.join();
+}
+
+PassengerCheckpoint PassengerCheckpointer::GetLastCheckpoint() const
+{
+  std::lock_guard<std::mutex> lock { m_mutex };
+  return m_lastCheckpoint;
+}
+
+// PassengerCheckpointer - Private methods
+
+void PassengerCheckpointer::Run()
+{
+  std::unique_lock<std::mutex> lock { m_mutex };
+  while (!m_wake.wait_for(lock, m_options.interval,
+                          [this]() { return m_stopping; }))
+  {
+    lock.unlock();
+    auto checkpoint { WritePassengerCheckpoint(m_network, m_log,
+                                               m_options.sync) };
+    lock.lock();
+    m_lastCheckpoint = std::move(checkpoint);
+  }
+}
+
+// Public functions
+
+PassengerEventLogReplay NetworkMonitor::ReplayPassengerEventLog(
+  const std::filesystem::path& directory,
+  TransportNetwork& network,
+  std::uint64_t fromSequence
+)
+{
+  NETWORK_MONITOR_TRACE_SCOPE("passenger-event-log", "Replay");
+  PassengerEventLogReplay replay {};
+  replay.nextSequence = fromSequence;
+  std::error_code ec {};
+  const auto segments { ListSegments(directory, ec) };
+  if (ec)
+  {
+    replay.error = "Could not list " + directory.string() + ": " +
+                   ec.message();
+    return replay;
+  }
+
+  if (!segments.empty() && segments.front().firstSequence > fromSequence)
+  {
+    replay.error = "The log starts at event " +
+                   std::to_string(segments.front().firstSequence) +
+                   ", after event " + std::to_string(fromSequence);
+    return replay;
+  }
+
+  std::vector<PassengerEvent> events {};
+  for (std::size_t idx {0}; idx < segments.size(); ++idx)
+  {
+    // Skip the segments that end before the first event we want
+    const bool isLast { idx + 1 == segments.size() };
+    if (!isLast && segments[idx + 1].firstSequence <= fromSequence)
+      continue;
+
+    ++replay.nSegments;
+    std::string decodeError {};
+    const auto scan { ScanSegment(segments[idx],
+      [&](auto firstSequence, auto nEvents, auto payload, auto size) {
+        const auto endSequence { firstSequence + nEvents };
+        if (endSequence <= fromSequence)
+          return true;
+        if (!DecodeBatch(payload, size, nEvents, events))
+        {
+          decodeError = "Invalid batch record in " +
+                        segments[idx].path.string();
+          return false;
+        }
+        if (firstSequence < fromSequence)
+          events.erase(events.begin(),
+                       events.begin() + (fromSequence - firstSequence));
+        replay.nEvents += events.size();
+        replay.nRecorded += network.RecordPassengerEvents(events);
+        return true;
+      }
+    )};
+    if (!scan.error.empty() || !decodeError.empty())
+    {
+      replay.error = scan.error.empty() ? decodeError : scan.error;
+      break;
+    }
+    replay.nextSequence = std::max(replay.nextSequence, scan.nextSequence);
+    if (scan.torn)
+    {
+      if (!isLast)
+      {
+        replay.error = "Corrupt batch record in " +
+                       segments[idx].path.string();
+        break;
+      }
+      replay.tornTail = true;
+    }
+  }
+  return replay;
+}
+
+PassengerCheckpoint NetworkMonitor::WritePassengerCheckpoint(
+  const TransportNetwork& network,
+  PassengerEventLog& log,
+  bool sync
+)
+{
+  NETWORK_MONITOR_TRACE_SCOPE("passenger-event-log", "WriteCheckpoint");
+  PassengerCheckpoint checkpoint {};
+  const auto snapshot { network.SnapshotPassengerCounts() };
+  checkpoint.sequence = snapshot.sequence;
+  checkpoint.nStations = snapshot.counts.size();
+
+  // The log must keep the events after the checkpoint before we remove the
+  //  ones before it
+  if (!log.Flush())
+  {
+    checkpoint.error = log.GetError();
+    return checkpoint;
+  }
+  if (log.GetDurableSequence() < snapshot.sequence)
+  {
+    checkpoint.error = "The network recorded events that are not in the log";
+    return checkpoint;
+  }
+
+  const auto& directory { log.GetDirectory() };
+  const auto data { EncodeCheckpoint(snapshot) };
+  checkpoint.nBytes = data.size();
+  const auto temporary { directory / "checkpoint.tmp" };
+  const auto path { directory / GetCheckpointName(snapshot.sequence) };
+  const int fd {
+    open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)
+  };
+  if (fd < 0)
+  {
+    checkpoint.error = GetErrnoMessage("Could not create", temporary);
+    return checkpoint;
+  }
+  const bool written {
+    WriteAll(fd, data.data(), data.size()) && (!sync || fsync(fd) == 0)
+  };
+  close(fd);
+  if (!written || std::rename(temporary.c_str(), path.c_str()) != 0 ||
+      (sync && !SyncDirectory(directory)))
+  {
+    checkpoint.error = GetErrnoMessage("Could not write", path);
+    return checkpoint;
+  }
+
+  // Reclaim the older checkpoints, and the segments that only hold events
+  //  before this one. The log only appends to its last segment, which we
+  //  never remove.
+  std::error_code ec {};
+  for (const auto& older: ListCheckpoints(directory, ec))
+  {
+    if (older.firstSequence < snapshot.sequence)
+      std::filesystem::remove(older.path, ec);
+  }
+  const auto segments { ListSegments(directory, ec) };
+  for (std::size_t idx {0}; idx + 1 < segments.size(); ++idx)
+  {
+    if (segments[idx + 1].firstSequence > snapshot.sequence)
+      break;
+    if (std::filesystem::remove(segments[idx].path, ec))
+      ++checkpoint.nSegmentsRemoved;
+  }
+  return checkpoint;
+}
+
+PassengerRecovery NetworkMonitor::RecoverPassengerCounts(
+  const std::filesystem::path& directory,
+  TransportNetwork& network
+)
+{
+  NETWORK_MONITOR_TRACE_SCOPE("passenger-event-log", "Recover");
+  PassengerRecovery recovery {};
+  std::error_code ec {};
+  const auto checkpoints { ListCheckpoints(directory, ec) };
+  if (ec)
+  {
+    recovery.error = "Could not list " + directory.string() + ": " +
+                     ec.message();
+    return recovery;
+  }
+
+  // The log before the latest checkpoint may be gone: Without it, we cannot
+  //  fall back to an older one
+  if (!checkpoints.empty())
+  {
+    PassengerCountSnapshot snapshot {};
+    if (!LoadCheckpoint(checkpoints.back(), snapshot, recovery.error))
+      return recovery;
+    recovery.checkpointLoaded = true;
+    recovery.checkpointSequence = snapshot.sequence;
+    recovery.nStationsRestored = network.RestorePassengerCounts(snapshot);
+  }
+  recovery.replay = ReplayPassengerEventLog(directory, network,
+                                            recovery.checkpointSequence);
+  recovery.error = recovery.replay.error;
+  return recovery;
+}
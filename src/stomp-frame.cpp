@@ -0,0 +1,254 @@
+#include <network-monitor/stomp-frame.h>
+
+#include <array>
+#include <charconv>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using NetworkMonitor::StompCommand;
+using NetworkMonitor::StompFrame;
+
+// Static functions
+
+static constexpr std::array<std::pair<StompCommand, std::string_view>, 15>
+  kCommands {{
+    { StompCommand::Abort,       "ABORT" },
+    { StompCommand::Ack,         "ACK" },
+    { StompCommand::Begin,       "BEGIN" },
+    { StompCommand::Commit,      "COMMIT" },
+    { StompCommand::Connect,     "CONNECT" },
+    { StompCommand::Connected,   "CONNECTED" },
+    { StompCommand::Disconnect,  "DISCONNECT" },
+    { StompCommand::Error,       "ERROR" },
+    { StompCommand::Message,     "MESSAGE" },
+    { StompCommand::Nack,        "NACK" },
+    { StompCommand::Receipt,     "RECEIPT" },
+    { StompCommand::Send,        "SEND" },
+    { StompCommand::Stomp,       "STOMP" },
+    { StompCommand::Subscribe,   "SUBSCRIBE" },
+    { StompCommand::Unsubscribe, "UNSUBSCRIBE" },
+  }};
+
+// The CONNECT and CONNECTED frames do not escape their headers, for backward
+//  compatibility with STOMP 1.0.
+static bool UsesHeaderEscaping(StompCommand command)
+{
+  return command != StompCommand::Connect &&
+         command != StompCommand::Connected;
+}
+
+// Read a line up to LF, dropping an optional trailing CR.
+// Returns false if there is no LF left.
+static bool ReadLine(std::string_view& src, std::string_view& line)
+{
+  const auto lf { src.find('\n') };
+  if (lf == std::string_view::npos)
+    return false;
+
+  line = src.substr(0, lf);
+  if (!line.empty() && line.back() == '\r')
+    line.remove_suffix(1);
+  src.remove_prefix(lf + 1);
+  return true;
+}
+
+static bool Unescape(std::string_view src, std::string& dst)
+{
+  dst.clear();
+  dst.reserve(src.size());
+  for (std::size_t idx {0}; idx < src.size(); ++idx)
+  {
+    if (src[idx] != '\\')
+    {
+      dst.push_back(src[idx]);
+      continue;
+    }
+
+    // Undefined escape sequences are a fatal protocol error
+    if (++idx == src.size())
+      return false;
+    switch (src[idx])
+    {
+    case 'r': dst.push_back('\r'); break;
+    case 'n': dst.push_back('\n'); break;
+    case 'c': dst.push_back(':'); break;
+    case '\\': dst.push_back('\\'); break;
+    default: return false;
+    }
+  }
+  return true;
+}
+
+static void AppendEscaped(std::string_view src, std::string& dst)
+{
+  for (const char c: src)
+  {
+    switch (c)
+    {
+    case '\r': dst += "\\r"; break;
+    case '\n': dst += "\\n"; break;
+    case ':': dst += "\\c"; break;
+    case '\\': dst += "\\\\"; break;
+    default: dst.push_back(c); break;
+    }
+  }
+}
+
+// Public functions
+
+std::string_view NetworkMonitor::ToString(
+  StompCommand command
+)
+{
+  for (const auto& [value, name]: kCommands)
+  {
+    if (value == command)
+      return name;
+  }
+  return {};
+}
+
+StompCommand NetworkMonitor::ToStompCommand(
+  std::string_view command
+)
+{
+  for (const auto& [value, name]: kCommands)
+  {
+    if (name == command)
+      return value;
+  }
+  return StompCommand::Unknown;
+}
+
+std::string_view StompFrame::GetHeader(
+  std::string_view name
+) const
+{
+  for (const auto& [key, value]: headers)
+  {
+    if (key == name)
+      return value;
+  }
+  return {};
+}
+
+bool StompFrame::HasHeader(
+  std::string_view name
+) const
+{
+  for (const auto& [key, value]: headers)
+  {
+    if (key == name)
+      return true;
+  }
+  return false;
+}
+
+bool NetworkMonitor::ParseStompFrame(
+  std::string_view src,
+  StompFrame& frame
+)
+{
+  frame = {};
+
+  // Command
+  std::string_view line {};
+  if (!ReadLine(src, line))
+    return false;
+  frame.command = ToStompCommand(line);
+  if (frame.command == StompCommand::Unknown)
+    return false;
+
+  // Headers, up to an empty line
+  const bool escaping { UsesHeaderEscaping(frame.command) };
+  while (true)
+  {
+    if (!ReadLine(src, line))
+      return false;
+    if (line.empty())
+      break;
+
+    const auto colon { line.find(':') };
+    if (colon == std::string_view::npos || colon == 0)
+      return false;
+
+    std::string key {};
+    std::string value {};
+    if (escaping)
+    {
+      if (!Unescape(line.substr(0, colon), key) ||
+          !Unescape(line.substr(colon + 1), value))
+        return false;
+    }
+    else
+    {
+      key = line.substr(0, colon);
+      value = line.substr(colon + 1);
+    }
+    frame.headers.emplace_back(std::move(key), std::move(value));
+  }
+
+  // Body
+  const auto contentLength { frame.GetHeader("content-length") };
+  std::size_t bodyLength { 0 };
+  if (!contentLength.empty())
+  {
+    const auto [end, ec] = std::from_chars(
+      contentLength.data(),
+      contentLength.data() + contentLength.size(),
+      bodyLength
+    );
+    if (ec != std::errc {} ||
+        end != contentLength.data() + contentLength.size())
+      return false;
+
+    // The body must be followed by the NULL octet
+    if (bodyLength >= src.size() || src[bodyLength] != '\0')
+      return false;
+  }
+  else
+  {
+    bodyLength = src.find('\0');
+    if (bodyLength == std::string_view::npos)
+      return false;
+  }
+  frame.body = src.substr(0, bodyLength);
+  src.remove_prefix(bodyLength + 1);
+
+  // Only end-of-line characters can follow the NULL octet
+  return src.find_first_not_of("\r\n") == std::string_view::npos;
+}
+
+std::string NetworkMonitor::SerializeStompFrame(
+  const StompFrame& frame
+)
+{
+  const bool escaping { UsesHeaderEscaping(frame.command) };
+
+  std::string serialized {};
+  serialized.reserve(64 + frame.body.size());
+  serialized += ToString(frame.command);
+  serialized.push_back('\n');
+  for (const auto& [key, value]: frame.headers)
+  {
+    if (escaping)
+    {
+      AppendEscaped(key, serialized);
+      serialized.push_back(':');
+      AppendEscaped(value, serialized);
+    }
+    else
+    {
+      serialized += key;
+      serialized.push_back(':');
+      serialized += value;
+    }
+    serialized.push_back('\n');
+  }
+  serialized.push_back('\n');
+  serialized += frame.body;
+  serialized.push_back('\0');
+  return serialized;
+}
@@ -0,0 +1,65 @@
+#include <network-monitor/tls-session-cache.h>
+
+#include <openssl/ssl.h>
+
+#include <mutex>
+#include <string>
+
+using NetworkMonitor::TlsSessionCache;
+
+// Public methods
+
+TlsSessionCache::TlsSessionCache() = default;
+
+TlsSessionCache::~TlsSessionCache() = default;
+
+bool TlsSessionCache::Apply(
+  const std::string& key,
+  SSL* ssl
+) const
+{
+  std::lock_guard<std::mutex> lock { m_mutex };
+  auto sessionIt { m_sessions.find(key) };
+  if (sessionIt == m_sessions.end())
+    return false;
+
+  // SSL_set_session takes its own reference to the session, so the cache can
+  //  replace or drop its copy while the connection is still using it.
+  return SSL_set_session(ssl, sessionIt->second.get()) == 1;
+}
+
+bool TlsSessionCache::Save(
+  const std::string& key,
+  SSL* ssl
+)
+{
+  // SSL_get1_session increments the reference count: We own the result.
+  SessionPtr session { SSL_get1_session(ssl) };
+  if (session == nullptr || SSL_SESSION_is_resumable(session.get()) != 1)
+    return false;
+
+  std::lock_guard<std::mutex> lock { m_mutex };
+  m_sessions[key] = std::move(session);
+  return true;
+}
+
+void TlsSessionCache::Erase(
+  const std::string& key
+)
+{
+  std::lock_guard<std::mutex> lock { m_mutex };
+  m_sessions.erase(key);
+}
+
+std::size_t TlsSessionCache::Size() const
+{
+  std::lock_guard<std::mutex> lock { m_mutex };
+  return m_sessions.size();
+}
+
+// Private methods
+
+void TlsSessionCache::SessionDeleter::operator()(SSL_SESSION* session) const
+{
+  SSL_SESSION_free(session);
+}
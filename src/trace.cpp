@@ -0,0 +1,192 @@
+#include <network-monitor/trace.h>
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+using NetworkMonitor::TraceEvent;
+using NetworkMonitor::TraceRecorder;
+
+// Buffer of the calling thread in the recorder
+thread_local void* tTraceBuffer {nullptr};
+
+// Public methods
+
+void TraceRecorder::Record(
+  const char* category,
+  const char* name,
+  std::chrono::steady_clock::time_point start,
+  std::chrono::steady_clock::time_point end
+)
+{
+  auto& buffer { GetBuffer() };
+  const auto index { buffer.head.load(std::memory_order_relaxed) };
+  auto& slot { buffer.slots[index % kCapacity] };
+
+  slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.category.store(category, std::memory_order_relaxed);
+  slot.name.store(name, std::memory_order_relaxed);
+  slot.start.store(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(
+      start.time_since_epoch()
+    ).count(),
+    std::memory_order_relaxed
+  );
+  slot.duration.store(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(),
+    std::memory_order_relaxed
+  );
+  slot.sequence.store(2 * index + 2, std::memory_order_release);
+  buffer.head.store(index + 1, std::memory_order_release);
+}
+
+void TraceRecorder::SetThreadName(
+  const std::string& name
+)
+{
+  auto& buffer { GetBuffer() };
+  std::lock_guard<std::mutex> lock { m_mutex };
+  buffer.threadName = name;
+}
+
+std::vector<TraceEvent> TraceRecorder::Snapshot() const
+{
+  std::vector<TraceEvent> events {};
+  std::lock_guard<std::mutex> lock { m_mutex };
+  for (const auto& buffer: m_buffers)
+  {
+    const auto head { buffer->head.load(std::memory_order_acquire) };
+    const auto first { std::max(
+      buffer->clearedAt.load(std::memory_order_relaxed),
+      head > kCapacity ? head - kCapacity : 0
+    )};
+    for (auto index { first }; index < head; ++index)
+    {
+      const auto& slot { buffer->slots[index % kCapacity] };
+      const auto sequence { slot.sequence.load(std::memory_order_acquire) };
+      if (sequence != 2 * index + 2)
+        continue;
+
+      TraceEvent event {};
+      event.category = slot.category.load(std::memory_order_relaxed);
+      event.name = slot.name.load(std::memory_order_relaxed);
+      event.threadId = buffer->threadId;
+      event.start = slot.start.load(std::memory_order_relaxed);
+      event.duration = slot.duration.load(std::memory_order_relaxed);
+
+      // The owning thread wrapped around and overwrote the slot meanwhile
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.sequence.load(std::memory_order_relaxed) != sequence)
+        continue;
+      events.push_back(event);
+    }
+  }
+  std::sort(events.begin(), events.end(),
+    [](const auto& a, const auto& b) { return a.start < b.start; }
+  );
+  return events;
+}
+
+void TraceRecorder::Clear()
+{
+  std::lock_guard<std::mutex> lock { m_mutex };
+  for (auto& buffer: m_buffers)
+  {
+    buffer->clearedAt.store(buffer->head.load(std::memory_order_acquire),
+                            std::memory_order_relaxed);
+  }
+}
+
+void TraceRecorder::WriteChromeTrace(
+  std::ostream& out
+) const
+{
+  auto traceEvents = nlohmann::json::array();
+  traceEvents.push_back({
+    {"name", "process_name"},
+    {"ph", "M"},
+    {"pid", 1},
+    {"args", {{"name", "network-monitor"}}},
+  });
+  {
+    std::lock_guard<std::mutex> lock { m_mutex };
+    for (const auto& buffer: m_buffers)
+    {
+      traceEvents.push_back({
+        {"name", "thread_name"},
+        {"ph", "M"},
+        {"pid", 1},
+        {"tid", buffer->threadId},
+        {"args", {{"name", buffer->threadName.empty() ?
+          "thread " + std::to_string(buffer->threadId) : buffer->threadName
+        }}},
+      });
+    }
+  }
+
+  // Complete events, with times in microseconds
+  for (const auto& event: Snapshot())
+  {
+    traceEvents.push_back({
+      {"name", event.name},
+      {"cat", event.category},
+      {"ph", "X"},
+      {"ts", static_cast<double>(event.start) / 1000.0},
+      {"dur", static_cast<double>(event.duration) / 1000.0},
+      {"pid", 1},
+      {"tid", event.threadId},
+    });
+  }
+  out << nlohmann::json {
+    {"displayTimeUnit", "ns"},
+    {"traceEvents", std::move(traceEvents)},
+  }.dump() << '\n';
+}
+
+bool TraceRecorder::WriteChromeTrace(
+  const std::filesystem::path& destination
+) const
+{
+  std::ofstream file { destination };
+  WriteChromeTrace(file);
+  return static_cast<bool>(file);
+}
+
+// Private methods
+
+TraceRecorder::TraceRecorder() = default;
+
+TraceRecorder::Buffer& TraceRecorder::GetBuffer()
+{
+  if (tTraceBuffer != nullptr)
+    return *static_cast<Buffer*>(tTraceBuffer);
+
+  auto buffer { std::make_unique<Buffer>() };
+  auto& added { *buffer };
+  {
+    std::lock_guard<std::mutex> lock { m_mutex };
+    added.threadId = static_cast<std::uint32_t>(m_buffers.size());
+    m_buffers.push_back(std::move(buffer));
+  }
+  tTraceBuffer = &added;
+  return added;
+}
+
+// Public functions
+
+TraceRecorder& NetworkMonitor::GetTraceRecorder()
+{
+  static TraceRecorder recorder {};
+  return recorder;
+}
@@ -1,16 +1,1278 @@
 #include <network-monitor/transport-network.h>
+#include <network-monitor/metrics.h>
+#include <network-monitor/trace.h>
 
 #include <nlohmann/json.hpp>
 
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
-using NetworkMonitor::TransportNetwork;
-using NetworkMonitor::Id;
-using NetworkMonitor::Station;
-using NetworkMonitor::Route;
-using NetworkMonitor::Line;
-using NetworkMonitor::PassengerEvent;
+using NetworkMonitor::TransportNetwork;
+using NetworkMonitor::AlternativeJourneyOptions;
+using NetworkMonitor::Id;
+using NetworkMonitor::InterchangePenalties;
+using NetworkMonitor::Journey;
+using NetworkMonitor::JourneyLeg;
+using NetworkMonitor::JourneyOptions;
+using NetworkMonitor::Station;
+using NetworkMonitor::Route;
+using NetworkMonitor::Line;
+using NetworkMonitor::PassengerCountSnapshot;
+using NetworkMonitor::PassengerEvent;
+using NetworkMonitor::PassengerFlow;
+using NetworkMonitor::PassengerFlowOptions;
+using NetworkMonitor::StationPassengerCount;
+using NetworkMonitor::TransportNetworkMemoryUsage;
+
+// Static functions
+
+// Single-writer update: Passenger events for the network are recorded from one
+//  thread at a time, so a relaxed load and store is enough for readers on
+//  other threads and avoids a locked read-modify-write on the hot path.
+static void AddPassengers(
+  std::atomic<long long int>& count,
+  long long int delta
+)
+{
+  count.store(count.load(std::memory_order_relaxed) + delta,
+              std::memory_order_relaxed);
+}
+
+// Save a value before its first change in a snapshot epoch. Only the
+//  recording thread calls this, right before it changes the value: The
+//  release fence orders the saved value before that change.
+template <typename T>
+static void SaveForSnapshot(
+  const std::atomic<T>& current,
+  std::atomic<T>& saved,
+  std::atomic<std::uint64_t>& savedEpoch,
+  std::uint64_t epoch
+)
+{
+  if (savedEpoch.load(std::memory_order_relaxed) == epoch)
+    return;
+  saved.store(current.load(std::memory_order_relaxed),
+              std::memory_order_relaxed);
+  savedEpoch.store(epoch, std::memory_order_release);
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+// Read a value as it was when a snapshot epoch started. If we read a change
+//  made in the epoch, the fences make sure that we also see the saved value.
+template <typename T>
+static T ReadForSnapshot(
+  const std::atomic<T>& current,
+  const std::atomic<T>& saved,
+  const std::atomic<std::uint64_t>& savedEpoch,
+  std::uint64_t epoch
+)
+{
+  const auto value { current.load(std::memory_order_relaxed) };
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (savedEpoch.load(std::memory_order_acquire) == epoch)
+    return saved.load(std::memory_order_relaxed);
+  return value;
+}
+
+// Time of the events that come without one. The buckets are at least one
+//  second wide, so the coarse clock is precise enough, and it is several times
+//  cheaper to read than the regular one.
+static std::chrono::system_clock::time_point GetEventTime()
+{
+#if defined(CLOCK_REALTIME_COARSE)
+  timespec now {};
+  if (clock_gettime(CLOCK_REALTIME_COARSE, &now) == 0)
+  {
+    return std::chrono::system_clock::time_point {
+      std::chrono::duration_cast<std::chrono::system_clock::duration>(
+        std::chrono::seconds {now.tv_sec} +
+        std::chrono::nanoseconds {now.tv_nsec}
+      )
+    };
+  }
+#endif
+  return std::chrono::system_clock::now();
+}
+
+// glibc malloc adds an 8-byte header to each request and rounds it up to a
+//  multiple of 16, with a minimum chunk of 32 bytes
+static std::size_t GetMallocChunk(std::size_t bytes)
+{
+  return std::max<std::size_t>(32, (bytes + 8 + 15) / 16 * 16);
+}
+
+// Count one heap allocation in a category
+static void AddAllocation(
+  TransportNetworkMemoryUsage& usage,
+  std::size_t& category,
+  std::size_t bytes
+)
+{
+  if (bytes == 0)
+    return;
+  category += bytes;
+  usage.allocator += GetMallocChunk(bytes) - bytes;
+  ++usage.nAllocations;
+}
+
+// make_shared allocates the control block (a vtable pointer and two
+//  reference counts) and the object together
+template <typename T>
+static std::size_t GetSharedAllocation()
+{
+  return sizeof(void*) + 2 * sizeof(int) + sizeof(T);
+}
+
+// Strings up to the small string capacity live inside the string object
+static std::size_t GetStringHeap(const std::string& value)
+{
+  static const std::size_t smallCapacity { std::string {}.capacity() };
+  return value.capacity() > smallCapacity ? value.capacity() + 1 : 0;
+}
+
+// Count the nodes and buckets of a map keyed by ID
+template <typename Map>
+static void AddMap(
+  TransportNetworkMemoryUsage& usage,
+  const Map& map
+)
+{
+  // Each node holds the next node pointer, the key-value pair and the cached
+  //  hash of the key
+  for (const auto& [key, value]: map)
+  {
+    AddAllocation(usage, usage.maps, sizeof(void*) +
+                  sizeof(typename Map::value_type) + sizeof(std::size_t));
+    AddAllocation(usage, usage.ids, GetStringHeap(key));
+  }
+
+  // A map with a single bucket keeps it inside the map object
+  if (map.bucket_count() > 1)
+    AddAllocation(usage, usage.maps, map.bucket_count() * sizeof(void*));
+}
+
+namespace {
+
+// SAX handler that builds a TransportNetwork while the JSON source is parsed
+// Only the record being parsed is kept in memory, plus any line or travel
+// time that arrives before the records it refers to.
+class NetworkBuilder : public nlohmann::json_sax<nlohmann::json>
+{
+public:
+  explicit NetworkBuilder(
+    TransportNetwork& network
+  ) : m_network { network }
+  {
+  }
+
+  // Call after parsing: Adds what was held back and reports the travel times
+  bool Finish()
+  {
+    if (!m_stationsDone || !m_linesDone || !m_travelTimesDone)
+      throw std::runtime_error("Missing network section");
+    return m_ok;
+  }
+
+  bool null() override
+  {
+    return true;
+  }
+
+  bool boolean(bool) override
+  {
+    return true;
+  }
+
+  bool number_integer(number_integer_t value) override
+  {
+    if (value >= 0)
+      return number_unsigned(static_cast<number_unsigned_t>(value));
+    return true;
+  }
+
+  bool number_unsigned(number_unsigned_t value) override
+  {
+    if (Top() == Context::TravelTime && m_key == "travel_time")
+      m_travelTime.travelTime = static_cast<unsigned int>(value);
+    return true;
+  }
+
+  bool number_float(number_float_t, const string_t&) override
+  {
+    return true;
+  }
+
+  bool string(string_t& value) override
+  {
+    switch (Top())
+    {
+    case Context::Station:
+      if (m_key == "station_id")
+        m_station.id = std::move(value);
+      else if (m_key == "name")
+        m_station.name = std::move(value);
+      break;
+    case Context::Line:
+      if (m_key == "line_id")
+        m_line.id = std::move(value);
+      else if (m_key == "name")
+        m_line.name = std::move(value);
+      break;
+    case Context::Route:
+    {
+      auto& route { m_line.routes.back() };
+      if (m_key == "route_id")
+        route.id = std::move(value);
+      else if (m_key == "direction")
+        route.direction = std::move(value);
+      else if (m_key == "line_id")
+        route.lineId = std::move(value);
+      else if (m_key == "start_station_id")
+        route.startStationId = std::move(value);
+      else if (m_key == "end_station_id")
+        route.endStationId = std::move(value);
+      break;
+    }
+    case Context::RouteStops:
+      m_line.routes.back().stops.push_back(std::move(value));
+      break;
+    case Context::TravelTime:
+      if (m_key == "start_station_id")
+        m_travelTime.stationA = std::move(value);
+      else if (m_key == "end_station_id")
+        m_travelTime.stationB = std::move(value);
+      break;
+    default:
+      break;
+    }
+    return true;
+  }
+
+  bool binary(binary_t&) override
+  {
+    return true;
+  }
+
+  bool start_object(std::size_t) override
+  {
+    Context context { Context::Skip };
+    switch (Top())
+    {
+    case Context::None:
+      context = m_contexts.empty() ? Context::Root : Context::Skip;
+      break;
+    case Context::Stations:
+      context = Context::Station;
+      m_station = {};
+      break;
+    case Context::Lines:
+      context = Context::Line;
+      m_line = {};
+      break;
+    case Context::Routes:
+      context = Context::Route;
+      m_line.routes.emplace_back();
+      break;
+    case Context::TravelTimes:
+      context = Context::TravelTime;
+      m_travelTime = {};
+      break;
+    default:
+      break;
+    }
+    m_contexts.push_back(context);
+    return true;
+  }
+
+  bool end_object() override
+  {
+    const auto context { Top() };
+    m_contexts.pop_back();
+    switch (context)
+    {
+    case Context::Station:
+      if (!m_network.AddStation(m_station))
+        throw std::runtime_error("Could not add station " + m_station.id);
+      break;
+    case Context::Line:
+      if (m_stationsDone)
+        AddLine(m_line);
+      else
+        m_pendingLines.push_back(std::move(m_line));
+      break;
+    case Context::TravelTime:
+      if (m_stationsDone && m_linesDone)
+        SetTravelTime(m_travelTime);
+      else
+        m_pendingTravelTimes.push_back(std::move(m_travelTime));
+      break;
+    default:
+      break;
+    }
+    return true;
+  }
+
+  bool start_array(std::size_t) override
+  {
+    Context context { Context::Skip };
+    if (Top() == Context::Root)
+    {
+      m_phaseStartedAt = std::chrono::steady_clock::now();
+      if (m_key == "stations")
+        context = Context::Stations;
+      else if (m_key == "lines")
+        context = Context::Lines;
+      else if (m_key == "travel_times")
+        context = Context::TravelTimes;
+    }
+    else if (Top() == Context::Line && m_key == "routes")
+    {
+      context = Context::Routes;
+    }
+    else if (Top() == Context::Route && m_key == "route_stops")
+    {
+      context = Context::RouteStops;
+    }
+    m_contexts.push_back(context);
+    return true;
+  }
+
+  bool end_array() override
+  {
+    const auto context { Top() };
+    m_contexts.pop_back();
+    switch (context)
+    {
+    case Context::Stations:
+      m_stationsDone = true;
+      for (const auto& line: m_pendingLines)
+        AddLine(line);
+      m_pendingLines.clear();
+      break;
+    case Context::Lines:
+      m_linesDone = true;
+      break;
+    case Context::TravelTimes:
+      m_travelTimesDone = true;
+      break;
+    default:
+      return true;
+    }
+
+    if (m_stationsDone && m_linesDone)
+    {
+      for (const auto& travelTime: m_pendingTravelTimes)
+        SetTravelTime(travelTime);
+      m_pendingTravelTimes.clear();
+    }
+
+    // Each phase spans the parsing of its section, plus the records that
+    //  waited for it
+    switch (context)
+    {
+    case Context::Stations:
+      NETWORK_MONITOR_TRACE_SINCE("transport-network", "FromJson/stations",
+                                  m_phaseStartedAt);
+      break;
+    case Context::Lines:
+      NETWORK_MONITOR_TRACE_SINCE("transport-network", "FromJson/lines",
+                                  m_phaseStartedAt);
+      break;
+    default:
+      NETWORK_MONITOR_TRACE_SINCE("transport-network",
+                                  "FromJson/travel_times", m_phaseStartedAt);
+      break;
+    }
+    return true;
+  }
+
+  bool key(string_t& value) override
+  {
+    m_key = std::move(value);
+    return true;
+  }
+
+  bool parse_error(
+    std::size_t,
+    const std::string&,
+    const nlohmann::detail::exception& ex
+  ) override
+  {
+    // Same behavior as nlohmann::json::parse
+    throw ex;
+  }
+
+private:
+  enum class Context
+  {
+    None,
+    Root,
+    Stations,
+    Station,
+    Lines,
+    Line,
+    Routes,
+    Route,
+    RouteStops,
+    TravelTimes,
+    TravelTime,
+    Skip,
+  };
+
+  struct TravelTime
+  {
+    NetworkMonitor::Id stationA {};
+    NetworkMonitor::Id stationB {};
+    unsigned int travelTime {0};
+  };
+
+  TransportNetwork& m_network;
+  std::vector<Context> m_contexts {};
+  std::string m_key {};
+
+  Station m_station {};
+  Line m_line {};
+  TravelTime m_travelTime {};
+
+  std::vector<Line> m_pendingLines {};
+  std::vector<TravelTime> m_pendingTravelTimes {};
+  bool m_stationsDone { false };
+  bool m_linesDone { false };
+  bool m_travelTimesDone { false };
+  bool m_ok { true };
+
+  // Start of the top-level section being parsed, for the trace spans
+  std::chrono::steady_clock::time_point m_phaseStartedAt {};
+
+  Context Top() const
+  {
+    return m_contexts.empty() ? Context::None : m_contexts.back();
+  }
+
+  void AddLine(const Line& line)
+  {
+    if (!m_network.AddLine(line))
+      throw std::runtime_error("Could not add line " + line.id);
+  }
+
+  void SetTravelTime(const TravelTime& travelTime)
+  {
+    m_ok &= m_network.SetTravelTime(
+      travelTime.stationA,
+      travelTime.stationB,
+      travelTime.travelTime
+    );
+  }
+};
+
+} // namespace
+
+// Round-based search of the journeys between two stations, for GetJourneys
+//  and GetAlternativeJourneys
+// Round r finds the journeys of r legs: It scans each route that serves a
+//  station labelled in round r - 1 once, from the first of those stations,
+//  boards it at the cheapest of their labels and labels the stops after. A
+//  new label is dropped if a label of the same station, from this round or
+//  an earlier one, is at least as cheap whatever route comes next. The
+//  routes are walked along their flat arrays of stops, and the
+//  per-station arrays are kept between the searches of a thread and reset
+//  through the labels, so a search only touches the stations it reaches.
+// A backward Dijkstra search from the target bounds the travel time left
+//  from each station. Labels and trips that cannot beat the best journey to
+//  the target within that bound are dropped. The backward search only runs
+//  until it reaches the origin, and resumes when a station needs a tighter
+//  bound than the cost of the stations it has yet to settle. Searches to the
+//  same target share it.
+struct TransportNetwork::JourneySearch
+{
+  static constexpr std::uint32_t kNone {
+    std::numeric_limits<std::uint32_t>::max()
+  };
+  static constexpr unsigned int kNoBound {
+    std::numeric_limits<unsigned int>::max()
+  };
+
+  // A ride from a stop of a route to the next one
+  struct Hop
+  {
+    const RouteInternal* route {nullptr};
+    std::uint32_t position {0};
+
+    auto operator<=>(const Hop& other) const = default;
+  };
+
+  struct Label
+  {
+    // The route of the last leg, nullptr for the origin
+    const RouteInternal* route {nullptr};
+    std::uint32_t station {0};
+
+    // Positions in the route of the stops where the last leg starts and ends
+    std::uint32_t boardedAt {0};
+    std::uint32_t position {0};
+
+    // Cost at the station, and when the last leg started
+    unsigned int cost {0};
+    unsigned int boardingCost {0};
+
+    std::uint32_t parent {kNone};
+    std::uint32_t round {0};
+
+    // Next label of the same station, from the same round or an earlier one
+    std::uint32_t next {kNone};
+  };
+
+  struct Candidate
+  {
+    std::vector<Hop> hops {};
+    unsigned int cost {0};
+  };
+
+  std::vector<Label> labels {};
+
+  // Per station: its latest label, and the last round it was marked in
+  std::vector<std::uint32_t> firstLabel {};
+  std::vector<std::uint32_t> markedRound {};
+
+  // Per route: the first stop marked on it in this round
+  std::vector<std::uint32_t> firstStop {};
+
+  // Per station: the travel time to the target found by the backward
+  //  search so far, the hop it starts with, and the stations that have one
+  std::vector<unsigned int> bounds {};
+  std::vector<Hop> boundHops {};
+  std::vector<std::uint32_t> bounded {};
+
+  // The stations the backward search has yet to settle, cheapest first
+  std::vector<std::pair<unsigned int, const GraphNode*>> boundsHeap {};
+
+  std::vector<const GraphNode*> marked {};
+  std::vector<const RouteInternal*> routes {};
+  std::uint32_t target {kNone};
+  std::uint32_t bestLabel {kNone};
+
+  // Labels that cost this much or more are dropped, even before a journey
+  //  reaches the target
+  unsigned int costLimit {kNoBound};
+
+  // Keep every label of the target and go on past the best journey, up to
+  //  the cost of the cheapest loopless one times 1 + maxStretch
+  bool exploring {false};
+  double maxStretch {0.0};
+
+  // Per station, for HasLoop: the last check that visited it
+  std::vector<std::uint32_t> visited {};
+  std::uint32_t visitStamp {0};
+  std::vector<Hop> targetHops {};
+
+  // The interchange penalties, resolved to the network objects
+  unsigned int defaultPenalty {0};
+  std::unordered_map<std::uint32_t, unsigned int> stationPenalties {};
+  std::map<
+    std::pair<const LineInternal*, const LineInternal*>, unsigned int
+  > linePenalties {};
+
+  // How much cheaper a label can make the next route than another label of
+  //  the same station: 0 unless the penalty depends on the arriving line
+  unsigned int penaltySpread {0};
+
+  // The per-station arrays are as large as the largest network the thread
+  //  searched: We only allocate them once.
+  static JourneySearch& GetThreadSearch()
+  {
+    thread_local JourneySearch search {};
+    return search;
+  }
+
+  void Reset(
+    const TransportNetwork& network,
+    const InterchangePenalties& penalties
+  )
+  {
+    ClearLabels();
+    for (const auto station: bounded)
+      bounds[station] = kNoBound;
+    bounded.clear();
+    boundsHeap.clear();
+    if (firstLabel.size() < network.m_stations.size())
+    {
+      firstLabel.resize(network.m_stations.size(), kNone);
+      markedRound.resize(network.m_stations.size(), kNone);
+      bounds.resize(network.m_stations.size(), kNoBound);
+      boundHops.resize(network.m_stations.size());
+      visited.resize(network.m_stations.size(), 0);
+    }
+    if (firstStop.size() < network.m_nRoutes)
+      firstStop.resize(network.m_nRoutes, kNone);
+    target = kNone;
+    costLimit = kNoBound;
+    exploring = false;
+
+    defaultPenalty = penalties.defaultPenalty;
+    stationPenalties.clear();
+    for (const auto& [stationId, penalty]: penalties.stations)
+    {
+      const auto station { network.GetStation(stationId) };
+      if (station != nullptr)
+      {
+        stationPenalties.emplace(static_cast<std::uint32_t>(station->index),
+                                 penalty);
+      }
+    }
+    linePenalties.clear();
+    unsigned int minPenalty { defaultPenalty };
+    unsigned int maxPenalty { defaultPenalty };
+    for (const auto& [linePair, penalty]: penalties.linePairs)
+    {
+      const auto fromLine { network.GetLine(linePair.first) };
+      const auto toLine { network.GetLine(linePair.second) };
+      if (fromLine == nullptr || toLine == nullptr)
+        continue;
+      linePenalties.emplace(std::make_pair(fromLine.get(), toLine.get()),
+                            penalty);
+      minPenalty = std::min(minPenalty, penalty);
+      maxPenalty = std::max(maxPenalty, penalty);
+    }
+    if (!linePenalties.empty())
+    {
+      for (const auto& [_, penalty]: stationPenalties)
+      {
+        minPenalty = std::min(minPenalty, penalty);
+        maxPenalty = std::max(maxPenalty, penalty);
+      }
+    }
+    penaltySpread = maxPenalty - minPenalty;
+  }
+
+  void ClearLabels()
+  {
+    for (const auto& label: labels)
+    {
+      firstLabel[label.station] = kNone;
+      markedRound[label.station] = kNone;
+    }
+    labels.clear();
+    bestLabel = kNone;
+  }
+
+  void SetTarget(
+    const GraphNode& to
+  )
+  {
+    target = static_cast<std::uint32_t>(to.index);
+    StartBounds(to);
+  }
+
+  // Get the label indices of the Pareto front, fewest legs first
+  std::vector<std::uint32_t> Run(
+    const GraphNode& from,
+    std::size_t maxRounds
+  )
+  {
+    const auto origin { static_cast<std::uint32_t>(from.index) };
+    std::vector<std::uint32_t> front {};
+
+    // Without a cost limit, the backward search must reach the origin to
+    //  tell if the target can be reached at all
+    if (costLimit == kNoBound)
+      ExtendBounds(origin, kNoBound);
+    if (!CanImprove(0, origin))
+      return front;
+    labels.push_back(Label {nullptr, origin});
+    firstLabel[origin] = 0;
+    markedRound[origin] = 0;
+    marked.assign(1, &from);
+
+    for (std::uint32_t round {1}; round <= maxRounds && !marked.empty();
+         ++round)
+    {
+      routes.clear();
+      for (const auto* station: marked)
+      {
+        for (const auto& [route, position]: station->routeStops)
+        {
+          auto& first { firstStop[route->index] };
+          if (first == kNone)
+            routes.push_back(route);
+          first = std::min(first, position);
+        }
+      }
+      marked.clear();
+      for (const auto* route: routes)
+      {
+        ScanRoute(*route, firstStop[route->index], round);
+        firstStop[route->index] = kNone;
+      }
+
+      if (bestLabel != kNone && labels[bestLabel].round == round)
+        front.push_back(bestLabel);
+    }
+    return front;
+  }
+
+  // Get up to k journeys, see GetAlternativeJourneys
+  // The search labels every station it can reach within the cost limit. The
+  //  journey of each label, followed by the path of the backward search from
+  //  its station, is a candidate. The candidates are built in the order of
+  //  their lower bound, the cost of the label plus the travel time of that
+  //  path, so a candidate is final once no lower bound left is cheaper.
+  std::vector<std::vector<Hop>> FindAlternatives(
+    const GraphNode& from,
+    const GraphNode& to,
+    std::size_t k,
+    const AlternativeJourneyOptions& options
+  )
+  {
+    std::vector<std::vector<Hop>> accepted {};
+    const auto maxLegs { options.journey.maxTransfers + 1 };
+    SetTarget(to);
+    exploring = true;
+    maxStretch = options.maxStretch;
+    Run(from, maxLegs);
+    exploring = false;
+    if (std::none_of(labels.begin(), labels.end(), [this](const auto& label) {
+          return label.station == target;
+        }))
+    {
+      return accepted;
+    }
+
+    // The labels from before the first journey to the target may be over
+    //  the cost limit, or at stations the backward search did not settle
+    for (const auto& label: labels)
+    {
+      if (label.cost < costLimit)
+        ExtendBounds(label.station, costLimit - label.cost);
+    }
+    std::vector<std::pair<unsigned int, std::uint32_t>> order {};
+    for (std::uint32_t labelIdx {0}; labelIdx < labels.size(); ++labelIdx)
+    {
+      const auto& label { labels[labelIdx] };
+      if (label.cost >= costLimit ||
+          bounds[label.station] >= costLimit - label.cost)
+      {
+        continue;
+      }
+
+      // Stations where the journey already follows the backward path only
+      //  repeat the candidate of the station before, but the journeys to
+      //  the target are all candidates
+      if (label.station != target && label.position > label.boardedAt)
+      {
+        const auto previous { label.route->path[label.position - 1].index };
+        if (previous != target && bounds[previous] != kNoBound &&
+            bounds[previous] == GetBound(previous) &&
+            boundHops[previous] == Hop {label.route, label.position - 1})
+        {
+          continue;
+        }
+      }
+      order.emplace_back(label.cost + bounds[label.station], labelIdx);
+    }
+    std::sort(order.begin(), order.end());
+
+    const auto isCostlier { [](const Candidate& a, const Candidate& b) {
+      return a.cost != b.cost ? a.cost > b.cost :
+                                a.hops.size() > b.hops.size();
+    }};
+    std::vector<Candidate> candidates {};
+    std::set<std::vector<Hop>> known {};
+    std::vector<std::unordered_set<std::uint64_t>> acceptedPairs {};
+    std::vector<Hop> hops {};
+    std::size_t nextLabel {0};
+    while (accepted.size() < k)
+    {
+      const bool hasLabels {
+        nextLabel < order.size() && known.size() < options.maxCandidates
+      };
+      const auto lowerBound {
+        hasLabels ? order[nextLabel].first : kNoBound
+      };
+      if (!candidates.empty() && candidates.front().cost <= lowerBound)
+      {
+        std::pop_heap(candidates.begin(), candidates.end(), isCostlier);
+        auto candidate { std::move(candidates.back()) };
+        candidates.pop_back();
+        if (candidate.cost >= costLimit)
+          continue;
+        auto pairs { GetSharedPairs(candidate.hops, acceptedPairs,
+                                    options.maxSharing) };
+        if (pairs.has_value())
+        {
+          // The first one is the cheapest loopless journey: It may be
+          //  cheaper than any loopless journey of the labels
+          LowerCostLimit(candidate.cost);
+          accepted.push_back(std::move(candidate.hops));
+          acceptedPairs.push_back(std::move(*pairs));
+        }
+        continue;
+      }
+      if (!hasLabels)
+        break;
+
+      const auto labelIdx { order[nextLabel++].second };
+      hops.clear();
+      AppendHops(labelIdx, hops);
+      for (auto station { labels[labelIdx].station }; station != target;)
+      {
+        const auto hop { boundHops[station] };
+        hops.push_back(hop);
+        station = hop.route->path[hop.position + 1].index;
+      }
+      const auto cost { GetCost(hops) };
+      if (cost >= costLimit || CountLegs(hops) > maxLegs || HasLoop(hops) ||
+          !known.insert(hops).second)
+      {
+        continue;
+      }
+      candidates.push_back(Candidate {hops, cost});
+      std::push_heap(candidates.begin(), candidates.end(), isCostlier);
+    }
+    costLimit = kNoBound;
+    return accepted;
+  }
+
+  // Lower the cost limit to the cost of a loopless journey times
+  //  1 + maxStretch
+  void LowerCostLimit(
+    unsigned int cost
+  )
+  {
+    const auto maxCost { static_cast<double>(cost) * (1.0 + maxStretch) };
+    if (maxCost < static_cast<double>(costLimit))
+      costLimit = static_cast<unsigned int>(maxCost) + 1;
+  }
+
+  // Get the pairs of consecutive stations of a journey, unless it shares
+  //  more than `maxSharing` of its travel time with one of the others
+  static std::optional<std::unordered_set<std::uint64_t>> GetSharedPairs(
+    const std::vector<Hop>& hops,
+    const std::vector<std::unordered_set<std::uint64_t>>& others,
+    double maxSharing
+  )
+  {
+    std::unordered_set<std::uint64_t> pairs {};
+    unsigned int travelTime {0};
+    std::vector<unsigned int> sharedTime(others.size(), 0);
+    for (const auto& hop: hops)
+    {
+      const auto pair {
+        (static_cast<std::uint64_t>(hop.route->path[hop.position].index)
+         << 32) | hop.route->path[hop.position + 1].index
+      };
+      const auto hopTime { hop.route->path[hop.position].travelTime };
+      travelTime += hopTime;
+      pairs.insert(pair);
+      for (std::size_t idx {0}; idx < others.size(); ++idx)
+      {
+        if (others[idx].count(pair) > 0)
+          sharedTime[idx] += hopTime;
+      }
+    }
+    for (const auto shared: sharedTime)
+    {
+      if (shared > maxSharing * travelTime)
+        return std::nullopt;
+    }
+    return pairs;
+  }
+
+  bool HasLoop(
+    const std::vector<Hop>& hops
+  )
+  {
+    if (++visitStamp == 0)
+    {
+      std::fill(visited.begin(), visited.end(), 0);
+      visitStamp = 1;
+    }
+    for (const auto& hop: hops)
+    {
+      auto& stamp { visited[hop.route->path[hop.position].index] };
+      if (stamp == visitStamp)
+        return true;
+      stamp = visitStamp;
+    }
+    return !hops.empty() &&
+           visited[hops.back().route->path[hops.back().position + 1].index] ==
+             visitStamp;
+  }
+
+  static bool IsTransfer(
+    const Hop& previous,
+    const Hop& hop
+  )
+  {
+    return hop.route != previous.route ||
+           hop.position != previous.position + 1;
+  }
+
+  static std::size_t CountLegs(
+    const std::vector<Hop>& hops
+  )
+  {
+    std::size_t nLegs { hops.empty() ? 0u : 1u };
+    for (std::size_t idx {1}; idx < hops.size(); ++idx)
+    {
+      if (IsTransfer(hops[idx - 1], hops[idx]))
+        ++nLegs;
+    }
+    return nLegs;
+  }
+
+  unsigned int GetCost(
+    const std::vector<Hop>& hops
+  ) const
+  {
+    unsigned int cost {0};
+    for (std::size_t idx {0}; idx < hops.size(); ++idx)
+    {
+      if (idx > 0 && IsTransfer(hops[idx - 1], hops[idx]))
+        cost += GetPenalty(hops[idx - 1], hops[idx]);
+      cost += hops[idx].route->path[hops[idx].position].travelTime;
+    }
+    return cost;
+  }
+
+  // Dijkstra from the target along the routes, backwards
+  static bool IsCostlier(
+    const std::pair<unsigned int, const GraphNode*>& a,
+    const std::pair<unsigned int, const GraphNode*>& b
+  )
+  {
+    return a.first > b.first;
+  }
+
+  void StartBounds(
+    const GraphNode& to
+  )
+  {
+    for (const auto station: bounded)
+      bounds[station] = kNoBound;
+    bounded.clear();
+    boundsHeap.clear();
+    bounds[to.index] = 0;
+    bounded.push_back(static_cast<std::uint32_t>(to.index));
+    boundsHeap.emplace_back(0, &to);
+  }
+
+  // Settle stations until `station` is settled or the stations left cost at
+  //  least `limit`
+  void ExtendBounds(
+    std::uint32_t station,
+    unsigned int limit
+  )
+  {
+    while (!boundsHeap.empty() && boundsHeap.front().first < limit &&
+           boundsHeap.front().first < bounds[station])
+    {
+      std::pop_heap(boundsHeap.begin(), boundsHeap.end(), IsCostlier);
+      const auto [cost, node] { boundsHeap.back() };
+      boundsHeap.pop_back();
+      if (cost > bounds[node->index])
+        continue;
+
+      // Walk the routes through the station back to their previous stop
+      for (const auto& [route, position]: node->routeStops)
+      {
+        if (position == 0)
+          continue;
+        const auto& previous { route->path[position - 1] };
+        const auto previousCost { cost + previous.travelTime };
+        if (previousCost >= bounds[previous.index])
+          continue;
+        if (bounds[previous.index] == kNoBound)
+          bounded.push_back(previous.index);
+        bounds[previous.index] = previousCost;
+        boundHops[previous.index] = Hop {route, position - 1};
+        boundsHeap.emplace_back(previousCost, previous.node);
+        std::push_heap(boundsHeap.begin(), boundsHeap.end(), IsCostlier);
+      }
+    }
+  }
+
+  // Get a lower bound of the travel time from a station to the target,
+  //  kNoBound if the target cannot be reached from it. The stations the
+  //  backward search has not settled cost at least as much as the cheapest
+  //  one left.
+  unsigned int GetBound(
+    std::uint32_t station
+  ) const
+  {
+    if (boundsHeap.empty())
+      return bounds[station];
+    return std::min(bounds[station], boundsHeap.front().first);
+  }
+
+  // Check if a journey that costs `cost` at `station` may still beat the
+  //  best journey so far and the cost limit
+  bool CanImprove(
+    unsigned int cost,
+    std::uint32_t station
+  )
+  {
+    auto limit { costLimit };
+    if (bestLabel != kNone)
+      limit = std::min(limit, labels[bestLabel].cost);
+    if (limit == kNoBound)
+      return GetBound(station) != kNoBound;
+    if (cost >= limit)
+      return false;
+    ExtendBounds(station, limit - cost);
+    return GetBound(station) < limit - cost;
+  }
+
+  // Append the hops of the journey to a label
+  void AppendHops(
+    std::uint32_t labelIdx,
+    std::vector<Hop>& hops
+  ) const
+  {
+    const auto first { hops.size() };
+    for (auto idx { labelIdx }; labels[idx].route != nullptr;
+         idx = labels[idx].parent)
+    {
+      const auto& label { labels[idx] };
+      for (auto position { label.position }; position > label.boardedAt;)
+        hops.push_back(Hop {label.route, --position});
+    }
+    std::reverse(hops.begin() + first, hops.end());
+  }
+
+  Journey GetJourney(
+    const std::vector<Hop>& hops
+  ) const
+  {
+    Journey journey {};
+    for (std::size_t idx {0}; idx < hops.size(); ++idx)
+    {
+      const auto& hop { hops[idx] };
+      const auto& route { *hop.route };
+      if (idx == 0 || IsTransfer(hops[idx - 1], hop))
+      {
+        JourneyLeg leg {
+          route.line->id,
+          route.id,
+          route.stops[hop.position]->id
+        };
+        leg.penalty = idx == 0 ? 0 : GetPenalty(hops[idx - 1], hop);
+        journey.cost += leg.penalty;
+        journey.legs.push_back(std::move(leg));
+      }
+      auto& leg { journey.legs.back() };
+      const auto travelTime { route.path[hop.position].travelTime };
+      leg.toStation = route.stops[hop.position + 1]->id;
+      ++leg.nStops;
+      leg.travelTime += travelTime;
+      journey.travelTime += travelTime;
+      journey.cost += travelTime;
+    }
+    return journey;
+  }
+
+  Journey GetJourney(
+    std::uint32_t labelIdx
+  ) const
+  {
+    std::vector<Hop> hops {};
+    AppendHops(labelIdx, hops);
+    return GetJourney(hops);
+  }
+
+  unsigned int GetPenalty(
+    const Hop& previous,
+    const Hop& hop
+  ) const
+  {
+    return GetPenalty(hop.route->path[hop.position].index, *previous.route,
+                      *hop.route);
+  }
+
+  unsigned int GetPenalty(
+    std::uint32_t station,
+    const RouteInternal& fromRoute,
+    const RouteInternal& toRoute
+  ) const
+  {
+    if (!linePenalties.empty())
+    {
+      const auto penalty { linePenalties.find(
+        std::make_pair(fromRoute.line.get(), toRoute.line.get())
+      )};
+      if (penalty != linePenalties.end())
+        return penalty->second;
+    }
+    if (!stationPenalties.empty())
+    {
+      const auto penalty { stationPenalties.find(station) };
+      if (penalty != stationPenalties.end())
+        return penalty->second;
+    }
+    return defaultPenalty;
+  }
+
+  void ScanRoute(
+    const RouteInternal& route,
+    std::uint32_t firstIdx,
+    std::uint32_t round
+  )
+  {
+    const auto& path { route.path };
+    const auto nStops { static_cast<std::uint32_t>(path.size()) };
+    bool onBoard {false};
+    Label trip {};
+    for (auto idx { firstIdx }; idx < nStops; ++idx)
+    {
+      const auto station { path[idx].index };
+      if (onBoard)
+      {
+        trip.station = station;
+        trip.position = idx;
+        AddLabel(trip);
+      }
+      if (idx + 1 == nStops)
+        break;
+
+      // Board from the labels of the previous round. The labels of this
+      //  round come first.
+      for (auto labelIdx { firstLabel[station] }; labelIdx != kNone;
+           labelIdx = labels[labelIdx].next)
+      {
+        const auto& label { labels[labelIdx] };
+        if (label.round == round)
+          continue;
+        if (label.round + 1 < round)
+          break;
+        const auto cost { label.cost + (label.route == nullptr ? 0 :
+          GetPenalty(station, *label.route, route)
+        )};
+        if (!onBoard || cost < trip.cost)
+        {
+          onBoard = true;
+          trip = Label {
+            &route, station, idx, idx, cost, cost, labelIdx, round
+          };
+        }
+      }
+      if (!onBoard)
+        continue;
+
+      // Nothing past this stop can beat the best journey so far
+      trip.cost += path[idx].travelTime;
+      if (!CanImprove(trip.cost, path[idx + 1].index))
+        onBoard = false;
+    }
+  }
+
+  void AddLabel(
+    const Label& label
+  )
+  {
+    if (!CanImprove(label.cost, label.station))
+      return;
+
+    // While exploring, every journey to the target is a candidate, and
+    //  none goes on from there. Line pair penalties can make a journey with a
+    //  loop the cheapest one, but only loopless ones set the cost limit.
+    if (exploring && label.station == target)
+    {
+      labels.push_back(label);
+      labels.back().next = kNone;
+      targetHops.clear();
+      AppendHops(static_cast<std::uint32_t>(labels.size() - 1), targetHops);
+      if (!HasLoop(targetHops))
+        LowerCostLimit(label.cost);
+      return;
+    }
+
+    const auto* line { label.route->line.get() };
+    auto replaced { kNone };
+    for (auto idx { firstLabel[label.station] }; idx != kNone;
+         idx = labels[idx].next)
+    {
+      const auto& other { labels[idx] };
+      const bool sameLine {
+        other.route == nullptr || other.route->line.get() == line
+      };
+      if (other.cost <= label.cost &&
+          (sameLine || label.cost - other.cost >= penaltySpread))
+      {
+        return;
+      }
+      if (sameLine && other.round == label.round)
+        replaced = idx;
+    }
+
+    // A label of this round is not a parent yet: We can overwrite it
+    auto labelIdx { replaced };
+    if (labelIdx == kNone)
+    {
+      labelIdx = static_cast<std::uint32_t>(labels.size());
+      labels.push_back(label);
+      labels.back().next = firstLabel[label.station];
+      firstLabel[label.station] = labelIdx;
+    }
+    else
+    {
+      const auto next { labels[labelIdx].next };
+      labels[labelIdx] = label;
+      labels[labelIdx].next = next;
+    }
+
+    if (label.station == target)
+    {
+      bestLabel = labelIdx;
+    }
+    else if (markedRound[label.station] != label.round)
+    {
+      markedRound[label.station] = label.round;
+      marked.push_back(label.route->path[label.position].node);
+    }
+  }
+};
+
+// TransportNetworkMemoryUsage - Public methods
+
+std::size_t TransportNetworkMemoryUsage::GetTotal() const
+{
+  return stations + edges + routes + lines + ids + maps + rankings + flows +
+         allocator;
+}
+
+// PassengerFlow - Public methods
+
+double PassengerFlow::GetInRate() const
+{
+  return window.count() == 0 ? 0.0 : static_cast<double>(in) / window.count();
+}
+
+double PassengerFlow::GetOutRate() const
+{
+  return window.count() == 0 ? 0.0 : static_cast<double>(out) / window.count();
+}
+
+// Journey - Public methods
+
+std::size_t Journey::GetTransferCount() const
+{
+  return legs.empty() ? 0 : legs.size() - 1;
+}
 
 // Station - Public methods
 
@@ -37,6 +1299,15 @@ bool Line::operator==(const Line& other) const
 
 TransportNetwork::TransportNetwork() = default;
 
+TransportNetwork::TransportNetwork(
+  const PassengerFlowOptions& flowOptions
+) : m_flowOptions { flowOptions }
+{
+  // Buckets must be at least one second wide
+  m_flowOptions.bucketWidth = std::max(m_flowOptions.bucketWidth,
+                                       std::chrono::seconds {1});
+}
+
 TransportNetwork::~TransportNetwork() = default;
 
 TransportNetwork::TransportNetwork(
@@ -59,9 +1330,11 @@ bool TransportNetwork::FromJson(
   nlohmann::json&& src
 )
 {
+  NETWORK_MONITOR_TRACE_SCOPE("transport-network", "FromJson");
   bool ok { true };
 
   // First add all the stations
+  auto phaseStartedAt { std::chrono::steady_clock::now() };
   for (auto&& stationJson: src.at("stations"))
   {
     Station station
@@ -74,8 +1347,11 @@ bool TransportNetwork::FromJson(
     if (!ok)
       throw std::runtime_error("Could not add station " + station.id);
   }
+  NETWORK_MONITOR_TRACE_SINCE("transport-network", "FromJson/stations",
+                              phaseStartedAt);
 
   // Then, add the lines
+  phaseStartedAt = std::chrono::steady_clock::now();
   for (auto&& lineJson: src.at("lines"))
   {
     Line line
@@ -104,8 +1380,11 @@ bool TransportNetwork::FromJson(
       throw std::runtime_error("Could not add line " + line.id);
 
   }
+  NETWORK_MONITOR_TRACE_SINCE("transport-network", "FromJson/lines",
+                              phaseStartedAt);
 
   // Finally, set the travel times.
+  phaseStartedAt = std::chrono::steady_clock::now();
   for (auto&& travelTimeJson: src.at("travel_times"))
   {
     ok &= SetTravelTime(
@@ -114,10 +1393,22 @@ bool TransportNetwork::FromJson(
       std::move(travelTimeJson.at("travel_time").get<unsigned int>())
     );
   }
+  NETWORK_MONITOR_TRACE_SINCE("transport-network", "FromJson/travel_times",
+                              phaseStartedAt);
 
   return ok;
 }
 
+bool TransportNetwork::FromJson(
+  std::istream& src
+)
+{
+  NETWORK_MONITOR_TRACE_SCOPE("transport-network", "FromJson");
+  NetworkBuilder builder { *this };
+  nlohmann::json::sax_parse(src, &builder);
+  return builder.Finish();
+}
+
 bool TransportNetwork::SetTravelTime(
   const Id& stationA,
   const Id& stationB,
@@ -128,10 +1419,10 @@ bool TransportNetwork::SetTravelTime(
 
   // Find the stations
   const auto stationANode { GetStation(stationA) };
-  const auto stationBNode { GetStation(stationA) };
+  const auto stationBNode { GetStation(stationB) };
 
   if (stationANode == nullptr || stationBNode == nullptr)
-    return 0;
+    return false;
   
   // Search all edges connecting A -> and B -> A
   // We use lambda to avoid code duplication
@@ -142,6 +1433,7 @@ bool TransportNetwork::SetTravelTime(
       if (edge->nextStop == to)
       {
         edge->travelTime = travelTime;
+        edge->route->path[edge->position].travelTime = travelTime;
         foundAnyEdge = true;
       }
     }
@@ -160,6 +1452,8 @@ unsigned int TransportNetwork::GetTravelTime(
   const Id& stationB
 ) const
 {
+  NETWORK_MONITOR_TIME_SCOPE(getTravelTimeOnRoute);
+
   // Find the route
   const auto routeInternal { GetRoute(line, route) };
   if (routeInternal == nullptr)
@@ -177,8 +1471,12 @@ unsigned int TransportNetwork::GetTravelTime(
   for (const auto& stop: routeInternal->stops)
   {
     // If we found station B, we should return the cumulative travel time so far
+    // If station A is further down the route, this is 0
     if (stop == stationBNode)
       return travelTime;
+
+    if (stop == stationANode)
+      foundA = true;
     
     // Accumulate the travel time since we found station A..
     if (foundA)
@@ -195,6 +1493,7 @@ unsigned int TransportNetwork::GetTravelTime(
   }
 
   // If we got here, we didn't find station A, B, or both
+  return 0;
 }
 
 unsigned int TransportNetwork::GetTravelTime(
@@ -202,9 +1501,11 @@ unsigned int TransportNetwork::GetTravelTime(
   const Id& stationB
 ) const
 {
+  NETWORK_MONITOR_TIME_SCOPE(getTravelTime);
+
   // Find the stations
   const auto stationANode { GetStation(stationA) };
-  const auto stationBNode { GetStation(stationA) };
+  const auto stationBNode { GetStation(stationB) };
 
   if (stationANode == nullptr || stationBNode == nullptr)
     return 0;
@@ -237,13 +1538,18 @@ bool TransportNetwork::AddStation(
     return false;
   
   // Create a new station and add it to the map
-  auto node { std::make_shared<GraphNode>(GraphNode {
-    station.id,
-    station.name,
-    0, // We start with no passengers
-    {} // We start with no edges
-  })};
+  // We start with no passengers and no edges
+  auto node { std::make_shared<GraphNode>() };
+  node->id = station.id;
+  node->name = station.name;
+  node->flow = std::vector<FlowBucket>(m_flowOptions.nBuckets);
+  if (m_crowdRanking == nullptr)
+    m_crowdRanking = std::make_shared<CrowdRanking>();
+  node->index = m_stations.size();
+  m_crowdRanking->Add(*node);
   m_stations.emplace(station.id, std::move(node));
+
+  return true;
 }
 
 bool TransportNetwork::AddLine(
@@ -278,21 +1584,129 @@ bool TransportNetwork::RecordPassengerEvent(
     const PassengerEvent& event
 )
 {
+  NETWORK_MONITOR_TIME_SCOPE(recordPassengerEvent);
+  const auto epoch { BeginPassengerEvents(1) };
+  bool recorded {false};
   const auto stationNode {GetStation(event.stationId)};
-  if (GetStation(event.stationId) == nullptr)
-    return false;
+  if (stationNode == nullptr)
+  {
+    NETWORK_MONITOR_COUNT(passengerEventsRejected);
+  }
+  else if (ApplyPassengerEvent(*stationNode, event, epoch))
+  {
+    m_crowdRanking->Update(
+      *stationNode,
+      stationNode->passengerCount.load(std::memory_order_relaxed)
+    );
+    recorded = true;
+  }
+  EndPassengerEvents();
+  return recorded;
+}
 
-  switch (event.type)
+std::size_t TransportNetwork::RecordPassengerEvents(
+  const std::vector<PassengerEvent>& events
+)
+{
+  NETWORK_MONITOR_TIME_SCOPE(recordPassengerEvents);
+  const auto epoch { BeginPassengerEvents(events.size()) };
+  std::size_t nRecorded {0};
+  std::vector<GraphNode*> stations {};
+  stations.reserve(events.size());
+  for (const auto& event: events)
   {
-  case PassengerEvent::Type::In:
-    ++stationNode->passengerCount;
-    return true;
-  case PassengerEvent::Type::Out:
-    --stationNode->passengerCount;
-    return true;
-  default:
-    return false;
+    const auto stationNode { GetStation(event.stationId) };
+    if (stationNode == nullptr)
+    {
+      NETWORK_MONITOR_COUNT(passengerEventsRejected);
+      continue;
+    }
+    if (!ApplyPassengerEvent(*stationNode, event, epoch))
+      continue;
+    ++nRecorded;
+    stations.push_back(stationNode.get());
   }
+
+  // Each station moves once, to the place of its final count: Updates for
+  //  the stations that appear again are no-ops
+  for (auto* station: stations)
+  {
+    m_crowdRanking->Update(
+      *station,
+      station->passengerCount.load(std::memory_order_relaxed)
+    );
+  }
+  EndPassengerEvents();
+  return nRecorded;
+}
+
+std::uint64_t TransportNetwork::GetPassengerEventSequence() const
+{
+  if (m_countSnapshots == nullptr)
+    return 0;
+  return m_countSnapshots->sequence.load(std::memory_order_relaxed);
+}
+
+PassengerCountSnapshot TransportNetwork::SnapshotPassengerCounts() const
+{
+  NETWORK_MONITOR_TRACE_SCOPE("transport-network", "SnapshotPassengerCounts");
+  PassengerCountSnapshot snapshot {};
+  if (m_countSnapshots == nullptr)
+    return snapshot;
+  auto& snapshots { *m_countSnapshots };
+  std::lock_guard<std::mutex> lock { snapshots.mutex };
+
+  // Either the recording thread sees the new epoch at the start of its next
+  //  call, or we see that call running and wait for it to end
+  const auto epoch { snapshots.epoch.fetch_add(1) + 1 };
+  const auto calls { snapshots.calls.load() };
+  if (calls % 2 == 1)
+  {
+    while (snapshots.calls.load(std::memory_order_acquire) == calls)
+      std::this_thread::yield();
+  }
+
+  snapshot.sequence = ReadForSnapshot(snapshots.sequence,
+                                      snapshots.savedSequence,
+                                      snapshots.savedEpoch, epoch);
+  snapshot.counts.reserve(m_stations.size());
+  for (const auto& [id, stationNode]: m_stations)
+  {
+    snapshot.counts.push_back({id, ReadForSnapshot(
+      stationNode->passengerCount,
+      stationNode->snapshotCount,
+      stationNode->snapshotEpoch,
+      epoch
+    )});
+  }
+  return snapshot;
+}
+
+std::size_t TransportNetwork::RestorePassengerCounts(
+  const PassengerCountSnapshot& snapshot
+)
+{
+  const auto epoch { BeginPassengerEvents(0) };
+  std::size_t nRestored {0};
+  for (const auto& count: snapshot.counts)
+  {
+    const auto stationNode { GetStation(count.stationId) };
+    if (stationNode == nullptr)
+      continue;
+    SaveForSnapshot(stationNode->passengerCount, stationNode->snapshotCount,
+                    stationNode->snapshotEpoch, epoch);
+    stationNode->passengerCount.store(count.passengerCount,
+                                      std::memory_order_relaxed);
+    m_crowdRanking->Update(*stationNode, count.passengerCount);
+    ++nRestored;
+  }
+  if (m_countSnapshots != nullptr)
+  {
+    m_countSnapshots->sequence.store(snapshot.sequence,
+                                     std::memory_order_relaxed);
+  }
+  EndPassengerEvents();
+  return nRestored;
 }
 
 long long int TransportNetwork::GetPassengerCount(
@@ -304,15 +1718,126 @@ long long int TransportNetwork::GetPassengerCount(
     throw std::runtime_error("Could not find the station in the networ: " +
                              station);
 
-  return stationNode->passengerCount;
+  return stationNode->passengerCount.load(std::memory_order_relaxed);
+}
+
+TransportNetworkMemoryUsage TransportNetwork::MemoryUsage() const
+{
+  TransportNetworkMemoryUsage usage {};
+
+  AddMap(usage, m_stations);
+  for (const auto& [id, station]: m_stations)
+  {
+    ++usage.nStations;
+    AddAllocation(usage, usage.stations, GetSharedAllocation<GraphNode>());
+    AddAllocation(usage, usage.ids, GetStringHeap(station->id));
+    AddAllocation(usage, usage.stations, GetStringHeap(station->name));
+    AddAllocation(usage, usage.edges,
+                  station->edges.capacity() * sizeof(station->edges[0]));
+    AddAllocation(usage, usage.edges,
+                  station->routeStops.capacity() *
+                    sizeof(station->routeStops[0]));
+    AddAllocation(usage, usage.flows,
+                  station->flow.capacity() * sizeof(FlowBucket));
+    for (std::size_t idx {0}; idx < station->edges.size(); ++idx)
+    {
+      ++usage.nEdges;
+      AddAllocation(usage, usage.edges, GetSharedAllocation<GraphEdge>());
+    }
+  }
+
+  if (m_crowdRanking != nullptr)
+  {
+    AddAllocation(usage, usage.rankings, GetSharedAllocation<CrowdRanking>());
+    AddAllocation(usage, usage.rankings,
+                  m_crowdRanking->entries.capacity() *
+                    sizeof(CrowdRanking::Entry));
+  }
+
+  AddMap(usage, m_lines);
+  for (const auto& [id, line]: m_lines)
+  {
+    ++usage.nLines;
+    AddAllocation(usage, usage.lines, GetSharedAllocation<LineInternal>());
+    AddAllocation(usage, usage.ids, GetStringHeap(line->id));
+    AddAllocation(usage, usage.lines, GetStringHeap(line->name));
+    AddMap(usage, line->routes);
+    for (const auto& [routeId, route]: line->routes)
+    {
+      ++usage.nRoutes;
+      AddAllocation(usage, usage.routes,
+                    GetSharedAllocation<RouteInternal>());
+      AddAllocation(usage, usage.ids, GetStringHeap(route->id));
+      AddAllocation(usage, usage.routes,
+                    route->stops.capacity() * sizeof(route->stops[0]));
+      AddAllocation(usage, usage.routes,
+                    route->path.capacity() * sizeof(route->path[0]));
+    }
+  }
+
+  return usage;
+}
+
+PassengerFlow TransportNetwork::GetPassengerFlow(
+  const Id& station,
+  std::chrono::seconds window,
+  std::chrono::system_clock::time_point now
+) const
+{
+  const auto stationNode { GetStation(station) };
+  if (stationNode == nullptr)
+    throw std::runtime_error("Could not find the station in the network: " +
+                             station);
+
+  const auto width { m_flowOptions.bucketWidth };
+  const auto nBuckets { std::min<std::int64_t>(
+    (std::max<std::int64_t>(window.count(), 0) + width.count() - 1) /
+      width.count(),
+    static_cast<std::int64_t>(stationNode->flow.size())
+  )};
+  if (nBuckets == 0)
+    return {};
+  const auto last { GetFlowSlot(now) };
+  auto flow { stationNode->GetFlow(last - nBuckets + 1, last) };
+  flow.window = nBuckets * width;
+  return flow;
+}
+
+std::vector<StationPassengerCount> TransportNetwork::GetMostCrowdedStations(
+  std::size_t k
+) const
+{
+  if (m_crowdRanking == nullptr)
+    return {};
+  return m_crowdRanking->Get(k, true);
+}
+
+std::vector<StationPassengerCount> TransportNetwork::GetLeastCrowdedStations(
+  std::size_t k
+) const
+{
+  if (m_crowdRanking == nullptr)
+    return {};
+  return m_crowdRanking->Get(k, false);
+}
+
+void TransportNetwork::ForEachPassengerCount(
+  const std::function<void (const Id&, long long int)>& visit
+) const
+{
+  for (const auto& [id, stationNode]: m_stations)
+    visit(id, stationNode->passengerCount.load(std::memory_order_relaxed));
 }
 
 std::vector<Id> TransportNetwork::GetRoutesServingStation(
   const Id& station
 ) const
 {
+  NETWORK_MONITOR_TIME_SCOPE(getRoutesServingStation);
   const auto stationNode { GetStation(station) };
   std::vector<Id> routes {};
+  if (stationNode == nullptr)
+    return routes;
 
   // Iterate over all edges departing from then node. Each edge corresponds to
   // one route serving the station
@@ -338,6 +1863,58 @@ std::vector<Id> TransportNetwork::GetRoutesServingStation(
       }
     }
   }
+
+  return routes;
+}
+
+std::vector<Journey> TransportNetwork::GetJourneys(
+  const Id& from,
+  const Id& to,
+  const JourneyOptions& options
+) const
+{
+  NETWORK_MONITOR_TIME_SCOPE(getJourneys);
+  std::vector<Journey> journeys {};
+  const auto fromNode { GetStation(from) };
+  const auto toNode { GetStation(to) };
+  if (fromNode == nullptr || toNode == nullptr || fromNode == toNode)
+    return journeys;
+
+  auto& search { JourneySearch::GetThreadSearch() };
+  search.Reset(*this, options.penalties);
+  search.SetTarget(*toNode);
+  for (const auto labelIdx: search.Run(*fromNode, options.maxTransfers + 1))
+  {
+    journeys.push_back(search.GetJourney(labelIdx));
+  }
+  return journeys;
+}
+
+std::vector<Journey> TransportNetwork::GetAlternativeJourneys(
+  const Id& from,
+  const Id& to,
+  std::size_t k,
+  const AlternativeJourneyOptions& options
+) const
+{
+  NETWORK_MONITOR_TIME_SCOPE(getAlternativeJourneys);
+  std::vector<Journey> journeys {};
+  const auto fromNode { GetStation(from) };
+  const auto toNode { GetStation(to) };
+  if (fromNode == nullptr || toNode == nullptr || fromNode == toNode ||
+      k == 0)
+  {
+    return journeys;
+  }
+
+  auto& search { JourneySearch::GetThreadSearch() };
+  search.Reset(*this, options.journey.penalties);
+  for (const auto& hops: search.FindAlternatives(*fromNode, *toNode, k,
+                                                 options))
+  {
+    journeys.push_back(search.GetJourney(hops));
+  }
+  return journeys;
 }
 
 // TransportNetwork - Private methods
@@ -357,6 +1934,345 @@ std::vector<
   );
 }
 
+void TransportNetwork::GraphNode::RecordFlow(
+  std::int64_t slot,
+  std::size_t position,
+  PassengerEvent::Type type
+)
+{
+  if (flow.empty() || slot < 0)
+    return;
+  auto& bucket { flow[position] };
+  const auto index { bucket.index.load(std::memory_order_relaxed) };
+
+  // The bucket already holds a later time slot: The event is too old
+  if (index > slot)
+    return;
+  if (index < slot)
+  {
+    bucket.index.store(-1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    bucket.in.store(0, std::memory_order_relaxed);
+    bucket.out.store(0, std::memory_order_relaxed);
+    bucket.index.store(slot, std::memory_order_release);
+  }
+  auto& count { type == PassengerEvent::Type::In ? bucket.in : bucket.out };
+  count.store(count.load(std::memory_order_relaxed) + 1,
+              std::memory_order_relaxed);
+}
+
+PassengerFlow TransportNetwork::GraphNode::GetFlow(
+  std::int64_t first,
+  std::int64_t last
+) const
+{
+  PassengerFlow sum {};
+  for (auto slot { std::max<std::int64_t>(first, 0) }; slot <= last; ++slot)
+  {
+    const auto& bucket { flow[static_cast<std::size_t>(slot) % flow.size()] };
+    if (bucket.index.load(std::memory_order_acquire) != slot)
+      continue;
+    const auto in { bucket.in.load(std::memory_order_relaxed) };
+    const auto out { bucket.out.load(std::memory_order_relaxed) };
+
+    // Skip the bucket if the writer reused it while we read the counts
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (bucket.index.load(std::memory_order_relaxed) != slot)
+      continue;
+    sum.in += in;
+    sum.out += out;
+  }
+  return sum;
+}
+
+TransportNetwork::CrowdRanking::Entry::Entry(
+  const Entry& other
+) : passengerCount { other.passengerCount.load(std::memory_order_relaxed) }
+  , station { other.station.load(std::memory_order_relaxed) }
+{
+}
+
+TransportNetwork::CrowdRanking::Entry&
+TransportNetwork::CrowdRanking::Entry::operator=(
+  const Entry& other
+)
+{
+  passengerCount.store(other.passengerCount.load(std::memory_order_relaxed),
+                       std::memory_order_relaxed);
+  station.store(other.station.load(std::memory_order_relaxed),
+                std::memory_order_relaxed);
+  return *this;
+}
+
+void TransportNetwork::CrowdRanking::Add(
+  GraphNode& station
+)
+{
+  const auto passengerCount {
+    station.passengerCount.load(std::memory_order_relaxed)
+  };
+  station.rank = entries.size();
+  entries.emplace_back();
+  entries.back().passengerCount.store(passengerCount,
+                                      std::memory_order_relaxed);
+  entries.back().station.store(&station, std::memory_order_relaxed);
+
+  // Usually a no-op: New stations have no passengers yet
+  Update(station, passengerCount);
+}
+
+void TransportNetwork::CrowdRanking::Update(
+  GraphNode& station,
+  long long int passengerCount
+)
+{
+  const auto seq { sequence.load(std::memory_order_relaxed) };
+  sequence.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  // Hop over the groups of stations the new count overtakes, one swap per
+  //  group. The entry keeps its old count until it reaches its place.
+  auto position { station.rank };
+  while (position > 0 &&
+         entries[position - 1].passengerCount.load(
+           std::memory_order_relaxed
+         ) < passengerCount)
+  {
+    const auto first { FindGroupFirst(position - 1) };
+    Swap(first, position);
+    position = first;
+  }
+  while (position + 1 < entries.size() &&
+         entries[position + 1].passengerCount.load(
+           std::memory_order_relaxed
+         ) > passengerCount)
+  {
+    const auto last { FindGroupLast(position + 1) };
+    Swap(position, last);
+    position = last;
+  }
+  entries[position].passengerCount.store(passengerCount,
+                                         std::memory_order_relaxed);
+
+  sequence.store(seq + 2, std::memory_order_release);
+}
+
+std::vector<StationPassengerCount> TransportNetwork::CrowdRanking::Get(
+  std::size_t k,
+  bool mostCrowded
+) const
+{
+  std::vector<std::pair<long long int, const GraphNode*>> copied {};
+  while (true)
+  {
+    const auto seq { sequence.load(std::memory_order_acquire) };
+    if (seq % 2 == 1)
+    {
+      std::this_thread::yield();
+      continue;
+    }
+    const auto nEntries { entries.size() };
+    const auto n { std::min(k, nEntries) };
+    copied.clear();
+    copied.reserve(n);
+    for (std::size_t idx {0}; idx < n; ++idx)
+    {
+      const auto& entry { entries[mostCrowded ? idx : nEntries - 1 - idx] };
+      copied.emplace_back(
+        entry.passengerCount.load(std::memory_order_relaxed),
+        entry.station.load(std::memory_order_relaxed)
+      );
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (sequence.load(std::memory_order_relaxed) == seq)
+      break;
+  }
+
+  // The station IDs never change, so we can copy them outside of the loop
+  std::vector<StationPassengerCount> stations {};
+  stations.reserve(copied.size());
+  for (const auto& [passengerCount, station]: copied)
+    stations.push_back({station->id, passengerCount});
+  return stations;
+}
+
+void TransportNetwork::CrowdRanking::Swap(
+  std::size_t a,
+  std::size_t b
+)
+{
+  if (a == b)
+    return;
+  auto& entryA { entries[a] };
+  auto& entryB { entries[b] };
+  const auto countA { entryA.passengerCount.load(std::memory_order_relaxed) };
+  auto* stationA { entryA.station.load(std::memory_order_relaxed) };
+  auto* stationB { entryB.station.load(std::memory_order_relaxed) };
+  entryA.passengerCount.store(
+    entryB.passengerCount.load(std::memory_order_relaxed),
+    std::memory_order_relaxed
+  );
+  entryA.station.store(stationB, std::memory_order_relaxed);
+  entryB.passengerCount.store(countA, std::memory_order_relaxed);
+  entryB.station.store(stationA, std::memory_order_relaxed);
+  stationA->rank = b;
+  stationB->rank = a;
+}
+
+std::size_t TransportNetwork::CrowdRanking::FindGroupFirst(
+  std::size_t position
+) const
+{
+  // Gallop towards the front, then bisect the last step: Most groups are
+  //  small, so this usually reads a few neighbouring entries only.
+  const auto count { entries[position].passengerCount.load(
+    std::memory_order_relaxed
+  )};
+  const auto inGroup { [this, count](std::size_t idx) {
+    return entries[idx].passengerCount.load(std::memory_order_relaxed) ==
+           count;
+  }};
+  std::size_t step {1};
+  while (step <= position && inGroup(position - step))
+  {
+    position -= step;
+    step *= 2;
+  }
+  if (step > position && inGroup(0))
+    return 0;
+
+  // `outside` is before the group, `position` is in it
+  auto outside { step <= position ? position - step : 0 };
+  while (position - outside > 1)
+  {
+    const auto middle { outside + (position - outside) / 2 };
+    if (inGroup(middle))
+      position = middle;
+    else
+      outside = middle;
+  }
+  return position;
+}
+
+std::size_t TransportNetwork::CrowdRanking::FindGroupLast(
+  std::size_t position
+) const
+{
+  const auto count { entries[position].passengerCount.load(
+    std::memory_order_relaxed
+  )};
+  const auto inGroup { [this, count](std::size_t idx) {
+    return entries[idx].passengerCount.load(std::memory_order_relaxed) ==
+           count;
+  }};
+  const auto end { entries.size() };
+  std::size_t step {1};
+  while (position + step < end && inGroup(position + step))
+  {
+    position += step;
+    step *= 2;
+  }
+
+  // `position` is in the group, `outside` is after it
+  auto outside { std::min(position + step, end) };
+  while (outside - position > 1)
+  {
+    const auto middle { position + (outside - position) / 2 };
+    if (inGroup(middle))
+      position = middle;
+    else
+      outside = middle;
+  }
+  return position;
+}
+
+std::uint64_t TransportNetwork::BeginPassengerEvents(
+  std::size_t nEvents
+)
+{
+  // A moved-from network
+  if (m_countSnapshots == nullptr)
+    return 0;
+  auto& snapshots { *m_countSnapshots };
+
+  // The sequentially consistent increment and load pair with the ones of
+  //  SnapshotPassengerCounts
+  snapshots.calls.fetch_add(1);
+  const auto epoch { snapshots.epoch.load() };
+  SaveForSnapshot(snapshots.sequence, snapshots.savedSequence,
+                  snapshots.savedEpoch, epoch);
+  snapshots.sequence.store(
+    snapshots.sequence.load(std::memory_order_relaxed) + nEvents,
+    std::memory_order_relaxed
+  );
+  return epoch;
+}
+
+void TransportNetwork::EndPassengerEvents()
+{
+  if (m_countSnapshots == nullptr)
+    return;
+  auto& calls { m_countSnapshots->calls };
+  calls.store(calls.load(std::memory_order_relaxed) + 1,
+              std::memory_order_release);
+}
+
+bool TransportNetwork::ApplyPassengerEvent(
+  GraphNode& station,
+  const PassengerEvent& event,
+  std::uint64_t epoch
+)
+{
+  SaveForSnapshot(station.passengerCount, station.snapshotCount,
+                  station.snapshotEpoch, epoch);
+  switch (event.type)
+  {
+  case PassengerEvent::Type::In:
+    AddPassengers(station.passengerCount, 1);
+    break;
+  case PassengerEvent::Type::Out:
+    AddPassengers(station.passengerCount, -1);
+    break;
+  default:
+    NETWORK_MONITOR_COUNT(passengerEventsRejected);
+    return false;
+  }
+  NETWORK_MONITOR_COUNT(passengerEvents);
+
+  // Only read the clock if the station keeps a history
+  if (!station.flow.empty())
+  {
+    const auto timestamp {
+      event.timestamp == std::chrono::system_clock::time_point {} ?
+        GetEventTime() : event.timestamp
+    };
+    const auto second {
+      std::chrono::floor<std::chrono::seconds>(timestamp.time_since_epoch())
+        .count()
+    };
+    if (second != m_lastFlowSecond)
+    {
+      m_lastFlowSecond = second;
+      m_lastFlowSlot = GetFlowSlot(timestamp);
+      m_lastFlowPosition = m_lastFlowSlot < 0 ? 0 :
+        static_cast<std::size_t>(m_lastFlowSlot) % station.flow.size();
+    }
+    station.RecordFlow(m_lastFlowSlot, m_lastFlowPosition, event.type);
+  }
+  return true;
+}
+
+std::int64_t TransportNetwork::GetFlowSlot(
+  std::chrono::system_clock::time_point time
+) const
+{
+  const auto sinceEpoch {
+    std::chrono::floor<std::chrono::seconds>(time.time_since_epoch())
+  };
+  return sinceEpoch.count() < 0 ? -1 :
+    sinceEpoch.count() / m_flowOptions.bucketWidth.count();
+}
+
 std::shared_ptr<TransportNetwork::GraphNode> TransportNetwork::GetStation(
   const Id& stationId
 ) const
@@ -421,7 +2337,8 @@ bool TransportNetwork::AddRouteToLine(
   auto routeInternal { std::make_shared<RouteInternal>(RouteInternal {
     route.id,
     lineInternal,
-    std::move(stops)
+    std::move(stops),
+    m_nRoutes
   })};
 
   // Walk the station nodes to add an edge for the route
@@ -432,10 +2349,25 @@ bool TransportNetwork::AddRouteToLine(
     thisStop->edges.emplace_back(std::make_shared<GraphEdge>(GraphEdge {
       routeInternal,
       nextStop,
-      0
+      0,
+      static_cast<std::uint32_t>(idx)
     }));
   }
+  routeInternal->path.reserve(routeInternal->stops.size());
+  for (const auto& stop: routeInternal->stops)
+  {
+    stop->routeStops.emplace_back(
+      routeInternal.get(),
+      static_cast<std::uint32_t>(routeInternal->path.size())
+    );
+    routeInternal->path.push_back(RouteInternal::Stop {
+      stop.get(), static_cast<std::uint32_t>(stop->index)
+    });
+  }
 
   // Finally, add the route to the line
   lineInternal->routes[route.id] = std::move(routeInternal);
+  ++m_nRoutes;
+
+  return true;
 }
\ No newline at end of file
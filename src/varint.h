@@ -0,0 +1,60 @@
+#ifndef VARINT_H
+#define VARINT_H
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Internal header: LEB128 varints, shared by the on-disk formats of the
+//  passenger event log and the feed capture
+
+namespace NetworkMonitor
+{
+/*! \brief Append an unsigned LEB128 varint to a buffer
+ *
+ *  Values below 128 take a single byte.
+ */
+inline void AppendVarint(
+  std::string& buffer,
+  std::uint64_t value
+)
+{
+  while (value >= 0x80)
+  {
+    buffer.push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  buffer.push_back(static_cast<char>(value));
+}
+
+/*! \brief Read an unsigned LEB128 varint from a buffer
+ *
+ *  \param offset Where the varint starts. On success, moved past it.
+ *
+ *  \returns false if the varint goes past the end of the buffer, or does not
+ *           fit in 64 bits
+ */
+inline bool ReadVarint(
+  const unsigned char* data,
+  std::size_t size,
+  std::size_t& offset,
+  std::uint64_t& value
+)
+{
+  value = 0;
+  for (unsigned int shift {0}; shift < 64; shift += 7)
+  {
+    if (offset >= size)
+      return false;
+    const auto byte { data[offset++] };
+    value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0)
+      return true;
+  }
+  return false;
+}
+
+} // namespace NetworkMonitor
+
+#endif
@@ -0,0 +1,198 @@
+#include <network-monitor/websocket-client-manager.h>
+
+#include <network-monitor/trace.h>
+#include <network-monitor/websocket-client.h>
+
+#include <boost/asio.hpp>
+#include <boost/beast/ssl.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using NetworkMonitor::ConnectionStats;
+using NetworkMonitor::TlsSessionCache;
+using NetworkMonitor::WebSocketClient;
+using NetworkMonitor::WebSocketClientManager;
+
+// Static functions
+
+static double PerSecond(
+  std::uint64_t count,
+  std::chrono::steady_clock::duration elapsed
+)
+{
+  const double seconds {
+    std::chrono::duration<double>(elapsed).count()
+  };
+  return seconds > 0.0 ? static_cast<double>(count) / seconds : 0.0;
+}
+
+// Public methods
+
+WebSocketClientManager::WebSocketClientManager(
+  boost::asio::ssl::context& ctx,
+  std::size_t nThreads
+) : m_ctx { ctx }
+  , m_tlsSessionCache { std::make_shared<TlsSessionCache>() }
+{
+  if (nThreads == 0)
+  {
+    // hardware_concurrency can return 0 if the value is not computable
+    nThreads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  m_iocs.reserve(nThreads);
+  m_workGuards.reserve(nThreads);
+  m_clientsPerThread.resize(nThreads, 0);
+  for (std::size_t idx {0}; idx < nThreads; ++idx)
+  {
+    // Each io_context is only ever run by one thread. The concurrency hint
+    //  tells Asio so, as a performance hint: it lets the scheduler keep the
+    //  handlers that thread posts in a thread-private queue. The scheduler
+    //  still locks, as other threads post to the io_context too.
+    m_iocs.emplace_back(std::make_unique<boost::asio::io_context>(1));
+
+    // The work guard keeps io_context::run from returning when a thread has
+    //  no client yet, or when all its clients are disconnected.
+    m_workGuards.emplace_back(boost::asio::make_work_guard(*m_iocs.back()));
+  }
+}
+
+WebSocketClientManager::~WebSocketClientManager()
+{
+  Stop();
+
+  // Destroy the clients while the io_context objects are still alive
+  std::lock_guard<std::mutex> lock { m_clientsMutex };
+  m_clients.clear();
+}
+
+std::shared_ptr<WebSocketClient> WebSocketClientManager::AddClient(
+  const std::string& url,
+  const std::string& endpoint,
+  const std::string& port
+)
+{
+  std::lock_guard<std::mutex> lock { m_clientsMutex };
+
+  // Pick the io_context with the fewest clients. Ties go to the lowest index,
+  //  which spreads clients round-robin when they are only ever added.
+  const auto threadIt {
+    std::min_element(m_clientsPerThread.begin(), m_clientsPerThread.end())
+  };
+  const std::size_t threadIdx {
+    static_cast<std::size_t>(threadIt - m_clientsPerThread.begin())
+  };
+  ++(*threadIt);
+
+  auto client { std::make_shared<WebSocketClient>(
+    url, endpoint, port, *m_iocs[threadIdx], m_ctx, m_tlsSessionCache
+  )};
+  m_clients.push_back(ClientEntry {
+    client,
+    threadIdx,
+    url,
+    endpoint,
+    0,
+    {}
+  });
+  return client;
+}
+
+void WebSocketClientManager::Run()
+{
+  if (m_running || m_stopped)
+    return;
+
+  m_running = true;
+  m_threads.reserve(m_iocs.size());
+  for (std::size_t idx {0}; idx < m_iocs.size(); ++idx)
+  {
+    m_threads.emplace_back([ioc = m_iocs[idx].get(), idx]() {
+      NETWORK_MONITOR_TRACE_THREAD_NAME(
+        "websocket-client-manager " + std::to_string(idx)
+      );
+      ioc->run();
+    });
+  }
+}
+
+void WebSocketClientManager::Stop()
+{
+  if (m_stopped)
+    return;
+
+  m_stopped = true;
+  for (auto& ioc: m_iocs)
+    ioc->stop();
+
+  for (auto& thread: m_threads)
+  {
+    if (thread.joinable())
+      thread.join();
+  }
+  m_threads.clear();
+  m_running = false;
+}
+
+std::size_t WebSocketClientManager::GetThreadCount() const
+{
+  return m_iocs.size();
+}
+
+std::shared_ptr<TlsSessionCache> WebSocketClientManager::GetTlsSessionCache(
+) const
+{
+  return m_tlsSessionCache;
+}
+
+std::vector<ConnectionStats> WebSocketClientManager::GetStats()
+{
+  const auto now { std::chrono::steady_clock::now() };
+
+  std::lock_guard<std::mutex> lock { m_clientsMutex };
+  std::vector<ConnectionStats> stats {};
+  stats.reserve(m_clients.size());
+  for (std::size_t idx {0}; idx < m_clients.size(); ++idx)
+  {
+    auto& entry { m_clients[idx] };
+
+    ConnectionStats connectionStats {};
+    connectionStats.clientIdx = idx;
+    connectionStats.threadIdx = entry.threadIdx;
+    connectionStats.url = entry.url;
+    connectionStats.endpoint = entry.endpoint;
+    connectionStats.traffic = entry.client->GetStats();
+
+    const auto connectedAt { connectionStats.traffic.connectedAt };
+    if (connectedAt != std::chrono::steady_clock::time_point {})
+    {
+      connectionStats.messagesPerSecond = PerSecond(
+        connectionStats.traffic.messagesReceived,
+        now - connectedAt
+      );
+      connectionStats.bytesPerSecond = PerSecond(
+        connectionStats.traffic.bytesReceived,
+        now - connectedAt
+      );
+
+      // The recent rate is measured since the last sample, or since the
+      //  connection if the client connected after the last sample.
+      const auto since { std::max(entry.lastSampleAt, connectedAt) };
+      connectionStats.recentMessagesPerSecond = PerSecond(
+        connectionStats.traffic.messagesReceived - entry.lastMessages,
+        now - since
+      );
+    }
+    entry.lastMessages = connectionStats.traffic.messagesReceived;
+    entry.lastSampleAt = now;
+
+    stats.push_back(std::move(connectionStats));
+  }
+  return stats;
+}
@@ -1,4 +1,7 @@
 #include <network-monitor/websocket-client.h>
+#include <network-monitor/feed-capture.h>
+#include <network-monitor/metrics.h>
+#include <network-monitor/trace.h>
 
 #include <boost/asio.hpp>
 #include <boost/beast.hpp>
@@ -6,13 +9,24 @@
 #include <boost/asio/ssl.hpp>
 #include <boost/beast/ssl.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <deque>
 #include <functional>
+#include <iterator>
 #include <iomanip>
 #include <iostream>
+#include <random>
 #include <string>
+#include <utility>
+#include <vector>
 
+using NetworkMonitor::ReconnectInfo;
+using NetworkMonitor::ReconnectPolicy;
 using NetworkMonitor::WebSocketClient;
+using NetworkMonitor::WebSocketClientStats;
 
 using tcp = boost::asio::ip::tcp;
 namespace websocket = boost::beast::websocket;
@@ -34,12 +48,19 @@ WebSocketClient::WebSocketClient(
     const std::string& endpoint,
     const std::string& port,
     boost::asio::io_context& ioc,
-    boost::asio::ssl::context& ctx
+    boost::asio::ssl::context& ctx,
+    std::shared_ptr<NetworkMonitor::TlsSessionCache> tlsSessionCache
 ) : m_url{ url }
   , m_endpoint{ endpoint }
   , m_port{ port }
-  , m_resolver{ boost::asio::make_strand(ioc) }
-  , m_ws{ boost::asio::make_strand(ioc), ctx }
+  , m_strand{ boost::asio::make_strand(ioc) }
+  , m_ctx{ ctx }
+  , m_resolver{ m_strand }
+  , m_reconnectTimer{ m_strand }
+  , m_ws{ std::make_unique<Stream>(m_strand, ctx) }
+  , m_random{ std::random_device {}() }
+  , m_tlsSessionCache{ std::move(tlsSessionCache) }
+  , m_tlsSessionKey{ url + ":" + port }
 {
 }
 
@@ -59,11 +80,8 @@ void WebSocketClient::Connect(
 
   // Start the chain of asynchronous callbacks
   m_closed = false;
-  m_resolver.async_resolve(m_url, m_port,
-    [this](auto ec, auto resolverIt) {
-      OnResolve(ec, resolverIt);
-    }
-  );
+  m_reconnecting = false;
+  StartConnection();
 }
 
 void WebSocketClient::Send(
@@ -71,31 +89,196 @@ void WebSocketClient::Send(
   std::function<void (boost::system::error_code)> onSend
 )
 {
-  m_ws.async_write(boost::asio::buffer(message),
-    [onSend](auto ec, auto) {
-      if (onSend) {
-        onSend(ec);
+  // The reconnection replaces the stream on the strand, so we only touch it
+  //  there.
+  boost::asio::dispatch(m_strand, [this, &message, onSend]() {
+    m_writeQueue.push_back(QueuedWrite { &message, onSend, false });
+    WriteNext();
+  });
+}
+
+void WebSocketClient::Close(
+  std::function<void (boost::system::error_code)> onClose
+)
+{
+  boost::asio::dispatch(m_strand, [this, onClose]() {
+    m_closed = true;
+
+    // If we are between two reconnection attempts there is no connection to
+    //  close. We just stop trying.
+    if (m_reconnecting)
+    {
+      m_reconnectTimer.cancel();
+      FailQueuedWrites(boost::asio::error::operation_aborted);
+      boost::asio::post(m_strand, [onClose]() {
+        if (onClose)
+          onClose({});
+      });
+      return;
+    }
+
+    // By now we have likely read the TLS 1.3 session tickets
+    SaveTlsSession();
+
+    m_ws->async_close(
+      websocket::close_code::none,
+      [onClose](auto ec) {
+        if (onClose)
+          onClose(ec);
       }
+    );
+  });
+}
+
+void WebSocketClient::EnableReconnect(
+  const ReconnectPolicy& policy,
+  std::function<void (boost::system::error_code,
+                      const ReconnectInfo&)> onReconnect
+)
+{
+  m_reconnectEnabled = true;
+  m_reconnectPolicy = policy;
+  m_onReconnect = onReconnect;
+}
+
+void WebSocketClient::SetReplayMessages(
+  std::vector<std::string> messages
+)
+{
+  m_replayMessages = std::move(messages);
+}
+
+void WebSocketClient::SetFeedCapture(
+  std::shared_ptr<FeedCapture> capture
+)
+{
+  m_feedCapture = std::move(capture);
+}
+
+WebSocketClientStats WebSocketClient::GetStats() const
+{
+  // Relaxed loads are enough: The counters are independent of each other and
+  //  we only need each of them to be eventually up to date.
+  WebSocketClientStats stats {};
+  stats.messagesReceived = m_messagesReceived.load(std::memory_order_relaxed);
+  stats.bytesReceived    = m_bytesReceived.load(std::memory_order_relaxed);
+  stats.messagesSent     = m_messagesSent.load(std::memory_order_relaxed);
+  stats.bytesSent        = m_bytesSent.load(std::memory_order_relaxed);
+  stats.connectedAt      = std::chrono::steady_clock::time_point {
+    std::chrono::steady_clock::duration {
+      m_connectedAt.load(std::memory_order_relaxed)
     }
+  };
+  stats.tlsHandshakeDuration = std::chrono::nanoseconds {
+    m_tlsHandshakeDuration.load(std::memory_order_relaxed)
+  };
+  stats.connectDuration = std::chrono::nanoseconds {
+    m_connectDuration.load(std::memory_order_relaxed)
+  };
+  stats.tlsSessionResumed = m_tlsSessionResumed.load(std::memory_order_relaxed);
+  stats.reconnects = m_reconnects.load(std::memory_order_relaxed);
+  stats.totalGapDuration = std::chrono::nanoseconds {
+    m_totalGapDuration.load(std::memory_order_relaxed)
+  };
+  return stats;
+}
+
+#if defined(BOOST_ASIO_HAS_CO_AWAIT)
+boost::asio::strand<boost::asio::io_context::executor_type>
+WebSocketClient::GetExecutor() const
+{
+  return m_strand;
+}
+
+boost::asio::awaitable<void> WebSocketClient::Connect(
+  boost::asio::use_awaitable_t<>
+)
+{
+  using boost::asio::use_awaitable;
+
+  m_closed = false;
+  m_connectStartedAt = std::chrono::steady_clock::now();
+
+  // Same sequence as the callback API, see OnResolve, OnConnect,
+  //  OnTlsHandshake and OnHandshake.
+  const auto endpoints {
+    co_await m_resolver.async_resolve(m_url, m_port, use_awaitable)
+  };
+  m_ws->next_layer().next_layer().expires_after(std::chrono::seconds(5));
+  co_await m_ws->next_layer().next_layer().async_connect(
+    endpoints, use_awaitable
   );
+
+  PrepareTlsHandshake();
+  try
+  {
+    co_await m_ws->next_layer().async_handshake(
+      boost::asio::ssl::stream_base::client, use_awaitable
+    );
+  }
+  catch (const boost::system::system_error&)
+  {
+    if (m_tlsSessionCache)
+      m_tlsSessionCache->Erase(m_tlsSessionKey);
+    throw;
+  }
+  OnTlsHandshakeDone();
+
+  co_await m_ws->async_handshake(m_url, m_endpoint, use_awaitable);
+  OnWebSocketHandshakeDone();
 }
 
-void WebSocketClient::Close(
-  std::function<void (boost::system::error_code)> onClose
+boost::asio::awaitable<void> WebSocketClient::Read(
+  std::string& message,
+  boost::asio::use_awaitable_t<>
+)
+{
+  const auto nBytes {
+    co_await m_ws->async_read(m_rBuffer, boost::asio::use_awaitable)
+  };
+  TakeMessage(nBytes, message);
+}
+
+boost::asio::awaitable<void> WebSocketClient::Send(
+  const std::string& message,
+  boost::asio::use_awaitable_t<>
+)
+{
+  const auto nBytes {
+    co_await m_ws->async_write(
+      boost::asio::buffer(message),
+      boost::asio::use_awaitable
+    )
+  };
+  m_messagesSent.fetch_add(1, std::memory_order_relaxed);
+  m_bytesSent.fetch_add(nBytes, std::memory_order_relaxed);
+}
+
+boost::asio::awaitable<void> WebSocketClient::Close(
+  boost::asio::use_awaitable_t<>
 )
 {
   m_closed = true;
-  m_ws.async_close(
+  SaveTlsSession();
+  co_await m_ws->async_close(
     websocket::close_code::none,
-    [onClose](auto ec) {
-      if (onClose)
-        onClose(ec);
-    }
+    boost::asio::use_awaitable
   );
 }
+#endif // BOOST_ASIO_HAS_CO_AWAIT
 
 // Private methods
 
+void WebSocketClient::StartConnection()
+{
+  m_connectStartedAt = std::chrono::steady_clock::now();
+  m_resolver.async_resolve(m_url, m_port,
+    [this](auto ec, auto resolverIt) {
+      OnResolve(ec, resolverIt);
+    }
+  );
+}
+
 void WebSocketClient::OnResolve(
   const boost::system::error_code& ec,
   tcp::resolver::iterator resolverIt
@@ -104,22 +287,19 @@ void WebSocketClient::OnResolve(
   if (ec)
   {
     Log("OnResolve", ec);
-
-    if (m_onConnect)
-      m_onConnect(ec);
-
+    OnConnectionFailed(ec);
     return;
   }
 
   // The following timeout only matters for the purpose of connecting to the
   //  TCP socket. We will reset the timeout to a sensible default after we are
   //  connected.
-  m_ws.next_layer().next_layer().expires_after(std::chrono::seconds(5));
+  m_ws->next_layer().next_layer().expires_after(std::chrono::seconds(5));
 
   // Connect to the TCP socket
   // Instead of constructing the socket and the ws object seperately, the
   //  socket is now embedded in m_ws, and we access it through next_layer()
-  m_ws.next_layer().next_layer().async_connect(*resolverIt,
+  m_ws->next_layer().next_layer().async_connect(*resolverIt,
     [this](auto ec) {
       OnConnect(ec);
     }
@@ -133,28 +313,15 @@ void WebSocketClient::OnConnect(
   if (ec)
   {
     Log("OnConnect", ec);
-    if (m_onConnect)
-    {
-      m_onConnect(ec);
-    }
+    OnConnectionFailed(ec);
     return;
   }
 
-  // Now that the TCP socket is connected, we can reset the timeout to
-  //  whatever Boost.Beast recommends.
-  // Note: The TCP layer is the lowest layer (WebSocket -> TLS -> TCP)
-  boost::beast::get_lowest_layer(m_ws).expires_never();
-  m_ws.set_option(websocket::stream_base::timeout::suggested(
-    boost::beast::role_type::client
-  ));
-
-  // Some clients require that we set the host name before the TLS handshake
-  // or the connection will fail. We use an OpenSSL function for that.
-  SSL_set_tlsext_host_name(m_ws.next_layer().native_handle(), m_url.c_str());
+  PrepareTlsHandshake();
 
   // Attempt a TLS handshake
   // Note: The TLS layer is the next layer (WebSocket -> TLS -> TCP)
-  m_ws.next_layer().async_handshake(boost::asio::ssl::stream_base::client,
+  m_ws->next_layer().async_handshake(boost::asio::ssl::stream_base::client,
     [this](auto ec) {
       OnTlsHandshake(ec);
     }
@@ -168,20 +335,32 @@ void WebSocketClient::OnHandshake(
   if (ec)
   {
     Log("OnHandshake", ec);
+    OnConnectionFailed(ec);
+    return;
+  }
 
-    if (m_onConnect)
-      m_onConnect(ec);
-
+  // The user closed the client while we were reconnecting
+  if (m_reconnecting && m_closed)
+  {
+    m_reconnecting = false;
+    m_ws->async_close(websocket::close_code::none, [](auto) {});
     return;
   }
 
-  // Tell the WebSocket object to exchange messages in text format
-  m_ws.text(true);
+  OnWebSocketHandshakeDone();
 
   // Now that we are connected, set up a recursive asynchronous listener to
   //  receive messages
   ListenToIncomingMessage(ec);
 
+  // After a reconnection we restore the session state before handing the
+  //  connection back to the user.
+  if (m_reconnecting)
+  {
+    QueueReplayMessages();
+    return;
+  }
+
   // Dispatch the user callbacj
   // Note: This call is asynchronous and will block the WebSocket strand
   if (m_onConnect)
@@ -206,9 +385,17 @@ void WebSocketClient::ListenToIncomingMessage(
 
   // Read a message asynchronously. On a successful read, process the message
   //  and recursively call this function again to process the next message.
-  m_ws.async_read(m_rBuffer,
+  m_ws->async_read(m_rBuffer,
     [this](auto ec, auto nBytes) {
       OnRead(ec, nBytes);
+
+      // A failed read means that the connection is gone. Unless the user
+      //  closed it, we try to get it back.
+      if (ec && !m_closed && m_reconnectEnabled)
+      {
+        OnConnectionLost(ec);
+        return;
+      }
       ListenToIncomingMessage(ec);
     }
   );
@@ -225,10 +412,14 @@ void WebSocketClient::OnRead(
 
   // Parse the message and forward it to the user callback
   // Note: This call is synchronous and will block the WebSocket strand
-  std::string message { boost::beast::buffers_to_string(m_rBuffer.data()) };
-  m_rBuffer.consume(nBytes);
+  NETWORK_MONITOR_TIME_SCOPE(webSocketOnRead);
+  NETWORK_MONITOR_COUNT(webSocketMessages);
+  NETWORK_MONITOR_TRACE_SCOPE("websocket", "WebSocketClient/OnRead");
+  std::string message {};
+  TakeMessage(nBytes, message);
   if (m_onMessage)
   {
+    NETWORK_MONITOR_TRACE_SCOPE("websocket", "WebSocketClient/dispatch");
     m_onMessage(ec, std::move(message));
   }
 }
@@ -240,13 +431,357 @@ void WebSocketClient::OnTlsHandshake(
   if (ec)
   {
     Log("OnTlsHandshake", ec);
+
+    // A session the server rejected during the handshake is not worth
+    //  offering again.
+    if (m_tlsSessionCache)
+      m_tlsSessionCache->Erase(m_tlsSessionKey);
+
+    OnConnectionFailed(ec);
     return;
   }
 
+  OnTlsHandshakeDone();
+
   // Attempt a WebSocket handshake
-  m_ws.async_handshake(m_url, m_endpoint,
+  m_ws->async_handshake(m_url, m_endpoint,
     [this](auto ec) {
       OnHandshake(ec);
     }
   );
 }
+
+void WebSocketClient::PrepareTlsHandshake()
+{
+  // Now that the TCP socket is connected, we can reset the timeout to
+  //  whatever Boost.Beast recommends.
+  // Note: The TCP layer is the lowest layer (WebSocket -> TLS -> TCP)
+  boost::beast::get_lowest_layer(*m_ws).expires_never();
+  auto timeout { websocket::stream_base::timeout::suggested(
+    boost::beast::role_type::client
+  )};
+  if (m_reconnectEnabled)
+  {
+    // The suggested client settings never time out an idle connection, so we
+    //  would not notice a server that silently went away. Beast pings the
+    //  server after half the idle timeout and drops the connection if the
+    //  server stays silent for the whole timeout.
+    timeout.idle_timeout = std::chrono::seconds(15);
+    timeout.keep_alive_pings = true;
+  }
+  m_ws->set_option(timeout);
+
+  // Some clients require that we set the host name before the TLS handshake
+  // or the connection will fail. We use an OpenSSL function for that.
+  SSL_set_tlsext_host_name(m_ws->next_layer().native_handle(), m_url.c_str());
+
+  // Offer the last session we had with this server, if any. The server can
+  //  still decline it, in which case we fall back to a full handshake.
+  if (m_tlsSessionCache)
+  {
+    m_tlsSessionCache->Apply(
+      m_tlsSessionKey,
+      m_ws->next_layer().native_handle()
+    );
+  }
+  m_tlsSessionSaved = false;
+  m_tlsStartedAt = std::chrono::steady_clock::now();
+}
+
+void WebSocketClient::OnTlsHandshakeDone()
+{
+  m_tlsHandshakeDuration.store(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - m_tlsStartedAt
+    ).count(),
+    std::memory_order_relaxed
+  );
+  m_tlsSessionResumed.store(
+    SSL_session_reused(m_ws->next_layer().native_handle()) == 1,
+    std::memory_order_relaxed
+  );
+
+  // With TLS 1.2 the session is already resumable at this point
+  SaveTlsSession();
+}
+
+void WebSocketClient::OnWebSocketHandshakeDone()
+{
+  // Tell the WebSocket object to exchange messages in text format
+  m_ws->text(true);
+
+  const auto now { std::chrono::steady_clock::now() };
+  m_connectedAt.store(
+    now.time_since_epoch().count(),
+    std::memory_order_relaxed
+  );
+  m_connectDuration.store(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(
+      now - m_connectStartedAt
+    ).count(),
+    std::memory_order_relaxed
+  );
+}
+
+void WebSocketClient::TakeMessage(
+  std::size_t nBytes,
+  std::string& message
+)
+{
+  NETWORK_MONITOR_TRACE_SCOPE("websocket", "WebSocketClient/read");
+  // The flat buffer holds the message in one contiguous block: assign keeps
+  //  the capacity of the string.
+  const auto data { m_rBuffer.data() };
+  message.assign(static_cast<const char*>(data.data()), data.size());
+  m_rBuffer.consume(nBytes);
+  if (m_feedCapture)
+    m_feedCapture->Record(message);
+  if (!m_tlsSessionSaved)
+  {
+    // Only try once: Some servers never send a session ticket, and we do not
+    //  want to query OpenSSL for every message.
+    SaveTlsSession();
+    m_tlsSessionSaved = true;
+  }
+  m_lastMessageAt = std::chrono::steady_clock::now();
+  m_messagesReceived.fetch_add(1, std::memory_order_relaxed);
+  m_bytesReceived.fetch_add(nBytes, std::memory_order_relaxed);
+}
+
+void WebSocketClient::SaveTlsSession()
+{
+  if (!m_tlsSessionCache)
+    return;
+
+  // Save returns false until the session is resumable. With TLS 1.3 this
+  //  only happens after we read the server's NewSessionTicket message.
+  m_tlsSessionSaved = m_tlsSessionCache->Save(
+    m_tlsSessionKey,
+    m_ws->next_layer().native_handle()
+  );
+}
+
+void WebSocketClient::OnConnectionFailed(
+  const boost::system::error_code& ec
+)
+{
+  // The user closed the client while we were reconnecting
+  if (m_reconnecting && m_closed)
+  {
+    m_reconnecting = false;
+    return;
+  }
+
+  // The initial connection is not retried
+  if (!m_reconnecting)
+  {
+    if (m_onConnect)
+      m_onConnect(ec);
+
+    return;
+  }
+
+  ++m_reconnectAttempts;
+  if (m_reconnectPolicy.maxAttempts > 0 &&
+      m_reconnectAttempts >= m_reconnectPolicy.maxAttempts)
+  {
+    // We give up: The connection is now lost for good.
+    m_reconnecting = false;
+    FailQueuedWrites(ec);
+    if (m_onReconnect)
+      m_onReconnect(ec, ReconnectInfo { m_reconnectAttempts, {} });
+    if (m_onDisconnect)
+      m_onDisconnect(ec);
+
+    return;
+  }
+  ScheduleReconnect();
+}
+
+void WebSocketClient::OnConnectionLost(
+  const boost::system::error_code& ec
+)
+{
+  Log("OnConnectionLost", ec);
+
+  // The replay starts over on the next connection
+  DropQueuedReplay();
+
+  // The connection dropped while we were still restoring it
+  if (m_reconnecting)
+  {
+    OnConnectionFailed(ec);
+    return;
+  }
+
+  // Save the session before we drop the stream, so the reconnection can
+  //  resume it.
+  SaveTlsSession();
+
+  m_reconnecting = true;
+  m_reconnectAttempts = 0;
+  m_disconnectedAt = std::chrono::steady_clock::now();
+  ScheduleReconnect();
+}
+
+void WebSocketClient::ScheduleReconnect()
+{
+  if (m_closed)
+    return;
+
+  // Exponential backoff, capped
+  const double baseDelay {
+    std::min(
+      static_cast<double>(m_reconnectPolicy.initialDelay.count()) *
+        std::pow(m_reconnectPolicy.multiplier, m_reconnectAttempts),
+      static_cast<double>(m_reconnectPolicy.maxDelay.count())
+    )
+  };
+
+  // Remove up to `jitter` of the delay at random
+  const double jitter { std::clamp(m_reconnectPolicy.jitter, 0.0, 1.0) };
+  std::uniform_real_distribution<double> distribution { 0.0, jitter };
+  const auto delay { std::chrono::duration<double, std::milli> {
+    baseDelay * (1.0 - distribution(m_random))
+  }};
+
+  m_reconnectTimer.expires_after(
+    std::chrono::duration_cast<std::chrono::steady_clock::duration>(delay)
+  );
+  m_reconnectTimer.async_wait([this](auto ec) {
+    // The timer is cancelled when the user closes the client
+    if (ec || m_closed)
+      return;
+
+    // Start over with a fresh stream. The old one is unusable after the
+    //  connection failure.
+    m_ws = std::make_unique<Stream>(m_strand, m_ctx);
+    m_rBuffer.clear();
+    StartConnection();
+  });
+}
+
+void WebSocketClient::WriteNext()
+{
+  // Beast allows a single write in flight, so the messages wait their turn.
+  //  While we reconnect, the user's messages also wait for the replay.
+  if (m_writing || m_writeQueue.empty())
+    return;
+  if (m_reconnecting && !m_writeQueue.front().replay)
+    return;
+
+  m_writing = true;
+  m_ws->async_write(boost::asio::buffer(*m_writeQueue.front().message),
+    [this](auto ec, auto nBytes) {
+      m_writing = false;
+      const auto write { std::move(m_writeQueue.front()) };
+      m_writeQueue.pop_front();
+      if (!ec)
+      {
+        m_messagesSent.fetch_add(1, std::memory_order_relaxed);
+        m_bytesSent.fetch_add(nBytes, std::memory_order_relaxed);
+      }
+      if (write.onSend)
+        write.onSend(ec);
+      WriteNext();
+    }
+  );
+}
+
+void WebSocketClient::QueueReplayMessages()
+{
+  if (m_replayMessages.empty())
+  {
+    OnReconnected();
+    return;
+  }
+
+  // The replay goes ahead of the messages the user sent while we were
+  //  reconnecting, but behind a write still in flight on the old stream.
+  // The buffers stay valid because m_replayMessages is not modified while we
+  //  are reconnecting.
+  std::vector<QueuedWrite> replay {};
+  replay.reserve(m_replayMessages.size());
+  for (std::size_t idx {0}; idx < m_replayMessages.size(); ++idx)
+  {
+    const bool last { idx + 1 == m_replayMessages.size() };
+    replay.push_back(QueuedWrite {
+      &m_replayMessages[idx],
+      [this, last](auto ec) {
+        if (ec)
+        {
+          // The new connection dropped already. The read loop notices as
+          //  well and will schedule another attempt.
+          Log("SendReplayMessage", ec);
+          return;
+        }
+        if (last)
+          OnReconnected();
+      },
+      true
+    });
+  }
+  m_writeQueue.insert(
+    m_writeQueue.begin() + (m_writing ? 1 : 0),
+    std::make_move_iterator(replay.begin()),
+    std::make_move_iterator(replay.end())
+  );
+  WriteNext();
+}
+
+void WebSocketClient::DropQueuedReplay()
+{
+  // The write in flight, if any, removes itself when it completes
+  const auto first { m_writeQueue.begin() + (m_writing ? 1 : 0) };
+  m_writeQueue.erase(
+    std::remove_if(first, m_writeQueue.end(), [](const auto& write) {
+      return write.replay;
+    }),
+    m_writeQueue.end()
+  );
+}
+
+void WebSocketClient::FailQueuedWrites(
+  const boost::system::error_code& ec
+)
+{
+  // The write in flight, if any, reports its own result
+  const auto first { m_writeQueue.begin() + (m_writing ? 1 : 0) };
+  std::vector<QueuedWrite> failed {
+    std::make_move_iterator(first),
+    std::make_move_iterator(m_writeQueue.end())
+  };
+  m_writeQueue.erase(first, m_writeQueue.end());
+  for (const auto& write: failed)
+  {
+    if (write.onSend)
+      write.onSend(ec);
+  }
+}
+
+void WebSocketClient::OnReconnected()
+{
+  // We measure the gap from the last message we know we received. If the
+  //  old connection never delivered a message we measure from the drop.
+  const auto now { std::chrono::steady_clock::now() };
+  const auto gapStart {
+    m_lastMessageAt != std::chrono::steady_clock::time_point {} ?
+      m_lastMessageAt :
+      m_disconnectedAt
+  };
+  const ReconnectInfo info {
+    m_reconnectAttempts + 1,
+    std::chrono::duration_cast<std::chrono::nanoseconds>(now - gapStart)
+  };
+
+  m_reconnecting = false;
+  m_reconnectAttempts = 0;
+  m_reconnects.fetch_add(1, std::memory_order_relaxed);
+  m_totalGapDuration.fetch_add(info.gap.count(), std::memory_order_relaxed);
+
+  if (m_onReconnect)
+    m_onReconnect({}, info);
+
+  // Send what the user queued during the reconnection
+  WriteNext();
+}
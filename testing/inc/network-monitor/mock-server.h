@@ -0,0 +1,183 @@
+#ifndef MOCK_SERVER_H
+#define MOCK_SERVER_H
+#pragma once
+
+#include <boost/asio.hpp>
+#include <boost/beast/ssl.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace NetworkMonitor
+{
+/*! \brief Configuration of a MockServer
+  */
+struct MockServerOptions
+{
+  // Address and port to listen on. Port 0 picks a free port; use
+  //  MockServer::GetPort to find out which one.
+  std::string address {"127.0.0.1"};
+  unsigned short port {0};
+
+  // PEM certificate chain and private key for the TLS layer
+  std::filesystem::path certFile {};
+  std::filesystem::path keyFile {};
+
+  // WebSocket endpoint of the STOMP feed
+  std::string endpoint {"/network-events"};
+
+  // STOMP credentials. If both are empty, any CONNECT frame is accepted.
+  std::string username {};
+  std::string password {};
+
+  // Passenger events per second sent to each subscription. 0 means as fast
+  //  as the connection allows.
+  double messagesPerSecond {1000.0};
+
+  // Stop streaming to a subscription after this many events. 0 means never.
+  std::uint64_t maxMessages {0};
+
+  // Number of stations the synthetic events are spread over: station_000,
+  //  station_001, ...
+  std::size_t nStations {100};
+
+  // Number of server threads
+  std::size_t nThreads {1};
+
+  // Directory served over HTTPS to GET and HEAD requests for any target other
+  //  than the WebSocket endpoint. Empty disables file serving.
+  std::filesystem::path documentRoot {};
+
+  // Throttle each file response body to this many bytes per second, to
+  //  simulate a slow link. 0 means no throttling.
+  double httpBytesPerSecond {0.0};
+};
+
+/*! \brief Counters of a MockServer
+  */
+struct MockServerStats
+{
+  std::uint64_t connections {0};
+  std::uint64_t subscriptions {0};
+  std::uint64_t messagesSent {0};
+  std::uint64_t bytesSent {0};
+
+  // File serving: requests received, 304 Not Modified, 206 Partial Content
+  //  and gzip-encoded responses, and body bytes sent
+  std::uint64_t httpRequests {0};
+  std::uint64_t httpNotModified {0};
+  std::uint64_t httpPartialContent {0};
+  std::uint64_t httpCompressed {0};
+  std::uint64_t httpBytesSent {0};
+};
+
+/*! \brief Local mock of the network events server
+  *
+  *  Serves a STOMP 1.2 feed over secure WebSockets. The server accepts the
+  *  CONNECT (or STOMP) and SUBSCRIBE frames and then streams synthetic
+  *  passenger events to each subscription as MESSAGE frames:
+  *
+  *      MESSAGE
+  *      subscription:<subscription id>
+  *      message-id:<sequence number, starting at 0>
+  *      destination:<destination of the subscription>
+  *      content-type:application/json
+  *      sent-at-ns:<system_clock nanoseconds since epoch at send time>
+  *      content-length:<body length>
+  *
+  *      {"datetime":"...","passenger_event":"in","station_id":"station_042"}
+  *
+  *  If a document root is set, the server also serves its files over HTTPS,
+  *  with keep-alive. File responses carry an ETag and a Last-Modified header,
+  *  and the server answers 304 Not Modified to a matching If-None-Match, or,
+  *  without If-None-Match, to an If-Modified-Since that is exactly the
+  *  Last-Modified date. Single byte ranges are supported, including
+  *  If-Range. A client that accepts gzip gets the pre-compressed <file>.gz
+  *  instead of <file>, if it exists, with Content-Encoding: gzip.
+  *
+  *  The server runs on its own threads, so it can be used from tests,
+  *  benchmarks and load generators without an external network.
+  */
+class MockServer
+{
+  public:
+    /*! \brief Construct a mock server
+      *
+      *  \note This constructor does not start listening
+      */
+    explicit MockServer(
+      const MockServerOptions& options
+    );
+
+    /*! \brief Destructor
+      *
+      *  Stops the server.
+      */
+    ~MockServer();
+
+    MockServer(const MockServer&) = delete;
+    MockServer& operator=(const MockServer&) = delete;
+
+    /*! \brief Start listening and serving on the server threads
+      *
+      *  \returns false if the TLS certificate could not be loaded or if the
+      *           server could not listen on the requested address
+      */
+    bool Start();
+
+    /*! \brief Stop serving and join the server threads
+      */
+    void Stop();
+
+    /*! \brief Get the port the server listens on
+      */
+    unsigned short GetPort() const;
+
+    /*! \brief Abruptly close all the open connections
+      *
+      *  The clients see the connections drop without a WebSocket close frame,
+      *  as if the upstream feed flapped. The server keeps listening.
+      */
+    void DropConnections();
+
+    /*! \brief Get the server counters
+      */
+    MockServerStats GetStats() const;
+
+  private:
+    class Session;
+    friend class Session;
+
+    MockServerOptions m_options {};
+
+    boost::asio::io_context m_ioc {};
+    boost::asio::ssl::context m_ctx;
+    boost::asio::ip::tcp::acceptor m_acceptor;
+    std::vector<std::thread> m_threads {};
+    unsigned short m_port {0};
+
+    std::mutex m_sessionsMutex {};
+    std::vector<std::weak_ptr<Session>> m_sessions {};
+
+    std::atomic<std::uint64_t> m_connections {0};
+    std::atomic<std::uint64_t> m_subscriptions {0};
+    std::atomic<std::uint64_t> m_messagesSent {0};
+    std::atomic<std::uint64_t> m_bytesSent {0};
+    std::atomic<std::uint64_t> m_httpRequests {0};
+    std::atomic<std::uint64_t> m_httpNotModified {0};
+    std::atomic<std::uint64_t> m_httpPartialContent {0};
+    std::atomic<std::uint64_t> m_httpCompressed {0};
+    std::atomic<std::uint64_t> m_httpBytesSent {0};
+
+    void Accept();
+};
+
+} // namespace NetworkMonitor
+
+#endif
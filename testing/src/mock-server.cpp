@@ -0,0 +1,1032 @@
+#include <network-monitor/mock-server.h>
+
+#include <network-monitor/stomp-frame.h>
+
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/beast.hpp>
+#include <boost/beast/ssl.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using NetworkMonitor::MockServer;
+using NetworkMonitor::MockServerOptions;
+using NetworkMonitor::MockServerStats;
+using NetworkMonitor::StompCommand;
+using NetworkMonitor::StompFrame;
+
+using tcp = boost::asio::ip::tcp;
+namespace http = boost::beast::http;
+namespace websocket = boost::beast::websocket;
+
+// Static functions
+
+struct CivilTime
+{
+  long long year {0};
+  long long month {0};
+  long long day {0};
+  long long weekday {0}; // 0 is Sunday
+  long long secondsOfDay {0};
+  long long micros {0};
+};
+
+// The widest a long long prints: 19 digits and a sign
+static constexpr std::size_t kMaxLongLongChars {20};
+
+// Split a time point into its UTC calendar fields.
+// We do not use std::gmtime because it is not thread-safe.
+static CivilTime ToCivilTime(std::chrono::system_clock::time_point time)
+{
+  using namespace std::chrono;
+  const auto sinceEpoch { time.time_since_epoch() };
+  const auto days { duration_cast<duration<long long, std::ratio<86400>>>(
+    sinceEpoch
+  ).count() };
+
+  // Civil date from days since 1970-01-01 (H. Hinnant's algorithm)
+  const long long z { days + 719468 };
+  const long long era { (z >= 0 ? z : z - 146096) / 146097 };
+  const long long doe { z - era * 146097 };
+  const long long yoe { (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365 };
+  const long long doy { doe - (365 * yoe + yoe / 4 - yoe / 100) };
+  const long long mp { (5 * doy + 2) / 153 };
+
+  CivilTime civil {};
+  civil.day = doy - (153 * mp + 2) / 5 + 1;
+  civil.month = mp < 10 ? mp + 3 : mp - 9;
+  civil.year = yoe + era * 400 + (civil.month <= 2 ? 1 : 0);
+  civil.weekday = ((days % 7) + 11) % 7; // 1970-01-01 was a Thursday
+  civil.secondsOfDay = duration_cast<seconds>(sinceEpoch).count() - days * 86400;
+  civil.micros = duration_cast<microseconds>(sinceEpoch).count() % 1'000'000;
+  return civil;
+}
+
+// Format a time point as an ISO 8601 UTC date, for example
+//  2021-03-04T05:06:07.890000Z
+static std::string FormatDateTime(std::chrono::system_clock::time_point time)
+{
+  const auto civil { ToCivilTime(time) };
+  // Sized for 7 fields of any value, so that the output is never truncated.
+  char buffer[7 * kMaxLongLongChars + 8] {};
+  std::snprintf(buffer, sizeof(buffer),
+    "%04lld-%02lld-%02lldT%02lld:%02lld:%02lld.%06lldZ",
+    civil.year, civil.month, civil.day,
+    civil.secondsOfDay / 3600, (civil.secondsOfDay / 60) % 60,
+    civil.secondsOfDay % 60,
+    civil.micros
+  );
+  return buffer;
+}
+
+// Format a time point as an HTTP date (RFC 7231 IMF-fixdate), for example
+//  Thu, 04 Mar 2021 05:06:07 GMT
+static std::string FormatHttpDate(std::chrono::system_clock::time_point time)
+{
+  static constexpr const char* kWeekdays[] {
+    "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"
+  };
+  static constexpr const char* kMonths[] {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+  };
+  const auto civil { ToCivilTime(time) };
+  // Sized for 5 fields of any value, so that the output is never truncated.
+  char buffer[5 * kMaxLongLongChars + 24] {};
+  std::snprintf(buffer, sizeof(buffer),
+    "%s, %02lld %s %04lld %02lld:%02lld:%02lld GMT",
+    kWeekdays[civil.weekday], civil.day, kMonths[civil.month - 1], civil.year,
+    civil.secondsOfDay / 3600, (civil.secondsOfDay / 60) % 60,
+    civil.secondsOfDay % 60
+  );
+  return buffer;
+}
+
+enum class ByteRange
+{
+  None,           // No range, or one we do not support: Send the whole file
+  Satisfiable,
+  Unsatisfiable,
+};
+
+// Parse a single-range Range header: bytes=<first>-<last>, bytes=<first>- or
+//  bytes=-<suffix length>. Multiple ranges are not supported.
+static ByteRange ParseByteRange(
+  std::string_view header,
+  std::uint64_t size,
+  std::uint64_t& first,
+  std::uint64_t& last
+)
+{
+  constexpr std::string_view prefix { "bytes=" };
+  if (header.substr(0, prefix.size()) != prefix ||
+      header.find(',') != std::string_view::npos)
+    return ByteRange::None;
+  header.remove_prefix(prefix.size());
+  const auto dash { header.find('-') };
+  if (dash == std::string_view::npos)
+    return ByteRange::None;
+
+  auto parse { [](std::string_view text, std::uint64_t& value) {
+    const auto [end, ec] = std::from_chars(
+      text.data(), text.data() + text.size(), value
+    );
+    return !text.empty() && ec == std::errc {} &&
+           end == text.data() + text.size();
+  }};
+  const auto firstText { header.substr(0, dash) };
+  const auto lastText { header.substr(dash + 1) };
+  if (firstText.empty())
+  {
+    std::uint64_t suffix { 0 };
+    if (!parse(lastText, suffix))
+      return ByteRange::None;
+    if (suffix == 0 || size == 0)
+      return ByteRange::Unsatisfiable;
+    first = size - std::min(suffix, size);
+    last = size - 1;
+    return ByteRange::Satisfiable;
+  }
+  if (!parse(firstText, first))
+    return ByteRange::None;
+  last = size - 1;
+  if (!lastText.empty())
+  {
+    if (!parse(lastText, last) || last < first)
+      return ByteRange::None;
+    last = std::min(last, size - 1);
+  }
+  return first < size ? ByteRange::Satisfiable : ByteRange::Unsatisfiable;
+}
+
+static std::string MakeStationId(std::size_t idx)
+{
+  char buffer[32] {};
+  std::snprintf(buffer, sizeof(buffer), "station_%03zu", idx);
+  return buffer;
+}
+
+static std::string MakeErrorFrame(const std::string& message)
+{
+  return NetworkMonitor::SerializeStompFrame(StompFrame {
+    StompCommand::Error,
+    {{"message", message}},
+    {}
+  });
+}
+
+// MockServer::Session
+
+// One client connection. All the handlers of a session run on its strand.
+class MockServer::Session : public std::enable_shared_from_this<Session>
+{
+  public:
+    Session(
+      MockServer& server,
+      tcp::socket&& socket
+    ) : m_server { server }
+      , m_ws { std::move(socket), server.m_ctx }
+      , m_timer { m_ws.get_executor() }
+      , m_random { std::random_device {}() }
+    {
+    }
+
+    void Run()
+    {
+      boost::asio::dispatch(m_ws.get_executor(),
+        [self = shared_from_this()]() {
+          self->DoTlsHandshake();
+        }
+      );
+    }
+
+    void Drop()
+    {
+      boost::asio::post(m_ws.get_executor(),
+        [self = shared_from_this()]() {
+          // Close the socket without a WebSocket or TLS goodbye, like a
+          //  network failure would.
+          boost::system::error_code ec {};
+          boost::beast::get_lowest_layer(self->m_ws).socket().close(ec);
+          self->m_timer.cancel();
+          self->m_dropped = true;
+        }
+      );
+    }
+
+  private:
+    struct Subscription
+    {
+      std::string id {};
+      std::string destination {};
+      std::uint64_t sequence {0};
+      std::chrono::steady_clock::time_point startedAt {};
+    };
+
+    struct PendingWrite
+    {
+      std::string message {};
+      bool isEvent {false};
+    };
+
+    MockServer& m_server;
+    websocket::stream<boost::beast::ssl_stream<boost::beast::tcp_stream>> m_ws;
+    boost::asio::steady_timer m_timer;
+    boost::beast::flat_buffer m_buffer {};
+    http::request<http::string_body> m_request {};
+    std::minstd_rand m_random;
+
+    bool m_dropped {false};
+    bool m_stompConnected {false};
+    bool m_closing {false};
+    std::vector<Subscription> m_subscriptions {};
+    bool m_streaming {false};
+
+    std::deque<PendingWrite> m_writeQueue {};
+    bool m_writing {false};
+
+    void DoTlsHandshake()
+    {
+      boost::beast::get_lowest_layer(m_ws).expires_after(
+        std::chrono::seconds(30)
+      );
+      m_ws.next_layer().async_handshake(boost::asio::ssl::stream_base::server,
+        [self = shared_from_this()](auto ec) {
+          if (ec)
+            return;
+
+          self->DoReadRequest();
+        }
+      );
+    }
+
+    void DoReadRequest()
+    {
+      // A new request on a kept-alive connection needs a fresh message
+      m_request = {};
+      boost::beast::get_lowest_layer(m_ws).expires_after(
+        std::chrono::seconds(30)
+      );
+      http::async_read(m_ws.next_layer(), m_buffer, m_request,
+        [self = shared_from_this()](auto ec, auto) {
+          if (ec)
+            return;
+
+          self->OnRequest();
+        }
+      );
+    }
+
+    void OnRequest()
+    {
+      if (websocket::is_upgrade(m_request) &&
+          m_request.target() == m_server.m_options.endpoint)
+      {
+        // The WebSocket stream handles its own timeouts
+        boost::beast::get_lowest_layer(m_ws).expires_never();
+        m_ws.set_option(websocket::stream_base::timeout::suggested(
+          boost::beast::role_type::server
+        ));
+        m_ws.text(true);
+        m_ws.async_accept(m_request,
+          [self = shared_from_this()](auto ec) {
+            if (ec)
+              return;
+
+            self->DoReadFrame();
+          }
+        );
+        return;
+      }
+
+      if (!m_server.m_options.documentRoot.empty() &&
+          !websocket::is_upgrade(m_request))
+      {
+        ServeFile();
+        return;
+      }
+
+      SendNotFound();
+    }
+
+    void SendNotFound()
+    {
+      auto response { std::make_shared<http::response<http::string_body>>(
+        http::status::not_found, m_request.version()
+      )};
+      response->set(http::field::content_type, "text/plain");
+      response->body() = "Not found\n";
+      response->prepare_payload();
+      response->keep_alive(false);
+      WriteResponse(std::move(response));
+    }
+
+    void ServeFile()
+    {
+      m_server.m_httpRequests.fetch_add(1, std::memory_order_relaxed);
+      const auto method { m_request.method() };
+      if (method != http::verb::get && method != http::verb::head)
+      {
+        SendNotFound();
+        return;
+      }
+
+      // Only serve regular files inside the document root
+      const auto root { m_server.m_options.documentRoot.lexically_normal() };
+      std::string_view target {
+        m_request.target().data(), m_request.target().size()
+      };
+      target = target.substr(0, target.find('?'));
+      const auto path {
+        (root / std::filesystem::path { target }.relative_path())
+          .lexically_normal()
+      };
+      const auto relative { path.lexically_relative(root) };
+      std::error_code ec {};
+      if (relative.empty() || *relative.begin() == ".." ||
+          !std::filesystem::is_regular_file(path, ec))
+      {
+        SendNotFound();
+        return;
+      }
+
+      // Like a static file server, we send the pre-compressed copy of the
+      //  file if there is one and the client accepts it
+      auto content { path };
+      bool compressed { false };
+      if (m_request.count(http::field::accept_encoding) > 0)
+      {
+        const std::string acceptEncoding {
+          m_request[http::field::accept_encoding]
+        };
+        auto gzipped { path };
+        gzipped += ".gz";
+        compressed = acceptEncoding.find("gzip") != std::string::npos &&
+                     std::filesystem::is_regular_file(gzipped, ec);
+        if (compressed)
+          content = gzipped;
+      }
+
+      const auto size { std::filesystem::file_size(content, ec) };
+      const auto modifiedAt { std::filesystem::last_write_time(content, ec) };
+      if (ec)
+      {
+        SendNotFound();
+        return;
+      }
+
+      // The ETag changes with the size and the modification time, like the
+      //  default of most web servers.
+      std::ostringstream etag {};
+      etag << '"' << std::hex << size << '-'
+           << modifiedAt.time_since_epoch().count() << '"';
+      const auto lastModified { FormatHttpDate(
+        std::chrono::time_point_cast<std::chrono::system_clock::duration>(
+          std::chrono::file_clock::to_sys(modifiedAt)
+        )
+      )};
+
+      bool notModified { false };
+      if (m_request.count(http::field::if_none_match) > 0)
+      {
+        const std::string ifNoneMatch {
+          m_request[http::field::if_none_match]
+        };
+        notModified = ifNoneMatch == "*" ||
+          ifNoneMatch.find(etag.str()) != std::string::npos;
+      }
+      else if (m_request.count(http::field::if_modified_since) > 0)
+      {
+        notModified = std::string {
+          m_request[http::field::if_modified_since]
+        } == lastModified;
+      }
+
+      // A Range request only applies if the If-Range validator, if any,
+      //  still matches the file
+      std::uint64_t first { 0 };
+      std::uint64_t last { size == 0 ? 0 : size - 1 };
+      auto range { ByteRange::None };
+      if (!notModified && m_request.count(http::field::range) > 0)
+      {
+        const std::string ifRange { m_request[http::field::if_range] };
+        if (ifRange.empty() || ifRange == etag.str() ||
+            ifRange == lastModified)
+        {
+          const std::string header { m_request[http::field::range] };
+          range = ParseByteRange(header, size, first, last);
+        }
+      }
+
+      auto response { std::make_shared<http::response<http::string_body>>(
+        notModified ? http::status::not_modified :
+        range == ByteRange::Satisfiable ? http::status::partial_content :
+        range == ByteRange::Unsatisfiable ?
+          http::status::range_not_satisfiable : http::status::ok,
+        m_request.version()
+      )};
+      response->set(http::field::server, "network-monitor-mock");
+      response->set(http::field::etag, etag.str());
+      response->set(http::field::last_modified, lastModified);
+      response->set(http::field::accept_ranges, "bytes");
+      response->set(http::field::vary, "Accept-Encoding");
+      if (compressed)
+        response->set(http::field::content_encoding, "gzip");
+      response->keep_alive(m_request.keep_alive());
+      if (notModified)
+      {
+        m_server.m_httpNotModified.fetch_add(1, std::memory_order_relaxed);
+        WriteResponse(std::move(response));
+        return;
+      }
+      if (range == ByteRange::Unsatisfiable)
+      {
+        response->set(http::field::content_range,
+          "bytes */" + std::to_string(size)
+        );
+        response->content_length(0);
+        WriteResponse(std::move(response));
+        return;
+      }
+      if (range == ByteRange::Satisfiable)
+      {
+        m_server.m_httpPartialContent.fetch_add(1, std::memory_order_relaxed);
+        response->set(http::field::content_range,
+          "bytes " + std::to_string(first) + "-" + std::to_string(last) +
+          "/" + std::to_string(size)
+        );
+      }
+
+      response->set(http::field::content_type,
+        path.extension() == ".json" ? "application/json" :
+                                      "application/octet-stream"
+      );
+      const auto length { size == 0 ? 0 : last - first + 1 };
+      if (method == http::verb::get)
+      {
+        if (compressed)
+          m_server.m_httpCompressed.fetch_add(1, std::memory_order_relaxed);
+        std::ifstream file { content, std::ios::binary };
+        file.seekg(static_cast<std::streamoff>(first));
+        response->body().resize(length);
+        file.read(response->body().data(), static_cast<std::streamsize>(length));
+        response->prepare_payload();
+        m_server.m_httpBytesSent.fetch_add(length, std::memory_order_relaxed);
+      }
+      else
+      {
+        response->content_length(length);
+      }
+      WriteResponse(std::move(response));
+    }
+
+    // Keep-alive responses go back to reading the next request
+    void WriteResponse(
+      std::shared_ptr<http::response<http::string_body>> response
+    )
+    {
+      if (m_server.m_options.httpBytesPerSecond > 0.0 &&
+          !response->body().empty())
+      {
+        auto serializer {
+          std::make_shared<http::response_serializer<http::string_body>>(
+            *response
+          )
+        };
+        serializer->limit(16 * 1024);
+        WriteThrottled(
+          std::move(response), std::move(serializer),
+          std::chrono::steady_clock::now(), 0
+        );
+        return;
+      }
+
+      http::async_write(m_ws.next_layer(), *response,
+        [self = shared_from_this(), response](auto ec, auto) {
+          if (ec)
+            return;
+
+          self->OnResponseWritten(response->keep_alive());
+        }
+      );
+    }
+
+    // Write the response in pieces, paced so that the average rate since
+    //  startedAt stays at httpBytesPerSecond
+    void WriteThrottled(
+      std::shared_ptr<http::response<http::string_body>> response,
+      std::shared_ptr<http::response_serializer<http::string_body>> serializer,
+      std::chrono::steady_clock::time_point startedAt,
+      std::size_t nBytesWritten
+    )
+    {
+      http::async_write_some(m_ws.next_layer(), *serializer,
+        [self = shared_from_this(), response, serializer, startedAt,
+         nBytesWritten](auto ec, auto nBytes) {
+          if (ec)
+            return;
+
+          if (serializer->is_done())
+          {
+            self->OnResponseWritten(response->keep_alive());
+            return;
+          }
+
+          const auto nBytesTotal { nBytesWritten + nBytes };
+          self->m_timer.expires_at(startedAt +
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+              std::chrono::duration<double> {
+                nBytesTotal / self->m_server.m_options.httpBytesPerSecond
+              }
+            )
+          );
+          self->m_timer.async_wait(
+            [self, response, serializer, startedAt, nBytesTotal](auto ec) {
+              if (ec)
+                return;
+
+              self->WriteThrottled(
+                response, serializer, startedAt, nBytesTotal
+              );
+            }
+          );
+        }
+      );
+    }
+
+    void OnResponseWritten(bool keepAlive)
+    {
+      if (keepAlive)
+      {
+        DoReadRequest();
+        return;
+      }
+      m_ws.next_layer().async_shutdown(
+        [self = shared_from_this()](auto) {}
+      );
+    }
+
+    void DoReadFrame()
+    {
+      m_ws.async_read(m_buffer,
+        [self = shared_from_this()](auto ec, auto nBytes) {
+          if (ec)
+          {
+            self->m_timer.cancel();
+            return;
+          }
+
+          const std::string message {
+            boost::beast::buffers_to_string(self->m_buffer.data())
+          };
+          self->m_buffer.consume(nBytes);
+          self->OnFrame(message);
+          if (!self->m_closing)
+            self->DoReadFrame();
+        }
+      );
+    }
+
+    void OnFrame(const std::string& message)
+    {
+      StompFrame frame {};
+      if (!NetworkMonitor::ParseStompFrame(message, frame))
+      {
+        SendErrorAndClose("Could not parse the STOMP frame");
+        return;
+      }
+
+      switch (frame.command)
+      {
+      case StompCommand::Connect:
+      case StompCommand::Stomp:
+        OnConnect(frame);
+        break;
+      case StompCommand::Subscribe:
+        OnSubscribe(frame);
+        break;
+      case StompCommand::Unsubscribe:
+        OnUnsubscribe(frame);
+        break;
+      case StompCommand::Disconnect:
+        SendReceipt(frame);
+        m_closing = true;
+        m_timer.cancel();
+        Close();
+        break;
+      default:
+        SendErrorAndClose("Unsupported STOMP command");
+        break;
+      }
+    }
+
+    void OnConnect(const StompFrame& frame)
+    {
+      const auto& options { m_server.m_options };
+      const bool checkCredentials {
+        !options.username.empty() || !options.password.empty()
+      };
+      if (checkCredentials && (
+            frame.GetHeader("login") != options.username ||
+            frame.GetHeader("passcode") != options.password))
+      {
+        SendErrorAndClose("ValidationInvalidAuth");
+        return;
+      }
+
+      m_stompConnected = true;
+      Write(NetworkMonitor::SerializeStompFrame(StompFrame {
+        StompCommand::Connected,
+        {{"version", "1.2"}, {"server", "network-monitor-mock"}},
+        {}
+      }));
+    }
+
+    void OnSubscribe(const StompFrame& frame)
+    {
+      if (!m_stompConnected)
+      {
+        SendErrorAndClose("Not connected");
+        return;
+      }
+      if (!frame.HasHeader("id") || !frame.HasHeader("destination"))
+      {
+        SendErrorAndClose("SUBSCRIBE requires the id and destination headers");
+        return;
+      }
+
+      m_subscriptions.push_back(Subscription {
+        std::string { frame.GetHeader("id") },
+        std::string { frame.GetHeader("destination") },
+        0,
+        std::chrono::steady_clock::now()
+      });
+      m_server.m_subscriptions.fetch_add(1, std::memory_order_relaxed);
+      SendReceipt(frame);
+
+      if (!m_streaming)
+      {
+        m_streaming = true;
+        SendNextEvent();
+      }
+    }
+
+    void OnUnsubscribe(const StompFrame& frame)
+    {
+      const auto id { frame.GetHeader("id") };
+      m_subscriptions.erase(
+        std::remove_if(m_subscriptions.begin(), m_subscriptions.end(),
+          [&id](const auto& subscription) {
+            return subscription.id == id;
+          }
+        ),
+        m_subscriptions.end()
+      );
+      SendReceipt(frame);
+    }
+
+    void SendReceipt(const StompFrame& frame)
+    {
+      if (!frame.HasHeader("receipt"))
+        return;
+
+      Write(NetworkMonitor::SerializeStompFrame(StompFrame {
+        StompCommand::Receipt,
+        {{"receipt-id", std::string { frame.GetHeader("receipt") }}},
+        {}
+      }));
+    }
+
+    void SendErrorAndClose(const std::string& message)
+    {
+      m_closing = true;
+      m_timer.cancel();
+      Write(MakeErrorFrame(message));
+      Close();
+    }
+
+    void Close()
+    {
+      // Queue the close behind any pending write
+      Write({});
+    }
+
+    // Send the next event of the subscription that is the most behind its
+    //  schedule, waiting if no subscription is due yet.
+    void SendNextEvent()
+    {
+      const auto& options { m_server.m_options };
+      if (m_closing || m_dropped)
+      {
+        m_streaming = false;
+        return;
+      }
+
+      Subscription* next { nullptr };
+      std::chrono::steady_clock::time_point nextDueAt {};
+      for (auto& subscription: m_subscriptions)
+      {
+        if (options.maxMessages > 0 &&
+            subscription.sequence >= options.maxMessages)
+          continue;
+
+        const auto dueAt {
+          options.messagesPerSecond > 0.0 ?
+            subscription.startedAt +
+              std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double> {
+                  subscription.sequence / options.messagesPerSecond
+                }
+              ) :
+            subscription.startedAt
+        };
+        if (next == nullptr || dueAt < nextDueAt)
+        {
+          next = &subscription;
+          nextDueAt = dueAt;
+        }
+      }
+
+      // All the subscriptions are done. A new SUBSCRIBE restarts streaming.
+      if (next == nullptr)
+      {
+        m_streaming = false;
+        return;
+      }
+
+      if (nextDueAt > std::chrono::steady_clock::now())
+      {
+        m_timer.expires_at(nextDueAt);
+        m_timer.async_wait([self = shared_from_this()](auto ec) {
+          if (ec)
+          {
+            self->m_streaming = false;
+            return;
+          }
+          self->SendNextEvent();
+        });
+        return;
+      }
+
+      Write(MakeEvent(*next), true);
+    }
+
+    std::string MakeEvent(Subscription& subscription)
+    {
+      const auto now { std::chrono::system_clock::now() };
+      const auto& options { m_server.m_options };
+      std::uniform_int_distribution<std::size_t> stationDistribution {
+        0, std::max<std::size_t>(options.nStations, 1) - 1
+      };
+      const bool in { (m_random() & 1) == 0 };
+
+      std::string body {};
+      body.reserve(96);
+      body += "{\"datetime\":\"";
+      body += FormatDateTime(now);
+      body += "\",\"passenger_event\":\"";
+      body += in ? "in" : "out";
+      body += "\",\"station_id\":\"";
+      body += MakeStationId(stationDistribution(m_random));
+      body += "\"}";
+
+      StompFrame frame {
+        StompCommand::Message,
+        {
+          {"subscription", subscription.id},
+          {"message-id", std::to_string(subscription.sequence)},
+          {"destination", subscription.destination},
+          {"content-type", "application/json"},
+          {"sent-at-ns", std::to_string(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+              now.time_since_epoch()
+            ).count()
+          )},
+          {"content-length", std::to_string(body.size())},
+        },
+        std::move(body)
+      };
+      ++subscription.sequence;
+      return NetworkMonitor::SerializeStompFrame(frame);
+    }
+
+    // An empty message is a request to close the WebSocket connection
+    void Write(std::string message, bool isEvent = false)
+    {
+      m_writeQueue.push_back(PendingWrite { std::move(message), isEvent });
+      if (!m_writing)
+        DoWrite();
+    }
+
+    void DoWrite()
+    {
+      if (m_writeQueue.empty() || m_dropped)
+      {
+        m_writing = false;
+        return;
+      }
+      m_writing = true;
+
+      if (m_writeQueue.front().message.empty())
+      {
+        m_writeQueue.clear();
+        m_ws.async_close(websocket::close_code::normal,
+          [self = shared_from_this()](auto) {
+            self->m_writing = false;
+          }
+        );
+        return;
+      }
+
+      m_ws.async_write(boost::asio::buffer(m_writeQueue.front().message),
+        [self = shared_from_this()](auto ec, auto nBytes) {
+          if (ec)
+          {
+            self->m_writing = false;
+            self->m_writeQueue.clear();
+            self->m_timer.cancel();
+            return;
+          }
+
+          const bool isEvent { self->m_writeQueue.front().isEvent };
+          self->m_writeQueue.pop_front();
+          if (isEvent)
+          {
+            self->m_server.m_messagesSent.fetch_add(
+              1, std::memory_order_relaxed
+            );
+            self->m_server.m_bytesSent.fetch_add(
+              nBytes, std::memory_order_relaxed
+            );
+            self->SendNextEvent();
+          }
+          self->DoWrite();
+        }
+      );
+    }
+};
+
+// Public methods
+
+MockServer::MockServer(
+  const MockServerOptions& options
+) : m_options { options }
+  , m_ctx { boost::asio::ssl::context::tls_server }
+  , m_acceptor { m_ioc }
+{
+}
+
+MockServer::~MockServer()
+{
+  Stop();
+}
+
+bool MockServer::Start()
+{
+  boost::system::error_code ec {};
+
+  // TLS
+  m_ctx.set_options(
+    boost::asio::ssl::context::default_workarounds |
+    boost::asio::ssl::context::no_sslv2 |
+    boost::asio::ssl::context::no_sslv3
+  );
+  m_ctx.use_certificate_chain_file(m_options.certFile.string(), ec);
+  if (ec)
+    return false;
+  m_ctx.use_private_key_file(
+    m_options.keyFile.string(),
+    boost::asio::ssl::context::pem,
+    ec
+  );
+  if (ec)
+    return false;
+
+  // Listen
+  const auto address { boost::asio::ip::make_address(m_options.address, ec) };
+  if (ec)
+    return false;
+  const tcp::endpoint endpoint { address, m_options.port };
+  m_acceptor.open(endpoint.protocol(), ec);
+  if (ec)
+    return false;
+  m_acceptor.set_option(boost::asio::socket_base::reuse_address(true), ec);
+  m_acceptor.bind(endpoint, ec);
+  if (ec)
+    return false;
+  m_acceptor.listen(boost::asio::socket_base::max_listen_connections, ec);
+  if (ec)
+    return false;
+  m_port = m_acceptor.local_endpoint().port();
+
+  Accept();
+
+  const auto nThreads { std::max<std::size_t>(m_options.nThreads, 1) };
+  m_threads.reserve(nThreads);
+  for (std::size_t idx {0}; idx < nThreads; ++idx)
+  {
+    m_threads.emplace_back([this]() {
+      m_ioc.run();
+    });
+  }
+  return true;
+}
+
+void MockServer::Stop()
+{
+  m_ioc.stop();
+  for (auto& thread: m_threads)
+  {
+    if (thread.joinable())
+      thread.join();
+  }
+  m_threads.clear();
+
+  // No thread is running the acceptor any more, so we can touch it here
+  boost::system::error_code ec {};
+  m_acceptor.close(ec);
+}
+
+unsigned short MockServer::GetPort() const
+{
+  return m_port;
+}
+
+void MockServer::DropConnections()
+{
+  std::lock_guard<std::mutex> lock { m_sessionsMutex };
+  for (auto& weakSession: m_sessions)
+  {
+    if (auto session { weakSession.lock() })
+      session->Drop();
+  }
+  m_sessions.clear();
+}
+
+MockServerStats MockServer::GetStats() const
+{
+  MockServerStats stats {};
+  stats.connections   = m_connections.load(std::memory_order_relaxed);
+  stats.subscriptions = m_subscriptions.load(std::memory_order_relaxed);
+  stats.messagesSent  = m_messagesSent.load(std::memory_order_relaxed);
+  stats.bytesSent     = m_bytesSent.load(std::memory_order_relaxed);
+  stats.httpRequests  = m_httpRequests.load(std::memory_order_relaxed);
+  stats.httpNotModified = m_httpNotModified.load(std::memory_order_relaxed);
+  stats.httpBytesSent = m_httpBytesSent.load(std::memory_order_relaxed);
+  stats.httpPartialContent =
+    m_httpPartialContent.load(std::memory_order_relaxed);
+  stats.httpCompressed = m_httpCompressed.load(std::memory_order_relaxed);
+  return stats;
+}
+
+// Private methods
+
+void MockServer::Accept()
+{
+  // Each connection gets its own strand
+  m_acceptor.async_accept(boost::asio::make_strand(m_ioc),
+    [this](auto ec, tcp::socket socket) {
+      if (ec)
+      {
+        // The acceptor was closed
+        if (ec == boost::asio::error::operation_aborted)
+          return;
+      }
+      else
+      {
+        m_connections.fetch_add(1, std::memory_order_relaxed);
+        auto session { std::make_shared<Session>(*this, std::move(socket)) };
+        {
+          std::lock_guard<std::mutex> lock { m_sessionsMutex };
+
+          // Forget about the sessions that are gone
+          m_sessions.erase(
+            std::remove_if(m_sessions.begin(), m_sessions.end(),
+              [](const auto& weakSession) {
+                return weakSession.expired();
+              }
+            ),
+            m_sessions.end()
+          );
+          m_sessions.push_back(session);
+        }
+        session->Run();
+      }
+      Accept();
+    }
+  );
+}
@@ -0,0 +1,248 @@
+#include <network-monitor/feed-capture.h>
+#include <network-monitor/stomp-frame.h>
+#include <network-monitor/transport-network.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using NetworkMonitor::FeedCapture;
+using NetworkMonitor::FeedCaptureReader;
+using NetworkMonitor::FeedMessage;
+using NetworkMonitor::FeedReplayOptions;
+using NetworkMonitor::ParsePassengerEventMessage;
+using NetworkMonitor::PassengerEvent;
+using NetworkMonitor::ReplayFeedCapture;
+using NetworkMonitor::SerializeStompFrame;
+using NetworkMonitor::StompCommand;
+using NetworkMonitor::StompFrame;
+using NetworkMonitor::TransportNetwork;
+
+using namespace std::chrono_literals;
+
+// A capture file, removed at the end of the test
+struct CaptureFile
+{
+  std::filesystem::path path {};
+
+  explicit CaptureFile(
+    const std::string& name
+  ) : path { std::filesystem::temp_directory_path() /
+             ("network-monitor-feed-" + name + ".cap") }
+  {
+    std::filesystem::remove(path);
+  }
+
+  ~CaptureFile()
+  {
+    std::filesystem::remove(path);
+  }
+};
+
+// A passenger event as the feed sends it
+static std::string MakeEventMessage(
+  const std::string& stationId,
+  const std::string& type,
+  const std::string& dateTime = "2024-01-01T08:00:00.000000Z"
+)
+{
+  std::string body {
+    "{\"datetime\":\"" + dateTime + "\",\"passenger_event\":\"" + type +
+    "\",\"station_id\":\"" + stationId + "\"}"
+  };
+  return SerializeStompFrame(StompFrame {
+    StompCommand::Message,
+    {
+      {"subscription", "0"},
+      {"message-id", "0"},
+      {"destination", "/passengers"},
+      {"content-length", std::to_string(body.size())},
+    },
+    std::move(body)
+  });
+}
+
+static TransportNetwork GetNetwork()
+{
+  TransportNetwork network {};
+  for (const std::string id: {"station_0", "station_1"})
+    network.AddStation({id, id});
+  return network;
+}
+
+BOOST_AUTO_TEST_SUITE(network_monitor);
+
+BOOST_AUTO_TEST_SUITE(class_FeedCapture);
+
+BOOST_AUTO_TEST_CASE(round_trip)
+{
+  CaptureFile file { "round-trip" };
+  FeedCapture capture {};
+  BOOST_REQUIRE(capture.Open(file.path));
+  const auto start { std::chrono::system_clock::now() };
+  const std::vector<std::string> payloads {
+    "CONNECTED\nversion:1.2\n\n", std::string(300, 'x'), ""
+  };
+  capture.Record(payloads[0], start + 1ms);
+  capture.Record(payloads[1], start + 1s);
+
+  // An older time does not go backwards
+  capture.Record(payloads[2], start);
+  BOOST_CHECK_EQUAL(capture.GetMessageCount(), 3);
+  capture.Close();
+  BOOST_CHECK(capture.GetError().empty());
+  BOOST_CHECK_EQUAL(capture.GetByteCount(),
+                    std::filesystem::file_size(file.path));
+
+  FeedCaptureReader reader {};
+  BOOST_REQUIRE(reader.Open(file.path));
+  BOOST_CHECK(reader.GetStartTime() <= start);
+  std::vector<FeedMessage> messages {};
+  FeedMessage message {};
+  while (reader.Next(message))
+    messages.push_back(message);
+  BOOST_CHECK(!reader.IsTruncated());
+  BOOST_REQUIRE_EQUAL(messages.size(), 3);
+  for (std::size_t idx {0}; idx < messages.size(); ++idx)
+    BOOST_CHECK_EQUAL(messages[idx].payload, payloads[idx]);
+  BOOST_CHECK(messages[0].receivedAt == start + 1ms);
+  BOOST_CHECK(messages[1].receivedAt == start + 1s);
+  BOOST_CHECK(messages[2].receivedAt == start + 1s);
+}
+
+BOOST_AUTO_TEST_CASE(truncated)
+{
+  CaptureFile file { "truncated" };
+  {
+    FeedCapture capture {};
+    BOOST_REQUIRE(capture.Open(file.path));
+    capture.Record(MakeEventMessage("station_0", "in"));
+    capture.Record(MakeEventMessage("station_1", "out"));
+  }
+
+  // Cut the last record short, like a crash while writing it
+  std::filesystem::resize_file(file.path,
+                               std::filesystem::file_size(file.path) - 3);
+  FeedCaptureReader reader {};
+  BOOST_REQUIRE(reader.Open(file.path));
+  FeedMessage message {};
+  BOOST_CHECK(reader.Next(message));
+  BOOST_CHECK_EQUAL(message.payload, MakeEventMessage("station_0", "in"));
+  BOOST_CHECK(!reader.Next(message));
+  BOOST_CHECK(reader.IsTruncated());
+}
+
+BOOST_AUTO_TEST_CASE(not_a_capture)
+{
+  CaptureFile file { "not-a-capture" };
+  FeedCaptureReader reader {};
+  BOOST_CHECK(!reader.Open(file.path));
+  BOOST_CHECK(!reader.GetError().empty());
+
+  std::ofstream { file.path } << "{\"stations\":[]}";
+  FeedCaptureReader other {};
+  BOOST_CHECK(!other.Open(file.path));
+  BOOST_CHECK(!other.GetError().empty());
+}
+
+BOOST_AUTO_TEST_CASE(parse_passenger_event)
+{
+  PassengerEvent event {};
+  BOOST_REQUIRE(ParsePassengerEventMessage(
+    MakeEventMessage("station_0", "out", "2024-02-29T23:59:30.25Z"), event
+  ));
+  BOOST_CHECK_EQUAL(event.stationId, "station_0");
+  BOOST_CHECK(event.type == PassengerEvent::Type::Out);
+  using namespace std::chrono;
+  BOOST_CHECK(event.timestamp ==
+              sys_days {2024y / February / 29} + 23h + 59min + 30s + 250ms);
+
+  BOOST_CHECK(ParsePassengerEventMessage(
+    MakeEventMessage("station_0", "in", "2024-01-01T08:00:00Z"), event
+  ));
+  BOOST_CHECK(event.type == PassengerEvent::Type::In);
+
+  // Not passenger events
+  BOOST_CHECK(!ParsePassengerEventMessage("CONNECTED\nversion:1.2\n\n\0",
+                                          event));
+  BOOST_CHECK(!ParsePassengerEventMessage("not a frame", event));
+  BOOST_CHECK(!ParsePassengerEventMessage(SerializeStompFrame(StompFrame {
+    StompCommand::Message, {{"destination", "/passengers"}}, "{\"datetime\""
+  }), event));
+  BOOST_CHECK(!ParsePassengerEventMessage(
+    MakeEventMessage("station_0", "sideways"), event
+  ));
+  BOOST_CHECK(!ParsePassengerEventMessage(
+    MakeEventMessage("station_0", "in", "2023-02-29T08:00:00Z"), event
+  ));
+  BOOST_CHECK(!ParsePassengerEventMessage(
+    MakeEventMessage("station_0", "in", "2024-01-01 08:00:00Z"), event
+  ));
+}
+
+BOOST_AUTO_TEST_CASE(replay)
+{
+  CaptureFile file { "replay" };
+  {
+    FeedCapture capture {};
+    BOOST_REQUIRE(capture.Open(file.path));
+    capture.Record("CONNECTED\nversion:1.2\n\n");
+    for (int idx {0}; idx < 100; ++idx)
+      capture.Record(MakeEventMessage("station_0", "in"));
+    for (int idx {0}; idx < 30; ++idx)
+      capture.Record(MakeEventMessage("station_1", "out"));
+
+    // Unknown to the network
+    capture.Record(MakeEventMessage("station_2", "in"));
+  }
+
+  auto network { GetNetwork() };
+  const auto report { ReplayFeedCapture(file.path, network) };
+  BOOST_CHECK(report.error.empty());
+  BOOST_CHECK(!report.truncated);
+  BOOST_CHECK_EQUAL(report.nMessages, 132);
+  BOOST_CHECK_EQUAL(report.nEvents, 131);
+  BOOST_CHECK_EQUAL(report.nRecorded, 130);
+  BOOST_CHECK(report.nBytes > 0);
+  BOOST_CHECK_EQUAL(network.GetPassengerCount("station_0"), 100);
+  BOOST_CHECK_EQUAL(network.GetPassengerCount("station_1"), -30);
+  BOOST_CHECK(report.p50 <= report.p90);
+  BOOST_CHECK(report.p90 <= report.p99);
+  BOOST_CHECK(report.p99 <= report.p999);
+  BOOST_CHECK(report.p999 <= report.max);
+  BOOST_CHECK(report.GetMessageRate() > 0.0);
+
+  BOOST_CHECK(!ReplayFeedCapture(file.path.string() + ".missing",
+                                 network).error.empty());
+}
+
+BOOST_AUTO_TEST_CASE(replay_paced)
+{
+  CaptureFile file { "replay-paced" };
+  {
+    FeedCapture capture {};
+    BOOST_REQUIRE(capture.Open(file.path));
+    const auto start { std::chrono::system_clock::now() };
+    for (int idx {0}; idx <= 10; ++idx)
+      capture.Record(MakeEventMessage("station_0", "in"), start + idx * 20ms);
+  }
+
+  // Ten times as fast as captured: 200 ms of feed in 20 ms
+  auto network { GetNetwork() };
+  FeedReplayOptions options {};
+  options.speed = 10.0;
+  const auto report { ReplayFeedCapture(file.path, network, options) };
+  BOOST_CHECK(report.error.empty());
+  BOOST_CHECK_EQUAL(report.nRecorded, 11);
+  BOOST_CHECK(report.captureDuration == 200ms);
+  BOOST_CHECK(report.duration >= 20ms);
+  BOOST_CHECK(report.duration < 200ms);
+}
+
+BOOST_AUTO_TEST_SUITE_END(); // class_FeedCapture
+
+BOOST_AUTO_TEST_SUITE_END(); // network_monitor
@@ -1,16 +1,34 @@
 #include <network-monitor/file-downloader.h>
+#include <network-monitor/mock-server.h>
+#include <network-monitor/transport-network.h>
 
 #include <boost/asio.hpp>
 #include <boost/test/unit_test.hpp>
 
 #include <nlohmann/json.hpp>
 
+#include <chrono>
 #include <filesystem>
 #include <fstream>
+#include <iterator>
+#include <stdexcept>
 #include <string>
+#include <thread>
 
 using NetworkMonitor::DownloadFile;
+using NetworkMonitor::DownloadFileIfModified;
+using NetworkMonitor::DownloadFileResumable;
+using NetworkMonitor::DownloadFileToStream;
+using NetworkMonitor::Downloader;
+using NetworkMonitor::DownloadFiles;
+using NetworkMonitor::DownloadRequest;
+using NetworkMonitor::DownloadResult;
+using NetworkMonitor::DownloadStatus;
+using NetworkMonitor::JsonFileError;
+using NetworkMonitor::MockServer;
+using NetworkMonitor::MockServerOptions;
 using NetworkMonitor::ParseJsonFile;
+using NetworkMonitor::TransportNetwork;
 
 BOOST_AUTO_TEST_SUITE(network_monitor);
 
@@ -53,9 +71,555 @@ BOOST_AUTO_TEST_CASE(file_downloader)
   std::filesystem::remove(destination);
 }
 
+BOOST_AUTO_TEST_CASE(file_downloader_if_modified)
+{
+  // Serve a copy of the network layout from a local HTTPS server
+  const auto root {
+    std::filesystem::temp_directory_path() / "network-monitor-http-root"
+  };
+  std::filesystem::create_directories(root);
+  std::filesystem::copy_file(TESTS_NETWORK_LAYOUT_JSON,
+    root / "network-layout.json",
+    std::filesystem::copy_options::overwrite_existing
+  );
+  MockServerOptions options {};
+  options.certFile = TESTS_LOCALHOST_PEM;
+  options.keyFile = TESTS_LOCALHOST_KEY_PEM;
+  options.documentRoot = root;
+  MockServer server { options };
+  BOOST_REQUIRE(server.Start());
+
+  const std::string fileUrl {
+    "https://localhost:" + std::to_string(server.GetPort()) +
+    "/network-layout.json"
+  };
+  const auto destination {
+    std::filesystem::temp_directory_path() / "network-layout-cached.json"
+  };
+  auto metadata { destination };
+  metadata += ".meta";
+  std::filesystem::remove(destination);
+  std::filesystem::remove(metadata);
+
+  // First download: no local copy yet
+  auto status { DownloadFileIfModified(
+    fileUrl, destination, TESTS_LOCALHOST_PEM
+  )};
+  BOOST_CHECK(status == DownloadStatus::Downloaded);
+  BOOST_CHECK(std::filesystem::exists(metadata));
+  const auto size { std::filesystem::file_size(TESTS_NETWORK_LAYOUT_JSON) };
+  BOOST_CHECK_EQUAL(std::filesystem::file_size(destination), size);
+  BOOST_CHECK_EQUAL(server.GetStats().httpBytesSent, size);
+
+  // Second download: the server confirms that the copy is up to date
+  status = DownloadFileIfModified(fileUrl, destination, TESTS_LOCALHOST_PEM);
+  BOOST_CHECK(status == DownloadStatus::NotModified);
+  BOOST_CHECK_EQUAL(server.GetStats().httpNotModified, 1);
+  BOOST_CHECK_EQUAL(server.GetStats().httpBytesSent, size);
+  BOOST_CHECK_EQUAL(std::filesystem::file_size(destination), size);
+
+  // The remote file changes
+  {
+    std::ofstream file { root / "network-layout.json", std::ios::app };
+    file << "\n";
+  }
+  status = DownloadFileIfModified(fileUrl, destination, TESTS_LOCALHOST_PEM);
+  BOOST_CHECK(status == DownloadStatus::Downloaded);
+  BOOST_CHECK_EQUAL(std::filesystem::file_size(destination), size + 1);
+
+  // A missing remote file leaves the local copy alone
+  status = DownloadFileIfModified(
+    "https://localhost:" + std::to_string(server.GetPort()) + "/missing.json",
+    destination, TESTS_LOCALHOST_PEM
+  );
+  BOOST_CHECK(status == DownloadStatus::Failed);
+  BOOST_CHECK_EQUAL(std::filesystem::file_size(destination), size + 1);
+
+  // Clean up
+  server.Stop();
+  std::filesystem::remove(destination);
+  std::filesystem::remove(metadata);
+  std::filesystem::remove_all(root);
+}
+
+BOOST_AUTO_TEST_CASE(file_downloader_to_stream)
+{
+  MockServerOptions options {};
+  options.certFile = TESTS_LOCALHOST_PEM;
+  options.keyFile = TESTS_LOCALHOST_KEY_PEM;
+  options.documentRoot =
+    std::filesystem::path { TESTS_NETWORK_LAYOUT_JSON }.parent_path();
+  MockServer server { options };
+  BOOST_REQUIRE(server.Start());
+  const std::string baseUrl {
+    "https://localhost:" + std::to_string(server.GetPort())
+  };
+
+  // Build the network while the file downloads
+  TransportNetwork network {};
+  bool ok { DownloadFileToStream(baseUrl + "/network-layout.json",
+    [&network](std::istream& src) {
+      return network.FromJson(src);
+    },
+    TESTS_LOCALHOST_PEM
+  )};
+  BOOST_CHECK(ok);
+  BOOST_CHECK_EQUAL(
+    server.GetStats().httpBytesSent,
+    std::filesystem::file_size(TESTS_NETWORK_LAYOUT_JSON)
+  );
+  BOOST_CHECK_EQUAL(network.GetTravelTime("station_000", "station_001"), 2);
+
+  // A missing file is a failed transfer, not a parse error
+  TransportNetwork empty {};
+  ok = DownloadFileToStream(baseUrl + "/missing.json",
+    [&empty](std::istream& src) {
+      return empty.FromJson(src);
+    },
+    TESTS_LOCALHOST_PEM
+  );
+  BOOST_CHECK(!ok);
+}
+
+BOOST_AUTO_TEST_CASE(file_downloader_to_stream_abort)
+{
+  // 300 kB at 100 kB/s: A full transfer takes 3 s
+  MockServerOptions options {};
+  options.certFile = TESTS_LOCALHOST_PEM;
+  options.keyFile = TESTS_LOCALHOST_KEY_PEM;
+  options.documentRoot =
+    std::filesystem::path { TESTS_NETWORK_LAYOUT_JSON }.parent_path();
+  options.httpBytesPerSecond = 100'000.0;
+  MockServer server { options };
+  BOOST_REQUIRE(server.Start());
+  const std::string fileUrl {
+    "https://localhost:" + std::to_string(server.GetPort()) +
+    "/network-layout.json"
+  };
+  const auto readSome { [](std::istream& src) {
+    char head[10] {};
+    src.read(head, sizeof(head));
+    return src.gcount() == sizeof(head);
+  }};
+
+  // A consumer that gives up after a few bytes does not wait for the rest
+  auto startedAt { std::chrono::steady_clock::now() };
+  bool ok { DownloadFileToStream(fileUrl,
+    [&readSome](std::istream& src) {
+      readSome(src);
+      return false;
+    },
+    TESTS_LOCALHOST_PEM
+  )};
+  BOOST_CHECK(!ok);
+  BOOST_CHECK(std::chrono::steady_clock::now() - startedAt <
+              std::chrono::seconds(1));
+
+  // Nor does one that throws, and its exception reaches the caller
+  startedAt = std::chrono::steady_clock::now();
+  BOOST_CHECK_THROW(DownloadFileToStream(fileUrl,
+    [&readSome](std::istream& src) -> bool {
+      if (readSome(src))
+        throw std::runtime_error { "Bad header" };
+      return true;
+    },
+    TESTS_LOCALHOST_PEM
+  ), std::runtime_error);
+  BOOST_CHECK(std::chrono::steady_clock::now() - startedAt <
+              std::chrono::seconds(1));
+}
+
+BOOST_AUTO_TEST_CASE(file_downloader_batch)
+{
+  MockServerOptions options {};
+  options.certFile = TESTS_LOCALHOST_PEM;
+  options.keyFile = TESTS_LOCALHOST_KEY_PEM;
+  options.documentRoot = TEST_DATA;
+  MockServer server { options };
+  BOOST_REQUIRE(server.Start());
+  const std::string baseUrl {
+    "https://localhost:" + std::to_string(server.GetPort()) + "/"
+  };
+
+  const auto outputDir {
+    std::filesystem::temp_directory_path() / "network-monitor-batch"
+  };
+  std::filesystem::create_directories(outputDir);
+  const std::vector<std::string> files {
+    "from_json_1line_1route.json",
+    "from_json_travel_times.json",
+    "from_json_bad_travel_times.json",
+    "missing.json",
+  };
+  std::vector<DownloadRequest> requests {};
+  for (const auto& file: files)
+    requests.push_back({baseUrl + file, outputDir / file});
+
+  std::vector<std::string> completed {};
+  const auto results { DownloadFiles(requests, std::chrono::seconds(10),
+    [&completed](const DownloadResult& result) {
+      completed.push_back(result.fileUrl);
+    },
+    TESTS_LOCALHOST_PEM
+  )};
+  BOOST_CHECK_EQUAL(completed.size(), files.size());
+  BOOST_REQUIRE_EQUAL(results.size(), files.size());
+  for (std::size_t idx {0}; idx < 3; ++idx)
+  {
+    const auto size {
+      std::filesystem::file_size(std::filesystem::path(TEST_DATA) / files[idx])
+    };
+    BOOST_CHECK(results[idx].ok);
+    BOOST_CHECK_EQUAL(results[idx].responseCode, 200);
+    BOOST_CHECK_EQUAL(results[idx].bytes, size);
+    BOOST_CHECK(results[idx].bytesPerSecond > 0.0);
+    BOOST_CHECK_EQUAL(std::filesystem::file_size(outputDir / files[idx]), size);
+  }
+  BOOST_CHECK(!results[3].ok);
+  BOOST_CHECK_EQUAL(results[3].responseCode, 404);
+  BOOST_CHECK(!std::filesystem::exists(outputDir / files[3]));
+
+  std::filesystem::remove_all(outputDir);
+}
+
+BOOST_AUTO_TEST_CASE(file_downloader_batch_queued)
+{
+  // 3 x 300 kB at 1 MB/s, one at a time
+  MockServerOptions options {};
+  options.certFile = TESTS_LOCALHOST_PEM;
+  options.keyFile = TESTS_LOCALHOST_KEY_PEM;
+  options.documentRoot =
+    std::filesystem::path { TESTS_NETWORK_LAYOUT_JSON }.parent_path();
+  options.httpBytesPerSecond = 1'000'000.0;
+  MockServer server { options };
+  BOOST_REQUIRE(server.Start());
+
+  const auto outputDir {
+    std::filesystem::temp_directory_path() / "network-monitor-queued"
+  };
+  std::filesystem::create_directories(outputDir);
+  std::vector<DownloadRequest> requests {};
+  for (int idx {0}; idx < 3; ++idx)
+  {
+    requests.push_back({
+      "https://localhost:" + std::to_string(server.GetPort()) +
+        "/network-layout.json",
+      outputDir / ("network-layout-" + std::to_string(idx) + ".json")
+    });
+  }
+  const auto startedAt { std::chrono::steady_clock::now() };
+  const auto results { DownloadFiles(requests, std::chrono::seconds(10),
+                                     nullptr, TESTS_LOCALHOST_PEM, 1) };
+  const auto elapsed { std::chrono::steady_clock::now() - startedAt };
+
+  // The time a transfer waits for its turn is not part of its duration
+  BOOST_REQUIRE_EQUAL(results.size(), 3);
+  for (const auto& result: results)
+  {
+    BOOST_CHECK(result.ok);
+    BOOST_CHECK(result.duration > std::chrono::nanoseconds {0});
+    BOOST_CHECK(result.duration < elapsed / 2);
+    BOOST_CHECK(result.bytesPerSecond > 0.0);
+  }
+
+  std::filesystem::remove_all(outputDir);
+}
+
+BOOST_AUTO_TEST_CASE(file_downloader_batch_deadline)
+{
+  // 300 kB at 100 kB/s cannot make a 200 ms deadline
+  MockServerOptions options {};
+  options.certFile = TESTS_LOCALHOST_PEM;
+  options.keyFile = TESTS_LOCALHOST_KEY_PEM;
+  options.documentRoot =
+    std::filesystem::path { TESTS_NETWORK_LAYOUT_JSON }.parent_path();
+  options.httpBytesPerSecond = 100'000.0;
+  MockServer server { options };
+  BOOST_REQUIRE(server.Start());
+
+  const auto destination {
+    std::filesystem::temp_directory_path() / "network-layout-deadline.json"
+  };
+  std::filesystem::remove(destination);
+  const auto startedAt { std::chrono::steady_clock::now() };
+  const auto results { DownloadFiles({{
+      "https://localhost:" + std::to_string(server.GetPort()) +
+        "/network-layout.json",
+      destination
+    }},
+    std::chrono::milliseconds(200),
+    nullptr,
+    TESTS_LOCALHOST_PEM
+  )};
+  const auto elapsed { std::chrono::steady_clock::now() - startedAt };
+
+  BOOST_REQUIRE_EQUAL(results.size(), 1);
+  BOOST_CHECK(!results[0].ok);
+  BOOST_CHECK_EQUAL(results[0].error, "Deadline exceeded");
+  BOOST_CHECK(elapsed < std::chrono::seconds(1));
+  BOOST_CHECK(!std::filesystem::exists(destination));
+}
+
+BOOST_AUTO_TEST_CASE(class_Downloader)
+{
+  MockServerOptions options {};
+  options.certFile = TESTS_LOCALHOST_PEM;
+  options.keyFile = TESTS_LOCALHOST_KEY_PEM;
+  options.documentRoot = TEST_DATA;
+  MockServer server { options };
+  BOOST_REQUIRE(server.Start());
+  const std::string fileUrl {
+    "https://localhost:" + std::to_string(server.GetPort()) +
+    "/from_json_travel_times.json"
+  };
+  const auto destination {
+    std::filesystem::temp_directory_path() / "from_json_travel_times.json"
+  };
+
+  // Repeated downloads share one connection
+  Downloader downloader { TESTS_LOCALHOST_PEM };
+  for (size_t idx {0}; idx < 5; ++idx)
+    BOOST_CHECK(downloader.DownloadFile(fileUrl, destination));
+  BOOST_CHECK_EQUAL(downloader.GetStats().transfers, 5);
+  BOOST_CHECK_EQUAL(downloader.GetStats().newConnections, 1);
+  BOOST_CHECK_EQUAL(server.GetStats().connections, 1);
+
+  // So do the other download modes
+  TransportNetwork network {};
+  BOOST_CHECK(downloader.DownloadFileToStream(fileUrl,
+    [&network](std::istream& src) {
+      return network.FromJson(src);
+    }
+  ));
+  const auto results { downloader.DownloadFiles({{fileUrl, destination}}) };
+  BOOST_REQUIRE_EQUAL(results.size(), 1);
+  BOOST_CHECK(results[0].ok);
+  BOOST_CHECK_EQUAL(downloader.GetStats().transfers, 7);
+  BOOST_CHECK_EQUAL(downloader.GetStats().newConnections, 1);
+
+  // The free functions start from scratch every time
+  BOOST_CHECK(DownloadFile(fileUrl, destination, TESTS_LOCALHOST_PEM));
+  BOOST_CHECK_EQUAL(server.GetStats().connections, 2);
+
+  std::filesystem::remove(destination);
+}
+
+static std::string ReadFile(
+  const std::filesystem::path& path
+)
+{
+  std::ifstream file { path, std::ios::binary };
+  return std::string {
+    std::istreambuf_iterator<char>(file),
+    std::istreambuf_iterator<char>()
+  };
+}
+
+BOOST_AUTO_TEST_CASE(file_downloader_resumable)
+{
+  // 300 kB at 200 kB/s: The connection drops half-way through
+  MockServerOptions options {};
+  options.certFile = TESTS_LOCALHOST_PEM;
+  options.keyFile = TESTS_LOCALHOST_KEY_PEM;
+  options.documentRoot =
+    std::filesystem::path { TESTS_NETWORK_LAYOUT_JSON }.parent_path();
+  options.httpBytesPerSecond = 200'000.0;
+  MockServer server { options };
+  BOOST_REQUIRE(server.Start());
+  const std::string fileUrl {
+    "https://localhost:" + std::to_string(server.GetPort()) +
+    "/network-layout.json"
+  };
+  const auto destination {
+    std::filesystem::temp_directory_path() / "network-layout-resumable.json"
+  };
+  auto partial { destination };
+  partial += ".part";
+  std::filesystem::remove(destination);
+  std::filesystem::remove(partial);
+
+  Downloader downloader { TESTS_LOCALHOST_PEM };
+  std::thread dropper { [&server]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    server.DropConnections();
+  }};
+  BOOST_CHECK(!downloader.DownloadFileResumable(fileUrl, destination));
+  dropper.join();
+  BOOST_CHECK(!std::filesystem::exists(destination));
+  BOOST_REQUIRE(std::filesystem::exists(partial));
+  const auto partialSize { std::filesystem::file_size(partial) };
+  BOOST_CHECK(partialSize > 0);
+
+  // The second attempt only fetches the rest
+  const auto bytesSent { server.GetStats().httpBytesSent };
+  BOOST_CHECK(downloader.DownloadFileResumable(fileUrl, destination));
+  BOOST_CHECK_EQUAL(server.GetStats().httpPartialContent, 1);
+  BOOST_CHECK_EQUAL(
+    server.GetStats().httpBytesSent - bytesSent,
+    std::filesystem::file_size(TESTS_NETWORK_LAYOUT_JSON) - partialSize
+  );
+  BOOST_CHECK(!std::filesystem::exists(partial));
+  BOOST_CHECK(ReadFile(destination) == ReadFile(TESTS_NETWORK_LAYOUT_JSON));
+
+  std::filesystem::remove(destination);
+}
+
+BOOST_AUTO_TEST_CASE(file_downloader_resumable_changed)
+{
+  // Serve a copy of the layout that we can change between the attempts
+  const auto documentRoot {
+    std::filesystem::temp_directory_path() / "network-monitor-resumable"
+  };
+  std::filesystem::create_directories(documentRoot);
+  const auto served { documentRoot / "network-layout.json" };
+  std::filesystem::copy_file(TESTS_NETWORK_LAYOUT_JSON, served,
+    std::filesystem::copy_options::overwrite_existing);
+
+  MockServerOptions options {};
+  options.certFile = TESTS_LOCALHOST_PEM;
+  options.keyFile = TESTS_LOCALHOST_KEY_PEM;
+  options.documentRoot = documentRoot;
+  options.httpBytesPerSecond = 200'000.0;
+  MockServer server { options };
+  BOOST_REQUIRE(server.Start());
+  const std::string fileUrl {
+    "https://localhost:" + std::to_string(server.GetPort()) +
+    "/network-layout.json"
+  };
+  const auto destination {
+    std::filesystem::temp_directory_path() / "network-layout-changed.json"
+  };
+  auto partial { destination };
+  partial += ".part";
+  std::filesystem::remove(destination);
+  std::filesystem::remove(partial);
+
+  Downloader downloader { TESTS_LOCALHOST_PEM };
+  std::thread dropper { [&server]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    server.DropConnections();
+  }};
+  BOOST_CHECK(!downloader.DownloadFileResumable(fileUrl, destination));
+  dropper.join();
+  BOOST_REQUIRE(std::filesystem::exists(partial));
+
+  // The new version has another size, hence another ETag: The server
+  //  ignores the range and the download starts over
+  {
+    std::ofstream file { served, std::ios::app };
+    file << "\n\n";
+  }
+  BOOST_CHECK(downloader.DownloadFileResumable(fileUrl, destination));
+  BOOST_CHECK_EQUAL(server.GetStats().httpPartialContent, 0);
+  BOOST_CHECK(!std::filesystem::exists(partial));
+  BOOST_CHECK(ReadFile(destination) == ReadFile(served));
+
+  std::filesystem::remove(destination);
+  std::filesystem::remove_all(documentRoot);
+}
+
+BOOST_AUTO_TEST_CASE(file_downloader_resumable_chunks)
+{
+  MockServerOptions options {};
+  options.certFile = TESTS_LOCALHOST_PEM;
+  options.keyFile = TESTS_LOCALHOST_KEY_PEM;
+  options.documentRoot =
+    std::filesystem::path { TESTS_NETWORK_LAYOUT_JSON }.parent_path();
+  options.httpBytesPerSecond = 200'000.0;
+  MockServer server { options };
+  BOOST_REQUIRE(server.Start());
+  const std::string fileUrl {
+    "https://localhost:" + std::to_string(server.GetPort()) +
+    "/network-layout.json"
+  };
+  const auto destination {
+    std::filesystem::temp_directory_path() / "network-layout-chunks.json"
+  };
+  auto partial { destination };
+  partial += ".part";
+  std::filesystem::remove(destination);
+  std::filesystem::remove(partial);
+
+  // 4 chunks at 200 kB/s each: The connections drop before they are done
+  std::thread dropper { [&server]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    server.DropConnections();
+  }};
+  BOOST_CHECK(!DownloadFileResumable(fileUrl, destination,
+                                     TESTS_LOCALHOST_PEM, 4));
+  dropper.join();
+  BOOST_CHECK(!std::filesystem::exists(destination));
+  BOOST_CHECK(std::filesystem::exists(partial));
+  BOOST_CHECK_EQUAL(server.GetStats().httpPartialContent, 4);
+
+  // Each chunk resumes where it stopped
+  BOOST_CHECK(DownloadFileResumable(fileUrl, destination,
+                                    TESTS_LOCALHOST_PEM, 4));
+  BOOST_CHECK_EQUAL(server.GetStats().httpPartialContent, 8);
+  BOOST_CHECK(!std::filesystem::exists(partial));
+  BOOST_CHECK(ReadFile(destination) == ReadFile(TESTS_NETWORK_LAYOUT_JSON));
+
+  std::filesystem::remove(destination);
+}
+
+BOOST_AUTO_TEST_CASE(file_downloader_gzip)
+{
+  // Serve the layout next to its compressed copy
+  const auto documentRoot {
+    std::filesystem::temp_directory_path() / "network-monitor-gzip"
+  };
+  std::filesystem::create_directories(documentRoot);
+  std::filesystem::copy_file(TESTS_NETWORK_LAYOUT_JSON,
+    documentRoot / "network-layout.json",
+    std::filesystem::copy_options::overwrite_existing
+  );
+  const auto gzipped {
+    std::filesystem::path(TEST_DATA) / "network-layout.json.gz"
+  };
+  std::filesystem::copy_file(gzipped,
+    documentRoot / "network-layout.json.gz",
+    std::filesystem::copy_options::overwrite_existing
+  );
+
+  MockServerOptions options {};
+  options.certFile = TESTS_LOCALHOST_PEM;
+  options.keyFile = TESTS_LOCALHOST_KEY_PEM;
+  options.documentRoot = documentRoot;
+  MockServer server { options };
+  BOOST_REQUIRE(server.Start());
+  const std::string fileUrl {
+    "https://localhost:" + std::to_string(server.GetPort()) +
+    "/network-layout.json"
+  };
+  const auto destination {
+    std::filesystem::temp_directory_path() / "network-layout-gzip.json"
+  };
+
+  // Only the compressed bytes go over the wire
+  BOOST_CHECK(DownloadFile(fileUrl, destination, TESTS_LOCALHOST_PEM));
+  BOOST_CHECK_EQUAL(server.GetStats().httpCompressed, 1);
+  BOOST_CHECK_EQUAL(server.GetStats().httpBytesSent,
+                    std::filesystem::file_size(gzipped));
+  BOOST_CHECK(ReadFile(destination) == ReadFile(TESTS_NETWORK_LAYOUT_JSON));
+
+  // So does a streamed download
+  TransportNetwork network {};
+  BOOST_CHECK(DownloadFileToStream(fileUrl,
+    [&network](std::istream& src) {
+      return network.FromJson(src);
+    },
+    TESTS_LOCALHOST_PEM
+  ));
+  BOOST_CHECK_EQUAL(server.GetStats().httpCompressed, 2);
+
+  std::filesystem::remove(destination);
+  std::filesystem::remove_all(documentRoot);
+}
+
 BOOST_AUTO_TEST_CASE(json_parser)
 {
-  nlohmann::json layout { ParseJsonFile(TESTS_NETWORK_LAYOUT_JSON) };
+  // Brace-initialization would wrap the object in an array
+  nlohmann::json layout = ParseJsonFile(TESTS_NETWORK_LAYOUT_JSON);
 
   BOOST_CHECK(layout.contains("lines"));
   BOOST_CHECK(layout.at("lines").size() > 0);
@@ -65,6 +629,74 @@ BOOST_AUTO_TEST_CASE(json_parser)
   BOOST_CHECK(layout.at("travel_times").size() > 0);
 }
 
+BOOST_AUTO_TEST_CASE(json_parser_error)
+{
+  const auto source {
+    std::filesystem::temp_directory_path() / "network-monitor-invalid.json"
+  };
+  {
+    std::ofstream file { source };
+    file << R"({"stations": [], "lines": [}, "travel_times": []})";
+  }
+
+  // The stray brace is the 28th byte
+  JsonFileError error {};
+  auto parsed = ParseJsonFile(source, error);
+  BOOST_CHECK(parsed.is_null());
+  BOOST_CHECK(!error.message.empty());
+  BOOST_CHECK_EQUAL(error.byteOffset, 28);
+
+  // Files that cannot be read have no offset
+  parsed = ParseJsonFile(source.string() + ".missing", error);
+  BOOST_CHECK(parsed.is_null());
+  BOOST_CHECK(!error.message.empty());
+  BOOST_CHECK_EQUAL(error.byteOffset, 0);
+
+  // Numbers that overflow a double are an error, not an exception
+  {
+    std::ofstream file { source };
+    file << R"({"a": 1e999})";
+  }
+  parsed = ParseJsonFile(source, error);
+  BOOST_CHECK(parsed.is_null());
+  BOOST_CHECK(error.message.find("1e999") != std::string::npos);
+  BOOST_CHECK_EQUAL(error.byteOffset, 0);
+
+  // A valid file clears the error
+  parsed = ParseJsonFile(TESTS_NETWORK_LAYOUT_JSON, error);
+  BOOST_CHECK(parsed.is_object());
+  BOOST_CHECK(error.message.empty());
+
+  std::filesystem::remove(source);
+}
+
+BOOST_AUTO_TEST_CASE(json_parser_gzip)
+{
+  const auto gzipped {
+    std::filesystem::path(TEST_DATA) / "network-layout.json.gz"
+  };
+  JsonFileError error {};
+  auto layout = ParseJsonFile(gzipped, error);
+  BOOST_CHECK(error.message.empty());
+  BOOST_CHECK(layout == ParseJsonFile(TESTS_NETWORK_LAYOUT_JSON));
+
+  // Truncated compressed data is not reported as a JSON syntax error
+  const auto truncated {
+    std::filesystem::temp_directory_path() / "network-layout-truncated.json.gz"
+  };
+  {
+    const auto content { ReadFile(gzipped) };
+    std::ofstream file { truncated, std::ios::binary };
+    file.write(content.data(), content.size() / 2);
+  }
+  layout = ParseJsonFile(truncated, error);
+  BOOST_CHECK(layout.is_null());
+  BOOST_CHECK(error.message.find("gzip") != std::string::npos);
+  BOOST_CHECK_EQUAL(error.byteOffset, 0);
+
+  std::filesystem::remove(truncated);
+}
+
 
 
 BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,224 @@
+#include <network-monitor/metrics-server.h>
+#include <network-monitor/metrics.h>
+#include <network-monitor/transport-network.h>
+
+#include <boost/asio.hpp>
+#include <boost/beast.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+using NetworkMonitor::CollectPassengerCounts;
+using NetworkMonitor::CollectRegistryMetrics;
+using NetworkMonitor::Counter;
+using NetworkMonitor::LatencyHistogram;
+using NetworkMonitor::MetricsServer;
+using NetworkMonitor::MetricsServerOptions;
+using NetworkMonitor::PassengerEvent;
+using NetworkMonitor::PrometheusWriter;
+using NetworkMonitor::TransportNetwork;
+
+using tcp = boost::asio::ip::tcp;
+namespace http = boost::beast::http;
+
+using namespace std::chrono_literals;
+
+static http::response<http::string_body> Get(
+  unsigned short port,
+  const std::string& target,
+  http::verb method = http::verb::get
+)
+{
+  boost::asio::io_context ioc {};
+  boost::beast::tcp_stream stream { ioc };
+  stream.connect(tcp::endpoint { boost::asio::ip::make_address("127.0.0.1"),
+                                 port });
+  http::request<http::empty_body> request { method, target, 11 };
+  request.set(http::field::host, "127.0.0.1");
+  http::write(stream, request);
+
+  boost::beast::flat_buffer buffer {};
+  http::response_parser<http::string_body> parser {};
+  parser.skip(method == http::verb::head);
+  http::read(stream, buffer, parser);
+  return parser.release();
+}
+
+BOOST_AUTO_TEST_SUITE(network_monitor);
+
+BOOST_AUTO_TEST_SUITE(class_PrometheusWriter);
+
+BOOST_AUTO_TEST_CASE(format)
+{
+  PrometheusWriter writer {};
+  writer.AddCounter("events_total", "Events \"ingested\"", 3);
+  writer.AddGauge("passengers", "Passengers", -2, {{"station", "a"}});
+  writer.AddGauge("passengers", "Passengers", 1.5,
+                  {{"station", "b\"\\\n"}, {"line", "c"}});
+  BOOST_CHECK_EQUAL(writer.GetText(),
+    "# HELP events_total Events \"ingested\"\n"
+    "# TYPE events_total counter\n"
+    "events_total 3\n"
+    "# HELP passengers Passengers\n"
+    "# TYPE passengers gauge\n"
+    "passengers{station=\"a\"} -2\n"
+    "passengers{station=\"b\\\"\\\\\\n\",line=\"c\"} 1.5\n"
+  );
+
+  // The family carries over to the next piece of text
+  BOOST_CHECK(!writer.TakeText().empty());
+  BOOST_CHECK(writer.GetText().empty());
+  writer.AddGauge("passengers", "Passengers", 0, {{"station", "d"}});
+  BOOST_CHECK_EQUAL(writer.GetText(), "passengers{station=\"d\"} 0\n");
+}
+
+BOOST_AUTO_TEST_CASE(summary)
+{
+  LatencyHistogram histogram { "test_summary_ns" };
+  histogram.Record(2ms);
+  PrometheusWriter writer {};
+  writer.AddSummary("latency_seconds", "", histogram.Snapshot(),
+                    {{"query", "q"}});
+  BOOST_CHECK_EQUAL(writer.GetText(),
+    "# TYPE latency_seconds summary\n"
+    "latency_seconds{query=\"q\",quantile=\"0.5\"} 0.002\n"
+    "latency_seconds{query=\"q\",quantile=\"0.9\"} 0.002\n"
+    "latency_seconds{query=\"q\",quantile=\"0.99\"} 0.002\n"
+    "latency_seconds{query=\"q\",quantile=\"0.999\"} 0.002\n"
+    "latency_seconds_sum{query=\"q\"} 0.002\n"
+    "latency_seconds_count{query=\"q\"} 1\n"
+  );
+}
+
+BOOST_AUTO_TEST_SUITE_END(); // class_PrometheusWriter
+
+BOOST_AUTO_TEST_SUITE(class_MetricsServer);
+
+BOOST_AUTO_TEST_CASE(scrape)
+{
+  TransportNetwork network {};
+  BOOST_REQUIRE(network.AddStation({"station_0", "Station 0"}));
+  BOOST_REQUIRE(network.AddStation({"station_1", "Station 1"}));
+  network.RecordPassengerEvent({"station_0", PassengerEvent::Type::In});
+  network.RecordPassengerEvent({"station_0", PassengerEvent::Type::In});
+  network.RecordPassengerEvent({"station_1", PassengerEvent::Type::Out});
+
+  Counter counter { "test_scrape_total" };
+  counter.Add(7);
+  LatencyHistogram histogram { "test_scrape_ns" };
+  histogram.Record(1ms);
+
+  MetricsServer server { MetricsServerOptions {} };
+  server.AddCollector(CollectRegistryMetrics());
+  server.AddCollector(CollectPassengerCounts(network));
+  server.AddCollector([](PrometheusWriter&) {
+    // Collectors with nothing to say do not end the response early
+  });
+  server.AddCollector([](PrometheusWriter& writer) {
+    writer.AddGauge("test_last", "", 1);
+  });
+  BOOST_REQUIRE(server.Start());
+  BOOST_CHECK(server.GetPort() != 0);
+
+  const auto response { Get(server.GetPort(), "/metrics") };
+  BOOST_CHECK_EQUAL(response.result(), http::status::ok);
+  BOOST_CHECK(response.chunked());
+  BOOST_CHECK_EQUAL(std::string(response[http::field::content_type]),
+                    "text/plain; version=0.0.4; charset=utf-8");
+  const auto& body { response.body() };
+  BOOST_CHECK(body.find("test_scrape_total 7\n") != std::string::npos);
+  BOOST_CHECK(body.find("# TYPE test_scrape_seconds summary\n") !=
+              std::string::npos);
+  BOOST_CHECK(body.find("test_scrape_seconds_count 1\n") != std::string::npos);
+  BOOST_CHECK(body.find(
+    "network_monitor_station_passengers{station=\"station_0\"} 2\n"
+  ) != std::string::npos);
+  BOOST_CHECK(body.find(
+    "network_monitor_station_passengers{station=\"station_1\"} -1\n"
+  ) != std::string::npos);
+  BOOST_CHECK(body.find("transport_network_passenger_events_total ") !=
+              std::string::npos);
+  BOOST_CHECK(body.size() >= 12 &&
+              body.compare(body.size() - 12, 12, "test_last 1\n") == 0);
+
+  // Other targets and methods
+  BOOST_CHECK_EQUAL(Get(server.GetPort(), "/other").result(),
+                    http::status::not_found);
+  BOOST_CHECK_EQUAL(Get(server.GetPort(), "/metrics", http::verb::post)
+                      .result(), http::status::method_not_allowed);
+  const auto head { Get(server.GetPort(), "/metrics", http::verb::head) };
+  BOOST_CHECK_EQUAL(head.result(), http::status::ok);
+  BOOST_CHECK(head.body().empty());
+  BOOST_CHECK_EQUAL(server.GetScrapes(), 2);
+  server.Stop();
+}
+
+BOOST_AUTO_TEST_CASE(scrape_while_recording)
+{
+  TransportNetwork network {};
+  for (int idx {0}; idx < 100; ++idx)
+  {
+    const auto id { "station_" + std::to_string(idx) };
+    BOOST_REQUIRE(network.AddStation({id, id}));
+  }
+
+  MetricsServer server { MetricsServerOptions {} };
+  server.AddCollector(CollectPassengerCounts(network));
+  BOOST_REQUIRE(server.Start());
+
+  // The ingestion thread never waits for the scrapes
+  std::atomic<bool> done {false};
+  std::thread ingestion { [&network, &done]() {
+    for (int idx {0}; idx < 100'000; ++idx)
+    {
+      network.RecordPassengerEvent(
+        {"station_" + std::to_string(idx % 100), PassengerEvent::Type::In}
+      );
+    }
+    done = true;
+  }};
+  std::size_t nScrapes {0};
+  while (!done || nScrapes == 0)
+  {
+    const auto response { Get(server.GetPort(), "/metrics") };
+    BOOST_REQUIRE_EQUAL(response.result(), http::status::ok);
+    ++nScrapes;
+  }
+  ingestion.join();
+
+  const auto body { Get(server.GetPort(), "/metrics").body() };
+  BOOST_CHECK(body.find(
+    "network_monitor_station_passengers{station=\"station_42\"} 1000\n"
+  ) != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(failing_collector)
+{
+  MetricsServer server { MetricsServerOptions {} };
+  server.AddCollector([](PrometheusWriter& writer) {
+    writer.AddGauge("test_before", "", 1);
+  });
+  server.AddCollector([](PrometheusWriter&) {
+    throw std::runtime_error("collector failed");
+  });
+  BOOST_REQUIRE(server.Start());
+
+  // The response is cut short instead of ending normally
+  BOOST_CHECK_THROW(Get(server.GetPort(), "/metrics"),
+                    boost::system::system_error);
+}
+
+BOOST_AUTO_TEST_CASE(bad_address)
+{
+  MetricsServerOptions options {};
+  options.address = "not-an-address";
+  MetricsServer server { options };
+  BOOST_CHECK(!server.Start());
+}
+
+BOOST_AUTO_TEST_SUITE_END(); // class_MetricsServer
+
+BOOST_AUTO_TEST_SUITE_END(); // network_monitor
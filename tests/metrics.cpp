@@ -0,0 +1,162 @@
+#include <network-monitor/metrics.h>
+#include <network-monitor/transport-network.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+using NetworkMonitor::Counter;
+using NetworkMonitor::GetLibraryMetrics;
+using NetworkMonitor::GetMetricsRegistry;
+using NetworkMonitor::LatencyHistogram;
+using NetworkMonitor::ScopedLatency;
+
+using namespace std::chrono_literals;
+
+BOOST_AUTO_TEST_SUITE(network_monitor);
+
+BOOST_AUTO_TEST_SUITE(class_LatencyHistogram);
+
+BOOST_AUTO_TEST_CASE(buckets)
+{
+  // Each value falls in a bucket whose limit is at most 1/64 above it
+  for (std::uint64_t value: {0ull, 1ull, 127ull, 128ull, 129ull, 1000ull,
+                             123'456ull, 1'000'000'007ull, (1ull << 39)})
+  {
+    const auto bucket { LatencyHistogram::GetBucket(value) };
+    BOOST_REQUIRE(bucket < LatencyHistogram::kBucketCount);
+    const auto limit { LatencyHistogram::GetBucketLimit(bucket) };
+    BOOST_CHECK(limit >= value);
+    BOOST_CHECK(limit - value <= value / 64);
+    if (bucket > 0)
+      BOOST_CHECK(LatencyHistogram::GetBucketLimit(bucket - 1) < value);
+  }
+
+  // Huge values go to the last bucket
+  BOOST_CHECK_EQUAL(LatencyHistogram::GetBucket(UINT64_MAX),
+                    LatencyHistogram::kBucketCount - 1);
+}
+
+BOOST_AUTO_TEST_CASE(percentiles)
+{
+  LatencyHistogram histogram { "test_percentiles" };
+  auto snapshot { histogram.Snapshot() };
+  BOOST_CHECK_EQUAL(snapshot.count, 0);
+  BOOST_CHECK_EQUAL(snapshot.p99, 0);
+
+  // 1 us to 10 ms, 1 us apart
+  for (std::uint64_t value {1}; value <= 10'000; ++value)
+    histogram.Record(std::chrono::microseconds(value));
+  snapshot = histogram.Snapshot();
+  BOOST_CHECK_EQUAL(snapshot.name, "test_percentiles");
+  BOOST_CHECK_EQUAL(snapshot.count, 10'000);
+  BOOST_CHECK_EQUAL(snapshot.min, 1'000);
+  BOOST_CHECK_EQUAL(snapshot.max, 10'000'000);
+  BOOST_CHECK_EQUAL(snapshot.sum, 10'000ull * 10'001 / 2 * 1'000);
+  BOOST_CHECK_CLOSE(static_cast<double>(snapshot.p50), 5'000'000.0, 1.6);
+  BOOST_CHECK_CLOSE(static_cast<double>(snapshot.p90), 9'000'000.0, 1.6);
+  BOOST_CHECK_CLOSE(static_cast<double>(snapshot.p99), 9'900'000.0, 1.6);
+  BOOST_CHECK_CLOSE(static_cast<double>(snapshot.p999), 9'990'000.0, 1.6);
+  BOOST_CHECK_EQUAL(snapshot.GetPercentile(100.0), snapshot.max);
+}
+
+BOOST_AUTO_TEST_CASE(threads)
+{
+  // Each thread records into its own shard; the snapshot merges them
+  LatencyHistogram histogram { "test_threads" };
+  Counter counter { "test_threads_total" };
+  std::vector<std::thread> threads {};
+  for (std::uint64_t thread {0}; thread < 4; ++thread)
+  {
+    threads.emplace_back([&histogram, &counter, thread]() {
+      for (std::uint64_t idx {0}; idx < 10'000; ++idx)
+      {
+        histogram.Record(std::chrono::nanoseconds(100 * (thread + 1)));
+        counter.Add();
+      }
+    });
+  }
+
+  // Reading while the threads record is safe
+  while (counter.Snapshot().value < 40'000)
+    std::this_thread::yield();
+  for (auto& thread: threads)
+    thread.join();
+
+  const auto snapshot { histogram.Snapshot() };
+  BOOST_CHECK_EQUAL(snapshot.count, 40'000);
+  BOOST_CHECK_EQUAL(snapshot.min, 100);
+  BOOST_CHECK_EQUAL(snapshot.max, 400);
+  BOOST_CHECK_EQUAL(counter.Snapshot().value, 40'000);
+}
+
+BOOST_AUTO_TEST_CASE(scoped_latency)
+{
+  LatencyHistogram histogram { "test_scoped_latency" };
+  {
+    ScopedLatency latency { histogram };
+    std::this_thread::sleep_for(2ms);
+  }
+  const auto snapshot { histogram.Snapshot() };
+  BOOST_CHECK_EQUAL(snapshot.count, 1);
+  BOOST_CHECK(snapshot.min >= 2'000'000);
+}
+
+BOOST_AUTO_TEST_SUITE_END(); // class_LatencyHistogram
+
+BOOST_AUTO_TEST_SUITE(class_MetricsRegistry);
+
+BOOST_AUTO_TEST_CASE(snapshot)
+{
+  Counter counter { "test_registry_total" };
+  counter.Add(3);
+  {
+    LatencyHistogram histogram { "test_registry_ns" };
+    histogram.Record(5us);
+    const auto histograms { GetMetricsRegistry().SnapshotHistograms() };
+    BOOST_CHECK(std::is_sorted(histograms.begin(), histograms.end(),
+      [](const auto& a, const auto& b) { return a.name < b.name; }
+    ));
+    const auto it { std::find_if(histograms.begin(), histograms.end(),
+      [](const auto& snapshot) { return snapshot.name == "test_registry_ns"; }
+    )};
+    BOOST_REQUIRE(it != histograms.end());
+    BOOST_CHECK_EQUAL(it->count, 1);
+  }
+
+  // Destroyed metrics leave the registry
+  for (const auto& snapshot: GetMetricsRegistry().SnapshotHistograms())
+    BOOST_CHECK(snapshot.name != "test_registry_ns");
+  const auto counters { GetMetricsRegistry().SnapshotCounters() };
+  const auto it { std::find_if(counters.begin(), counters.end(),
+    [](const auto& snapshot) { return snapshot.name == "test_registry_total"; }
+  )};
+  BOOST_REQUIRE(it != counters.end());
+  BOOST_CHECK_EQUAL(it->value, 3);
+}
+
+BOOST_AUTO_TEST_CASE(library_metrics)
+{
+  NetworkMonitor::TransportNetwork network {};
+  network.AddStation({"station_0", "Station 0"});
+  const auto before { GetLibraryMetrics().recordPassengerEvent.Snapshot() };
+  network.RecordPassengerEvent({"station_0"});
+  network.RecordPassengerEvent({"station_1"});
+  const auto after { GetLibraryMetrics().recordPassengerEvent.Snapshot() };
+
+  // The hot paths are only instrumented in metrics builds
+#if defined(NETWORK_MONITOR_METRICS)
+  BOOST_CHECK_EQUAL(after.count - before.count, 2);
+#else
+  BOOST_CHECK_EQUAL(after.count, before.count);
+#endif
+}
+
+BOOST_AUTO_TEST_SUITE_END(); // class_MetricsRegistry
+
+BOOST_AUTO_TEST_SUITE_END(); // network_monitor
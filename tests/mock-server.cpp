@@ -0,0 +1,193 @@
+#include <network-monitor/mock-server.h>
+#include <network-monitor/stomp-frame.h>
+#include <network-monitor/websocket-client.h>
+
+#include <boost/asio.hpp>
+#include <boost/beast/ssl.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <nlohmann/json.hpp>
+
+#include <string>
+#include <vector>
+
+using NetworkMonitor::MockServer;
+using NetworkMonitor::MockServerOptions;
+using NetworkMonitor::ParseStompFrame;
+using NetworkMonitor::SerializeStompFrame;
+using NetworkMonitor::StompCommand;
+using NetworkMonitor::StompFrame;
+using NetworkMonitor::WebSocketClient;
+
+static MockServerOptions GetTestOptions()
+{
+  MockServerOptions options {};
+  options.certFile = TESTS_LOCALHOST_PEM;
+  options.keyFile = TESTS_LOCALHOST_KEY_PEM;
+  options.username = "username";
+  options.password = "password";
+  return options;
+}
+
+static std::string MakeConnectFrame(
+  const std::string& username,
+  const std::string& password
+)
+{
+  return SerializeStompFrame(StompFrame {
+    StompCommand::Connect,
+    {
+      {"accept-version", "1.2"},
+      {"host", "localhost"},
+      {"login", username},
+      {"passcode", password},
+    },
+    {}
+  });
+}
+
+BOOST_AUTO_TEST_SUITE(network_monitor);
+
+BOOST_AUTO_TEST_SUITE(class_MockServer);
+
+BOOST_AUTO_TEST_CASE(start_stop)
+{
+  MockServer server { GetTestOptions() };
+  BOOST_REQUIRE(server.Start());
+  BOOST_CHECK(server.GetPort() != 0);
+  server.Stop();
+
+  // Missing certificate
+  auto options { GetTestOptions() };
+  options.certFile = "not-a-certificate.pem";
+  MockServer badServer { options };
+  BOOST_CHECK(!badServer.Start());
+}
+
+BOOST_AUTO_TEST_CASE(stream_events)
+{
+  auto options { GetTestOptions() };
+  options.messagesPerSecond = 0.0;
+  options.maxMessages = 10;
+  MockServer server { options };
+  BOOST_REQUIRE(server.Start());
+
+  boost::asio::ssl::context ctx { boost::asio::ssl::context::tls_client };
+  ctx.load_verify_file(TESTS_LOCALHOST_PEM);
+  boost::asio::io_context ioc {};
+  WebSocketClient client {
+    "localhost", options.endpoint, std::to_string(server.GetPort()), ioc, ctx
+  };
+
+  const std::string connectFrame { MakeConnectFrame("username", "password") };
+  const std::string subscribeFrame { SerializeStompFrame(StompFrame {
+    StompCommand::Subscribe,
+    {{"id", "0"}, {"destination", "/passengers"}, {"receipt", "r0"}},
+    {}
+  })};
+
+  std::vector<StompFrame> frames {};
+  client.Connect(
+    [&client, &connectFrame](auto ec) {
+      BOOST_REQUIRE(!ec);
+      client.Send(connectFrame);
+    },
+    [&client, &frames, &subscribeFrame](auto ec, auto&& message) {
+      StompFrame frame {};
+      BOOST_REQUIRE(ParseStompFrame(message, frame));
+      if (frame.command == StompCommand::Connected)
+        client.Send(subscribeFrame);
+      frames.push_back(std::move(frame));
+
+      // CONNECTED + RECEIPT + 10 events
+      if (frames.size() == 12)
+        client.Close();
+    }
+  );
+  ioc.run();
+
+  BOOST_REQUIRE_EQUAL(frames.size(), 12);
+  BOOST_CHECK(frames[0].command == StompCommand::Connected);
+  BOOST_CHECK(frames[1].command == StompCommand::Receipt);
+  BOOST_CHECK_EQUAL(frames[1].GetHeader("receipt-id"), "r0");
+  for (std::size_t idx {0}; idx < 10; ++idx)
+  {
+    const auto& frame { frames[idx + 2] };
+    BOOST_CHECK(frame.command == StompCommand::Message);
+    BOOST_CHECK_EQUAL(frame.GetHeader("subscription"), "0");
+    BOOST_CHECK_EQUAL(frame.GetHeader("message-id"), std::to_string(idx));
+    BOOST_CHECK(frame.HasHeader("sent-at-ns"));
+
+    const auto event = nlohmann::json::parse(frame.body);
+    BOOST_CHECK(event.contains("datetime"));
+    BOOST_CHECK(event.at("station_id").get<std::string>().rfind("station_", 0)
+                == 0);
+    const auto type { event.at("passenger_event").get<std::string>() };
+    BOOST_CHECK(type == "in" || type == "out");
+  }
+
+  const auto stats { server.GetStats() };
+  BOOST_CHECK_EQUAL(stats.connections, 1);
+  BOOST_CHECK_EQUAL(stats.subscriptions, 1);
+  BOOST_CHECK_EQUAL(stats.messagesSent, 10);
+}
+
+BOOST_AUTO_TEST_CASE(bad_credentials)
+{
+  auto options { GetTestOptions() };
+  MockServer server { options };
+  BOOST_REQUIRE(server.Start());
+
+  boost::asio::ssl::context ctx { boost::asio::ssl::context::tls_client };
+  ctx.load_verify_file(TESTS_LOCALHOST_PEM);
+  boost::asio::io_context ioc {};
+  WebSocketClient client {
+    "localhost", options.endpoint, std::to_string(server.GetPort()), ioc, ctx
+  };
+
+  const std::string connectFrame { MakeConnectFrame("username", "wrong") };
+  StompFrame response {};
+  bool disconnected {false};
+  client.Connect(
+    [&client, &connectFrame](auto ec) {
+      BOOST_REQUIRE(!ec);
+      client.Send(connectFrame);
+    },
+    [&response](auto ec, auto&& message) {
+      BOOST_CHECK(ParseStompFrame(message, response));
+    },
+    [&disconnected](auto ec) {
+      disconnected = true;
+    }
+  );
+  ioc.run();
+
+  BOOST_CHECK(response.command == StompCommand::Error);
+  BOOST_CHECK_EQUAL(response.GetHeader("message"), "ValidationInvalidAuth");
+  BOOST_CHECK(disconnected);
+}
+
+BOOST_AUTO_TEST_CASE(wrong_endpoint)
+{
+  auto options { GetTestOptions() };
+  MockServer server { options };
+  BOOST_REQUIRE(server.Start());
+
+  boost::asio::ssl::context ctx { boost::asio::ssl::context::tls_client };
+  ctx.load_verify_file(TESTS_LOCALHOST_PEM);
+  boost::asio::io_context ioc {};
+  WebSocketClient client {
+    "localhost", "/not-found", std::to_string(server.GetPort()), ioc, ctx
+  };
+
+  bool failed {false};
+  client.Connect([&failed](auto ec) {
+    failed = static_cast<bool>(ec);
+  });
+  ioc.run();
+  BOOST_CHECK(failed);
+}
+
+BOOST_AUTO_TEST_SUITE_END(); // class_MockServer
+
+BOOST_AUTO_TEST_SUITE_END(); // network_monitor
@@ -0,0 +1,148 @@
+#include <network-monitor/network-generator.h>
+#include <network-monitor/transport-network.h>
+
+#include <boost/test/unit_test.hpp>
+#include <nlohmann/json.hpp>
+
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+using NetworkMonitor::GenerateNetworkLayout;
+using NetworkMonitor::NetworkGeneratorOptions;
+using NetworkMonitor::TransportNetwork;
+using NetworkMonitor::TravelTimeDistribution;
+
+BOOST_AUTO_TEST_SUITE(network_monitor);
+
+BOOST_AUTO_TEST_SUITE(generate_network_layout);
+
+BOOST_AUTO_TEST_CASE(valid_layout)
+{
+  NetworkGeneratorOptions options {};
+  options.nStations = 500;
+  options.nLines = 12;
+  options.routesPerLine = 4;
+  options.minRouteLength = 15;
+  options.maxRouteLength = 30;
+  options.interchangeDensity = 0.2;
+  auto layout = GenerateNetworkLayout(options);
+
+  BOOST_CHECK_EQUAL(layout.at("stations").size(), options.nStations);
+  BOOST_CHECK_EQUAL(layout.at("lines").size(), options.nLines);
+  std::unordered_map<std::string, std::size_t> nLinesPerStation {};
+  for (const auto& line: layout.at("lines"))
+  {
+    BOOST_CHECK_EQUAL(line.at("routes").size(), options.routesPerLine);
+    for (const auto& station: line.at("stations"))
+      ++nLinesPerStation[station.get<std::string>()];
+    for (const auto& route: line.at("routes"))
+    {
+      const auto& stops { route.at("route_stops") };
+      BOOST_CHECK(stops.size() >= 2);
+      BOOST_CHECK_EQUAL(route.at("start_station_id"), stops.front());
+      BOOST_CHECK_EQUAL(route.at("end_station_id"), stops.back());
+      BOOST_CHECK_EQUAL(route.at("line_id"), line.at("line_id"));
+
+      // No loops
+      std::unordered_set<std::string> unique {
+        stops.begin(), stops.end()
+      };
+      BOOST_CHECK_EQUAL(unique.size(), stops.size());
+    }
+  }
+
+  // Every station is served, and some by more than one line
+  BOOST_CHECK_EQUAL(nLinesPerStation.size(), options.nStations);
+  std::size_t nInterchanges {0};
+  for (const auto& [station, nLines]: nLinesPerStation)
+    nInterchanges += nLines > 1 ? 1 : 0;
+  BOOST_CHECK(nInterchanges > 0);
+
+  for (const auto& travelTime: layout.at("travel_times"))
+  {
+    const auto value { travelTime.at("travel_time").get<unsigned int>() };
+    BOOST_CHECK(value >= options.minTravelTime);
+    BOOST_CHECK(value <= options.maxTravelTime);
+  }
+
+  // The network accepts all the stations, lines and travel times
+  TransportNetwork network {};
+  BOOST_CHECK(network.FromJson(std::move(layout)));
+  BOOST_CHECK(network.GetRoutesServingStation("station_000").size() > 0);
+}
+
+BOOST_AUTO_TEST_CASE(deterministic)
+{
+  NetworkGeneratorOptions options {};
+  options.nStations = 200;
+  options.nLines = 8;
+  options.travelTimeDistribution = TravelTimeDistribution::Exponential;
+  options.maxTravelTime = 10;
+  const auto layout = GenerateNetworkLayout(options);
+  BOOST_CHECK(layout == GenerateNetworkLayout(options));
+
+  options.seed = 2;
+  BOOST_CHECK(layout != GenerateNetworkLayout(options));
+}
+
+BOOST_AUTO_TEST_CASE(no_interchanges)
+{
+  // With no interchanges, each line serves its own stations
+  NetworkGeneratorOptions options {};
+  options.nStations = 100;
+  options.nLines = 5;
+  options.minRouteLength = 20;
+  options.maxRouteLength = 20;
+  options.interchangeDensity = 0.0;
+  const auto layout = GenerateNetworkLayout(options);
+
+  std::set<std::string> stations {};
+  for (const auto& line: layout.at("lines"))
+  {
+    BOOST_CHECK_EQUAL(line.at("stations").size(), 20);
+    for (const auto& station: line.at("stations"))
+      BOOST_CHECK(stations.insert(station.get<std::string>()).second);
+  }
+  BOOST_CHECK_EQUAL(stations.size(), 100);
+  BOOST_CHECK_EQUAL(layout.at("travel_times").size(), 5 * 19);
+}
+
+BOOST_AUTO_TEST_CASE(more_lines_than_stations)
+{
+  // Lines run out of new stations and reuse the existing ones
+  NetworkGeneratorOptions options {};
+  options.nStations = 3;
+  options.nLines = 10;
+  const auto layout = GenerateNetworkLayout(options);
+  for (const auto& line: layout.at("lines"))
+    BOOST_CHECK(line.at("stations").size() >= 2);
+
+  TransportNetwork network {};
+  BOOST_CHECK(network.FromJson(nlohmann::json(layout)));
+}
+
+BOOST_AUTO_TEST_CASE(invalid_options)
+{
+  NetworkGeneratorOptions options {};
+  options.nStations = 1;
+  BOOST_CHECK_THROW(GenerateNetworkLayout(options), std::invalid_argument);
+
+  options = {};
+  options.minRouteLength = 1;
+  BOOST_CHECK_THROW(GenerateNetworkLayout(options), std::invalid_argument);
+
+  options = {};
+  options.interchangeDensity = 1.5;
+  BOOST_CHECK_THROW(GenerateNetworkLayout(options), std::invalid_argument);
+
+  options = {};
+  options.minTravelTime = 6;
+  BOOST_CHECK_THROW(GenerateNetworkLayout(options), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_SUITE_END(); // generate_network_layout
+
+BOOST_AUTO_TEST_SUITE_END(); // network_monitor
@@ -0,0 +1,597 @@
+#include <network-monitor/passenger-event-log.h>
+#include <network-monitor/transport-network.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using NetworkMonitor::PassengerCheckpointer;
+using NetworkMonitor::PassengerCheckpointOptions;
+using NetworkMonitor::PassengerEvent;
+using NetworkMonitor::PassengerEventLog;
+using NetworkMonitor::PassengerEventLogOptions;
+using NetworkMonitor::RecoverPassengerCounts;
+using NetworkMonitor::ReplayPassengerEventLog;
+using NetworkMonitor::TransportNetwork;
+using NetworkMonitor::WritePassengerCheckpoint;
+
+using namespace std::chrono_literals;
+
+using EventType = PassengerEvent::Type;
+
+// An empty log directory, removed at the end of the test
+struct LogDirectory
+{
+  std::filesystem::path path {};
+
+  explicit LogDirectory(
+    const std::string& name
+  ) : path { std::filesystem::temp_directory_path() /
+             ("network-monitor-event-log-" + name) }
+  {
+    std::filesystem::remove_all(path);
+  }
+
+  ~LogDirectory()
+  {
+    std::filesystem::remove_all(path);
+  }
+
+  std::vector<std::filesystem::path> GetSegments() const
+  {
+    std::vector<std::filesystem::path> segments {};
+    for (const auto& entry: std::filesystem::directory_iterator(path))
+    {
+      if (entry.path().extension() == ".log")
+        segments.push_back(entry.path());
+    }
+    std::sort(segments.begin(), segments.end());
+    return segments;
+  }
+};
+
+// Make the writes of this process fail past `size` bytes, with EFBIG, until
+//  the end of the test
+struct FileSizeLimit
+{
+  rlimit previous {};
+  void (*previousHandler)(int) { nullptr };
+
+  explicit FileSizeLimit(
+    rlim_t size
+  )
+  {
+    // Without this, SIGXFSZ would kill the test process
+    previousHandler = std::signal(SIGXFSZ, SIG_IGN);
+    getrlimit(RLIMIT_FSIZE, &previous);
+    rlimit limit { previous };
+    limit.rlim_cur = size;
+    setrlimit(RLIMIT_FSIZE, &limit);
+  }
+
+  ~FileSizeLimit()
+  {
+    setrlimit(RLIMIT_FSIZE, &previous);
+    std::signal(SIGXFSZ, previousHandler);
+  }
+};
+
+static PassengerEventLogOptions GetOptions(
+  const LogDirectory& directory
+)
+{
+  PassengerEventLogOptions options {};
+  options.directory = directory.path;
+  options.commitInterval = 1ms;
+  options.sync = false;
+  return options;
+}
+
+static TransportNetwork GetNetwork()
+{
+  TransportNetwork network {};
+  for (int idx {0}; idx < 4; ++idx)
+  {
+    const auto id { "station_" + std::to_string(idx) };
+    network.AddStation({id, id});
+  }
+  return network;
+}
+
+BOOST_AUTO_TEST_SUITE(network_monitor);
+
+BOOST_AUTO_TEST_SUITE(class_PassengerEventLog);
+
+BOOST_AUTO_TEST_CASE(round_trip)
+{
+  LogDirectory directory { "round_trip" };
+  const std::chrono::system_clock::time_point noon {
+    std::chrono::hours {24 * 20000 + 12}
+  };
+  {
+    PassengerEventLog log { GetOptions(directory) };
+    BOOST_REQUIRE(log.Open());
+    BOOST_CHECK_EQUAL(log.Append({"station_0", EventType::In, noon}), 0);
+    BOOST_CHECK_EQUAL(log.Append({"station_0", EventType::In, noon}), 1);
+    BOOST_CHECK_EQUAL(log.Append({"station_1", EventType::Out, noon}), 2);
+    BOOST_CHECK_EQUAL(log.Append({
+      {"station_2", EventType::In, noon + 30s},
+      {"station_0", EventType::Out, noon + 30s},
+    }), 3);
+    BOOST_CHECK_EQUAL(log.GetNextSequence(), 5);
+    BOOST_REQUIRE(log.Flush());
+    BOOST_CHECK_EQUAL(log.GetDurableSequence(), 5);
+  }
+
+  auto network { GetNetwork() };
+  const auto replay { ReplayPassengerEventLog(directory.path, network) };
+  BOOST_CHECK(replay.error.empty());
+  BOOST_CHECK_EQUAL(replay.nEvents, 5);
+  BOOST_CHECK_EQUAL(replay.nRecorded, 5);
+  BOOST_CHECK_EQUAL(replay.nextSequence, 5);
+  BOOST_CHECK_EQUAL(replay.nSegments, 1);
+  BOOST_CHECK(!replay.tornTail);
+  BOOST_CHECK_EQUAL(network.GetPassengerCount("station_0"), 1);
+  BOOST_CHECK_EQUAL(network.GetPassengerCount("station_1"), -1);
+  BOOST_CHECK_EQUAL(network.GetPassengerCount("station_2"), 1);
+
+  // The events keep their time
+  const auto flow { network.GetPassengerFlow("station_0", 10s, noon) };
+  BOOST_CHECK_EQUAL(flow.in, 2);
+  BOOST_CHECK_EQUAL(flow.out, 0);
+}
+
+BOOST_AUTO_TEST_CASE(reopen)
+{
+  LogDirectory directory { "reopen" };
+  {
+    PassengerEventLog log { GetOptions(directory) };
+    BOOST_REQUIRE(log.Open());
+    log.Append({"station_0", EventType::In});
+    log.Append({"station_0", EventType::In});
+  }
+  {
+    // Closing the log wrote the events
+    PassengerEventLog log { GetOptions(directory) };
+    BOOST_REQUIRE(log.Open());
+    BOOST_CHECK_EQUAL(log.GetNextSequence(), 2);
+    BOOST_CHECK_EQUAL(log.Append({"station_3", EventType::In}), 2);
+  }
+
+  auto network { GetNetwork() };
+  const auto replay { ReplayPassengerEventLog(directory.path, network) };
+  BOOST_CHECK(replay.error.empty());
+  BOOST_CHECK_EQUAL(replay.nEvents, 3);
+  BOOST_CHECK_EQUAL(network.GetPassengerCount("station_0"), 2);
+  BOOST_CHECK_EQUAL(network.GetPassengerCount("station_3"), 1);
+}
+
+BOOST_AUTO_TEST_CASE(torn_tail)
+{
+  LogDirectory directory { "torn_tail" };
+  {
+    PassengerEventLog log { GetOptions(directory) };
+    BOOST_REQUIRE(log.Open());
+    log.Append({"station_0", EventType::In});
+    BOOST_REQUIRE(log.Flush());
+    log.Append({"station_1", EventType::In});
+    BOOST_REQUIRE(log.Flush());
+  }
+
+  // A crash in the middle of the second batch record
+  const auto segments { directory.GetSegments() };
+  BOOST_REQUIRE_EQUAL(segments.size(), 1);
+  const auto size { std::filesystem::file_size(segments[0]) };
+  std::filesystem::resize_file(segments[0], size - 3);
+  {
+    auto network { GetNetwork() };
+    const auto replay { ReplayPassengerEventLog(directory.path, network) };
+    BOOST_CHECK(replay.error.empty());
+    BOOST_CHECK(replay.tornTail);
+    BOOST_CHECK_EQUAL(replay.nEvents, 1);
+    BOOST_CHECK_EQUAL(replay.nextSequence, 1);
+    BOOST_CHECK_EQUAL(network.GetPassengerCount("station_1"), 0);
+  }
+
+  // The log goes on after the last complete batch record
+  {
+    PassengerEventLog log { GetOptions(directory) };
+    BOOST_REQUIRE(log.Open());
+    BOOST_CHECK_EQUAL(log.GetNextSequence(), 1);
+    log.Append({"station_2", EventType::In});
+  }
+  auto network { GetNetwork() };
+  const auto replay { ReplayPassengerEventLog(directory.path, network) };
+  BOOST_CHECK(replay.error.empty());
+  BOOST_CHECK(!replay.tornTail);
+  BOOST_CHECK_EQUAL(replay.nEvents, 2);
+  BOOST_CHECK_EQUAL(network.GetPassengerCount("station_0"), 1);
+  BOOST_CHECK_EQUAL(network.GetPassengerCount("station_2"), 1);
+}
+
+BOOST_AUTO_TEST_CASE(checksum)
+{
+  LogDirectory directory { "checksum" };
+  {
+    PassengerEventLog log { GetOptions(directory) };
+    BOOST_REQUIRE(log.Open());
+    log.Append({"station_0", EventType::In});
+    BOOST_REQUIRE(log.Flush());
+    log.Append({"station_1", EventType::In});
+    BOOST_REQUIRE(log.Flush());
+  }
+
+  // Flip a byte of the station ID in the last batch record
+  const auto segments { directory.GetSegments() };
+  BOOST_REQUIRE_EQUAL(segments.size(), 1);
+  const auto size { std::filesystem::file_size(segments[0]) };
+  {
+    std::fstream file { segments[0],
+                        std::ios::in | std::ios::out | std::ios::binary };
+    file.seekp(static_cast<std::streamoff>(size - 1));
+    file.put('7');
+  }
+  auto network { GetNetwork() };
+  const auto replay { ReplayPassengerEventLog(directory.path, network) };
+  BOOST_CHECK(replay.tornTail);
+  BOOST_CHECK_EQUAL(replay.nEvents, 1);
+  BOOST_CHECK_EQUAL(network.GetPassengerCount("station_1"), 0);
+}
+
+BOOST_AUTO_TEST_CASE(write_failure)
+{
+  LogDirectory directory { "write_failure" };
+  {
+    PassengerEventLog log { GetOptions(directory) };
+    BOOST_REQUIRE(log.Open());
+    log.Append({"station_0", EventType::In});
+    BOOST_REQUIRE(log.Flush());
+    BOOST_CHECK_EQUAL(log.GetDurableSequence(), 1);
+    const auto segmentSize {
+      std::filesystem::file_size(directory.GetSegments().at(0))
+    };
+    {
+      // The batch of 1000 events does not fit, nor does it with the next
+      //  10 events
+      FileSizeLimit limit { segmentSize + 1024 };
+      log.Append(std::vector<PassengerEvent>(
+        1000, {"station_1", EventType::In}
+      ));
+      BOOST_CHECK(!log.Flush());
+      BOOST_CHECK(!log.GetError().empty());
+      log.Append(std::vector<PassengerEvent>(
+        10, {"station_2", EventType::In}
+      ));
+      BOOST_CHECK(!log.Flush());
+      BOOST_CHECK_EQUAL(log.GetDurableSequence(), 1);
+      BOOST_CHECK_EQUAL(log.GetNextSequence(), 1011);
+    }
+
+    // The events are written in order once the disk has room again
+    BOOST_CHECK(log.Flush());
+    BOOST_CHECK_EQUAL(log.GetDurableSequence(), 1011);
+  }
+
+  auto network { GetNetwork() };
+  const auto replay { ReplayPassengerEventLog(directory.path, network) };
+  BOOST_CHECK(replay.error.empty());
+  BOOST_CHECK(!replay.tornTail);
+  BOOST_CHECK_EQUAL(replay.nEvents, 1011);
+  BOOST_CHECK_EQUAL(replay.nextSequence, 1011);
+  BOOST_CHECK_EQUAL(network.GetPassengerCount("station_1"), 1000);
+  BOOST_CHECK_EQUAL(network.GetPassengerCount("station_2"), 10);
+}
+
+BOOST_AUTO_TEST_CASE(segments)
+{
+  LogDirectory directory { "segments" };
+  auto options { GetOptions(directory) };
+  options.segmentSize = 100;
+  {
+    PassengerEventLog log { options };
+    BOOST_REQUIRE(log.Open());
+    for (int idx {0}; idx < 10; ++idx)
+    {
+      log.Append({"station_" + std::to_string(idx % 2), EventType::In});
+      log.Append({"station_3", EventType::Out});
+      BOOST_REQUIRE(log.Flush());
+    }
+  }
+  const auto segments { directory.GetSegments() };
+  BOOST_CHECK(segments.size() > 1);
+  BOOST_CHECK_EQUAL(segments[0].filename(),
+                    "events-00000000000000000000.log");
+
+  auto network { GetNetwork() };
+  auto replay { ReplayPassengerEventLog(directory.path, network) };
+  BOOST_CHECK(replay.error.empty());
+  BOOST_CHECK_EQUAL(replay.nEvents, 20);
+  BOOST_CHECK_EQUAL(replay.nSegments, segments.size());
+  BOOST_CHECK_EQUAL(network.GetPassengerCount("station_0"), 5);
+  BOOST_CHECK_EQUAL(network.GetPassengerCount("station_1"), 5);
+  BOOST_CHECK_EQUAL(network.GetPassengerCount("station_3"), -10);
+
+  // Only the events from sequence 15 on: The Out of the 8th round, then the
+  //  last 2 rounds
+  auto partial { GetNetwork() };
+  replay = ReplayPassengerEventLog(directory.path, partial, 15);
+  BOOST_CHECK(replay.error.empty());
+  BOOST_CHECK_EQUAL(replay.nEvents, 5);
+  BOOST_CHECK_EQUAL(replay.nextSequence, 20);
+  BOOST_CHECK(replay.nSegments < segments.size());
+  BOOST_CHECK_EQUAL(partial.GetPassengerCount("station_0"), 1);
+  BOOST_CHECK_EQUAL(partial.GetPassengerCount("station_1"), 1);
+  BOOST_CHECK_EQUAL(partial.GetPassengerCount("station_3"), -3);
+
+  // Corrupt segments before the last one are an error
+  {
+    std::fstream file { segments[0],
+                        std::ios::in | std::ios::out | std::ios::binary };
+    file.seekp(20);
+    file.put('\xff');
+  }
+  auto corrupt { GetNetwork() };
+  replay = ReplayPassengerEventLog(directory.path, corrupt);
+  BOOST_CHECK(!replay.error.empty());
+}
+
+BOOST_AUTO_TEST_CASE(unknown_stations)
+{
+  LogDirectory directory { "unknown_stations" };
+  {
+    PassengerEventLog log { GetOptions(directory) };
+    BOOST_REQUIRE(log.Open());
+    log.Append({
+      {"station_0", EventType::In},
+      {"station_42", EventType::In},
+    });
+  }
+  auto network { GetNetwork() };
+  const auto replay { ReplayPassengerEventLog(directory.path, network) };
+  BOOST_CHECK(replay.error.empty());
+  BOOST_CHECK_EQUAL(replay.nEvents, 2);
+  BOOST_CHECK_EQUAL(replay.nRecorded, 1);
+}
+
+BOOST_AUTO_TEST_CASE(empty_directory)
+{
+  LogDirectory directory { "empty_directory" };
+  auto network { GetNetwork() };
+  auto replay { ReplayPassengerEventLog(directory.path, network) };
+  BOOST_CHECK(!replay.error.empty());
+
+  std::filesystem::create_directories(directory.path);
+  replay = ReplayPassengerEventLog(directory.path, network);
+  BOOST_CHECK(replay.error.empty());
+  BOOST_CHECK_EQUAL(replay.nEvents, 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END(); // class_PassengerEventLog
+
+BOOST_AUTO_TEST_SUITE(class_PassengerCheckpointer);
+
+// Record an event into the log and the network, like the ingestion does
+static void Ingest(
+  PassengerEventLog& log,
+  TransportNetwork& network,
+  const PassengerEvent& event
+)
+{
+  log.Append(event);
+  network.RecordPassengerEvent(event);
+}
+
+static void CheckSameCounts(
+  const TransportNetwork& recovered,
+  const TransportNetwork& network
+)
+{
+  network.ForEachPassengerCount([&recovered](const auto& id, auto count) {
+    BOOST_CHECK_EQUAL(recovered.GetPassengerCount(id), count);
+  });
+}
+
+BOOST_AUTO_TEST_CASE(recover)
+{
+  LogDirectory directory { "checkpoint_recover" };
+  auto network { GetNetwork() };
+  {
+    PassengerEventLog log { GetOptions(directory) };
+    BOOST_REQUIRE(log.Open());
+    for (int idx {0}; idx < 10; ++idx)
+      Ingest(log, network, {"station_" + std::to_string(idx % 3),
+                            EventType::In});
+    Ingest(log, network, {"station_42", EventType::In});
+    const auto checkpoint { WritePassengerCheckpoint(network, log, false) };
+    BOOST_REQUIRE(checkpoint.error.empty());
+    BOOST_CHECK_EQUAL(checkpoint.sequence, 11);
+    BOOST_CHECK_EQUAL(checkpoint.nStations, 4);
+    BOOST_CHECK(checkpoint.nBytes > 0);
+
+    Ingest(log, network, {"station_3", EventType::Out});
+    Ingest(log, network, {"station_0", EventType::Out});
+  }
+
+  // Only the events after the checkpoint are replayed
+  auto recovered { GetNetwork() };
+  const auto recovery { RecoverPassengerCounts(directory.path, recovered) };
+  BOOST_CHECK(recovery.error.empty());
+  BOOST_CHECK(recovery.checkpointLoaded);
+  BOOST_CHECK_EQUAL(recovery.checkpointSequence, 11);
+  BOOST_CHECK_EQUAL(recovery.nStationsRestored, 4);
+  BOOST_CHECK_EQUAL(recovery.replay.nEvents, 2);
+  BOOST_CHECK_EQUAL(recovered.GetPassengerEventSequence(), 13);
+  BOOST_CHECK_EQUAL(recovered.GetPassengerCount("station_0"), 3);
+  BOOST_CHECK_EQUAL(recovered.GetPassengerCount("station_3"), -1);
+  CheckSameCounts(recovered, network);
+}
+
+BOOST_AUTO_TEST_CASE(no_checkpoint)
+{
+  LogDirectory directory { "checkpoint_none" };
+  auto network { GetNetwork() };
+  {
+    PassengerEventLog log { GetOptions(directory) };
+    BOOST_REQUIRE(log.Open());
+    Ingest(log, network, {"station_1", EventType::In});
+  }
+  auto recovered { GetNetwork() };
+  const auto recovery { RecoverPassengerCounts(directory.path, recovered) };
+  BOOST_CHECK(recovery.error.empty());
+  BOOST_CHECK(!recovery.checkpointLoaded);
+  BOOST_CHECK_EQUAL(recovery.replay.nEvents, 1);
+  CheckSameCounts(recovered, network);
+}
+
+BOOST_AUTO_TEST_CASE(truncation)
+{
+  LogDirectory directory { "checkpoint_truncation" };
+  auto options { GetOptions(directory) };
+  options.segmentSize = 100;
+  auto network { GetNetwork() };
+  {
+    PassengerEventLog log { options };
+    BOOST_REQUIRE(log.Open());
+    for (int idx {0}; idx < 10; ++idx)
+    {
+      Ingest(log, network, {"station_" + std::to_string(idx % 4),
+                            EventType::In});
+      BOOST_REQUIRE(log.Flush());
+    }
+    const auto nSegments { directory.GetSegments().size() };
+    BOOST_REQUIRE(nSegments > 2);
+
+    auto checkpoint { WritePassengerCheckpoint(network, log, false) };
+    BOOST_REQUIRE(checkpoint.error.empty());
+    BOOST_CHECK(checkpoint.nSegmentsRemoved > 0);
+    BOOST_CHECK_EQUAL(directory.GetSegments().size(),
+                      nSegments - checkpoint.nSegmentsRemoved);
+
+    // The segments left start at or before the checkpoint
+    for (int idx {0}; idx < 5; ++idx)
+    {
+      Ingest(log, network, {"station_3", EventType::Out});
+      BOOST_REQUIRE(log.Flush());
+    }
+    checkpoint = WritePassengerCheckpoint(network, log, false);
+    BOOST_REQUIRE(checkpoint.error.empty());
+    BOOST_CHECK_EQUAL(checkpoint.sequence, 15);
+    Ingest(log, network, {"station_2", EventType::Out});
+  }
+
+  // Only the latest checkpoint is left
+  std::size_t nCheckpoints {0};
+  for (const auto& entry: std::filesystem::directory_iterator(directory.path))
+  {
+    if (entry.path().extension() == ".ckpt")
+    {
+      ++nCheckpoints;
+      BOOST_CHECK_EQUAL(entry.path().filename(),
+                        "checkpoint-00000000000000000015.ckpt");
+    }
+  }
+  BOOST_CHECK_EQUAL(nCheckpoints, 1);
+
+  // The log alone misses the events of the removed segments
+  auto partial { GetNetwork() };
+  BOOST_CHECK(!ReplayPassengerEventLog(directory.path, partial).error.empty());
+
+  auto recovered { GetNetwork() };
+  const auto recovery { RecoverPassengerCounts(directory.path, recovered) };
+  BOOST_CHECK(recovery.error.empty());
+  BOOST_CHECK_EQUAL(recovery.replay.nEvents, 1);
+  CheckSameCounts(recovered, network);
+
+  // A new log goes on after the last event
+  PassengerEventLog log { options };
+  BOOST_REQUIRE(log.Open());
+  BOOST_CHECK_EQUAL(log.GetNextSequence(), 16);
+}
+
+BOOST_AUTO_TEST_CASE(network_ahead_of_log)
+{
+  LogDirectory directory { "checkpoint_ahead" };
+  auto network { GetNetwork() };
+  PassengerEventLog log { GetOptions(directory) };
+  BOOST_REQUIRE(log.Open());
+  Ingest(log, network, {"station_1", EventType::In});
+  network.RecordPassengerEvent({"station_1", EventType::In});
+  const auto checkpoint { WritePassengerCheckpoint(network, log, false) };
+  BOOST_CHECK(!checkpoint.error.empty());
+}
+
+BOOST_AUTO_TEST_CASE(corrupt_checkpoint)
+{
+  LogDirectory directory { "checkpoint_corrupt" };
+  auto network { GetNetwork() };
+  {
+    PassengerEventLog log { GetOptions(directory) };
+    BOOST_REQUIRE(log.Open());
+    Ingest(log, network, {"station_1", EventType::In});
+    BOOST_REQUIRE(WritePassengerCheckpoint(network, log, false).error.empty());
+  }
+  const auto path { directory.path / "checkpoint-00000000000000000001.ckpt" };
+  {
+    std::fstream file { path, std::ios::in | std::ios::out | std::ios::binary };
+    file.seekp(-1, std::ios::end);
+    file.put('\x7f');
+  }
+  auto recovered { GetNetwork() };
+  const auto recovery { RecoverPassengerCounts(directory.path, recovered) };
+  BOOST_CHECK(!recovery.error.empty());
+  BOOST_CHECK(!recovery.checkpointLoaded);
+}
+
+BOOST_AUTO_TEST_CASE(periodic)
+{
+  LogDirectory directory { "checkpoint_periodic" };
+  auto network { GetNetwork() };
+  PassengerEventLog log { GetOptions(directory) };
+  BOOST_REQUIRE(log.Open());
+
+  PassengerCheckpointOptions options {};
+  options.interval = 5ms;
+  options.sync = false;
+  PassengerCheckpointer checkpointer { options, network, log };
+  checkpointer.Start();
+
+  // The ingestion goes on while the checkpoints are taken
+  for (int idx {0}; idx < 2000; ++idx)
+  {
+    Ingest(log, network, {"station_" + std::to_string(idx % 4),
+                          EventType::In});
+    if (idx % 100 == 0)
+      std::this_thread::sleep_for(1ms);
+  }
+  const auto deadline { std::chrono::steady_clock::now() + 5s };
+  while (checkpointer.GetLastCheckpoint().sequence < 2000 &&
+         std::chrono::steady_clock::now() < deadline)
+  {
+    std::this_thread::sleep_for(1ms);
+  }
+  checkpointer.Stop();
+  const auto checkpoint { checkpointer.GetLastCheckpoint() };
+  BOOST_CHECK(checkpoint.error.empty());
+  BOOST_CHECK_EQUAL(checkpoint.sequence, 2000);
+  log.Close();
+
+  auto recovered { GetNetwork() };
+  const auto recovery { RecoverPassengerCounts(directory.path, recovered) };
+  BOOST_CHECK(recovery.error.empty());
+  BOOST_CHECK_EQUAL(recovery.checkpointSequence, 2000);
+  BOOST_CHECK_EQUAL(recovery.replay.nEvents, 0);
+  CheckSameCounts(recovered, network);
+}
+
+BOOST_AUTO_TEST_SUITE_END(); // class_PassengerCheckpointer
+
+BOOST_AUTO_TEST_SUITE_END(); // network_monitor
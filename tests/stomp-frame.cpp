@@ -0,0 +1,129 @@
+#include <network-monitor/stomp-frame.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+
+using NetworkMonitor::ParseStompFrame;
+using NetworkMonitor::SerializeStompFrame;
+using NetworkMonitor::StompCommand;
+using NetworkMonitor::StompFrame;
+
+using namespace std::string_literals;
+
+BOOST_AUTO_TEST_SUITE(network_monitor);
+
+BOOST_AUTO_TEST_SUITE(stomp_frame);
+
+BOOST_AUTO_TEST_CASE(parse_basic)
+{
+  const std::string message {
+    "CONNECT\n"
+    "accept-version:1.2\n"
+    "host:ltnm.learncppthroughprojects.com\n"
+    "\n"
+    "Frame body\0"s
+  };
+
+  StompFrame frame {};
+  BOOST_REQUIRE(ParseStompFrame(message, frame));
+  BOOST_CHECK(frame.command == StompCommand::Connect);
+  BOOST_CHECK_EQUAL(frame.GetHeader("accept-version"), "1.2");
+  BOOST_CHECK_EQUAL(
+    frame.GetHeader("host"), "ltnm.learncppthroughprojects.com"
+  );
+  BOOST_CHECK(!frame.HasHeader("login"));
+  BOOST_CHECK_EQUAL(frame.GetHeader("login"), "");
+  BOOST_CHECK_EQUAL(frame.body, "Frame body");
+}
+
+BOOST_AUTO_TEST_CASE(parse_content_length)
+{
+  // With a content-length header, the body can contain NULL octets
+  const std::string message {
+    "SEND\r\n"
+    "destination:/passengers\r\n"
+    "content-length:5\r\n"
+    "\r\n"
+    "ab\0cd\0\n\n"s
+  };
+
+  StompFrame frame {};
+  BOOST_REQUIRE(ParseStompFrame(message, frame));
+  BOOST_CHECK(frame.command == StompCommand::Send);
+  BOOST_CHECK_EQUAL(frame.body, "ab\0cd"s);
+}
+
+BOOST_AUTO_TEST_CASE(parse_escaped_headers)
+{
+  const std::string message {
+    "MESSAGE\n"
+    "key\\cwith\\ccolons:line\\nbreak\\\\\n"
+    "\n"
+    "\0"s
+  };
+
+  StompFrame frame {};
+  BOOST_REQUIRE(ParseStompFrame(message, frame));
+  BOOST_CHECK_EQUAL(frame.GetHeader("key:with:colons"), "line\nbreak\\");
+}
+
+BOOST_AUTO_TEST_CASE(parse_invalid)
+{
+  StompFrame frame {};
+
+  // Unknown command
+  BOOST_CHECK(!ParseStompFrame("HELLO\n\n\0"s, frame));
+
+  // Missing NULL octet
+  BOOST_CHECK(!ParseStompFrame("SEND\ndestination:/a\n\nbody"s, frame));
+
+  // Header without a colon
+  BOOST_CHECK(!ParseStompFrame("SEND\ndestination\n\n\0"s, frame));
+
+  // Undefined escape sequence
+  BOOST_CHECK(!ParseStompFrame("SEND\ndestination:\\t\n\n\0"s, frame));
+
+  // Wrong content-length
+  BOOST_CHECK(!ParseStompFrame("SEND\ncontent-length:10\n\nabc\0"s, frame));
+  BOOST_CHECK(!ParseStompFrame("SEND\ncontent-length:x\n\nabc\0"s, frame));
+
+  // Trailing content after the frame
+  BOOST_CHECK(!ParseStompFrame("SEND\n\nabc\0def"s, frame));
+}
+
+BOOST_AUTO_TEST_CASE(serialize_round_trip)
+{
+  const StompFrame frame {
+    StompCommand::Message,
+    {
+      {"subscription", "sub:0"},
+      {"message-id", "42"},
+      {"content-length", "8"},
+    },
+    "{\"a\":1}\n"
+  };
+
+  const auto serialized { SerializeStompFrame(frame) };
+  BOOST_CHECK_EQUAL(serialized.back(), '\0');
+
+  StompFrame parsed {};
+  BOOST_REQUIRE(ParseStompFrame(serialized, parsed));
+  BOOST_CHECK(parsed.command == frame.command);
+  BOOST_CHECK(parsed.headers == frame.headers);
+  BOOST_CHECK_EQUAL(parsed.body, frame.body);
+}
+
+BOOST_AUTO_TEST_CASE(serialize_connect_not_escaped)
+{
+  const StompFrame frame {
+    StompCommand::Connect,
+    {{"passcode", "pa:ss"}},
+    {}
+  };
+  BOOST_CHECK_EQUAL(SerializeStompFrame(frame), "CONNECT\npasscode:pa:ss\n\n\0"s);
+}
+
+BOOST_AUTO_TEST_SUITE_END(); // stomp_frame
+
+BOOST_AUTO_TEST_SUITE_END(); // network_monitor
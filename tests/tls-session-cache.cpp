@@ -0,0 +1,78 @@
+#include <network-monitor/tls-session-cache.h>
+
+#include <boost/test/unit_test.hpp>
+#include <openssl/ssl.h>
+
+#include <memory>
+#include <string>
+
+using NetworkMonitor::TlsSessionCache;
+
+// Wrap the OpenSSL objects so we do not leak them if a check fails
+struct SslCtxDeleter { void operator()(SSL_CTX* ctx) { SSL_CTX_free(ctx); } };
+struct SslDeleter { void operator()(SSL* ssl) { SSL_free(ssl); } };
+struct SessionDeleter {
+  void operator()(SSL_SESSION* session) { SSL_SESSION_free(session); }
+};
+
+BOOST_AUTO_TEST_SUITE(network_monitor);
+
+BOOST_AUTO_TEST_SUITE(class_TlsSessionCache);
+
+BOOST_AUTO_TEST_CASE(empty)
+{
+  std::unique_ptr<SSL_CTX, SslCtxDeleter> ctx {
+    SSL_CTX_new(TLS_client_method())
+  };
+  std::unique_ptr<SSL, SslDeleter> ssl { SSL_new(ctx.get()) };
+
+  TlsSessionCache cache {};
+  BOOST_CHECK_EQUAL(cache.Size(), 0);
+  BOOST_CHECK(!cache.Apply("localhost:443", ssl.get()));
+
+  // A connection that never completed a handshake has no session to store
+  BOOST_CHECK(!cache.Save("localhost:443", ssl.get()));
+  BOOST_CHECK_EQUAL(cache.Size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(save_apply_erase)
+{
+  std::unique_ptr<SSL_CTX, SslCtxDeleter> ctx {
+    SSL_CTX_new(TLS_client_method())
+  };
+
+  // A session is resumable as soon as it has an ID. We build one by hand so
+  //  that the test does not depend on a TLS server.
+  std::unique_ptr<SSL_SESSION, SessionDeleter> session { SSL_SESSION_new() };
+  const unsigned char sessionId[] { "0123456789abcdef0123456789abcdef" };
+  BOOST_REQUIRE(SSL_SESSION_set1_id(session.get(), sessionId, 32) == 1);
+  BOOST_REQUIRE(SSL_SESSION_set_protocol_version(
+    session.get(), TLS1_2_VERSION
+  ) == 1);
+
+  std::unique_ptr<SSL, SslDeleter> ssl { SSL_new(ctx.get()) };
+  BOOST_REQUIRE(SSL_set_session(ssl.get(), session.get()) == 1);
+
+  TlsSessionCache cache {};
+  BOOST_CHECK(cache.Save("localhost:443", ssl.get()));
+  BOOST_CHECK_EQUAL(cache.Size(), 1);
+
+  // The cached session is only offered to the same server
+  std::unique_ptr<SSL, SslDeleter> otherSsl { SSL_new(ctx.get()) };
+  BOOST_CHECK(!cache.Apply("localhost:8443", otherSsl.get()));
+  BOOST_CHECK(cache.Apply("localhost:443", otherSsl.get()));
+  BOOST_CHECK(SSL_get_session(otherSsl.get()) == session.get());
+
+  // Saving again replaces the session for the same server
+  BOOST_CHECK(cache.Save("localhost:443", otherSsl.get()));
+  BOOST_CHECK_EQUAL(cache.Size(), 1);
+
+  cache.Erase("localhost:443");
+  BOOST_CHECK_EQUAL(cache.Size(), 0);
+  std::unique_ptr<SSL, SslDeleter> thirdSsl { SSL_new(ctx.get()) };
+  BOOST_CHECK(!cache.Apply("localhost:443", thirdSsl.get()));
+}
+
+BOOST_AUTO_TEST_SUITE_END(); // class_TlsSessionCache
+
+BOOST_AUTO_TEST_SUITE_END(); // network_monitor
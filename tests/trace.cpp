@@ -0,0 +1,170 @@
+#include <network-monitor/file-downloader.h>
+#include <network-monitor/trace.h>
+#include <network-monitor/transport-network.h>
+
+#include <boost/test/unit_test.hpp>
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using NetworkMonitor::GetTraceRecorder;
+using NetworkMonitor::ParseJsonFile;
+using NetworkMonitor::TraceEvent;
+using NetworkMonitor::TraceRecorder;
+using NetworkMonitor::TraceSpan;
+using NetworkMonitor::TransportNetwork;
+
+using namespace std::chrono_literals;
+
+static std::vector<TraceEvent> GetEvents(const std::string& category)
+{
+  auto events { GetTraceRecorder().Snapshot() };
+  events.erase(std::remove_if(events.begin(), events.end(),
+    [&category](const auto& event) { return event.category != category; }
+  ), events.end());
+  return events;
+}
+
+BOOST_AUTO_TEST_SUITE(network_monitor);
+
+BOOST_AUTO_TEST_SUITE(class_TraceRecorder);
+
+BOOST_AUTO_TEST_CASE(spans)
+{
+  GetTraceRecorder().Clear();
+  {
+    TraceSpan outer { "test", "outer" };
+    std::this_thread::sleep_for(1ms);
+    {
+      TraceSpan inner { "test", "inner" };
+      std::this_thread::sleep_for(1ms);
+    }
+  }
+  const auto events { GetEvents("test") };
+  BOOST_REQUIRE_EQUAL(events.size(), 2);
+
+  // Sorted by start time: The outer span started first
+  BOOST_CHECK_EQUAL(std::string(events[0].name), "outer");
+  BOOST_CHECK_EQUAL(std::string(events[1].name), "inner");
+  BOOST_CHECK(events[0].start <= events[1].start);
+  BOOST_CHECK(events[1].start + events[1].duration <=
+              events[0].start + events[0].duration);
+  BOOST_CHECK(events[1].duration >= 1'000'000);
+  BOOST_CHECK_EQUAL(events[0].threadId, events[1].threadId);
+
+  GetTraceRecorder().Clear();
+  BOOST_CHECK(GetEvents("test").empty());
+}
+
+BOOST_AUTO_TEST_CASE(threads)
+{
+  GetTraceRecorder().Clear();
+  std::vector<std::thread> threads {};
+  for (int thread {0}; thread < 4; ++thread)
+  {
+    threads.emplace_back([]() {
+      for (int idx {0}; idx < 100; ++idx)
+        TraceSpan span { "test_threads", "span" };
+    });
+  }
+
+  // Reading while the threads record is safe
+  while (GetEvents("test_threads").size() < 400)
+    std::this_thread::yield();
+  for (auto& thread: threads)
+    thread.join();
+
+  std::set<std::uint32_t> threadIds {};
+  for (const auto& event: GetEvents("test_threads"))
+    threadIds.insert(event.threadId);
+  BOOST_CHECK_EQUAL(threadIds.size(), 4);
+}
+
+BOOST_AUTO_TEST_CASE(wrap_around)
+{
+  // A full buffer keeps the most recent spans
+  GetTraceRecorder().Clear();
+  const auto now { std::chrono::steady_clock::now() };
+  const std::size_t nSpans { TraceRecorder::kCapacity + 10 };
+  for (std::size_t idx {0}; idx < nSpans; ++idx)
+  {
+    const auto start { now + std::chrono::microseconds(idx) };
+    GetTraceRecorder().Record("test_wrap", "span", start, start + 1us);
+  }
+  const auto events { GetEvents("test_wrap") };
+  BOOST_REQUIRE_EQUAL(events.size(), TraceRecorder::kCapacity);
+  BOOST_CHECK_EQUAL(events.back().start - events.front().start,
+                    (TraceRecorder::kCapacity - 1) * 1'000);
+  BOOST_CHECK_EQUAL(events.front().duration, 1'000);
+}
+
+BOOST_AUTO_TEST_CASE(chrome_trace)
+{
+  GetTraceRecorder().Clear();
+  std::thread thread { []() {
+    GetTraceRecorder().SetThreadName("test-thread");
+    TraceSpan span { "test_chrome", "named \"span\"" };
+  }};
+  thread.join();
+
+  std::stringstream out {};
+  GetTraceRecorder().WriteChromeTrace(out);
+  const auto trace = nlohmann::json::parse(out);
+  BOOST_CHECK_EQUAL(trace.at("displayTimeUnit"), "ns");
+
+  const nlohmann::json* span { nullptr };
+  const nlohmann::json* threadName { nullptr };
+  for (const auto& event: trace.at("traceEvents"))
+  {
+    if (event.at("ph") == "X" && event.at("cat") == "test_chrome")
+      span = &event;
+    if (event.at("ph") == "M" && event.at("name") == "thread_name" &&
+        event.at("args").at("name") == "test-thread")
+      threadName = &event;
+  }
+  BOOST_REQUIRE(span != nullptr);
+  BOOST_REQUIRE(threadName != nullptr);
+  BOOST_CHECK_EQUAL(span->at("name"), "named \"span\"");
+  BOOST_CHECK_EQUAL(span->at("tid"), threadName->at("tid"));
+  BOOST_CHECK(span->at("ts").get<double>() > 0.0);
+  BOOST_CHECK(span->at("dur").get<double>() >= 0.0);
+}
+
+BOOST_AUTO_TEST_CASE(library_spans)
+{
+  GetTraceRecorder().Clear();
+  TransportNetwork network {};
+  BOOST_REQUIRE(network.FromJson(ParseJsonFile(TESTS_NETWORK_LAYOUT_JSON)));
+  TransportNetwork streamed {};
+  std::ifstream file { TESTS_NETWORK_LAYOUT_JSON };
+  BOOST_REQUIRE(streamed.FromJson(file));
+
+  std::vector<std::string> names {};
+  for (const auto& event: GetTraceRecorder().Snapshot())
+    names.emplace_back(event.name);
+
+  // The library only records spans in tracing builds
+#if defined(NETWORK_MONITOR_TRACING)
+  for (const auto* name: {"ParseJsonFile", "FromJson", "FromJson/stations",
+                          "FromJson/lines", "FromJson/travel_times"})
+  {
+    const auto count {
+      std::count(names.begin(), names.end(), std::string(name))
+    };
+    BOOST_CHECK_EQUAL(count, std::string(name) == "ParseJsonFile" ? 1 : 2);
+  }
+#else
+  BOOST_CHECK(names.empty());
+#endif
+}
+
+BOOST_AUTO_TEST_SUITE_END(); // class_TraceRecorder
+
+BOOST_AUTO_TEST_SUITE_END(); // network_monitor
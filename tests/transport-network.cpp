@@ -1,17 +1,37 @@
+#include <network-monitor/file-downloader.h>
 #include <network-monitor/transport-network.h>
 
 #include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <filesystem>
 #include <fstream>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <random>
+#include <set>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
+using NetworkMonitor::AlternativeJourneyOptions;
 using NetworkMonitor::Id;
+using NetworkMonitor::Journey;
+using NetworkMonitor::JourneyOptions;
 using NetworkMonitor::Line;
-using NetworkMonitor::PassengerEvent
+using NetworkMonitor::ParseJsonFile;
+using NetworkMonitor::PassengerCountSnapshot;
+using NetworkMonitor::PassengerEvent;
+using NetworkMonitor::PassengerFlowOptions;
 using NetworkMonitor::Route;
 using NetworkMonitor::Station;
-using NetworkMonitor::TransportNetwork
+using NetworkMonitor::TransportNetwork;
 
 BOOST_AUTO_TEST_SUITE(network_monitor);
 
@@ -225,7 +245,7 @@ BOOST_AUTO_TEST_CASE(duplicate)
 
 BOOST_AUTO_TEST_SUITE_END(); // AddLine
 
-BOOST_AUTO_TEST_SUITE(PassengerEvent);
+BOOST_AUTO_TEST_SUITE(RecordPassengerEvent);
 
 BOOST_AUTO_TEST_CASE(basic)
 {
@@ -312,7 +332,138 @@ BOOST_AUTO_TEST_CASE(basic)
 
 }
 
-BOOST_AUTO_TEST_END(); // PassengerEvents
+BOOST_AUTO_TEST_SUITE_END(); // RecordPassengerEvent
+
+BOOST_AUTO_TEST_SUITE(GetPassengerFlow);
+
+using namespace std::chrono_literals;
+
+// 12:00:00 on some day, at the start of a 10-second bucket
+static const std::chrono::system_clock::time_point kNoon {
+  std::chrono::hours {24 * 20000 + 12}
+};
+
+BOOST_AUTO_TEST_CASE(windows)
+{
+  PassengerFlowOptions options {};
+  options.bucketWidth = 10s;
+  options.nBuckets = 6;
+  TransportNetwork nw { options };
+  BOOST_REQUIRE(nw.AddStation({"station_0", "Station 0"}));
+  BOOST_REQUIRE(nw.AddStation({"station_1", "Station 1"}));
+
+  using EventType = PassengerEvent::Type;
+  BOOST_REQUIRE(nw.RecordPassengerEvent({"station_0", EventType::In,
+                                         kNoon}));
+  BOOST_REQUIRE(nw.RecordPassengerEvent({"station_0", EventType::In,
+                                         kNoon + 5s}));
+  BOOST_REQUIRE(nw.RecordPassengerEvent({"station_0", EventType::Out,
+                                         kNoon + 15s}));
+  BOOST_REQUIRE(nw.RecordPassengerEvent({"station_0", EventType::In,
+                                         kNoon + 19s}));
+  BOOST_REQUIRE(nw.RecordPassengerEvent({"station_1", EventType::In,
+                                         kNoon + 19s}));
+
+  // Current bucket only
+  auto flow { nw.GetPassengerFlow("station_0", 10s, kNoon + 15s) };
+  BOOST_CHECK_EQUAL(flow.in, 1);
+  BOOST_CHECK_EQUAL(flow.out, 1);
+  BOOST_CHECK(flow.window == 10s);
+
+  // Rounded up to two buckets
+  flow = nw.GetPassengerFlow("station_0", 15s, kNoon + 15s);
+  BOOST_CHECK_EQUAL(flow.in, 3);
+  BOOST_CHECK_EQUAL(flow.out, 1);
+  BOOST_CHECK(flow.window == 20s);
+  BOOST_CHECK_CLOSE(flow.GetInRate(), 0.15, 1e-9);
+  BOOST_CHECK_CLOSE(flow.GetOutRate(), 0.05, 1e-9);
+
+  // Later windows leave the first buckets out
+  flow = nw.GetPassengerFlow("station_0", 20s, kNoon + 25s);
+  BOOST_CHECK_EQUAL(flow.in, 1);
+  BOOST_CHECK_EQUAL(flow.out, 1);
+  flow = nw.GetPassengerFlow("station_0", 10s, kNoon + 25s);
+  BOOST_CHECK_EQUAL(flow.in, 0);
+  BOOST_CHECK_EQUAL(flow.out, 0);
+
+  // Each station has its own history
+  flow = nw.GetPassengerFlow("station_1", 60s, kNoon + 25s);
+  BOOST_CHECK_EQUAL(flow.in, 1);
+  BOOST_CHECK_EQUAL(flow.out, 0);
+
+  // An empty window
+  flow = nw.GetPassengerFlow("station_0", 0s, kNoon + 15s);
+  BOOST_CHECK_EQUAL(flow.in, 0);
+  BOOST_CHECK(flow.window == 0s);
+  BOOST_CHECK_EQUAL(flow.GetInRate(), 0.0);
+
+  BOOST_CHECK_THROW(nw.GetPassengerFlow("station_42", 10s),
+                    std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(history_length)
+{
+  PassengerFlowOptions options {};
+  options.bucketWidth = 10s;
+  options.nBuckets = 6;
+  TransportNetwork nw { options };
+  BOOST_REQUIRE(nw.AddStation({"station_0", "Station 0"}));
+
+  using EventType = PassengerEvent::Type;
+  for (int idx {0}; idx < 10; ++idx)
+  {
+    BOOST_REQUIRE(nw.RecordPassengerEvent({"station_0", EventType::In,
+                                           kNoon + idx * 10s}));
+  }
+
+  // The window is capped to the last 6 buckets
+  auto flow { nw.GetPassengerFlow("station_0", 1h, kNoon + 95s) };
+  BOOST_CHECK_EQUAL(flow.in, 6);
+  BOOST_CHECK(flow.window == 60s);
+
+  // An event older than the history only counts in the total
+  BOOST_REQUIRE(nw.RecordPassengerEvent({"station_0", EventType::In,
+                                         kNoon + 5s}));
+  flow = nw.GetPassengerFlow("station_0", 1h, kNoon + 95s);
+  BOOST_CHECK_EQUAL(flow.in, 6);
+  BOOST_CHECK_EQUAL(nw.GetPassengerCount("station_0"), 11);
+
+  // Late events still count if their bucket is in the history
+  BOOST_REQUIRE(nw.RecordPassengerEvent({"station_0", EventType::Out,
+                                         kNoon + 45s}));
+  flow = nw.GetPassengerFlow("station_0", 1h, kNoon + 95s);
+  BOOST_CHECK_EQUAL(flow.out, 1);
+}
+
+BOOST_AUTO_TEST_CASE(current_time)
+{
+  TransportNetwork nw {};
+  BOOST_REQUIRE(nw.AddStation({"station_0", "Station 0"}));
+
+  // Events without a timestamp happen now
+  BOOST_REQUIRE(nw.RecordPassengerEvent({"station_0",
+                                         PassengerEvent::Type::In}));
+  const auto flow { nw.GetPassengerFlow("station_0", 60s) };
+  BOOST_CHECK_EQUAL(flow.in, 1);
+  BOOST_CHECK(flow.window == 60s);
+}
+
+BOOST_AUTO_TEST_CASE(disabled)
+{
+  PassengerFlowOptions options {};
+  options.nBuckets = 0;
+  TransportNetwork nw { options };
+  BOOST_REQUIRE(nw.AddStation({"station_0", "Station 0"}));
+  BOOST_REQUIRE(nw.RecordPassengerEvent({"station_0",
+                                         PassengerEvent::Type::In}));
+  const auto flow { nw.GetPassengerFlow("station_0", 60s) };
+  BOOST_CHECK_EQUAL(flow.in, 0);
+  BOOST_CHECK(flow.window == 0s);
+  BOOST_CHECK_EQUAL(nw.GetPassengerCount("station_0"), 1);
+  BOOST_CHECK_EQUAL(nw.MemoryUsage().flows, 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END(); // GetPassengerFlow
 
 BOOST_AUTO_TEST_SUITE(GetRoutesServingStation);
 
@@ -383,6 +534,8 @@ BOOST_AUTO_TEST_CASE(basic)
 
 BOOST_AUTO_TEST_SUITE_END(); // GetRoutesServingStation
 
+BOOST_AUTO_TEST_SUITE(TravelTime);
+
 BOOST_AUTO_TEST_CASE(basic)
 {
   TransportNetwork nw {};
@@ -573,13 +726,13 @@ BOOST_AUTO_TEST_CASE(from_json_travel_times)
 
   BOOST_CHECK_EQUAL(nw.GetTravelTime("station_0", "station_1"), 1);
   BOOST_CHECK_EQUAL(nw.GetTravelTime("station_1", "station_0"), 1);
-  BOOST_CHECK_EQUAL(nw.GetTravelTime("station_0", "station_2"), 2);
+  BOOST_CHECK_EQUAL(nw.GetTravelTime("station_1", "station_2"), 2);
   BOOST_CHECK_EQUAL(
     nw.GetTravelTime("line_0", "route_0", "station_0", "station_2"), 1 + 2
   );
 }
 
-BOOST_AUTO_TEST_CASE(from_json_travel_times)
+BOOST_AUTO_TEST_CASE(from_json_bad_travel_times)
 {
   auto testFilePath { std::filesystem::path(TEST_DATA) / "from_json_bad_travel_times.json" };
   auto src = ParseJsonFile(testFilePath); // use copy initialization
@@ -589,6 +742,991 @@ BOOST_AUTO_TEST_CASE(from_json_travel_times)
   BOOST_REQUIRE(!ok);
 }
 
+BOOST_AUTO_TEST_SUITE(FromJsonStream);
+
+BOOST_AUTO_TEST_CASE(travel_times)
+{
+  std::ifstream src {
+    std::filesystem::path(TEST_DATA) / "from_json_travel_times.json"
+  };
+
+  // Lines come before the stations in this file
+  TransportNetwork nw {};
+  auto ok { nw.FromJson(src) };
+  BOOST_REQUIRE(ok);
+
+  BOOST_CHECK_EQUAL(nw.GetTravelTime("station_0", "station_1"), 1);
+  BOOST_CHECK_EQUAL(nw.GetTravelTime("station_1", "station_0"), 1);
+  BOOST_CHECK_EQUAL(nw.GetTravelTime("station_1", "station_2"), 2);
+  BOOST_CHECK_EQUAL(
+    nw.GetTravelTime("line_0", "route_0", "station_0", "station_2"), 1 + 2
+  );
+}
+
+BOOST_AUTO_TEST_CASE(bad_travel_times)
+{
+  std::ifstream src {
+    std::filesystem::path(TEST_DATA) / "from_json_bad_travel_times.json"
+  };
+
+  TransportNetwork nw {};
+  auto ok { nw.FromJson(src) };
+  BOOST_REQUIRE(!ok);
+}
+
+BOOST_AUTO_TEST_CASE(same_as_json_object)
+{
+  auto src = ParseJsonFile(TESTS_NETWORK_LAYOUT_JSON);
+  const auto travelTimes = src.at("travel_times");
+  const auto stations = src.at("stations");
+  TransportNetwork expected {};
+  BOOST_REQUIRE(expected.FromJson(std::move(src)));
+
+  std::ifstream file { TESTS_NETWORK_LAYOUT_JSON };
+  TransportNetwork nw {};
+  BOOST_REQUIRE(nw.FromJson(file));
+
+  for (const auto& travelTime: travelTimes)
+  {
+    const auto from { travelTime.at("start_station_id").get<Id>() };
+    const auto to { travelTime.at("end_station_id").get<Id>() };
+    BOOST_CHECK_EQUAL(
+      nw.GetTravelTime(from, to), expected.GetTravelTime(from, to)
+    );
+  }
+  for (const auto& station: stations)
+  {
+    const auto id { station.at("station_id").get<Id>() };
+    BOOST_CHECK_EQUAL(
+      nw.GetRoutesServingStation(id).size(),
+      expected.GetRoutesServingStation(id).size()
+    );
+  }
+}
+
+BOOST_AUTO_TEST_CASE(invalid)
+{
+  // Truncated JSON
+  {
+    std::istringstream src { R"({"stations": [{"station_id": "station_0")" };
+    TransportNetwork nw {};
+    BOOST_CHECK_THROW(nw.FromJson(src), nlohmann::json::exception);
+  }
+
+  // Missing section
+  {
+    std::istringstream src { R"({"stations": [], "lines": []})" };
+    TransportNetwork nw {};
+    BOOST_CHECK_THROW(nw.FromJson(src), std::runtime_error);
+  }
+
+  // Line with an unknown station
+  {
+    std::istringstream src { R"({
+      "stations": [{"station_id": "station_0", "name": "Station 0"}],
+      "lines": [{"line_id": "line_0", "name": "Line 0", "routes": [{
+        "route_id": "route_0", "direction": "inbound", "line_id": "line_0",
+        "start_station_id": "station_0", "end_station_id": "station_1",
+        "route_stops": ["station_0", "station_1"]
+      }]}],
+      "travel_times": []
+    })" };
+    TransportNetwork nw {};
+    BOOST_CHECK_THROW(nw.FromJson(src), std::runtime_error);
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END(); // FromJsonStream
+
+BOOST_AUTO_TEST_SUITE(CrowdedStations);
+
+// Check a ranking against the counts of the network
+static void CheckRanking(
+  const TransportNetwork& nw,
+  std::size_t nStations,
+  std::size_t k
+)
+{
+  std::vector<long long int> counts {};
+  nw.ForEachPassengerCount([&counts](const auto&, auto count) {
+    counts.push_back(count);
+  });
+  std::sort(counts.rbegin(), counts.rend());
+
+  const auto most { nw.GetMostCrowdedStations(k) };
+  BOOST_REQUIRE_EQUAL(most.size(), std::min(k, nStations));
+  for (std::size_t idx {0}; idx < most.size(); ++idx)
+  {
+    BOOST_CHECK_EQUAL(most[idx].passengerCount, counts[idx]);
+    BOOST_CHECK_EQUAL(nw.GetPassengerCount(most[idx].stationId),
+                      most[idx].passengerCount);
+  }
+  const auto least { nw.GetLeastCrowdedStations(k) };
+  BOOST_REQUIRE_EQUAL(least.size(), std::min(k, nStations));
+  for (std::size_t idx {0}; idx < least.size(); ++idx)
+  {
+    BOOST_CHECK_EQUAL(least[idx].passengerCount,
+                      counts[counts.size() - 1 - idx]);
+    BOOST_CHECK_EQUAL(nw.GetPassengerCount(least[idx].stationId),
+                      least[idx].passengerCount);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(basic)
+{
+  TransportNetwork nw {};
+  BOOST_CHECK(nw.GetMostCrowdedStations(3).empty());
+  for (int idx {0}; idx < 4; ++idx)
+  {
+    const auto id { "station_" + std::to_string(idx) };
+    BOOST_REQUIRE(nw.AddStation({id, id}));
+  }
+
+  using EventType = PassengerEvent::Type;
+  for (int idx {0}; idx < 3; ++idx)
+    BOOST_REQUIRE(nw.RecordPassengerEvent({"station_2", EventType::In}));
+  BOOST_REQUIRE(nw.RecordPassengerEvent({"station_1", EventType::In}));
+  BOOST_REQUIRE(nw.RecordPassengerEvent({"station_3", EventType::Out}));
+
+  const auto most { nw.GetMostCrowdedStations(2) };
+  BOOST_REQUIRE_EQUAL(most.size(), 2);
+  BOOST_CHECK_EQUAL(most[0].stationId, "station_2");
+  BOOST_CHECK_EQUAL(most[0].passengerCount, 3);
+  BOOST_CHECK_EQUAL(most[1].stationId, "station_1");
+  BOOST_CHECK_EQUAL(most[1].passengerCount, 1);
+
+  const auto least { nw.GetLeastCrowdedStations(2) };
+  BOOST_REQUIRE_EQUAL(least.size(), 2);
+  BOOST_CHECK_EQUAL(least[0].stationId, "station_3");
+  BOOST_CHECK_EQUAL(least[0].passengerCount, -1);
+  BOOST_CHECK_EQUAL(least[1].stationId, "station_0");
+  BOOST_CHECK_EQUAL(least[1].passengerCount, 0);
+
+  // Passengers leave: The order follows
+  for (int idx {0}; idx < 3; ++idx)
+    BOOST_REQUIRE(nw.RecordPassengerEvent({"station_2", EventType::Out}));
+  BOOST_CHECK_EQUAL(nw.GetMostCrowdedStations(1).at(0).stationId, "station_1");
+
+  // More stations than asked for
+  BOOST_CHECK_EQUAL(nw.GetMostCrowdedStations(10).size(), 4);
+  CheckRanking(nw, 4, 10);
+}
+
+BOOST_AUTO_TEST_CASE(batch)
+{
+  TransportNetwork nw {};
+  BOOST_REQUIRE(nw.AddStation({"station_0", "Station 0"}));
+  BOOST_REQUIRE(nw.AddStation({"station_1", "Station 1"}));
+
+  using EventType = PassengerEvent::Type;
+  const std::vector<PassengerEvent> events {
+    {"station_1", EventType::In},
+    {"station_42", EventType::In},
+    {"station_1", EventType::In},
+    {"station_0", EventType::Out},
+    {"station_1", EventType::Out},
+    {"station_1", EventType::In},
+  };
+  BOOST_CHECK_EQUAL(nw.RecordPassengerEvents(events), 5);
+  BOOST_CHECK_EQUAL(nw.GetPassengerCount("station_0"), -1);
+  BOOST_CHECK_EQUAL(nw.GetPassengerCount("station_1"), 2);
+  const auto most { nw.GetMostCrowdedStations(2) };
+  BOOST_CHECK_EQUAL(most.at(0).stationId, "station_1");
+  BOOST_CHECK_EQUAL(most.at(1).stationId, "station_0");
+  BOOST_CHECK_EQUAL(nw.RecordPassengerEvents({}), 0);
+}
+
+BOOST_AUTO_TEST_CASE(random_events)
+{
+  // Few stations and many events, so that the groups of stations with the
+  //  same count grow and shrink
+  constexpr std::size_t nStations {50};
+  TransportNetwork nw {};
+  std::vector<Id> ids {};
+  for (std::size_t idx {0}; idx < nStations; ++idx)
+  {
+    ids.push_back("station_" + std::to_string(idx));
+    BOOST_REQUIRE(nw.AddStation({ids.back(), ids.back()}));
+  }
+
+  std::mt19937 random {42};
+  std::uniform_int_distribution<std::size_t> pickStation {0, nStations - 1};
+  std::uniform_int_distribution<int> pickType {0, 2};
+  for (int round {0}; round < 200; ++round)
+  {
+    std::vector<PassengerEvent> events {};
+    for (int idx {0}; idx < 20; ++idx)
+    {
+      // Skewed towards entries, so that counts spread out
+      events.push_back({ids[pickStation(random)], pickType(random) == 0 ?
+                        PassengerEvent::Type::Out : PassengerEvent::Type::In});
+    }
+    if (round % 2 == 0)
+    {
+      BOOST_REQUIRE_EQUAL(nw.RecordPassengerEvents(events), events.size());
+    }
+    else
+    {
+      for (const auto& event: events)
+        BOOST_REQUIRE(nw.RecordPassengerEvent(event));
+    }
+    if (round % 20 == 0)
+      CheckRanking(nw, nStations, 20);
+  }
+  CheckRanking(nw, nStations, nStations);
+
+  // Stations added later start at 0, in the middle of the ranking
+  BOOST_REQUIRE(nw.AddStation({"station_new", "Station new"}));
+  CheckRanking(nw, nStations + 1, nStations + 1);
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_reader)
+{
+  constexpr std::size_t nStations {100};
+  TransportNetwork nw {};
+  for (std::size_t idx {0}; idx < nStations; ++idx)
+  {
+    const auto id { "station_" + std::to_string(idx) };
+    BOOST_REQUIRE(nw.AddStation({id, id}));
+  }
+
+  std::atomic<bool> done {false};
+  std::thread ingestion { [&nw, &done]() {
+    for (int idx {0}; idx < 200'000; ++idx)
+    {
+      nw.RecordPassengerEvent({
+        "station_" + std::to_string((idx * 7) % nStations),
+        idx % 3 == 0 ? PassengerEvent::Type::Out : PassengerEvent::Type::In
+      });
+    }
+    done = true;
+  }};
+
+  // Each ranking is sorted, even while it moves
+  std::size_t nQueries {0};
+  while (!done || nQueries == 0)
+  {
+    const auto most { nw.GetMostCrowdedStations(20) };
+    BOOST_REQUIRE_EQUAL(most.size(), 20);
+    for (std::size_t idx {1}; idx < most.size(); ++idx)
+      BOOST_REQUIRE(most[idx - 1].passengerCount >= most[idx].passengerCount);
+    ++nQueries;
+  }
+  ingestion.join();
+  CheckRanking(nw, nStations, nStations);
+}
+
+BOOST_AUTO_TEST_SUITE_END(); // CrowdedStations
+
+BOOST_AUTO_TEST_SUITE(SnapshotPassengerCounts);
+
+// The i-th event of the snapshot tests
+static PassengerEvent GetSnapshotEvent(
+  std::size_t idx,
+  std::size_t nStations
+)
+{
+  return {
+    "station_" + std::to_string((idx * 7) % nStations),
+    idx % 3 == 0 ? PassengerEvent::Type::Out : PassengerEvent::Type::In
+  };
+}
+
+BOOST_AUTO_TEST_CASE(basic)
+{
+  TransportNetwork nw {};
+  BOOST_CHECK_EQUAL(nw.SnapshotPassengerCounts().counts.size(), 0);
+  for (int idx {0}; idx < 3; ++idx)
+  {
+    const auto id { "station_" + std::to_string(idx) };
+    BOOST_REQUIRE(nw.AddStation({id, id}));
+  }
+
+  // Rejected events count in the sequence too
+  using EventType = PassengerEvent::Type;
+  BOOST_REQUIRE(nw.RecordPassengerEvent({"station_0", EventType::In}));
+  BOOST_REQUIRE(!nw.RecordPassengerEvent({"station_42", EventType::In}));
+  BOOST_REQUIRE_EQUAL(nw.RecordPassengerEvents({
+    {"station_1", EventType::Out},
+    {"station_0", EventType::In},
+    {"station_42", EventType::Out},
+  }), 2);
+  BOOST_CHECK_EQUAL(nw.GetPassengerEventSequence(), 5);
+
+  auto snapshot { nw.SnapshotPassengerCounts() };
+  BOOST_CHECK_EQUAL(snapshot.sequence, 5);
+  BOOST_REQUIRE_EQUAL(snapshot.counts.size(), 3);
+  std::sort(snapshot.counts.begin(), snapshot.counts.end(),
+    [](const auto& a, const auto& b) { return a.stationId < b.stationId; }
+  );
+  BOOST_CHECK_EQUAL(snapshot.counts[0].passengerCount, 2);
+  BOOST_CHECK_EQUAL(snapshot.counts[1].passengerCount, -1);
+  BOOST_CHECK_EQUAL(snapshot.counts[2].passengerCount, 0);
+
+  // Events after a snapshot do not change it, and show in the next one
+  BOOST_REQUIRE(nw.RecordPassengerEvent({"station_2", EventType::In}));
+  BOOST_CHECK_EQUAL(snapshot.counts[2].passengerCount, 0);
+  snapshot = nw.SnapshotPassengerCounts();
+  BOOST_CHECK_EQUAL(snapshot.sequence, 6);
+  for (const auto& count: snapshot.counts)
+  {
+    BOOST_CHECK_EQUAL(count.passengerCount,
+                      nw.GetPassengerCount(count.stationId));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(restore)
+{
+  TransportNetwork nw {};
+  for (int idx {0}; idx < 3; ++idx)
+  {
+    const auto id { "station_" + std::to_string(idx) };
+    BOOST_REQUIRE(nw.AddStation({id, id}));
+  }
+
+  PassengerCountSnapshot snapshot {};
+  snapshot.sequence = 1000;
+  snapshot.counts = {
+    {"station_0", 7},
+    {"station_2", -3},
+    {"station_42", 5},
+  };
+  BOOST_CHECK_EQUAL(nw.RestorePassengerCounts(snapshot), 2);
+  BOOST_CHECK_EQUAL(nw.GetPassengerEventSequence(), 1000);
+  BOOST_CHECK_EQUAL(nw.GetPassengerCount("station_0"), 7);
+  BOOST_CHECK_EQUAL(nw.GetPassengerCount("station_1"), 0);
+  BOOST_CHECK_EQUAL(nw.GetPassengerCount("station_2"), -3);
+
+  // The ranking follows the restored counts
+  const auto most { nw.GetMostCrowdedStations(1) };
+  BOOST_REQUIRE_EQUAL(most.size(), 1);
+  BOOST_CHECK_EQUAL(most[0].stationId, "station_0");
+
+  // New events go on from there
+  BOOST_REQUIRE(nw.RecordPassengerEvent({
+    "station_2", PassengerEvent::Type::In
+  }));
+  BOOST_CHECK_EQUAL(nw.GetPassengerEventSequence(), 1001);
+  BOOST_CHECK_EQUAL(nw.GetPassengerCount("station_2"), -2);
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_recording)
+{
+  constexpr std::size_t nStations {50};
+  constexpr std::size_t nEvents {300'000};
+  TransportNetwork nw {};
+  for (std::size_t idx {0}; idx < nStations; ++idx)
+  {
+    const auto id { "station_" + std::to_string(idx) };
+    BOOST_REQUIRE(nw.AddStation({id, id}));
+  }
+
+  // Single events and batches, mixed
+  std::atomic<bool> done {false};
+  std::thread ingestion { [&nw, &done]() {
+    std::vector<PassengerEvent> batch {};
+    for (std::size_t idx {0}; idx < nEvents;)
+    {
+      if (idx % 1000 < 500)
+      {
+        nw.RecordPassengerEvent(GetSnapshotEvent(idx++, nStations));
+        continue;
+      }
+      batch.clear();
+      for (int event {0}; event < 10; ++event)
+        batch.push_back(GetSnapshotEvent(idx++, nStations));
+      nw.RecordPassengerEvents(batch);
+    }
+    done = true;
+  }};
+
+  // Each snapshot holds the counts after exactly its first `sequence` events
+  std::vector<PassengerCountSnapshot> snapshots {};
+  while (!done || snapshots.empty())
+    snapshots.push_back(nw.SnapshotPassengerCounts());
+  ingestion.join();
+  snapshots.push_back(nw.SnapshotPassengerCounts());
+  BOOST_CHECK(snapshots.size() > 2);
+  BOOST_CHECK_EQUAL(snapshots.back().sequence, nEvents);
+
+  TransportNetwork expected {};
+  for (std::size_t idx {0}; idx < nStations; ++idx)
+  {
+    const auto id { "station_" + std::to_string(idx) };
+    BOOST_REQUIRE(expected.AddStation({id, id}));
+  }
+  std::size_t nRecorded {0};
+  for (const auto& snapshot: snapshots)
+  {
+    BOOST_REQUIRE(snapshot.sequence >= nRecorded);
+    while (nRecorded < snapshot.sequence)
+      expected.RecordPassengerEvent(GetSnapshotEvent(nRecorded++, nStations));
+    BOOST_REQUIRE_EQUAL(snapshot.counts.size(), nStations);
+    for (const auto& count: snapshot.counts)
+    {
+      BOOST_REQUIRE_EQUAL(count.passengerCount,
+                          expected.GetPassengerCount(count.stationId));
+    }
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END(); // SnapshotPassengerCounts
+
+// Journeys from station_a to station_d:
+//  line_1: a -5-> b -5-> c -5-> d   15, no transfer
+//  line_2: a -4-> e                  8, 1 transfer
+//  line_3:        e -4-> d
+//  line_4: a -1-> f                  6, 2 transfers
+//  line_5:        f -1-> e
+static TransportNetwork GetJourneyNetwork()
+{
+  TransportNetwork nw {};
+  for (const std::string id: {"a", "b", "c", "d", "e", "f", "g"})
+    BOOST_REQUIRE(nw.AddStation({"station_" + id, id}));
+  const std::vector<std::vector<Id>> routes {
+    {"station_a", "station_b", "station_c", "station_d"},
+    {"station_a", "station_e"},
+    {"station_e", "station_d"},
+    {"station_a", "station_f"},
+    {"station_f", "station_e"},
+  };
+  for (std::size_t idx {0}; idx < routes.size(); ++idx)
+  {
+    const auto suffix { std::to_string(idx + 1) };
+    const auto& stops { routes[idx] };
+    BOOST_REQUIRE(nw.AddLine({"line_" + suffix, "Line " + suffix, {{
+      "route_" + suffix, "inbound", "line_" + suffix, stops.front(),
+      stops.back(), stops
+    }}}));
+  }
+  bool ok {true};
+  ok &= nw.SetTravelTime("station_a", "station_b", 5);
+  ok &= nw.SetTravelTime("station_b", "station_c", 5);
+  ok &= nw.SetTravelTime("station_c", "station_d", 5);
+  ok &= nw.SetTravelTime("station_a", "station_e", 4);
+  ok &= nw.SetTravelTime("station_e", "station_d", 4);
+  ok &= nw.SetTravelTime("station_a", "station_f", 1);
+  ok &= nw.SetTravelTime("station_f", "station_e", 1);
+  BOOST_REQUIRE(ok);
+  return nw;
+}
+
+static std::vector<unsigned int> GetCosts(
+  const std::vector<Journey>& journeys
+)
+{
+  std::vector<unsigned int> costs {};
+  for (const auto& journey: journeys)
+    costs.push_back(journey.cost);
+  return costs;
+}
+
+BOOST_AUTO_TEST_SUITE(GetJourneys);
+
+BOOST_AUTO_TEST_CASE(pareto_front)
+{
+  const auto nw { GetJourneyNetwork() };
+  const auto journeys { nw.GetJourneys("station_a", "station_d") };
+  BOOST_REQUIRE_EQUAL(journeys.size(), 3);
+  for (std::size_t idx {0}; idx < journeys.size(); ++idx)
+    BOOST_CHECK_EQUAL(journeys[idx].GetTransferCount(), idx);
+  BOOST_CHECK(GetCosts(journeys) == (std::vector<unsigned int> {15, 8, 6}));
+
+  const auto& direct { journeys[0] };
+  BOOST_REQUIRE_EQUAL(direct.legs.size(), 1);
+  BOOST_CHECK_EQUAL(direct.legs[0].line, "line_1");
+  BOOST_CHECK_EQUAL(direct.legs[0].route, "route_1");
+  BOOST_CHECK_EQUAL(direct.legs[0].fromStation, "station_a");
+  BOOST_CHECK_EQUAL(direct.legs[0].toStation, "station_d");
+  BOOST_CHECK_EQUAL(direct.legs[0].nStops, 3);
+  BOOST_CHECK_EQUAL(direct.legs[0].travelTime, 15);
+
+  const auto& fastest { journeys[2] };
+  BOOST_REQUIRE_EQUAL(fastest.legs.size(), 3);
+  BOOST_CHECK_EQUAL(fastest.legs[0].line, "line_4");
+  BOOST_CHECK_EQUAL(fastest.legs[1].line, "line_5");
+  BOOST_CHECK_EQUAL(fastest.legs[1].fromStation, "station_f");
+  BOOST_CHECK_EQUAL(fastest.legs[1].toStation, "station_e");
+  BOOST_CHECK_EQUAL(fastest.legs[2].line, "line_3");
+  BOOST_CHECK_EQUAL(fastest.legs[2].toStation, "station_d");
+  BOOST_CHECK_EQUAL(fastest.travelTime, 6);
+}
+
+BOOST_AUTO_TEST_CASE(penalties)
+{
+  const auto nw { GetJourneyNetwork() };
+
+  // 2 transfers cost as much as 1: Only the journey with fewer stays
+  JourneyOptions options {};
+  options.penalties.defaultPenalty = 2;
+  auto journeys { nw.GetJourneys("station_a", "station_d", options) };
+  BOOST_CHECK(GetCosts(journeys) == (std::vector<unsigned int> {15, 10}));
+  BOOST_REQUIRE_EQUAL(journeys.size(), 2);
+  BOOST_CHECK_EQUAL(journeys[1].travelTime, 8);
+  BOOST_CHECK_EQUAL(journeys[1].legs[0].penalty, 0);
+  BOOST_CHECK_EQUAL(journeys[1].legs[1].penalty, 2);
+
+  // A slow interchange at station_e rules out both changes there
+  options.penalties.stations["station_e"] = 10;
+  journeys = nw.GetJourneys("station_a", "station_d", options);
+  BOOST_CHECK(GetCosts(journeys) == (std::vector<unsigned int> {15}));
+
+  // The line pair comes first
+  options.penalties.linePairs[{"line_2", "line_3"}] = 0;
+  journeys = nw.GetJourneys("station_a", "station_d", options);
+  BOOST_CHECK(GetCosts(journeys) == (std::vector<unsigned int> {15, 8}));
+  BOOST_REQUIRE_EQUAL(journeys.size(), 2);
+  BOOST_CHECK_EQUAL(journeys[1].legs[1].penalty, 0);
+
+  // Unknown stations and lines are ignored
+  options.penalties.stations["station_x"] = 1;
+  options.penalties.linePairs[{"line_x", "line_3"}] = 1;
+  BOOST_CHECK(GetCosts(nw.GetJourneys("station_a", "station_d", options)) ==
+              (std::vector<unsigned int> {15, 8}));
+}
+
+BOOST_AUTO_TEST_CASE(max_transfers)
+{
+  const auto nw { GetJourneyNetwork() };
+  JourneyOptions options {};
+  options.maxTransfers = 0;
+  BOOST_CHECK(GetCosts(nw.GetJourneys("station_a", "station_d", options)) ==
+              (std::vector<unsigned int> {15}));
+  options.maxTransfers = 1;
+  BOOST_CHECK(GetCosts(nw.GetJourneys("station_a", "station_d", options)) ==
+              (std::vector<unsigned int> {15, 8}));
+
+  // Only with a transfer
+  options.maxTransfers = 0;
+  BOOST_CHECK(nw.GetJourneys("station_f", "station_d", options).empty());
+}
+
+BOOST_AUTO_TEST_CASE(no_journey)
+{
+  const auto nw { GetJourneyNetwork() };
+  BOOST_CHECK(nw.GetJourneys("station_a", "station_g").empty());
+  BOOST_CHECK(nw.GetJourneys("station_d", "station_a").empty());
+  BOOST_CHECK(nw.GetJourneys("station_a", "station_a").empty());
+  BOOST_CHECK(nw.GetJourneys("station_a", "station_x").empty());
+  BOOST_CHECK(nw.GetJourneys("station_x", "station_a").empty());
+}
+
+BOOST_AUTO_TEST_CASE(route_change_on_line)
+{
+  // Two routes of the same line: Changing between them is a transfer
+  TransportNetwork nw {};
+  for (const std::string id: {"a", "b", "c"})
+    BOOST_REQUIRE(nw.AddStation({"station_" + id, id}));
+  BOOST_REQUIRE(nw.AddLine({"line_0", "Line 0", {
+    {"route_0", "inbound", "line_0", "station_a", "station_b",
+     {"station_a", "station_b"}},
+    {"route_1", "inbound", "line_0", "station_b", "station_c",
+     {"station_b", "station_c"}},
+  }}));
+  BOOST_REQUIRE(nw.SetTravelTime("station_a", "station_b", 1));
+  BOOST_REQUIRE(nw.SetTravelTime("station_b", "station_c", 1));
+  JourneyOptions options {};
+  options.penalties.defaultPenalty = 5;
+  options.penalties.linePairs[{"line_0", "line_0"}] = 1;
+  const auto journeys { nw.GetJourneys("station_a", "station_c", options) };
+  BOOST_REQUIRE_EQUAL(journeys.size(), 1);
+  BOOST_CHECK_EQUAL(journeys[0].GetTransferCount(), 1);
+  BOOST_CHECK_EQUAL(journeys[0].cost, 3);
+}
+
+// Without penalties, the cheapest journey takes the shortest path
+BOOST_AUTO_TEST_CASE(layout)
+{
+  auto src = ParseJsonFile(TESTS_NETWORK_LAYOUT_JSON);
+  TransportNetwork nw {};
+  BOOST_REQUIRE(nw.FromJson(nlohmann::json(src)));
+
+  std::vector<Id> stations {};
+  std::unordered_map<Id, std::vector<std::pair<Id, unsigned int>>> edges {};
+  for (const auto& station: src.at("stations"))
+    stations.push_back(station.at("station_id").get<Id>());
+  for (const auto& line: src.at("lines"))
+  {
+    for (const auto& route: line.at("routes"))
+    {
+      const auto stops { route.at("route_stops").get<std::vector<Id>>() };
+      for (std::size_t idx {0}; idx + 1 < stops.size(); ++idx)
+      {
+        edges[stops[idx]].emplace_back(
+          stops[idx + 1], nw.GetTravelTime(stops[idx], stops[idx + 1])
+        );
+      }
+    }
+  }
+  auto getShortestPath { [&edges](const Id& from, const Id& to) {
+    using Entry = std::pair<unsigned int, Id>;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<>> queue {};
+    std::unordered_map<Id, unsigned int> costs {{from, 0}};
+    queue.emplace(0, from);
+    while (!queue.empty())
+    {
+      const auto [cost, station] = queue.top();
+      queue.pop();
+      if (station == to)
+        return cost;
+      if (cost > costs[station])
+        continue;
+      for (const auto& [next, travelTime]: edges[station])
+      {
+        const auto found { costs.find(next) };
+        if (found == costs.end() || cost + travelTime < found->second)
+        {
+          costs[next] = cost + travelTime;
+          queue.emplace(cost + travelTime, next);
+        }
+      }
+    }
+    return std::numeric_limits<unsigned int>::max();
+  }};
+
+  JourneyOptions options {};
+  options.maxTransfers = 20;
+  options.penalties.defaultPenalty = 0;
+  std::mt19937 random {42};
+  std::size_t nFound {0};
+  for (std::size_t idx {0}; idx < 200; ++idx)
+  {
+    const auto& from { stations[random() % stations.size()] };
+    const auto& to { stations[random() % stations.size()] };
+    if (from == to)
+      continue;
+    const auto journeys { nw.GetJourneys(from, to, options) };
+    const auto shortest { getShortestPath(from, to) };
+    if (journeys.empty())
+    {
+      BOOST_CHECK_EQUAL(shortest, std::numeric_limits<unsigned int>::max());
+      continue;
+    }
+    ++nFound;
+    BOOST_CHECK_EQUAL(journeys.back().cost, shortest);
+    for (std::size_t jdx {0}; jdx < journeys.size(); ++jdx)
+    {
+      const auto& journey { journeys[jdx] };
+      if (jdx > 0)
+      {
+        BOOST_CHECK(journey.GetTransferCount() >
+                    journeys[jdx - 1].GetTransferCount());
+        BOOST_CHECK(journey.cost < journeys[jdx - 1].cost);
+      }
+      BOOST_CHECK_EQUAL(journey.legs.front().fromStation, from);
+      BOOST_CHECK_EQUAL(journey.legs.back().toStation, to);
+      unsigned int travelTime {0};
+      for (std::size_t ldx {0}; ldx < journey.legs.size(); ++ldx)
+      {
+        const auto& leg { journey.legs[ldx] };
+        BOOST_CHECK_EQUAL(leg.travelTime, nw.GetTravelTime(
+          leg.line, leg.route, leg.fromStation, leg.toStation
+        ));
+        if (ldx > 0)
+          BOOST_CHECK_EQUAL(leg.fromStation, journey.legs[ldx - 1].toStation);
+        travelTime += leg.travelTime;
+      }
+      BOOST_CHECK_EQUAL(journey.travelTime, travelTime);
+      BOOST_CHECK_EQUAL(journey.cost, travelTime);
+    }
+  }
+  BOOST_CHECK(nFound > 50);
+}
+
+BOOST_AUTO_TEST_SUITE_END(); // GetJourneys
+
+BOOST_AUTO_TEST_SUITE(GetAlternativeJourneys);
+
+BOOST_AUTO_TEST_CASE(alternatives)
+{
+  const auto nw { GetJourneyNetwork() };
+
+  // The direct journey costs more than 1.5 times the cheapest one
+  auto journeys { nw.GetAlternativeJourneys("station_a", "station_d", 3) };
+  BOOST_CHECK(GetCosts(journeys) == (std::vector<unsigned int> {6, 8}));
+  BOOST_REQUIRE_EQUAL(journeys.size(), 2);
+  BOOST_CHECK_EQUAL(journeys[0].GetTransferCount(), 2);
+  BOOST_CHECK_EQUAL(journeys[1].legs[0].line, "line_2");
+  BOOST_CHECK_EQUAL(journeys[1].legs[1].line, "line_3");
+
+  AlternativeJourneyOptions options {};
+  options.maxStretch = 2.0;
+  journeys = nw.GetAlternativeJourneys("station_a", "station_d", 3, options);
+  BOOST_CHECK(GetCosts(journeys) == (std::vector<unsigned int> {6, 8, 15}));
+  journeys = nw.GetAlternativeJourneys("station_a", "station_d", 1, options);
+  BOOST_CHECK(GetCosts(journeys) == (std::vector<unsigned int> {6}));
+  BOOST_CHECK(nw.GetAlternativeJourneys("station_a", "station_d", 0,
+                                        options).empty());
+}
+
+BOOST_AUTO_TEST_CASE(sharing)
+{
+  const auto nw { GetJourneyNetwork() };
+
+  // The journey through station_e shares half its time with the cheapest
+  AlternativeJourneyOptions options {};
+  options.maxStretch = 2.0;
+  options.maxSharing = 0.4;
+  BOOST_CHECK(GetCosts(nw.GetAlternativeJourneys(
+    "station_a", "station_d", 3, options
+  )) == (std::vector<unsigned int> {6, 15}));
+}
+
+BOOST_AUTO_TEST_CASE(penalties)
+{
+  const auto nw { GetJourneyNetwork() };
+  AlternativeJourneyOptions options {};
+  options.maxStretch = 2.0;
+  options.journey.penalties.defaultPenalty = 2;
+
+  // Same cost: The journey with fewer stops comes first
+  auto journeys { nw.GetAlternativeJourneys("station_a", "station_d", 3,
+                                            options) };
+  BOOST_CHECK(GetCosts(journeys) == (std::vector<unsigned int> {10, 10, 15}));
+  BOOST_REQUIRE_EQUAL(journeys.size(), 3);
+  BOOST_CHECK_EQUAL(journeys[0].GetTransferCount(), 1);
+  BOOST_CHECK_EQUAL(journeys[1].GetTransferCount(), 2);
+  BOOST_CHECK_EQUAL(journeys[1].legs[2].penalty, 2);
+
+  options.journey.maxTransfers = 1;
+  journeys = nw.GetAlternativeJourneys("station_a", "station_d", 3, options);
+  BOOST_CHECK(GetCosts(journeys) == (std::vector<unsigned int> {10, 15}));
+}
+
+BOOST_AUTO_TEST_CASE(cheaper_loop)
+{
+  // line_0: a -1-> b
+  // line_1:        b -1-> d
+  // line_2:        b -1-> c -1-> b, on two routes
+  TransportNetwork nw {};
+  for (const std::string id: {"a", "b", "c", "d"})
+    BOOST_REQUIRE(nw.AddStation({"station_" + id, id}));
+  BOOST_REQUIRE(nw.AddLine({"line_0", "Line 0", {{
+    "route_0", "inbound", "line_0", "station_a", "station_b",
+    {"station_a", "station_b"}
+  }}}));
+  BOOST_REQUIRE(nw.AddLine({"line_1", "Line 1", {{
+    "route_1", "inbound", "line_1", "station_b", "station_d",
+    {"station_b", "station_d"}
+  }}}));
+  BOOST_REQUIRE(nw.AddLine({"line_2", "Line 2", {
+    {
+      "route_2", "inbound", "line_2", "station_b", "station_c",
+      {"station_b", "station_c"}
+    },
+    {
+      "route_3", "outbound", "line_2", "station_c", "station_b",
+      {"station_c", "station_b"}
+    },
+  }}));
+  BOOST_REQUIRE(nw.SetTravelTime("station_a", "station_b", 1));
+  BOOST_REQUIRE(nw.SetTravelTime("station_b", "station_d", 1));
+  BOOST_REQUIRE(nw.SetTravelTime("station_b", "station_c", 1));
+
+  // The loop through station_c avoids the line_0 to line_1 penalty, for a
+  //  cost of 6. The stretch applies to the loopless journey, which costs 10.
+  AlternativeJourneyOptions options {};
+  options.journey.penalties.linePairs = {
+    {{"line_0", "line_1"}, 8},
+    {{"line_0", "line_2"}, 1},
+    {{"line_2", "line_1"}, 1},
+  };
+  const auto journeys { nw.GetAlternativeJourneys("station_a", "station_d", 3,
+                                                  options) };
+  BOOST_CHECK(GetCosts(journeys) == (std::vector<unsigned int> {10}));
+}
+
+BOOST_AUTO_TEST_CASE(leave_route)
+{
+  // line_0: a -1-> b -1-> c -1-> d
+  // line_1:        b -3-> d
+  // line_2:               c -1-> e -1-> d
+  TransportNetwork nw {};
+  for (const std::string id: {"a", "b", "c", "d", "e"})
+    BOOST_REQUIRE(nw.AddStation({"station_" + id, id}));
+  const std::vector<std::vector<Id>> routes {
+    {"station_a", "station_b", "station_c", "station_d"},
+    {"station_b", "station_d"},
+    {"station_c", "station_e", "station_d"},
+  };
+  for (std::size_t idx {0}; idx < routes.size(); ++idx)
+  {
+    const auto suffix { std::to_string(idx) };
+    const auto& stops { routes[idx] };
+    BOOST_REQUIRE(nw.AddLine({"line_" + suffix, "Line " + suffix, {{
+      "route_" + suffix, "inbound", "line_" + suffix, stops.front(),
+      stops.back(), stops
+    }}}));
+  }
+  BOOST_REQUIRE(nw.SetTravelTime("station_a", "station_b", 1));
+  BOOST_REQUIRE(nw.SetTravelTime("station_b", "station_c", 1));
+  BOOST_REQUIRE(nw.SetTravelTime("station_c", "station_d", 1));
+  BOOST_REQUIRE(nw.SetTravelTime("station_b", "station_d", 3));
+  BOOST_REQUIRE(nw.SetTravelTime("station_c", "station_e", 1));
+  BOOST_REQUIRE(nw.SetTravelTime("station_e", "station_d", 1));
+
+  const auto journeys { nw.GetAlternativeJourneys("station_a", "station_d",
+                                                  5) };
+  BOOST_CHECK(GetCosts(journeys) == (std::vector<unsigned int> {3, 4, 4}));
+  BOOST_REQUIRE_EQUAL(journeys.size(), 3);
+  BOOST_CHECK_EQUAL(journeys[0].legs.size(), 1);
+  BOOST_REQUIRE_EQUAL(journeys[1].legs.size(), 2);
+  BOOST_CHECK_EQUAL(journeys[1].legs[0].toStation, "station_b");
+  BOOST_CHECK_EQUAL(journeys[1].legs[1].line, "line_1");
+
+  // The first leg rides two stops of line_0 before the change
+  BOOST_REQUIRE_EQUAL(journeys[2].legs.size(), 2);
+  BOOST_CHECK_EQUAL(journeys[2].legs[0].line, "line_0");
+  BOOST_CHECK_EQUAL(journeys[2].legs[0].toStation, "station_c");
+  BOOST_CHECK_EQUAL(journeys[2].legs[0].nStops, 2);
+  BOOST_CHECK_EQUAL(journeys[2].legs[1].line, "line_2");
+}
+
+BOOST_AUTO_TEST_CASE(no_journey)
+{
+  const auto nw { GetJourneyNetwork() };
+  BOOST_CHECK(nw.GetAlternativeJourneys("station_a", "station_g", 3).empty());
+  BOOST_CHECK(nw.GetAlternativeJourneys("station_d", "station_a", 3).empty());
+  BOOST_CHECK(nw.GetAlternativeJourneys("station_a", "station_a", 3).empty());
+  BOOST_CHECK(nw.GetAlternativeJourneys("station_a", "station_x", 3).empty());
+}
+
+BOOST_AUTO_TEST_CASE(layout)
+{
+  auto src = ParseJsonFile(TESTS_NETWORK_LAYOUT_JSON);
+  TransportNetwork nw {};
+  BOOST_REQUIRE(nw.FromJson(nlohmann::json(src)));
+  std::vector<Id> stations {};
+  for (const auto& station: src.at("stations"))
+    stations.push_back(station.at("station_id").get<Id>());
+
+  AlternativeJourneyOptions options {};
+  options.journey.penalties.defaultPenalty = 3;
+  std::mt19937 random {7};
+  std::size_t nFound {0};
+  std::size_t nAlternatives {0};
+  for (std::size_t idx {0}; idx < 100; ++idx)
+  {
+    const auto& from { stations[random() % stations.size()] };
+    const auto& to { stations[random() % stations.size()] };
+    const auto journeys { nw.GetAlternativeJourneys(from, to, 5, options) };
+    const auto pareto { nw.GetJourneys(from, to, options.journey) };
+    if (pareto.empty())
+    {
+      BOOST_CHECK(journeys.empty());
+      continue;
+    }
+    ++nFound;
+    nAlternatives += journeys.size() - 1;
+    BOOST_REQUIRE(!journeys.empty());
+    BOOST_CHECK(journeys.size() <= 5);
+    BOOST_CHECK_EQUAL(journeys.front().cost, pareto.back().cost);
+    for (std::size_t jdx {0}; jdx < journeys.size(); ++jdx)
+    {
+      const auto& journey { journeys[jdx] };
+      BOOST_CHECK(journey.cost <= journeys.front().cost * 1.5);
+      BOOST_CHECK(journey.GetTransferCount() <=
+                  options.journey.maxTransfers);
+      if (jdx > 0)
+        BOOST_CHECK(journey.cost >= journeys[jdx - 1].cost);
+
+      // Loopless, and the cost adds up
+      BOOST_CHECK_EQUAL(journey.legs.front().fromStation, from);
+      BOOST_CHECK_EQUAL(journey.legs.back().toStation, to);
+      std::set<Id> visited {from};
+      unsigned int cost {0};
+      for (std::size_t ldx {0}; ldx < journey.legs.size(); ++ldx)
+      {
+        const auto& leg { journey.legs[ldx] };
+        BOOST_CHECK_EQUAL(leg.penalty, ldx == 0 ? 0 : 3);
+        BOOST_CHECK_EQUAL(leg.travelTime, nw.GetTravelTime(
+          leg.line, leg.route, leg.fromStation, leg.toStation
+        ));
+        if (ldx > 0)
+          BOOST_CHECK_EQUAL(leg.fromStation, journey.legs[ldx - 1].toStation);
+        BOOST_CHECK(visited.insert(leg.toStation).second);
+        cost += leg.penalty + leg.travelTime;
+      }
+      BOOST_CHECK_EQUAL(journey.cost, cost);
+    }
+  }
+  BOOST_CHECK(nFound > 20);
+  BOOST_CHECK(nAlternatives > 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END(); // GetAlternativeJourneys
+
+BOOST_AUTO_TEST_SUITE(MemoryUsage);
+
+BOOST_AUTO_TEST_CASE(empty)
+{
+  TransportNetwork nw {};
+  const auto usage { nw.MemoryUsage() };
+  BOOST_CHECK_EQUAL(usage.GetTotal(), 0);
+  BOOST_CHECK_EQUAL(usage.nAllocations, 0);
+}
+
+BOOST_AUTO_TEST_CASE(counts)
+{
+  auto src = ParseJsonFile(TESTS_NETWORK_LAYOUT_JSON);
+  std::size_t nRoutes {0};
+  std::size_t nEdges {0};
+  for (const auto& line: src.at("lines"))
+  {
+    for (const auto& route: line.at("routes"))
+    {
+      ++nRoutes;
+      nEdges += route.at("route_stops").size() - 1;
+    }
+  }
+  const auto nStations { src.at("stations").size() };
+  const auto nLines { src.at("lines").size() };
+  TransportNetwork nw {};
+  BOOST_REQUIRE(nw.FromJson(std::move(src)));
+
+  const auto usage { nw.MemoryUsage() };
+  BOOST_CHECK_EQUAL(usage.nStations, nStations);
+  BOOST_CHECK_EQUAL(usage.nLines, nLines);
+  BOOST_CHECK_EQUAL(usage.nRoutes, nRoutes);
+  BOOST_CHECK_EQUAL(usage.nEdges, nEdges);
+  BOOST_CHECK(usage.stations > 0);
+  BOOST_CHECK(usage.edges > 0);
+  BOOST_CHECK(usage.routes > 0);
+  BOOST_CHECK(usage.lines > 0);
+  BOOST_CHECK(usage.maps > 0);
+  BOOST_CHECK(usage.rankings >= nStations * 16);
+  BOOST_CHECK(usage.allocator > 0);
+  BOOST_CHECK_EQUAL(usage.flows,
+                    nStations * PassengerFlowOptions {}.nBuckets * 16);
+  BOOST_CHECK_EQUAL(usage.GetTotal(),
+    usage.stations + usage.edges + usage.routes + usage.lines + usage.ids +
+    usage.maps + usage.rankings + usage.flows + usage.allocator
+  );
+
+  // Each station, edge, route and line is at least one allocation
+  BOOST_CHECK(usage.nAllocations >= nStations + nEdges + nRoutes + nLines);
+}
+
+BOOST_AUTO_TEST_CASE(long_strings)
+{
+  // Short IDs and names live inside the strings
+  TransportNetwork nw {};
+  BOOST_REQUIRE(nw.AddStation({"s", "S"}));
+  const auto before { nw.MemoryUsage() };
+  BOOST_CHECK_EQUAL(before.ids, 0);
+
+  // Long ones take a heap buffer each, plus one for the map key
+  const std::string id(100, 'i');
+  const std::string name(200, 'n');
+  BOOST_REQUIRE(nw.AddStation({id, name}));
+  const auto after { nw.MemoryUsage() };
+  BOOST_CHECK_EQUAL(after.nStations, 2);
+  BOOST_CHECK(after.ids >= 2 * (id.size() + 1));
+  BOOST_CHECK(after.stations - 2 * before.stations >= name.size() + 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END(); // MemoryUsage
+
 BOOST_AUTO_TEST_SUITE_END(); // class_TransportNetwork
 
-BOOST_AUTO_TEST_SUITE_END(); // websocket_client
+BOOST_AUTO_TEST_SUITE_END(); // network_monitor
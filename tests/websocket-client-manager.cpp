@@ -0,0 +1,97 @@
+#include <network-monitor/websocket-client-manager.h>
+
+#include <boost/asio.hpp>
+#include <boost/beast/ssl.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <chrono>
+#include <future>
+#include <set>
+#include <string>
+#include <thread>
+
+using NetworkMonitor::WebSocketClientManager;
+
+BOOST_AUTO_TEST_SUITE(network_monitor);
+
+BOOST_AUTO_TEST_SUITE(class_WebSocketClientManager);
+
+BOOST_AUTO_TEST_CASE(spread_clients)
+{
+  boost::asio::ssl::context ctx { boost::asio::ssl::context::tlsv12_client };
+  WebSocketClientManager manager { ctx, 4 };
+  BOOST_REQUIRE_EQUAL(manager.GetThreadCount(), 4);
+
+  // 8 clients on 4 threads: We expect 2 clients per thread
+  for (size_t idx {0}; idx < 8; ++idx)
+  {
+    auto client { manager.AddClient("localhost", "/", "443") };
+    BOOST_REQUIRE(client != nullptr);
+  }
+
+  const auto stats { manager.GetStats() };
+  BOOST_REQUIRE_EQUAL(stats.size(), 8);
+  std::vector<size_t> clientsPerThread(4, 0);
+  for (size_t idx {0}; idx < stats.size(); ++idx)
+  {
+    BOOST_CHECK_EQUAL(stats[idx].clientIdx, idx);
+    BOOST_REQUIRE(stats[idx].threadIdx < 4);
+    ++clientsPerThread[stats[idx].threadIdx];
+
+    // Nothing was connected
+    BOOST_CHECK_EQUAL(stats[idx].traffic.messagesReceived, 0);
+    BOOST_CHECK_EQUAL(stats[idx].messagesPerSecond, 0.0);
+  }
+  for (const auto nClients: clientsPerThread)
+  {
+    BOOST_CHECK_EQUAL(nClients, 2);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(run_stop)
+{
+  boost::asio::ssl::context ctx { boost::asio::ssl::context::tlsv12_client };
+  WebSocketClientManager manager { ctx, 2 };
+
+  // Run and Stop can be called more than once
+  manager.Run();
+  manager.Run();
+  manager.Stop();
+  manager.Stop();
+
+  // Nothing runs after Stop
+  manager.Run();
+  auto client { manager.AddClient("localhost", "/", "443") };
+  BOOST_CHECK(client != nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(callbacks_on_pool_threads)
+{
+  boost::asio::ssl::context ctx { boost::asio::ssl::context::tlsv12_client };
+  WebSocketClientManager manager { ctx, 2 };
+  manager.Run();
+
+  // Nobody listens on port 1 of the local host, so the connection fails
+  //  quickly without the need for an external network.
+  auto client { manager.AddClient("127.0.0.1", "/", "1") };
+
+  std::promise<std::thread::id> onConnectThread {};
+  bool failed {false};
+  client->Connect([&onConnectThread, &failed](auto ec) {
+    failed = static_cast<bool>(ec);
+    onConnectThread.set_value(std::this_thread::get_id());
+  });
+
+  auto future { onConnectThread.get_future() };
+  BOOST_REQUIRE(
+    future.wait_for(std::chrono::seconds(10)) == std::future_status::ready
+  );
+  BOOST_CHECK(future.get() != std::this_thread::get_id());
+  BOOST_CHECK(failed);
+
+  manager.Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END(); // class_WebSocketClientManager
+
+BOOST_AUTO_TEST_SUITE_END(); // network_monitor
@@ -1,3 +1,7 @@
+#include <network-monitor/feed-capture.h>
+#include <network-monitor/mock-server.h>
+#include <network-monitor/stomp-frame.h>
+#include <network-monitor/tls-session-cache.h>
 #include <network-monitor/websocket-client.h>
 
 #include <openssl/ssl.h>
@@ -5,10 +9,27 @@
 #include <boost/test/unit_test.hpp>
 #include <boost/beast/ssl.hpp>
 
+#include <chrono>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <optional>
 #include <string>
+#include <thread>
 #include <filesystem>
-
+#include <vector>
+
+using NetworkMonitor::FeedCapture;
+using NetworkMonitor::FeedCaptureReader;
+using NetworkMonitor::FeedMessage;
+using NetworkMonitor::MockServer;
+using NetworkMonitor::MockServerOptions;
+using NetworkMonitor::ReconnectInfo;
+using NetworkMonitor::ReconnectPolicy;
+using NetworkMonitor::SerializeStompFrame;
+using NetworkMonitor::StompCommand;
+using NetworkMonitor::StompFrame;
+using NetworkMonitor::TlsSessionCache;
 using NetworkMonitor::WebSocketClient;
 
 BOOST_AUTO_TEST_SUITE(network_monitor);
@@ -171,4 +192,382 @@ BOOST_AUTO_TEST_CASE(send_stomp_frame)
 	BOOST_CHECK(CheckResponse(response));
 }
 
+// The following tests use a local mock server, so they do not need access to
+//	the internet.
+
+static MockServerOptions GetLocalServerOptions()
+{
+	MockServerOptions options {};
+	options.certFile = TESTS_LOCALHOST_PEM;
+	options.keyFile = TESTS_LOCALHOST_KEY_PEM;
+	return options;
+}
+
+static const std::string kStompConnect { SerializeStompFrame(StompFrame {
+	StompCommand::Connect,
+	{{"accept-version", "1.2"}, {"host", "localhost"}},
+	{}
+})};
+
+static const std::string kStompSubscribe { SerializeStompFrame(StompFrame {
+	StompCommand::Subscribe,
+	{{"id", "0"}, {"destination", "/passengers"}},
+	{}
+})};
+
+BOOST_AUTO_TEST_CASE(local_reconnect)
+{
+	auto options { GetLocalServerOptions() };
+	options.messagesPerSecond = 1000.0;
+	MockServer server { options };
+	BOOST_REQUIRE(server.Start());
+
+	boost::asio::ssl::context ctx { boost::asio::ssl::context::tls_client };
+	ctx.load_verify_file(TESTS_LOCALHOST_PEM);
+	boost::asio::io_context ioc {};
+	WebSocketClient client {
+		"localhost", options.endpoint, std::to_string(server.GetPort()), ioc, ctx
+	};
+
+	// Reconnect quickly, and restore the STOMP subscription
+	ReconnectPolicy policy {};
+	policy.initialDelay = std::chrono::milliseconds(10);
+	policy.maxAttempts = 5;
+	bool reconnected {false};
+	ReconnectInfo reconnectInfo {};
+	client.EnableReconnect(policy,
+		[&reconnected, &reconnectInfo](auto ec, const auto& info) {
+			reconnected = !ec;
+			reconnectInfo = info;
+		}
+	);
+	client.SetReplayMessages({kStompConnect, kStompSubscribe});
+
+	bool subscribed {false};
+	size_t nEvents {0};
+	size_t nEventsAfterReconnect {0};
+	client.Connect(
+		[&client](auto ec) {
+			BOOST_REQUIRE(!ec);
+			client.Send(kStompConnect);
+		},
+		[&](auto ec, auto&& message) {
+			// We subscribe once the server confirmed the connection.
+			//	After the reconnection, the client replays the subscription itself.
+			if (message.rfind("CONNECTED", 0) == 0 && !subscribed)
+			{
+				subscribed = true;
+				client.Send(kStompSubscribe);
+			}
+			if (message.rfind("MESSAGE", 0) != 0)
+				return;
+
+			// Simulate an upstream flap after a few events
+			if (++nEvents == 5)
+				server.DropConnections();
+
+			if (reconnected && ++nEventsAfterReconnect == 5)
+				client.Close();
+		}
+	);
+	ioc.run();
+
+	BOOST_CHECK(reconnected);
+	BOOST_CHECK_EQUAL(nEventsAfterReconnect, 5);
+	BOOST_CHECK(reconnectInfo.attempts >= 1);
+	BOOST_CHECK(reconnectInfo.gap.count() > 0);
+
+	const auto stats { client.GetStats() };
+	BOOST_CHECK_EQUAL(stats.reconnects, 1);
+	BOOST_CHECK(stats.totalGapDuration == reconnectInfo.gap);
+	BOOST_CHECK_EQUAL(server.GetStats().connections, 2);
+	BOOST_CHECK_EQUAL(server.GetStats().subscriptions, 2);
+}
+
+BOOST_AUTO_TEST_CASE(local_reconnect_send_during_replay)
+{
+	auto options { GetLocalServerOptions() };
+	options.messagesPerSecond = 1000.0;
+	MockServer server { options };
+	BOOST_REQUIRE(server.Start());
+
+	boost::asio::ssl::context ctx { boost::asio::ssl::context::tls_client };
+	ctx.load_verify_file(TESTS_LOCALHOST_PEM);
+	boost::asio::io_context ioc {};
+	WebSocketClient client {
+		"localhost", options.endpoint, std::to_string(server.GetPort()), ioc, ctx
+	};
+
+	// The large subscription is still being written when the server confirms
+	//	the replayed connection.
+	const std::string largeSubscribe { SerializeStompFrame(StompFrame {
+		StompCommand::Subscribe,
+		{
+			{"id", "0"},
+			{"destination", "/passengers"},
+			{"padding", std::string(4'000'000, 'x')},
+		},
+		{}
+	})};
+	ReconnectPolicy policy {};
+	policy.initialDelay = std::chrono::milliseconds(10);
+	policy.maxAttempts = 5;
+	bool reconnected {false};
+	client.EnableReconnect(policy, [&reconnected](auto ec, const auto&) {
+		reconnected = !ec;
+	});
+	client.SetReplayMessages({kStompConnect, largeSubscribe});
+
+	// This handler sends a message on every CONNECTED frame, also during the
+	//	replay. The client must queue it behind the replay.
+	bool sentDuringReplay {false};
+	size_t nSent {0};
+	size_t nEvents {0};
+	size_t nEventsAfterReconnect {0};
+	client.Connect(
+		[&client](auto ec) {
+			BOOST_REQUIRE(!ec);
+			client.Send(kStompConnect);
+		},
+		[&](auto ec, auto&& message) {
+			if (message.rfind("CONNECTED", 0) == 0)
+			{
+				sentDuringReplay = nEvents > 0 && !reconnected;
+				client.Send(kStompSubscribe, [&nSent](auto ec) {
+					BOOST_CHECK(!ec);
+					++nSent;
+				});
+			}
+			if (message.rfind("MESSAGE", 0) != 0)
+				return;
+
+			if (++nEvents == 5)
+				server.DropConnections();
+
+			if (reconnected && ++nEventsAfterReconnect == 5)
+				client.Close();
+		}
+	);
+	ioc.run();
+
+	BOOST_CHECK(reconnected);
+	BOOST_CHECK(sentDuringReplay);
+	BOOST_CHECK_EQUAL(nSent, 2);
+	BOOST_CHECK_EQUAL(nEventsAfterReconnect, 5);
+
+	// Interleaved writes would have corrupted the frames, and the server would
+	//	have dropped the connection instead of counting the subscriptions.
+	BOOST_CHECK_EQUAL(server.GetStats().connections, 2);
+	BOOST_CHECK_EQUAL(server.GetStats().subscriptions, 3);
+}
+
+BOOST_AUTO_TEST_CASE(local_reconnect_close_from_other_thread)
+{
+	auto options { GetLocalServerOptions() };
+	std::optional<MockServer> server {};
+	server.emplace(options);
+	BOOST_REQUIRE(server->Start());
+
+	boost::asio::ssl::context ctx { boost::asio::ssl::context::tls_client };
+	ctx.load_verify_file(TESTS_LOCALHOST_PEM);
+	boost::asio::io_context ioc {};
+	WebSocketClient client {
+		"localhost", options.endpoint, std::to_string(server->GetPort()), ioc, ctx
+	};
+
+	ReconnectPolicy policy {};
+	policy.initialDelay = std::chrono::milliseconds(1);
+	policy.maxDelay = std::chrono::milliseconds(1);
+	client.EnableReconnect(policy);
+	std::promise<void> connected {};
+	client.Connect([&connected](auto ec) {
+		BOOST_REQUIRE(!ec);
+		connected.set_value();
+	});
+	std::thread runner { [&ioc]() { ioc.run(); } };
+
+	// Destroying the server closes its connections, and nothing listens on
+	//	the port any more: The client keeps reconnecting.
+	connected.get_future().wait();
+	server.reset();
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+	// Close from this thread while the strand replaces the stream
+	std::promise<boost::system::error_code> closed {};
+	client.Close([&closed](auto ec) {
+		closed.set_value(ec);
+	});
+	auto result { closed.get_future() };
+	BOOST_CHECK(result.wait_for(std::chrono::seconds(5)) ==
+							std::future_status::ready);
+	runner.join();
+}
+
+BOOST_AUTO_TEST_CASE(local_tls_session_resumption)
+{
+	auto options { GetLocalServerOptions() };
+	MockServer server { options };
+	BOOST_REQUIRE(server.Start());
+
+	// TLS 1.2 resumes with a session ID, TLS 1.3 with a session ticket
+	for (auto method: {
+		boost::asio::ssl::context::tlsv12_client,
+		boost::asio::ssl::context::tlsv13_client
+	})
+	{
+		boost::asio::ssl::context ctx { method };
+		ctx.load_verify_file(TESTS_LOCALHOST_PEM);
+		auto cache { std::make_shared<TlsSessionCache>() };
+
+		std::vector<bool> resumed {};
+		for (size_t idx {0}; idx < 2; ++idx)
+		{
+			boost::asio::io_context ioc {};
+			WebSocketClient client {
+				"localhost", options.endpoint, std::to_string(server.GetPort()),
+				ioc, ctx, cache
+			};
+
+			// We wait for the CONNECTED frame, so that the TLS 1.3 tickets have
+			//	been read.
+			client.Connect(
+				[&client](auto ec) {
+					BOOST_REQUIRE(!ec);
+					client.Send(kStompConnect);
+				},
+				[&client](auto ec, auto&& message) {
+					client.Close();
+				}
+			);
+			ioc.run();
+			resumed.push_back(client.GetStats().tlsSessionResumed);
+		}
+
+		BOOST_CHECK(!resumed[0]);
+		BOOST_CHECK(resumed[1]);
+		BOOST_CHECK_EQUAL(cache->Size(), 1);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(local_feed_capture)
+{
+	auto options { GetLocalServerOptions() };
+	options.messagesPerSecond = 1000.0;
+	MockServer server { options };
+	BOOST_REQUIRE(server.Start());
+
+	const auto path {
+		std::filesystem::temp_directory_path() / "network-monitor-feed-client.cap"
+	};
+	auto capture { std::make_shared<FeedCapture>() };
+	BOOST_REQUIRE(capture->Open(path));
+
+	boost::asio::ssl::context ctx { boost::asio::ssl::context::tls_client };
+	ctx.load_verify_file(TESTS_LOCALHOST_PEM);
+	boost::asio::io_context ioc {};
+	WebSocketClient client {
+		"localhost", options.endpoint, std::to_string(server.GetPort()), ioc, ctx
+	};
+	client.SetFeedCapture(capture);
+
+	std::vector<std::string> received {};
+	client.Connect(
+		[&client](auto ec) {
+			BOOST_REQUIRE(!ec);
+			client.Send(kStompConnect);
+		},
+		[&](auto ec, auto&& message) {
+			if (received.empty())
+				client.Send(kStompSubscribe);
+			received.push_back(message);
+			if (received.size() == 10)
+				client.Close();
+		}
+	);
+	ioc.run();
+	capture->Close();
+
+	// The capture holds the messages the client received, in order
+	FeedCaptureReader reader {};
+	BOOST_REQUIRE(reader.Open(path));
+	std::vector<std::string> captured {};
+	FeedMessage message {};
+	while (reader.Next(message))
+		captured.push_back(message.payload);
+	BOOST_CHECK(!reader.IsTruncated());
+	BOOST_CHECK(captured == received);
+	std::filesystem::remove(path);
+}
+
+#if defined(BOOST_ASIO_HAS_CO_AWAIT)
+BOOST_AUTO_TEST_CASE(local_awaitable)
+{
+	auto options { GetLocalServerOptions() };
+	MockServer server { options };
+	BOOST_REQUIRE(server.Start());
+
+	boost::asio::ssl::context ctx { boost::asio::ssl::context::tls_client };
+	ctx.load_verify_file(TESTS_LOCALHOST_PEM);
+	boost::asio::io_context ioc {};
+	WebSocketClient client {
+		"localhost", options.endpoint, std::to_string(server.GetPort()), ioc, ctx
+	};
+
+	using boost::asio::use_awaitable;
+	size_t nEvents {0};
+	bool done {false};
+	boost::asio::co_spawn(client.GetExecutor(),
+		[&]() -> boost::asio::awaitable<void> {
+			co_await client.Connect(use_awaitable);
+			co_await client.Send(kStompConnect, use_awaitable);
+			std::string message {};
+			co_await client.Read(message, use_awaitable);
+			BOOST_CHECK_EQUAL(message.rfind("CONNECTED", 0), 0);
+			co_await client.Send(kStompSubscribe, use_awaitable);
+			while (nEvents < 5)
+			{
+				co_await client.Read(message, use_awaitable);
+				if (message.rfind("MESSAGE", 0) == 0)
+					++nEvents;
+			}
+			co_await client.Close(use_awaitable);
+			done = true;
+		},
+		[](std::exception_ptr e) {
+			BOOST_CHECK(e == nullptr);
+		}
+	);
+	ioc.run();
+
+	BOOST_CHECK(done);
+	BOOST_CHECK_EQUAL(nEvents, 5);
+	BOOST_CHECK_EQUAL(client.GetStats().messagesSent, 2);
+}
+
+BOOST_AUTO_TEST_CASE(local_awaitable_connection_error)
+{
+	boost::asio::ssl::context ctx { boost::asio::ssl::context::tls_client };
+	boost::asio::io_context ioc {};
+	WebSocketClient client { "127.0.0.1", "/", "1", ioc, ctx };
+
+	bool threw {false};
+	boost::asio::co_spawn(client.GetExecutor(),
+		[&]() -> boost::asio::awaitable<void> {
+			try
+			{
+				co_await client.Connect(boost::asio::use_awaitable);
+			}
+			catch (const boost::system::system_error& e)
+			{
+				threw = true;
+			}
+		},
+		boost::asio::detached
+	);
+	ioc.run();
+
+	BOOST_CHECK(threw);
+}
+#endif // BOOST_ASIO_HAS_CO_AWAIT
+
 BOOST_AUTO_TEST_SUITE_END();
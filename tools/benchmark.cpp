@@ -0,0 +1,1342 @@
+// Benchmarks for the network-monitor library
+//
+// Runs a fixed set of micro and macro benchmarks and prints one row per
+//  benchmark. Each benchmark is calibrated to run for at least --min-time
+//  seconds, then repeated; we report the median, min and max time per
+//  operation across the repetitions. All the random inputs come from a
+//  seeded generator and the feed and the files are served by an in-process
+//  MockServer, so two runs on the same machine measure the same work.
+//
+// Usage: network-monitor-bench [options]
+//   --filter <text>           Only run the benchmarks whose name contains
+//                             this text
+//   --repetitions <n>         Measurements per benchmark (default: 5)
+//   --min-time <seconds>      Minimum time of each measurement
+//                             (default: 0.2)
+//   --scale <n>               Size of the large generated layout, in
+//                             multiples of the test layout (default: 100)
+//   --seed <n>                Seed of the random inputs (default: 1)
+//   --output <file>           Also write the results as JSON
+//   --baseline <file>         JSON results of an earlier run: print the
+//                             speedup of each benchmark against it
+//   --trace <file>            Write the trace spans of the last iterations
+//                             as Chrome trace_event JSON. The library must
+//                             be built with NETWORK_MONITOR_TRACING.
+//
+// The JSON output lists, for each benchmark, the number of operations per
+//  measurement and the median/min/max nanoseconds per operation, plus bytes
+//  per second where the benchmark processes a payload.
+//
+// The MemoryUsage/<layout> rows are not timed: They load the test layout and
+//  the generated layouts (x10 and x<scale>) and print the footprint of the
+//  TransportNetwork, by category, with the bytes per station and per edge.
+
+#include <network-monitor/file-downloader.h>
+#include <network-monitor/metrics.h>
+#include <network-monitor/mock-server.h>
+#include <network-monitor/network-generator.h>
+#include <network-monitor/passenger-event-log.h>
+#include <network-monitor/stomp-frame.h>
+#include <network-monitor/trace.h>
+#include <network-monitor/transport-network.h>
+#include <network-monitor/websocket-client.h>
+
+#include <boost/asio.hpp>
+#include <boost/beast/ssl.hpp>
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using NetworkMonitor::AlternativeJourneyOptions;
+using NetworkMonitor::Downloader;
+using NetworkMonitor::DownloadFile;
+using NetworkMonitor::GenerateNetworkLayout;
+using NetworkMonitor::Id;
+using NetworkMonitor::JourneyOptions;
+using NetworkMonitor::LatencyHistogram;
+using NetworkMonitor::Line;
+using NetworkMonitor::MockServer;
+using NetworkMonitor::MockServerOptions;
+using NetworkMonitor::NetworkGeneratorOptions;
+using NetworkMonitor::ParseJsonFile;
+using NetworkMonitor::ParseStompFrame;
+using NetworkMonitor::PassengerEvent;
+using NetworkMonitor::PassengerEventLog;
+using NetworkMonitor::PassengerEventLogOptions;
+using NetworkMonitor::ReplayPassengerEventLog;
+using NetworkMonitor::Route;
+using NetworkMonitor::SerializeStompFrame;
+using NetworkMonitor::Station;
+using NetworkMonitor::StompCommand;
+using NetworkMonitor::StompFrame;
+using NetworkMonitor::TransportNetwork;
+using NetworkMonitor::TransportNetworkMemoryUsage;
+using NetworkMonitor::WebSocketClient;
+using NetworkMonitor::WritePassengerCheckpoint;
+
+struct Options
+{
+  std::string filter {};
+  std::size_t repetitions {5};
+  double minTime {0.2};
+  std::size_t scale {100};
+  std::uint32_t seed {1};
+  std::string output {};
+  std::string baseline {};
+  std::string trace {};
+};
+
+struct BenchmarkResult
+{
+  std::string name {};
+  std::uint64_t iterations {0};
+  double medianNs {0.0};
+  double minNs {0.0};
+  double maxNs {0.0};
+
+  // Payload processed by one operation, if any
+  double bytesPerOp {0.0};
+};
+
+struct MemoryResult
+{
+  std::string name {};
+  TransportNetworkMemoryUsage usage {};
+};
+
+// Runs nIterations operations and returns the time they took. Each
+//  benchmark times itself, so that it can leave its setup out.
+using Benchmark = std::function<std::chrono::nanoseconds (std::uint64_t)>;
+
+// Keep the compiler from optimizing away a result we do not use
+template <typename T>
+static void KeepAlive(const T& value)
+{
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+static std::optional<std::size_t> ParseSize(std::string_view value)
+{
+  std::size_t parsed {0};
+  const auto [end, ec] = std::from_chars(
+    value.data(), value.data() + value.size(), parsed
+  );
+  if (ec != std::errc {} || end != value.data() + value.size())
+    return std::nullopt;
+  return parsed;
+}
+
+static bool ParseOptions(int argc, char* argv[], Options& options)
+{
+  for (int idx {1}; idx < argc; ++idx)
+  {
+    const std::string_view name { argv[idx] };
+    if (idx + 1 >= argc)
+    {
+      std::cerr << "Missing value for " << name << '\n';
+      return false;
+    }
+    const std::string value { argv[++idx] };
+
+    if (name == "--filter")
+    {
+      options.filter = value;
+    }
+    else if (name == "--repetitions")
+    {
+      const auto parsed { ParseSize(value) };
+      if (!parsed || *parsed == 0)
+      {
+        std::cerr << "Invalid --repetitions: " << value << '\n';
+        return false;
+      }
+      options.repetitions = *parsed;
+    }
+    else if (name == "--min-time")
+    {
+      try
+      {
+        options.minTime = std::stod(value);
+      }
+      catch (const std::exception&)
+      {
+        std::cerr << "Invalid --min-time: " << value << '\n';
+        return false;
+      }
+    }
+    else if (name == "--scale")
+    {
+      const auto parsed { ParseSize(value) };
+      if (!parsed || *parsed == 0)
+      {
+        std::cerr << "Invalid --scale: " << value << '\n';
+        return false;
+      }
+      options.scale = *parsed;
+    }
+    else if (name == "--seed")
+    {
+      const auto parsed { ParseSize(value) };
+      if (!parsed)
+      {
+        std::cerr << "Invalid --seed: " << value << '\n';
+        return false;
+      }
+      options.seed = static_cast<std::uint32_t>(*parsed);
+    }
+    else if (name == "--output")
+    {
+      options.output = value;
+    }
+    else if (name == "--baseline")
+    {
+      options.baseline = value;
+    }
+    else if (name == "--trace")
+    {
+      options.trace = value;
+    }
+    else
+    {
+      std::cerr << "Unknown option " << name << '\n';
+      return false;
+    }
+  }
+  return true;
+}
+
+static std::chrono::nanoseconds Since(
+  std::chrono::steady_clock::time_point startedAt
+)
+{
+  return std::chrono::steady_clock::now() - startedAt;
+}
+
+// Calibrate the number of iterations, unless it is fixed, then measure
+static BenchmarkResult Measure(
+  const Options& options,
+  const std::string& name,
+  const Benchmark& benchmark,
+  double bytesPerOp = 0.0,
+  std::uint64_t fixedIterations = 0
+)
+{
+  const std::chrono::duration<double> minTime { options.minTime };
+  std::uint64_t nIterations { fixedIterations > 0 ? fixedIterations : 1 };
+  while (fixedIterations == 0)
+  {
+    const std::chrono::duration<double> elapsed { benchmark(nIterations) };
+    if (elapsed >= minTime || nIterations >= (1ull << 32))
+      break;
+
+    // Aim a bit past the minimum time, but grow at most 10x at a time in
+    //  case the first runs were dominated by warm-up
+    const double ratio { elapsed.count() > 0.0 ?
+      minTime / elapsed * 1.2 : 10.0
+    };
+    nIterations = static_cast<std::uint64_t>(
+      static_cast<double>(nIterations) * std::clamp(ratio, 2.0, 10.0)
+    );
+  }
+
+  std::vector<double> nsPerOp {};
+  for (std::size_t idx {0}; idx < options.repetitions; ++idx)
+  {
+    const auto elapsed { benchmark(nIterations) };
+    nsPerOp.push_back(static_cast<double>(elapsed.count()) /
+                      static_cast<double>(nIterations));
+  }
+  std::sort(nsPerOp.begin(), nsPerOp.end());
+
+  BenchmarkResult result {};
+  result.name = name;
+  result.iterations = nIterations;
+  result.medianNs = nsPerOp[nsPerOp.size() / 2];
+  result.minNs = nsPerOp.front();
+  result.maxNs = nsPerOp.back();
+  result.bytesPerOp = bytesPerOp;
+  return result;
+}
+
+// A generated layout the size of `scale` test layouts, with lines and
+//  routes of a similar shape
+static nlohmann::json ScaleLayout(
+  const nlohmann::json& layout,
+  std::size_t scale,
+  std::uint32_t seed
+)
+{
+  const auto& lines { layout.at("lines") };
+  std::size_t nRoutes {0};
+  std::size_t nStops {0};
+  for (const auto& line: lines)
+  {
+    nRoutes += line.at("routes").size();
+    nStops += line.at("stations").size();
+  }
+
+  NetworkGeneratorOptions generator {};
+  generator.nStations = layout.at("stations").size() * scale;
+  generator.nLines = lines.size() * scale;
+  const auto stopsPerLine { nStops / lines.size() };
+  generator.routesPerLine = std::max<std::size_t>(2, nRoutes / lines.size());
+  generator.minRouteLength = std::max<std::size_t>(2, stopsPerLine / 2);
+  generator.maxRouteLength = std::max<std::size_t>(2, stopsPerLine * 3 / 2);
+  generator.seed = seed;
+  return GenerateNetworkLayout(generator);
+}
+
+static std::vector<Line> GetLines(
+  const nlohmann::json& layout
+)
+{
+  std::vector<Line> lines {};
+  for (const auto& line: layout.at("lines"))
+  {
+    Line parsed {
+      line.at("line_id").get<Id>(), line.at("name").get<std::string>(), {}
+    };
+    for (const auto& route: line.at("routes"))
+    {
+      parsed.routes.push_back(Route {
+        route.at("route_id").get<Id>(),
+        route.at("direction").get<std::string>(),
+        route.at("line_id").get<Id>(),
+        route.at("start_station_id").get<Id>(),
+        route.at("end_station_id").get<Id>(),
+        route.at("route_stops").get<std::vector<Id>>(),
+      });
+    }
+    lines.push_back(std::move(parsed));
+  }
+  return lines;
+}
+
+static void RunParseBenchmarks(
+  const Options& options,
+  const std::string& label,
+  const std::filesystem::path& path,
+  std::vector<BenchmarkResult>& results
+)
+{
+  const auto size { static_cast<double>(std::filesystem::file_size(path)) };
+  results.push_back(Measure(options, "ParseJsonFile/mmap/" + label,
+    [&path](std::uint64_t nIterations) {
+      const auto startedAt { std::chrono::steady_clock::now() };
+      for (std::uint64_t idx {0}; idx < nIterations; ++idx)
+        KeepAlive(ParseJsonFile(path));
+      return Since(startedAt);
+    },
+    size
+  ));
+
+  // What ParseJsonFile used to do
+  results.push_back(Measure(options, "ParseJsonFile/ifstream/" + label,
+    [&path](std::uint64_t nIterations) {
+      const auto startedAt { std::chrono::steady_clock::now() };
+      for (std::uint64_t idx {0}; idx < nIterations; ++idx)
+      {
+        nlohmann::json parsed {};
+        std::ifstream file { path };
+        file >> parsed;
+        KeepAlive(parsed);
+      }
+      return Since(startedAt);
+    },
+    size
+  ));
+}
+
+static void RunFromJsonBenchmarks(
+  const Options& options,
+  const std::string& label,
+  const nlohmann::json& layout,
+  std::vector<BenchmarkResult>& results
+)
+{
+  const auto text { layout.dump() };
+  const auto size { static_cast<double>(text.size()) };
+
+  // The copy of the JSON object is not part of the measurement
+  results.push_back(Measure(options, "FromJson/object/" + label,
+    [&layout](std::uint64_t nIterations) {
+      std::chrono::nanoseconds elapsed {0};
+      for (std::uint64_t idx {0}; idx < nIterations; ++idx)
+      {
+        auto copy = layout;
+        TransportNetwork network {};
+        const auto startedAt { std::chrono::steady_clock::now() };
+        KeepAlive(network.FromJson(std::move(copy)));
+        elapsed += Since(startedAt);
+      }
+      return elapsed;
+    },
+    size
+  ));
+
+  // Includes parsing the text
+  results.push_back(Measure(options, "FromJson/stream/" + label,
+    [&text](std::uint64_t nIterations) {
+      std::chrono::nanoseconds elapsed {0};
+      for (std::uint64_t idx {0}; idx < nIterations; ++idx)
+      {
+        std::istringstream src { text };
+        TransportNetwork network {};
+        const auto startedAt { std::chrono::steady_clock::now() };
+        KeepAlive(network.FromJson(src));
+        elapsed += Since(startedAt);
+      }
+      return elapsed;
+    },
+    size
+  ));
+}
+
+static void RunNetworkBenchmarks(
+  const Options& options,
+  const nlohmann::json& layout,
+  std::vector<BenchmarkResult>& results
+)
+{
+  std::vector<Station> stations {};
+  for (const auto& station: layout.at("stations"))
+  {
+    stations.push_back(Station {
+      station.at("station_id").get<Id>(), station.at("name").get<std::string>()
+    });
+  }
+  const auto lines { GetLines(layout) };
+
+  // Time per line, on a network that already has all its stations
+  results.push_back(Measure(options, "AddLine",
+    [&stations, &lines](std::uint64_t nIterations) {
+      std::chrono::nanoseconds elapsed {0};
+      std::uint64_t nAdded {0};
+      while (nAdded < nIterations)
+      {
+        TransportNetwork network {};
+        for (const auto& station: stations)
+          network.AddStation(station);
+        const auto startedAt { std::chrono::steady_clock::now() };
+        for (std::size_t idx {0};
+             idx < lines.size() && nAdded < nIterations;
+             ++idx, ++nAdded)
+        {
+          KeepAlive(network.AddLine(lines[idx]));
+        }
+        elapsed += Since(startedAt);
+      }
+      return elapsed;
+    }
+  ));
+
+  TransportNetwork network {};
+  network.FromJson(nlohmann::json(layout));
+
+  // The same pseudo-random queries on every run
+  constexpr std::size_t nQueries { 4096 };
+  std::mt19937 random { options.seed };
+  const auto& travelTimes { layout.at("travel_times") };
+  std::vector<std::pair<Id, Id>> adjacent {};
+  std::vector<std::pair<Id, Id>> stationPairs {};
+  std::vector<std::pair<Id, Id>> routes {};
+  std::vector<Id> queriedStations {};
+  std::vector<PassengerEvent> events {};
+  std::uniform_int_distribution<std::size_t> pickTravelTime {
+    0, travelTimes.size() - 1
+  };
+  std::uniform_int_distribution<std::size_t> pickStation {
+    0, stations.size() - 1
+  };
+  std::uniform_int_distribution<std::size_t> pickLine { 0, lines.size() - 1 };
+  for (std::size_t idx {0}; idx < nQueries; ++idx)
+  {
+    const auto& travelTime { travelTimes.at(pickTravelTime(random)) };
+    adjacent.emplace_back(
+      travelTime.at("start_station_id").get<Id>(),
+      travelTime.at("end_station_id").get<Id>()
+    );
+
+    const auto& line { lines[pickLine(random)] };
+    std::uniform_int_distribution<std::size_t> pickRoute {
+      0, line.routes.size() - 1
+    };
+    const auto& route { line.routes[pickRoute(random)] };
+    std::uniform_int_distribution<std::size_t> pickStop {
+      0, route.stops.size() - 1
+    };
+    auto first { pickStop(random) };
+    auto second { pickStop(random) };
+    if (first > second)
+      std::swap(first, second);
+    routes.emplace_back(line.id, route.id);
+    stationPairs.emplace_back(route.stops[first], route.stops[second]);
+
+    queriedStations.push_back(stations[pickStation(random)].id);
+    events.push_back(PassengerEvent {
+      stations[pickStation(random)].id,
+      random() % 2 == 0 ? PassengerEvent::Type::In : PassengerEvent::Type::Out
+    });
+  }
+
+  results.push_back(Measure(options, "GetTravelTime/adjacent",
+    [&network, &adjacent](std::uint64_t nIterations) {
+      const auto startedAt { std::chrono::steady_clock::now() };
+      for (std::uint64_t idx {0}; idx < nIterations; ++idx)
+      {
+        const auto& [stationA, stationB] = adjacent[idx % nQueries];
+        KeepAlive(network.GetTravelTime(stationA, stationB));
+      }
+      return Since(startedAt);
+    }
+  ));
+
+  results.push_back(Measure(options, "GetTravelTime/route",
+    [&network, &routes, &stationPairs](std::uint64_t nIterations) {
+      const auto startedAt { std::chrono::steady_clock::now() };
+      for (std::uint64_t idx {0}; idx < nIterations; ++idx)
+      {
+        const auto& [line, route] = routes[idx % nQueries];
+        const auto& [stationA, stationB] = stationPairs[idx % nQueries];
+        KeepAlive(network.GetTravelTime(line, route, stationA, stationB));
+      }
+      return Since(startedAt);
+    }
+  ));
+
+  results.push_back(Measure(options, "GetRoutesServingStation",
+    [&network, &queriedStations](std::uint64_t nIterations) {
+      const auto startedAt { std::chrono::steady_clock::now() };
+      for (std::uint64_t idx {0}; idx < nIterations; ++idx)
+      {
+        KeepAlive(network.GetRoutesServingStation(
+          queriedStations[idx % nQueries]
+        ));
+      }
+      return Since(startedAt);
+    }
+  ));
+
+  results.push_back(Measure(options, "RecordPassengerEvent",
+    [&network, &events](std::uint64_t nIterations) {
+      const auto startedAt { std::chrono::steady_clock::now() };
+      for (std::uint64_t idx {0}; idx < nIterations; ++idx)
+        KeepAlive(network.RecordPassengerEvent(events[idx % nQueries]));
+      return Since(startedAt);
+    }
+  ));
+
+  // Events from the feed carry their time: No clock read per event
+  auto timestampedEvents { events };
+  const std::chrono::system_clock::time_point feedStart {
+    std::chrono::hours {24 * 20000}
+  };
+  for (std::size_t idx {0}; idx < nQueries; ++idx)
+  {
+    timestampedEvents[idx].timestamp =
+      feedStart + idx * std::chrono::milliseconds {100};
+  }
+  results.push_back(Measure(options, "RecordPassengerEvent/timestamped",
+    [&network, &timestampedEvents](std::uint64_t nIterations) {
+      const auto startedAt { std::chrono::steady_clock::now() };
+      for (std::uint64_t idx {0}; idx < nIterations; ++idx)
+      {
+        KeepAlive(network.RecordPassengerEvent(
+          timestampedEvents[idx % nQueries]
+        ));
+      }
+      return Since(startedAt);
+    }
+  ));
+
+  // The feed handler can hand over the events of a message at once. The
+  //  time is per batch.
+  constexpr std::size_t batchSize {64};
+  std::vector<std::vector<PassengerEvent>> batches {};
+  for (std::size_t idx {0}; idx < nQueries; idx += batchSize)
+  {
+    batches.emplace_back(timestampedEvents.begin() + idx,
+                         timestampedEvents.begin() + idx + batchSize);
+  }
+  results.push_back(Measure(options, "RecordPassengerEvents/batch-64",
+    [&network, &batches](std::uint64_t nIterations) {
+      const auto startedAt { std::chrono::steady_clock::now() };
+      for (std::uint64_t idx {0}; idx < nIterations; ++idx)
+        KeepAlive(network.RecordPassengerEvents(batches[idx % batches.size()]));
+      return Since(startedAt);
+    }
+  ));
+
+  // The ranking is kept up to date, against sorting all the counts
+  results.push_back(Measure(options, "GetMostCrowdedStations/20",
+    [&network](std::uint64_t nIterations) {
+      const auto startedAt { std::chrono::steady_clock::now() };
+      for (std::uint64_t idx {0}; idx < nIterations; ++idx)
+        KeepAlive(network.GetMostCrowdedStations(20));
+      return Since(startedAt);
+    }
+  ));
+  results.push_back(Measure(options, "ForEachPassengerCount/sort-20",
+    [&network](std::uint64_t nIterations) {
+      const auto startedAt { std::chrono::steady_clock::now() };
+      for (std::uint64_t idx {0}; idx < nIterations; ++idx)
+      {
+        std::vector<std::pair<long long int, Id>> counts {};
+        network.ForEachPassengerCount(
+          [&counts](const auto& id, auto count) {
+            counts.emplace_back(count, id);
+          }
+        );
+        const auto k { std::min<std::size_t>(20, counts.size()) };
+        std::partial_sort(counts.begin(), counts.begin() + k, counts.end(),
+                          std::greater<> {});
+        counts.resize(k);
+        KeepAlive(counts);
+      }
+      return Since(startedAt);
+    }
+  ));
+}
+
+static void RunEventLogBenchmarks(
+  const Options& options,
+  const nlohmann::json& layout,
+  std::vector<BenchmarkResult>& results
+)
+{
+  TransportNetwork network {};
+  network.FromJson(nlohmann::json(layout));
+  std::vector<Id> stationIds {};
+  network.ForEachPassengerCount([&stationIds](const auto& id, auto) {
+    stationIds.push_back(id);
+  });
+  std::mt19937 random { options.seed };
+  std::uniform_int_distribution<std::size_t> pickStation {
+    0, stationIds.size() - 1
+  };
+  constexpr std::size_t nEvents {1'000'000};
+  const std::chrono::system_clock::time_point feedStart {
+    std::chrono::hours {24 * 20000}
+  };
+  std::vector<PassengerEvent> events {};
+  events.reserve(nEvents);
+  for (std::size_t idx {0}; idx < nEvents; ++idx)
+  {
+    events.push_back(PassengerEvent {
+      stationIds[pickStation(random)],
+      random() % 2 == 0 ? PassengerEvent::Type::In : PassengerEvent::Type::Out,
+      feedStart + idx * std::chrono::milliseconds {10}
+    });
+  }
+
+  // The ingestion thread only encodes the events: The writer thread writes
+  //  them. We leave out the syncs, which measure the disk.
+  const auto directory {
+    std::filesystem::temp_directory_path() / "network-monitor-bench-log"
+  };
+  std::filesystem::remove_all(directory);
+  PassengerEventLogOptions logOptions {};
+  logOptions.directory = directory;
+  logOptions.sync = false;
+  {
+    PassengerEventLog log { logOptions };
+    if (!log.Open())
+    {
+      std::cerr << "Could not open the event log: " << log.GetError() << '\n';
+      return;
+    }
+    results.push_back(Measure(options, "PassengerEventLog/Append",
+      [&log, &events](std::uint64_t nIterations) {
+        const auto startedAt { std::chrono::steady_clock::now() };
+        for (std::uint64_t idx {0}; idx < nIterations; ++idx)
+          KeepAlive(log.Append(events[idx % nEvents]));
+        return Since(startedAt);
+      }
+    ));
+  }
+
+  // Replay a log of 1M events, from a warm page cache
+  std::filesystem::remove_all(directory);
+  std::uintmax_t logSize {0};
+  {
+    PassengerEventLog log { logOptions };
+    if (!log.Open())
+      return;
+    for (std::size_t idx {0}; idx < nEvents; idx += 1000)
+    {
+      log.Append(std::vector<PassengerEvent>(events.begin() + idx,
+                                             events.begin() + idx + 1000));
+    }
+  }
+  for (const auto& entry: std::filesystem::directory_iterator(directory))
+    logSize += entry.file_size();
+  results.push_back(Measure(options, "ReplayPassengerEventLog/1M",
+    [&network, &directory](std::uint64_t nIterations) {
+      const auto startedAt { std::chrono::steady_clock::now() };
+      for (std::uint64_t idx {0}; idx < nIterations; ++idx)
+        KeepAlive(ReplayPassengerEventLog(directory, network).nRecorded);
+      return Since(startedAt);
+    },
+    static_cast<double>(logSize)
+  ));
+  std::filesystem::remove_all(directory);
+}
+
+// Snapshot and checkpoint of the passenger counts of every station
+static void RunCheckpointBenchmarks(
+  const Options& options,
+  const std::string& label,
+  const nlohmann::json& layout,
+  std::vector<BenchmarkResult>& results
+)
+{
+  TransportNetwork network {};
+  network.FromJson(nlohmann::json(layout));
+  std::vector<Id> stationIds {};
+  network.ForEachPassengerCount([&stationIds](const auto& id, auto) {
+    stationIds.push_back(id);
+  });
+  std::mt19937 random { options.seed };
+  for (std::size_t idx {0}; idx < 4 * stationIds.size(); ++idx)
+  {
+    network.RecordPassengerEvent({
+      stationIds[random() % stationIds.size()],
+      random() % 3 == 0 ? PassengerEvent::Type::Out : PassengerEvent::Type::In
+    });
+  }
+
+  results.push_back(Measure(options, "SnapshotPassengerCounts/" + label,
+    [&network](std::uint64_t nIterations) {
+      const auto startedAt { std::chrono::steady_clock::now() };
+      for (std::uint64_t idx {0}; idx < nIterations; ++idx)
+        KeepAlive(network.SnapshotPassengerCounts().counts.size());
+      return Since(startedAt);
+    }
+  ));
+
+  // The log only holds the events, so that the checkpoint can cover them.
+  //  We leave out the syncs, which measure the disk.
+  const auto directory {
+    std::filesystem::temp_directory_path() / "network-monitor-bench-ckpt"
+  };
+  std::filesystem::remove_all(directory);
+  PassengerEventLogOptions logOptions {};
+  logOptions.directory = directory;
+  logOptions.sync = false;
+  {
+    PassengerEventLog log { logOptions };
+    if (!log.Open())
+      return;
+    log.Append(std::vector<PassengerEvent>(
+      network.GetPassengerEventSequence(),
+      PassengerEvent { stationIds[0], PassengerEvent::Type::In }
+    ));
+    const auto nBytes {
+      WritePassengerCheckpoint(network, log, false).nBytes
+    };
+    results.push_back(Measure(options, "WritePassengerCheckpoint/" + label,
+      [&network, &log](std::uint64_t nIterations) {
+        const auto startedAt { std::chrono::steady_clock::now() };
+        for (std::uint64_t idx {0}; idx < nIterations; ++idx)
+          KeepAlive(WritePassengerCheckpoint(network, log, false).nBytes);
+        return Since(startedAt);
+      },
+      static_cast<double>(nBytes)
+    ));
+  }
+  std::filesystem::remove_all(directory);
+}
+
+// Journey queries between random stations, with a penalty per route change
+static void RunJourneyBenchmarks(
+  const Options& options,
+  const std::string& label,
+  const nlohmann::json& layout,
+  std::vector<BenchmarkResult>& results
+)
+{
+  TransportNetwork network {};
+  network.FromJson(nlohmann::json(layout));
+  const auto& stations { layout.at("stations") };
+  constexpr std::size_t nQueries { 1024 };
+  std::mt19937 random { options.seed };
+  std::vector<std::pair<Id, Id>> stationPairs {};
+  for (std::size_t idx {0}; idx < nQueries; ++idx)
+  {
+    stationPairs.emplace_back(
+      stations.at(random() % stations.size()).at("station_id").get<Id>(),
+      stations.at(random() % stations.size()).at("station_id").get<Id>()
+    );
+  }
+  JourneyOptions journeyOptions {};
+  journeyOptions.penalties.defaultPenalty = 3;
+
+  results.push_back(Measure(options, "GetJourneys/" + label,
+    [&network, &stationPairs, &journeyOptions](std::uint64_t nIterations) {
+      const auto startedAt { std::chrono::steady_clock::now() };
+      for (std::uint64_t idx {0}; idx < nIterations; ++idx)
+      {
+        const auto& [from, to] = stationPairs[idx % nQueries];
+        KeepAlive(network.GetJourneys(from, to, journeyOptions));
+      }
+      return Since(startedAt);
+    }
+  ));
+
+  // The 5 alternatives of a recommendation
+  AlternativeJourneyOptions alternativeOptions {};
+  alternativeOptions.journey = journeyOptions;
+  results.push_back(Measure(options, "GetAlternativeJourneys/" + label,
+    [&network, &stationPairs, &alternativeOptions](std::uint64_t nIterations) {
+      const auto startedAt { std::chrono::steady_clock::now() };
+      for (std::uint64_t idx {0}; idx < nIterations; ++idx)
+      {
+        const auto& [from, to] = stationPairs[idx % nQueries];
+        KeepAlive(network.GetAlternativeJourneys(from, to, 5,
+                                                 alternativeOptions));
+      }
+      return Since(startedAt);
+    }
+  ));
+}
+
+// Cost of the instrumentation of one call, when metrics are enabled
+static void RunMetricsBenchmarks(
+  const Options& options,
+  std::vector<BenchmarkResult>& results
+)
+{
+  static LatencyHistogram histogram { "bench_record_ns" };
+  results.push_back(Measure(options, "LatencyHistogram/Record",
+    [](std::uint64_t nIterations) {
+      const auto startedAt { std::chrono::steady_clock::now() };
+      for (std::uint64_t idx {0}; idx < nIterations; ++idx)
+        histogram.Record(std::chrono::nanoseconds(idx & 0xffff));
+      return Since(startedAt);
+    }
+  ));
+}
+
+static void RunFeedBenchmarks(
+  const Options& options,
+  std::vector<BenchmarkResult>& results
+)
+{
+  // A frame as the feed sends it
+  const auto message { SerializeStompFrame(StompFrame {
+    StompCommand::Message,
+    {
+      {"subscription", "0"},
+      {"message-id", "123456"},
+      {"destination", "/passengers"},
+      {"content-type", "application/json"},
+      {"sent-at-ns", "1700000000000000000"},
+    },
+    R"({"datetime":"2024-01-01T08:00:00.000000Z",)"
+    R"("passenger_event":"in","station_id":"station_042"})"
+  })};
+  results.push_back(Measure(options, "StompFrame/Parse",
+    [&message](std::uint64_t nIterations) {
+      const auto startedAt { std::chrono::steady_clock::now() };
+      for (std::uint64_t idx {0}; idx < nIterations; ++idx)
+      {
+        StompFrame frame {};
+        KeepAlive(ParseStompFrame(message, frame));
+        KeepAlive(frame);
+      }
+      return Since(startedAt);
+    },
+    static_cast<double>(message.size())
+  ));
+
+  // Time per message from the first MESSAGE frame received to the last, over
+  //  TLS from an in-process server. The server shares the CPU with the
+  //  client, so compare this number across runs on the same machine only.
+  constexpr std::uint64_t nMessages { 50'000 };
+  MockServerOptions serverOptions {};
+  serverOptions.certFile = BENCH_LOCALHOST_PEM;
+  serverOptions.keyFile = BENCH_LOCALHOST_KEY_PEM;
+  serverOptions.messagesPerSecond = 0.0;
+  serverOptions.maxMessages = nMessages;
+  MockServer server { serverOptions };
+  if (!server.Start())
+  {
+    std::cerr << "Could not start the mock server\n";
+    return;
+  }
+  const auto port { std::to_string(server.GetPort()) };
+  results.push_back(Measure(options, "WebSocketClient/Dispatch",
+    [&serverOptions, &port](std::uint64_t nIterations) {
+      boost::asio::io_context ioc {};
+      boost::asio::ssl::context ctx { boost::asio::ssl::context::tls_client };
+      ctx.load_verify_file(BENCH_LOCALHOST_PEM);
+      WebSocketClient client {
+        "localhost", serverOptions.endpoint, port, ioc, ctx
+      };
+      const auto connectFrame { SerializeStompFrame(StompFrame {
+        StompCommand::Connect,
+        {{"accept-version", "1.2"}, {"host", "localhost"}},
+        {}
+      })};
+      const auto subscribeFrame { SerializeStompFrame(StompFrame {
+        StompCommand::Subscribe,
+        {{"id", "0"}, {"destination", "/passengers"}},
+        {}
+      })};
+      std::uint64_t nReceived {0};
+      std::chrono::steady_clock::time_point firstAt {};
+      std::chrono::steady_clock::time_point lastAt {};
+      client.Connect(
+        [&client, &connectFrame](auto ec) {
+          if (!ec)
+            client.Send(connectFrame);
+        },
+        [&](auto ec, auto&& message) {
+          StompFrame frame {};
+          if (ec || !ParseStompFrame(message, frame))
+            return;
+          if (frame.command == StompCommand::Connected)
+          {
+            client.Send(subscribeFrame);
+          }
+          else if (frame.command == StompCommand::Message)
+          {
+            lastAt = std::chrono::steady_clock::now();
+            if (nReceived++ == 0)
+              firstAt = lastAt;
+            if (nReceived == nIterations)
+              client.Close();
+          }
+        }
+      );
+      ioc.run();
+      if (nReceived < 2)
+        return std::chrono::nanoseconds {0};
+
+      // The first message starts the clock
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        (lastAt - firstAt) * static_cast<double>(nReceived) /
+        static_cast<double>(nReceived - 1)
+      );
+    },
+    0.0,
+    nMessages
+  ));
+}
+
+static void RunDownloadBenchmarks(
+  const Options& options,
+  std::vector<BenchmarkResult>& results
+)
+{
+  MockServerOptions serverOptions {};
+  serverOptions.certFile = BENCH_LOCALHOST_PEM;
+  serverOptions.keyFile = BENCH_LOCALHOST_KEY_PEM;
+  serverOptions.documentRoot = BENCH_DATA;
+  MockServer server { serverOptions };
+  if (!server.Start())
+  {
+    std::cerr << "Could not start the mock server\n";
+    return;
+  }
+  const std::string fileUrl {
+    "https://localhost:" + std::to_string(server.GetPort()) +
+    "/from_json_travel_times.json"
+  };
+  const auto destination {
+    std::filesystem::temp_directory_path() / "network-monitor-bench.json"
+  };
+
+  // One TLS connection for all the downloads
+  Downloader downloader { BENCH_LOCALHOST_PEM };
+  results.push_back(Measure(options, "Downloader/reuse",
+    [&downloader, &fileUrl, &destination](std::uint64_t nIterations) {
+      const auto startedAt { std::chrono::steady_clock::now() };
+      for (std::uint64_t idx {0}; idx < nIterations; ++idx)
+        KeepAlive(downloader.DownloadFile(fileUrl, destination));
+      return Since(startedAt);
+    }
+  ));
+
+  // A new connection, TLS handshake and certificate store every time
+  results.push_back(Measure(options, "DownloadFile/new-connection",
+    [&fileUrl, &destination](std::uint64_t nIterations) {
+      const auto startedAt { std::chrono::steady_clock::now() };
+      for (std::uint64_t idx {0}; idx < nIterations; ++idx)
+        KeepAlive(DownloadFile(fileUrl, destination, BENCH_LOCALHOST_PEM));
+      return Since(startedAt);
+    }
+  ));
+
+  std::filesystem::remove(destination);
+}
+
+static MemoryResult MeasureMemoryUsage(
+  const std::string& label,
+  const nlohmann::json& layout
+)
+{
+  TransportNetwork network {};
+  if (!network.FromJson(nlohmann::json(layout)))
+    std::cerr << "Could not load " << label << '\n';
+  return {"MemoryUsage/" + label, network.MemoryUsage()};
+}
+
+static double PerItem(
+  std::size_t bytes,
+  std::size_t nItems
+)
+{
+  return nItems == 0 ? 0.0 : static_cast<double>(bytes) / nItems;
+}
+
+static void PrintMemoryUsage(
+  const std::vector<MemoryResult>& results
+)
+{
+  std::cout << '\n'
+            << std::left << std::setw(24) << "network" << std::right
+            << std::setw(9) << "stations"
+            << std::setw(9) << "edges"
+            << std::setw(9) << "routes"
+            << std::setw(10) << "total-MB"
+            << std::setw(11) << "B/station"
+            << std::setw(8) << "B/edge"
+            << "   share: stations/edges/routes/lines/ids/maps/rankings/flows/"
+               "allocator"
+            << '\n';
+  for (const auto& result: results)
+  {
+    const auto& usage { result.usage };
+    const auto total { usage.GetTotal() };
+    std::cout << std::left << std::setw(24) << result.name << std::right
+              << std::setw(9) << usage.nStations
+              << std::setw(9) << usage.nEdges
+              << std::setw(9) << usage.nRoutes
+              << std::fixed << std::setprecision(2)
+              << std::setw(10) << total / 1e6
+              << std::setprecision(1)
+              << std::setw(11) << PerItem(total, usage.nStations)
+              << std::setw(8) << PerItem(usage.edges, usage.nEdges)
+              << "   ";
+    const std::size_t categories[] {
+      usage.stations, usage.edges, usage.routes, usage.lines,
+      usage.ids, usage.maps, usage.rankings, usage.flows, usage.allocator,
+    };
+    for (std::size_t idx {0}; idx < std::size(categories); ++idx)
+    {
+      std::cout << (idx == 0 ? "" : "/") << std::setprecision(0)
+                << 100.0 * PerItem(categories[idx], total) << '%';
+    }
+    std::cout << '\n';
+  }
+}
+
+static nlohmann::json ToJson(
+  const Options& options,
+  const std::vector<BenchmarkResult>& results,
+  const std::vector<MemoryResult>& memory
+)
+{
+  nlohmann::json benchmarks = nlohmann::json::array();
+  for (const auto& result: results)
+  {
+    nlohmann::json benchmark {
+      {"name", result.name},
+      {"iterations", result.iterations},
+      {"ns_per_op", {
+        {"median", result.medianNs},
+        {"min", result.minNs},
+        {"max", result.maxNs},
+      }},
+    };
+    if (result.bytesPerOp > 0.0)
+      benchmark["bytes_per_second"] = result.bytesPerOp / result.medianNs * 1e9;
+    benchmarks.push_back(std::move(benchmark));
+  }
+  nlohmann::json memoryUsage = nlohmann::json::array();
+  for (const auto& result: memory)
+  {
+    const auto& usage { result.usage };
+    memoryUsage.push_back({
+      {"name", result.name},
+      {"stations", usage.nStations},
+      {"edges", usage.nEdges},
+      {"routes", usage.nRoutes},
+      {"lines", usage.nLines},
+      {"allocations", usage.nAllocations},
+      {"bytes", {
+        {"total", usage.GetTotal()},
+        {"stations", usage.stations},
+        {"edges", usage.edges},
+        {"routes", usage.routes},
+        {"lines", usage.lines},
+        {"ids", usage.ids},
+        {"maps", usage.maps},
+        {"rankings", usage.rankings},
+        {"flows", usage.flows},
+        {"allocator", usage.allocator},
+      }},
+      {"bytes_per_station", PerItem(usage.GetTotal(), usage.nStations)},
+      {"bytes_per_edge", PerItem(usage.edges, usage.nEdges)},
+    });
+  }
+
+  const auto now { std::chrono::system_clock::to_time_t(
+    std::chrono::system_clock::now()
+  )};
+  std::ostringstream date {};
+  date << std::put_time(std::gmtime(&now), "%Y-%m-%dT%H:%M:%SZ");
+  return {
+    {"context", {
+      {"date", date.str()},
+#if defined(__clang__)
+      {"compiler", "clang " __clang_version__},
+#elif defined(__GNUC__)
+      {"compiler", "gcc " __VERSION__},
+#endif
+#if defined(NETWORK_MONITOR_METRICS)
+      {"metrics", true},
+#else
+      {"metrics", false},
+#endif
+#if defined(NETWORK_MONITOR_TRACING)
+      {"tracing", true},
+#else
+      {"tracing", false},
+#endif
+#if defined(NDEBUG)
+      {"assertions", false},
+#else
+      {"assertions", true},
+#endif
+      {"hardware_concurrency", std::thread::hardware_concurrency()},
+      {"repetitions", options.repetitions},
+      {"min_time", options.minTime},
+      {"scale", options.scale},
+      {"seed", options.seed},
+    }},
+    {"benchmarks", std::move(benchmarks)},
+    {"memory", std::move(memoryUsage)},
+  };
+}
+
+static void Print(
+  const BenchmarkResult& result,
+  const nlohmann::json& baseline
+)
+{
+  std::cout << std::left << std::setw(34) << result.name << std::right
+            << std::fixed << std::setprecision(1)
+            << std::setw(12) << result.iterations
+            << std::setw(15) << result.medianNs
+            << std::setw(15) << result.minNs
+            << std::setw(15) << result.maxNs;
+  if (result.bytesPerOp > 0.0)
+  {
+    std::cout << std::setw(10)
+              << result.bytesPerOp / result.medianNs * 1e9 / 1e6;
+  }
+  else
+  {
+    std::cout << std::setw(10) << "-";
+  }
+
+  // Speedup against the median of the earlier run
+  if (baseline.is_object())
+  {
+    for (const auto& earlier: baseline.value("benchmarks",
+                                              nlohmann::json::array()))
+    {
+      if (earlier.value("name", "") != result.name)
+        continue;
+      const auto earlierNs {
+        earlier.at("ns_per_op").value("median", 0.0)
+      };
+      if (earlierNs > 0.0 && result.medianNs > 0.0)
+      {
+        std::cout << std::setw(10) << std::setprecision(2)
+                  << earlierNs / result.medianNs << 'x';
+      }
+    }
+  }
+  std::cout << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+  Options options {};
+  if (!ParseOptions(argc, argv, options))
+    return 1;
+
+  nlohmann::json baseline {};
+  if (!options.baseline.empty())
+  {
+    NetworkMonitor::JsonFileError error {};
+    baseline = ParseJsonFile(options.baseline, error);
+    if (!error.message.empty())
+    {
+      std::cerr << "Could not load the baseline: " << error.message << '\n';
+      return 1;
+    }
+  }
+
+  // The large layout goes to a temporary file, for the parsing benchmarks
+  const std::filesystem::path layoutFile { BENCH_NETWORK_LAYOUT_JSON };
+  const auto layout = ParseJsonFile(layoutFile);
+  const auto scaled = ScaleLayout(layout, options.scale, options.seed);
+  const auto scaledLabel { "layout-x" + std::to_string(options.scale) };
+  const auto scaledFile {
+    std::filesystem::temp_directory_path() /
+    ("network-monitor-bench-" + scaledLabel + ".json")
+  };
+  {
+    std::ofstream file { scaledFile };
+    file << scaled.dump(2);
+  }
+
+  // Each group only runs if one of its benchmarks passes the filter
+  std::vector<BenchmarkResult> results {};
+  std::size_t nPrinted {0};
+  auto runGroup { [&](
+    std::initializer_list<std::string_view> names,
+    const std::function<void ()>& run
+  ) {
+    const bool selected { std::any_of(names.begin(), names.end(),
+      [&options](auto name) {
+        return name.find(options.filter) != std::string_view::npos;
+      }
+    )};
+    if (!selected)
+      return;
+    run();
+    for (; nPrinted < results.size(); ++nPrinted)
+    {
+      if (results[nPrinted].name.find(options.filter) == std::string::npos)
+        continue;
+      Print(results[nPrinted], baseline);
+    }
+  }};
+
+  std::cout << std::left << std::setw(34) << "benchmark" << std::right
+            << std::setw(12) << "iterations"
+            << std::setw(15) << "median-ns/op"
+            << std::setw(15) << "min-ns/op"
+            << std::setw(15) << "max-ns/op"
+            << std::setw(10) << "MB/s"
+            << (baseline.is_object() ? "   speedup" : "")
+            << '\n';
+  runGroup({"ParseJsonFile/mmap/layout", "ParseJsonFile/ifstream/layout"},
+    [&]() { RunParseBenchmarks(options, "layout", layoutFile, results); }
+  );
+  runGroup({"ParseJsonFile/mmap/" + scaledLabel,
+            "ParseJsonFile/ifstream/" + scaledLabel}, [&]() {
+      RunParseBenchmarks(options, scaledLabel, scaledFile, results);
+    }
+  );
+  runGroup({"FromJson/object/layout", "FromJson/stream/layout"},
+    [&]() { RunFromJsonBenchmarks(options, "layout", layout, results); }
+  );
+  runGroup({"FromJson/object/" + scaledLabel,
+            "FromJson/stream/" + scaledLabel}, [&]() {
+      RunFromJsonBenchmarks(options, scaledLabel, scaled, results);
+    }
+  );
+  runGroup({"AddLine", "GetTravelTime/adjacent", "GetTravelTime/route",
+            "GetRoutesServingStation", "RecordPassengerEvent",
+            "RecordPassengerEvent/timestamped",
+            "RecordPassengerEvents/batch-64",
+            "GetMostCrowdedStations/20", "ForEachPassengerCount/sort-20"},
+    [&]() { RunNetworkBenchmarks(options, layout, results); }
+  );
+  runGroup({"PassengerEventLog/Append", "ReplayPassengerEventLog/1M"},
+    [&]() { RunEventLogBenchmarks(options, layout, results); }
+  );
+  runGroup({"SnapshotPassengerCounts/layout",
+            "WritePassengerCheckpoint/layout"},
+    [&]() { RunCheckpointBenchmarks(options, "layout", layout, results); }
+  );
+  runGroup({"SnapshotPassengerCounts/" + scaledLabel,
+            "WritePassengerCheckpoint/" + scaledLabel}, [&]() {
+      RunCheckpointBenchmarks(options, scaledLabel, scaled, results);
+    }
+  );
+  runGroup({"GetJourneys/layout", "GetAlternativeJourneys/layout"},
+    [&]() { RunJourneyBenchmarks(options, "layout", layout, results); }
+  );
+  runGroup({"GetJourneys/" + scaledLabel,
+            "GetAlternativeJourneys/" + scaledLabel}, [&]() {
+      RunJourneyBenchmarks(options, scaledLabel, scaled, results);
+    }
+  );
+  runGroup({"LatencyHistogram/Record"},
+    [&]() { RunMetricsBenchmarks(options, results); }
+  );
+  runGroup({"StompFrame/Parse", "WebSocketClient/Dispatch"},
+    [&]() { RunFeedBenchmarks(options, results); }
+  );
+  runGroup({"Downloader/reuse", "DownloadFile/new-connection"},
+    [&]() { RunDownloadBenchmarks(options, results); }
+  );
+  std::filesystem::remove(scaledFile);
+
+  // Footprint of the network at a few sizes
+  std::vector<MemoryResult> memory {};
+  const auto memorySelected { [&options](const std::string& name) {
+    return name.find(options.filter) != std::string::npos;
+  }};
+  if (memorySelected("MemoryUsage/layout"))
+    memory.push_back(MeasureMemoryUsage("layout", layout));
+  if (options.scale != 10 && memorySelected("MemoryUsage/layout-x10"))
+  {
+    memory.push_back(MeasureMemoryUsage("layout-x10",
+      ScaleLayout(layout, 10, options.seed)
+    ));
+  }
+  if (memorySelected("MemoryUsage/" + scaledLabel))
+    memory.push_back(MeasureMemoryUsage(scaledLabel, scaled));
+  if (!memory.empty())
+    PrintMemoryUsage(memory);
+
+  // Drop the results of the group members that did not pass the filter
+  results.erase(std::remove_if(results.begin(), results.end(),
+    [&options](const auto& result) {
+      return result.name.find(options.filter) == std::string::npos;
+    }
+  ), results.end());
+  if (!options.output.empty())
+  {
+    std::ofstream file { options.output };
+    file << ToJson(options, results, memory).dump(2) << '\n';
+    if (!file)
+    {
+      std::cerr << "Could not write " << options.output << '\n';
+      return 1;
+    }
+  }
+  if (!options.trace.empty() &&
+      !NetworkMonitor::GetTraceRecorder().WriteChromeTrace(options.trace))
+  {
+    std::cerr << "Could not write " << options.trace << '\n';
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,322 @@
+// Capture and replay of the WebSocket feed
+//
+// capture: Subscribes to the passenger events of a feed server and records
+//  every message it receives, with its time, into a capture file. By default
+//  the feed is served by an in-process MockServer.
+// replay: Replays a capture through the passenger event pipeline, STOMP and
+//  JSON parsing and TransportNetwork::RecordPassengerEvent, and reports the
+//  throughput and the latency percentiles.
+//
+// Usage: network-monitor-replay capture --output <file> [options]
+//   --host <host>             Use an external server instead of the mock
+//   --port <port>             Port of the external server
+//   --endpoint <endpoint>     WebSocket endpoint (default: /network-events)
+//   --username <username>     STOMP login
+//   --password <password>     STOMP passcode
+//   --cacert <file>           CA certificates to verify the server
+//   --rate <n>                Mock server events per second, 0 for as fast as
+//                             possible (default: 1000)
+//   --duration <seconds>      Capture time (default: 10)
+//
+// Usage: network-monitor-replay replay --input <file> [options]
+//   --layout <file>           Network layout. Without one, the network only
+//                             has the stations the capture mentions.
+//   --speed <x>               1 replays at the captured pace, 2 twice as
+//                             fast, 0 as fast as possible (default: 0)
+
+#include <network-monitor/feed-capture.h>
+#include <network-monitor/file-downloader.h>
+#include <network-monitor/mock-server.h>
+#include <network-monitor/stomp-frame.h>
+#include <network-monitor/transport-network.h>
+#include <network-monitor/websocket-client.h>
+
+#include <boost/asio.hpp>
+#include <boost/beast/ssl.hpp>
+
+#include <chrono>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+
+using NetworkMonitor::FeedCapture;
+using NetworkMonitor::FeedCaptureReader;
+using NetworkMonitor::FeedMessage;
+using NetworkMonitor::FeedReplayOptions;
+using NetworkMonitor::MockServer;
+using NetworkMonitor::MockServerOptions;
+using NetworkMonitor::ParseJsonFile;
+using NetworkMonitor::ParsePassengerEventMessage;
+using NetworkMonitor::PassengerEvent;
+using NetworkMonitor::ReplayFeedCapture;
+using NetworkMonitor::SerializeStompFrame;
+using NetworkMonitor::StompCommand;
+using NetworkMonitor::StompFrame;
+using NetworkMonitor::TransportNetwork;
+using NetworkMonitor::WebSocketClient;
+
+struct Options
+{
+  std::string mode {};
+  std::string host {};
+  std::string port {};
+  std::string endpoint {"/network-events"};
+  std::string username {"username"};
+  std::string password {"password"};
+  std::string caCertFile { REPLAY_LOCALHOST_PEM };
+  double rate {1000.0};
+  double duration {10.0};
+  std::string output {};
+  std::string input {};
+  std::string layout {};
+  double speed {0.0};
+};
+
+static bool ParseOptions(int argc, char* argv[], Options& options)
+{
+  if (argc < 2)
+  {
+    std::cerr << "Usage: network-monitor-replay capture|replay [options]\n";
+    return false;
+  }
+  options.mode = argv[1];
+  if (options.mode != "capture" && options.mode != "replay")
+  {
+    std::cerr << "Unknown mode: " << options.mode << '\n';
+    return false;
+  }
+  for (int idx {2}; idx < argc; ++idx)
+  {
+    const std::string_view name { argv[idx] };
+    if (idx + 1 >= argc)
+    {
+      std::cerr << "Missing value for " << name << '\n';
+      return false;
+    }
+    const std::string value { argv[++idx] };
+
+    try
+    {
+      if (name == "--host") options.host = value;
+      else if (name == "--port") options.port = value;
+      else if (name == "--endpoint") options.endpoint = value;
+      else if (name == "--username") options.username = value;
+      else if (name == "--password") options.password = value;
+      else if (name == "--cacert") options.caCertFile = value;
+      else if (name == "--rate") options.rate = std::stod(value);
+      else if (name == "--duration") options.duration = std::stod(value);
+      else if (name == "--output") options.output = value;
+      else if (name == "--input") options.input = value;
+      else if (name == "--layout") options.layout = value;
+      else if (name == "--speed") options.speed = std::stod(value);
+      else
+      {
+        std::cerr << "Unknown option: " << name << '\n';
+        return false;
+      }
+    }
+    catch (const std::exception&)
+    {
+      std::cerr << "Invalid value for " << name << ": " << value << '\n';
+      return false;
+    }
+  }
+  if (options.mode == "capture" && options.output.empty())
+  {
+    std::cerr << "Missing --output\n";
+    return false;
+  }
+  if (options.mode == "replay" && options.input.empty())
+  {
+    std::cerr << "Missing --input\n";
+    return false;
+  }
+  return true;
+}
+
+static int RunCapture(
+  const Options& options
+)
+{
+  // Serve the feed locally unless we were given a server
+  std::unique_ptr<MockServer> server {nullptr};
+  std::string host { options.host };
+  std::string port { options.port };
+  if (host.empty())
+  {
+    MockServerOptions serverOptions {};
+    serverOptions.certFile = REPLAY_LOCALHOST_PEM;
+    serverOptions.keyFile = REPLAY_LOCALHOST_KEY_PEM;
+    serverOptions.endpoint = options.endpoint;
+    serverOptions.username = options.username;
+    serverOptions.password = options.password;
+    serverOptions.messagesPerSecond = options.rate;
+    server = std::make_unique<MockServer>(serverOptions);
+    if (!server->Start())
+    {
+      std::cerr << "Could not start the mock server\n";
+      return 1;
+    }
+    host = "localhost";
+    port = std::to_string(server->GetPort());
+  }
+
+  auto capture { std::make_shared<FeedCapture>() };
+  if (!capture->Open(options.output))
+  {
+    std::cerr << capture->GetError() << '\n';
+    return 1;
+  }
+
+  boost::asio::ssl::context ctx { boost::asio::ssl::context::tls_client };
+  ctx.load_verify_file(options.caCertFile);
+  boost::asio::io_context ioc {};
+  WebSocketClient client { host, options.endpoint, port, ioc, ctx };
+  client.SetFeedCapture(capture);
+
+  const auto connectFrame { SerializeStompFrame(StompFrame {
+    StompCommand::Connect,
+    {
+      {"accept-version", "1.2"},
+      {"host", host},
+      {"login", options.username},
+      {"passcode", options.password},
+    },
+    {}
+  })};
+  const auto subscribeFrame { SerializeStompFrame(StompFrame {
+    StompCommand::Subscribe,
+    {{"id", "0"}, {"destination", "/passengers"}},
+    {}
+  })};
+  bool failed {false};
+  client.Connect(
+    [&](auto ec) {
+      if (ec)
+      {
+        failed = true;
+        return;
+      }
+      client.Send(connectFrame);
+    },
+    [&](auto ec, auto&& message) {
+      if (message.rfind("CONNECTED", 0) == 0)
+        client.Send(subscribeFrame);
+    }
+  );
+
+  // Stop the capture after the requested time
+  boost::asio::steady_timer timer { ioc };
+  timer.expires_after(std::chrono::duration_cast<
+    std::chrono::steady_clock::duration
+  >(std::chrono::duration<double> { options.duration }));
+  timer.async_wait([&client](auto ec) {
+    client.Close();
+  });
+  ioc.run();
+  capture->Close();
+  if (failed || !capture->GetError().empty())
+  {
+    std::cerr << "Capture failed " << capture->GetError() << '\n';
+    return 1;
+  }
+
+  std::cout << "Captured " << capture->GetMessageCount() << " messages, "
+            << capture->GetByteCount() << " bytes, into " << options.output
+            << '\n';
+  return 0;
+}
+
+// A network with only the stations of the passenger events of a capture
+static bool LoadCaptureStations(
+  const std::string& path,
+  TransportNetwork& network
+)
+{
+  FeedCaptureReader reader {};
+  if (!reader.Open(path))
+  {
+    std::cerr << reader.GetError() << '\n';
+    return false;
+  }
+  std::unordered_set<std::string> stations {};
+  FeedMessage message {};
+  PassengerEvent event {};
+  while (reader.Next(message))
+  {
+    if (ParsePassengerEventMessage(message.payload, event) &&
+        stations.insert(event.stationId).second)
+    {
+      network.AddStation({event.stationId, event.stationId});
+    }
+  }
+  return true;
+}
+
+static int RunReplay(
+  const Options& options
+)
+{
+  TransportNetwork network {};
+  if (options.layout.empty())
+  {
+    if (!LoadCaptureStations(options.input, network))
+      return 1;
+  }
+  else if (!network.FromJson(ParseJsonFile(options.layout)))
+  {
+    std::cerr << "Could not load the network layout " << options.layout
+              << '\n';
+    return 1;
+  }
+
+  FeedReplayOptions replayOptions {};
+  replayOptions.speed = options.speed;
+  const auto report { ReplayFeedCapture(options.input, network,
+                                        replayOptions) };
+  if (!report.error.empty())
+  {
+    std::cerr << report.error << '\n';
+    return 1;
+  }
+
+  const auto seconds { [](auto duration) {
+    return std::chrono::duration<double> { duration }.count();
+  }};
+  const auto micros { [](std::int64_t nanoseconds) {
+    return static_cast<double>(nanoseconds) / 1000.0;
+  }};
+  std::cout << std::fixed << std::setprecision(1)
+            << "messages:     " << report.nMessages
+            << (report.truncated ? " (truncated capture)" : "") << '\n'
+            << "events:       " << report.nEvents << ", "
+            << report.nRecorded << " recorded\n"
+            << std::setprecision(3)
+            << "capture:      " << seconds(report.captureDuration) << " s\n"
+            << "replay:       " << seconds(report.duration) << " s\n"
+            << std::setprecision(1)
+            << "messages/s:   " << report.GetMessageRate() << '\n'
+            << "MB/s:         "
+            << (report.duration.count() == 0 ? 0.0 :
+                static_cast<double>(report.nBytes) / 1e6 /
+                seconds(report.duration)) << '\n'
+            << std::setprecision(2)
+            << "latency (us): p50 " << micros(report.p50)
+            << "  p90 " << micros(report.p90)
+            << "  p99 " << micros(report.p99)
+            << "  p999 " << micros(report.p999)
+            << "  max " << micros(report.max) << '\n';
+  return 0;
+}
+
+int main(int argc, char* argv[])
+{
+  Options options {};
+  if (!ParseOptions(argc, argv, options))
+    return 1;
+  return options.mode == "capture" ? RunCapture(options) : RunReplay(options);
+}
@@ -0,0 +1,558 @@
+// Load generator for the WebSocket client
+//
+// Connects many STOMP clients to a feed server, through a
+//  WebSocketClientManager, and reports the aggregate throughput and the
+//  end-to-end latency of the passenger events. By default the feed is served
+//  by an in-process MockServer, so no external network is needed.
+//
+// Usage: network-monitor-loadgen [options]
+//   --host <host>             Use an external server instead of the mock
+//   --port <port>             Port of the external server
+//   --endpoint <endpoint>     WebSocket endpoint (default: /network-events)
+//   --username <username>     STOMP login
+//   --password <password>     STOMP passcode
+//   --cacert <file>           CA certificates to verify the server
+//   --cert <file>             Mock server certificate
+//   --key <file>              Mock server private key
+//   --clients <n>             Number of clients (default: 8)
+//   --threads <n>[,<n>...]    io_context threads; a list runs one benchmark
+//                             per value (default: 1,2,4)
+//   --server-threads <n>      Mock server threads (default: 4)
+//   --rate <n>                Events per second per client, 0 for as fast
+//                             as possible (default: 0)
+//   --duration <seconds>      Measurement time per run (default: 5)
+//   --reconnects <n>          Instead of the throughput benchmark, measure
+//                             the latency of n reconnections with and
+//                             without TLS session resumption
+//   --api <api>[,<api>...]    Client API to drive: callback, coro, or a list
+//                             to compare them (default: callback)
+//   --metrics-port <port>     Serve the client metrics to Prometheus on
+//                             http://127.0.0.1:<port>/metrics during each run
+//   --trace <file>            Write the trace spans of the clients as Chrome
+//                             trace_event JSON at exit. The library must be
+//                             built with NETWORK_MONITOR_TRACING.
+//
+// The cpu-ns/msg column is the process CPU time per received message. It
+//  includes the in-process mock server, which does the same work for both
+//  APIs, so only the difference between two rows is meaningful.
+
+#include <network-monitor/metrics-server.h>
+#include <network-monitor/mock-server.h>
+#include <network-monitor/stomp-frame.h>
+#include <network-monitor/tls-session-cache.h>
+#include <network-monitor/trace.h>
+#include <network-monitor/websocket-client.h>
+#include <network-monitor/websocket-client-manager.h>
+
+#include <boost/asio.hpp>
+#include <boost/beast/ssl.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <ctime>
+#include <exception>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using NetworkMonitor::CollectRegistryMetrics;
+using NetworkMonitor::CollectWebSocketClientManager;
+using NetworkMonitor::MetricsServer;
+using NetworkMonitor::MetricsServerOptions;
+using NetworkMonitor::MockServer;
+using NetworkMonitor::MockServerOptions;
+using NetworkMonitor::ParseStompFrame;
+using NetworkMonitor::SerializeStompFrame;
+using NetworkMonitor::StompCommand;
+using NetworkMonitor::StompFrame;
+using NetworkMonitor::TlsSessionCache;
+using NetworkMonitor::WebSocketClient;
+using NetworkMonitor::WebSocketClientManager;
+
+struct Options
+{
+  std::string host {};
+  std::string port {};
+  std::string endpoint {"/network-events"};
+  std::string username {"username"};
+  std::string password {"password"};
+  std::string caCertFile { LOADGEN_LOCALHOST_PEM };
+  std::string certFile { LOADGEN_LOCALHOST_PEM };
+  std::string keyFile { LOADGEN_LOCALHOST_KEY_PEM };
+  std::size_t nClients {8};
+  std::vector<std::size_t> nThreads {1, 2, 4};
+  std::size_t nServerThreads {4};
+  double rate {0.0};
+  double duration {5.0};
+  std::size_t nReconnects {0};
+  std::vector<std::string> apis {"callback"};
+  unsigned short metricsPort {0};
+  std::string trace {};
+};
+
+// Per-client measurements. Each instance is only written by the thread that
+//  runs its client.
+struct ClientState
+{
+  std::shared_ptr<WebSocketClient> client {nullptr};
+  std::string connectFrame {};
+  std::string subscribeFrame {};
+  std::vector<std::int64_t> latencies {};
+  bool failed {false};
+};
+
+static std::optional<std::size_t> ParseSize(std::string_view value)
+{
+  std::size_t parsed {0};
+  const auto [end, ec] = std::from_chars(
+    value.data(), value.data() + value.size(), parsed
+  );
+  if (ec != std::errc {} || end != value.data() + value.size())
+    return std::nullopt;
+  return parsed;
+}
+
+static bool ParseOptions(int argc, char* argv[], Options& options)
+{
+  for (int idx {1}; idx < argc; ++idx)
+  {
+    const std::string_view name { argv[idx] };
+    if (idx + 1 >= argc)
+    {
+      std::cerr << "Missing value for " << name << '\n';
+      return false;
+    }
+    const std::string value { argv[++idx] };
+
+    try
+    {
+      if (name == "--host") options.host = value;
+      else if (name == "--port") options.port = value;
+      else if (name == "--endpoint") options.endpoint = value;
+      else if (name == "--username") options.username = value;
+      else if (name == "--password") options.password = value;
+      else if (name == "--cacert") options.caCertFile = value;
+      else if (name == "--cert") options.certFile = value;
+      else if (name == "--key") options.keyFile = value;
+      else if (name == "--clients") options.nClients = std::stoul(value);
+      else if (name == "--server-threads")
+        options.nServerThreads = std::stoul(value);
+      else if (name == "--rate") options.rate = std::stod(value);
+      else if (name == "--duration") options.duration = std::stod(value);
+      else if (name == "--reconnects") options.nReconnects = std::stoul(value);
+      else if (name == "--trace") options.trace = value;
+      else if (name == "--metrics-port")
+      {
+        const auto port { ParseSize(value) };
+        if (!port || *port == 0 || *port > 65535)
+        {
+          std::cerr << "Invalid metrics port: " << value << '\n';
+          return false;
+        }
+        options.metricsPort = static_cast<unsigned short>(*port);
+      }
+      else if (name == "--api")
+      {
+        options.apis.clear();
+        std::string_view list { value };
+        while (!list.empty())
+        {
+          const auto comma { std::min(list.find(','), list.size()) };
+          const std::string api { list.substr(0, comma) };
+          if (api != "callback" && api != "coro")
+          {
+            std::cerr << "Invalid API: " << api << '\n';
+            return false;
+          }
+          options.apis.push_back(api);
+          list.remove_prefix(std::min(comma + 1, list.size()));
+        }
+      }
+      else if (name == "--threads")
+      {
+        options.nThreads.clear();
+        std::string_view list { value };
+        while (!list.empty())
+        {
+          const auto comma { std::min(list.find(','), list.size()) };
+          const auto nThreads { ParseSize(list.substr(0, comma)) };
+          if (!nThreads || *nThreads == 0)
+          {
+            std::cerr << "Invalid thread count: " << value << '\n';
+            return false;
+          }
+          options.nThreads.push_back(*nThreads);
+          list.remove_prefix(std::min(comma + 1, list.size()));
+        }
+      }
+      else
+      {
+        std::cerr << "Unknown option: " << name << '\n';
+        return false;
+      }
+    }
+    catch (const std::exception&)
+    {
+      std::cerr << "Invalid value for " << name << ": " << value << '\n';
+      return false;
+    }
+  }
+  return !options.nThreads.empty() && !options.apis.empty();
+}
+
+static std::int64_t Percentile(
+  const std::vector<std::int64_t>& sorted,
+  double percentile
+)
+{
+  if (sorted.empty())
+    return 0;
+  const auto idx { static_cast<std::size_t>(
+    percentile / 100.0 * static_cast<double>(sorted.size() - 1) + 0.5
+  )};
+  return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+static std::int64_t NowNs()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::system_clock::now().time_since_epoch()
+  ).count();
+}
+
+// Record the latency of a passenger event. Returns true if the client should
+//  subscribe now.
+static bool OnFeedMessage(
+  ClientState& state,
+  const std::string& message
+)
+{
+  const auto receivedAt { NowNs() };
+  StompFrame frame {};
+  if (!ParseStompFrame(message, frame))
+    return false;
+
+  switch (frame.command)
+  {
+  case StompCommand::Connected:
+    return true;
+  case StompCommand::Message:
+  {
+    const auto sentAt { ParseSize(frame.GetHeader("sent-at-ns")) };
+    if (sentAt)
+    {
+      state.latencies.push_back(
+        receivedAt - static_cast<std::int64_t>(*sentAt)
+      );
+    }
+    return false;
+  }
+  case StompCommand::Error:
+    state.failed = true;
+    return false;
+  default:
+    return false;
+  }
+}
+
+static void StartCallbackClient(
+  ClientState& state
+)
+{
+  state.client->Connect(
+    [&state](auto ec) {
+      if (ec)
+      {
+        state.failed = true;
+        return;
+      }
+      state.client->Send(state.connectFrame);
+    },
+    [&state](auto ec, auto&& message) {
+      if (OnFeedMessage(state, message))
+        state.client->Send(state.subscribeFrame);
+    }
+  );
+}
+
+#if defined(BOOST_ASIO_HAS_CO_AWAIT)
+static void StartCoroutineClient(
+  ClientState& state
+)
+{
+  using boost::asio::use_awaitable;
+  boost::asio::co_spawn(
+    state.client->GetExecutor(),
+    [&state]() -> boost::asio::awaitable<void> {
+      co_await state.client->Connect(use_awaitable);
+      co_await state.client->Send(state.connectFrame, use_awaitable);
+      std::string message {};
+      for (;;)
+      {
+        co_await state.client->Read(message, use_awaitable);
+        if (OnFeedMessage(state, message))
+          co_await state.client->Send(state.subscribeFrame, use_awaitable);
+      }
+    },
+    [&state](std::exception_ptr e) {
+      state.failed = e != nullptr;
+    }
+  );
+}
+#endif // BOOST_ASIO_HAS_CO_AWAIT
+
+static void RunThroughput(
+  const Options& options,
+  const std::string& host,
+  const std::string& port,
+  std::size_t nThreads,
+  const std::string& api
+)
+{
+  boost::asio::ssl::context ctx { boost::asio::ssl::context::tls_client };
+  ctx.load_verify_file(options.caCertFile);
+  WebSocketClientManager manager { ctx, nThreads };
+
+  std::vector<ClientState> states(options.nClients);
+  for (std::size_t idx {0}; idx < states.size(); ++idx)
+  {
+    auto& state { states[idx] };
+    state.client = manager.AddClient(host, options.endpoint, port);
+    state.connectFrame = SerializeStompFrame(StompFrame {
+      StompCommand::Connect,
+      {
+        {"accept-version", "1.2"},
+        {"host", host},
+        {"login", options.username},
+        {"passcode", options.password},
+      },
+      {}
+    });
+    state.subscribeFrame = SerializeStompFrame(StompFrame {
+      StompCommand::Subscribe,
+      {{"id", std::to_string(idx)}, {"destination", "/passengers"}},
+      {}
+    });
+    state.latencies.reserve(1 << 16);
+  }
+
+  for (auto& state: states)
+  {
+#if defined(BOOST_ASIO_HAS_CO_AWAIT)
+    if (api == "coro")
+    {
+      StartCoroutineClient(state);
+      continue;
+    }
+#endif // BOOST_ASIO_HAS_CO_AWAIT
+    StartCallbackClient(state);
+  }
+
+  // Let a Prometheus scraper follow the clients for the length of the run
+  std::unique_ptr<MetricsServer> metricsServer {nullptr};
+  if (options.metricsPort != 0)
+  {
+    MetricsServerOptions metricsOptions {};
+    metricsOptions.port = options.metricsPort;
+    metricsServer = std::make_unique<MetricsServer>(metricsOptions);
+    metricsServer->AddCollector(CollectRegistryMetrics());
+    metricsServer->AddCollector(CollectWebSocketClientManager(manager));
+    if (!metricsServer->Start())
+    {
+      std::cerr << "Could not serve the metrics on port "
+                << options.metricsPort << '\n';
+    }
+  }
+
+  // Let the connections settle before we start measuring
+  manager.Run();
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  auto countMessages { [&manager]() {
+    std::uint64_t nMessages {0};
+    for (const auto& stats: manager.GetStats())
+      nMessages += stats.traffic.messagesReceived;
+    return nMessages;
+  }};
+  const auto startMessages { countMessages() };
+  const auto startedAt { std::chrono::steady_clock::now() };
+  const auto startCpu { std::clock() };
+  std::this_thread::sleep_for(std::chrono::duration<double> {
+    options.duration
+  });
+  const auto endMessages { countMessages() };
+  const auto endCpu { std::clock() };
+  const auto elapsed { std::chrono::duration<double> {
+    std::chrono::steady_clock::now() - startedAt
+  }.count() };
+  const auto stats { manager.GetStats() };
+  manager.Stop();
+
+  std::vector<std::int64_t> latencies {};
+  std::size_t nFailed {0};
+  for (const auto& state: states)
+  {
+    latencies.insert(
+      latencies.end(), state.latencies.begin(), state.latencies.end()
+    );
+    nFailed += state.failed ? 1 : 0;
+  }
+  std::sort(latencies.begin(), latencies.end());
+
+  double minRate { stats.empty() ? 0.0 : stats.front().messagesPerSecond };
+  double maxRate { 0.0 };
+  for (const auto& connectionStats: stats)
+  {
+    minRate = std::min(minRate, connectionStats.messagesPerSecond);
+    maxRate = std::max(maxRate, connectionStats.messagesPerSecond);
+  }
+
+  const auto nMessages { endMessages - startMessages };
+  const double throughput { static_cast<double>(nMessages) / elapsed };
+  const double cpuNsPerMessage { nMessages == 0 ? 0.0 :
+    static_cast<double>(endCpu - startCpu) / CLOCKS_PER_SEC * 1e9 /
+    static_cast<double>(nMessages)
+  };
+  std::cout << std::fixed << std::setprecision(1)
+            << std::setw(9) << api
+            << std::setw(8) << nThreads
+            << std::setw(9) << options.nClients
+            << std::setw(9) << nFailed
+            << std::setw(14) << throughput
+            << std::setw(12) << minRate
+            << std::setw(12) << maxRate
+            << std::setw(10) << Percentile(latencies, 50.0) / 1000.0
+            << std::setw(10) << Percentile(latencies, 99.0) / 1000.0
+            << std::setw(10) << Percentile(latencies, 99.9) / 1000.0
+            << std::setw(12) << cpuNsPerMessage
+            << std::endl;
+}
+
+static void RunReconnects(
+  const Options& options,
+  const std::string& host,
+  const std::string& port
+)
+{
+  std::cout << "session-cache  resumed  connect-p50-us  connect-p99-us"
+               "  tls-p50-us  tls-p99-us\n";
+  for (const bool useCache: {false, true})
+  {
+    boost::asio::ssl::context ctx { boost::asio::ssl::context::tls_client };
+    ctx.load_verify_file(options.caCertFile);
+    auto cache { useCache ? std::make_shared<TlsSessionCache>() : nullptr };
+
+    std::vector<std::int64_t> connectDurations {};
+    std::vector<std::int64_t> tlsDurations {};
+    std::size_t nResumed {0};
+
+    // The first connection of each series fills the cache, so we do not
+    //  measure it.
+    for (std::size_t idx {0}; idx <= options.nReconnects; ++idx)
+    {
+      boost::asio::io_context ioc {};
+      WebSocketClient client {
+        host, options.endpoint, port, ioc, ctx, cache
+      };
+      const std::string connectFrame { SerializeStompFrame(StompFrame {
+        StompCommand::Connect,
+        {
+          {"accept-version", "1.2"},
+          {"host", host},
+          {"login", options.username},
+          {"passcode", options.password},
+        },
+        {}
+      })};
+      client.Connect(
+        [&client, &connectFrame](auto ec) {
+          if (!ec)
+            client.Send(connectFrame);
+        },
+        [&client](auto ec, auto&& message) {
+          client.Close();
+        }
+      );
+      ioc.run();
+
+      if (idx == 0)
+        continue;
+      const auto stats { client.GetStats() };
+      connectDurations.push_back(stats.connectDuration.count());
+      tlsDurations.push_back(stats.tlsHandshakeDuration.count());
+      nResumed += stats.tlsSessionResumed ? 1 : 0;
+    }
+    std::sort(connectDurations.begin(), connectDurations.end());
+    std::sort(tlsDurations.begin(), tlsDurations.end());
+
+    std::cout << std::fixed << std::setprecision(1)
+              << std::setw(13) << (useCache ? "on" : "off")
+              << std::setw(9) << nResumed
+              << std::setw(16) << Percentile(connectDurations, 50.0) / 1000.0
+              << std::setw(16) << Percentile(connectDurations, 99.0) / 1000.0
+              << std::setw(12) << Percentile(tlsDurations, 50.0) / 1000.0
+              << std::setw(12) << Percentile(tlsDurations, 99.0) / 1000.0
+              << std::endl;
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  Options options {};
+  if (!ParseOptions(argc, argv, options))
+    return 1;
+
+  // Serve the feed locally unless we were given a server
+  std::unique_ptr<MockServer> server {nullptr};
+  std::string host { options.host };
+  std::string port { options.port };
+  if (host.empty())
+  {
+    MockServerOptions serverOptions {};
+    serverOptions.certFile = options.certFile;
+    serverOptions.keyFile = options.keyFile;
+    serverOptions.endpoint = options.endpoint;
+    serverOptions.username = options.username;
+    serverOptions.password = options.password;
+    serverOptions.messagesPerSecond = options.rate;
+    serverOptions.nThreads = options.nServerThreads;
+    server = std::make_unique<MockServer>(serverOptions);
+    if (!server->Start())
+    {
+      std::cerr << "Could not start the mock server\n";
+      return 1;
+    }
+    host = "localhost";
+    port = std::to_string(server->GetPort());
+  }
+
+  if (options.nReconnects > 0)
+  {
+    RunReconnects(options, host, port);
+  }
+  else
+  {
+    std::cout << "      api threads  clients   failed    messages/s"
+                 "  min-conn/s  max-conn/s   p50-us    p99-us   p999-us"
+                 "  cpu-ns/msg\n";
+    for (const auto& api: options.apis)
+    {
+      for (const auto nThreads: options.nThreads)
+        RunThroughput(options, host, port, nThreads, api);
+    }
+  }
+
+  if (!options.trace.empty() &&
+      !NetworkMonitor::GetTraceRecorder().WriteChromeTrace(options.trace))
+  {
+    std::cerr << "Could not write " << options.trace << '\n';
+    return 1;
+  }
+  return 0;
+}
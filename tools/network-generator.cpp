@@ -0,0 +1,217 @@
+// Synthetic network layout generator
+//
+// Writes a network layout in the TransportNetwork::FromJson schema, for
+//  scale tests and benchmarks. The same options and seed always give the
+//  same file.
+//
+// Usage: network-monitor-generate [options]
+//   --stations <n>            Number of stations (default: 1000)
+//   --lines <n>               Number of lines (default: 30)
+//   --routes-per-line <n>     Routes per line (default: 2)
+//   --min-route-length <n>    Minimum number of stops on a line (default: 10)
+//   --max-route-length <n>    Maximum number of stops on a line (default: 40)
+//   --interchanges <p>        Probability that a stop is an interchange, in
+//                             [0, 1] (default: 0.1)
+//   --travel-times <shape>    uniform or exponential (default: uniform)
+//   --min-travel-time <n>     Minimum travel time, in minutes (default: 1)
+//   --max-travel-time <n>     Maximum travel time, in minutes (default: 5)
+//   --mean-travel-time <t>    Mean of the exponential travel times
+//                             (default: 2)
+//   --seed <n>                Random seed (default: 1)
+//   --indent <n>              JSON indentation, -1 for a single line
+//                             (default: 2)
+//   --output <file>           Output file (default: standard output)
+
+#include <network-monitor/network-generator.h>
+
+#include <nlohmann/json.hpp>
+
+#include <charconv>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+
+using NetworkMonitor::GenerateNetworkLayout;
+using NetworkMonitor::NetworkGeneratorOptions;
+using NetworkMonitor::TravelTimeDistribution;
+
+struct Options
+{
+  NetworkGeneratorOptions generator {};
+  int indent {2};
+  std::string output {};
+};
+
+static std::optional<std::size_t> ParseSize(std::string_view value)
+{
+  std::size_t parsed {0};
+  const auto [end, ec] = std::from_chars(
+    value.data(), value.data() + value.size(), parsed
+  );
+  if (ec != std::errc {} || end != value.data() + value.size())
+    return std::nullopt;
+  return parsed;
+}
+
+static std::optional<double> ParseDouble(const std::string& value)
+{
+  try
+  {
+    std::size_t nParsed {0};
+    const auto parsed { std::stod(value, &nParsed) };
+    if (nParsed != value.size())
+      return std::nullopt;
+    return parsed;
+  }
+  catch (const std::exception&)
+  {
+    return std::nullopt;
+  }
+}
+
+static bool ParseOptions(int argc, char* argv[], Options& options)
+{
+  auto& generator { options.generator };
+  for (int idx {1}; idx < argc; ++idx)
+  {
+    const std::string_view name { argv[idx] };
+    if (idx + 1 >= argc)
+    {
+      std::cerr << "Missing value for " << name << '\n';
+      return false;
+    }
+    const std::string value { argv[++idx] };
+
+    // Options that take a count
+    std::size_t* count { nullptr };
+    if (name == "--stations")
+      count = &generator.nStations;
+    else if (name == "--lines")
+      count = &generator.nLines;
+    else if (name == "--routes-per-line")
+      count = &generator.routesPerLine;
+    else if (name == "--min-route-length")
+      count = &generator.minRouteLength;
+    else if (name == "--max-route-length")
+      count = &generator.maxRouteLength;
+    if (count != nullptr)
+    {
+      const auto parsed { ParseSize(value) };
+      if (!parsed)
+      {
+        std::cerr << "Invalid " << name << ": " << value << '\n';
+        return false;
+      }
+      *count = *parsed;
+      continue;
+    }
+
+    if (name == "--interchanges" || name == "--mean-travel-time")
+    {
+      const auto parsed { ParseDouble(value) };
+      if (!parsed)
+      {
+        std::cerr << "Invalid " << name << ": " << value << '\n';
+        return false;
+      }
+      (name == "--interchanges" ? generator.interchangeDensity :
+                                  generator.meanTravelTime) = *parsed;
+    }
+    else if (name == "--min-travel-time" || name == "--max-travel-time")
+    {
+      const auto parsed { ParseSize(value) };
+      if (!parsed)
+      {
+        std::cerr << "Invalid " << name << ": " << value << '\n';
+        return false;
+      }
+      (name == "--min-travel-time" ? generator.minTravelTime :
+                                     generator.maxTravelTime) =
+        static_cast<unsigned int>(*parsed);
+    }
+    else if (name == "--travel-times")
+    {
+      if (value == "uniform")
+      {
+        generator.travelTimeDistribution = TravelTimeDistribution::Uniform;
+      }
+      else if (value == "exponential")
+      {
+        generator.travelTimeDistribution =
+          TravelTimeDistribution::Exponential;
+      }
+      else
+      {
+        std::cerr << "Unknown travel time distribution: " << value << '\n';
+        return false;
+      }
+    }
+    else if (name == "--seed")
+    {
+      const auto parsed { ParseSize(value) };
+      if (!parsed)
+      {
+        std::cerr << "Invalid --seed: " << value << '\n';
+        return false;
+      }
+      generator.seed = *parsed;
+    }
+    else if (name == "--indent")
+    {
+      try
+      {
+        options.indent = std::stoi(value);
+      }
+      catch (const std::exception&)
+      {
+        std::cerr << "Invalid --indent: " << value << '\n';
+        return false;
+      }
+    }
+    else if (name == "--output")
+    {
+      options.output = value;
+    }
+    else
+    {
+      std::cerr << "Unknown option " << name << '\n';
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char* argv[])
+{
+  Options options {};
+  if (!ParseOptions(argc, argv, options))
+    return 1;
+
+  nlohmann::json layout {};
+  try
+  {
+    layout = GenerateNetworkLayout(options.generator);
+  }
+  catch (const std::invalid_argument& e)
+  {
+    std::cerr << e.what() << '\n';
+    return 1;
+  }
+
+  if (options.output.empty())
+  {
+    std::cout << layout.dump(options.indent) << '\n';
+    return std::cout ? 0 : 1;
+  }
+  std::ofstream file { options.output };
+  file << layout.dump(options.indent) << '\n';
+  if (!file)
+  {
+    std::cerr << "Could not write " << options.output << '\n';
+    return 1;
+  }
+  return 0;
+}